@@ -0,0 +1,188 @@
+# Checks the code that the compiler generated for the wrappers in intrinsics.c.cpp. This is run by
+# ctest (and by the checkCodegen target) once per tier, e.g:
+#
+# cmake -DOBJDUMP=/usr/bin/objdump -DOBJECT=intrinsics.c.cpp.o -DTIER=avx2 -P codegen.cmake
+#
+# Each wrapper codegen_<name> is checked against three rules:
+# a) It may have at most as many instructions as its budget below, for the given tier.
+# b) Unless its name ends in _bulk, it may not contain a loop: an operation on a single vector
+#    should be straight-line code.
+# c) Every loop must contain at least one instruction on an xmm, ymm or zmm register.
+# A scalar fallback breaks (a) by a wide margin, and usually (b) or (c) too.
+#
+# The budgets are the instruction counts from GCC 12, with some headroom for other compilers and
+# versions. If a check fails because code got shorter, lower the budget. If it fails because code got
+# longer, look at the disassembly that's printed: if the new code is genuinely no worse, raise the
+# budget, but if it's a scalar fallback then the function needs intrinsics on that tier.
+cmake_minimum_required(VERSION 3.13)
+
+# The tiers match the ISA flags in CMakeLists.txt: plain is SSE2 only (the x86-64 baseline), sse4
+# is SSE4.2, avx2 is AVX2 and avx512 is AVX512-F, BW and VL.
+set(tiers plain sse4 avx2 avx512)
+
+# function                      plain  sse4  avx2  avx512
+set(budgets
+  "m256_xor_epi64                  12    12     8       8"
+  "m256_or_epi64                   12    12     8       8"
+  "m256_and_epi64                  12    12     8       8"
+  "m256_and_epi16                  12    12     8       8"
+  "m256_add_epi16                  12    12     8       8"
+  "m256_sub_epi16                  12    12     8       8"
+  "m256_mullo_epi16                12    12     8       8"
+  "m256_mulhi_epi16                12    12     8       8"
+  "m256_slli_epi16                 10    10     8       8"
+  "m256_srli_epi16                 10    10     8       8"
+  "m256_srai_epi16                 10    10     8       8"
+  "m256_sign_epi16                 24    10     8       8"
+  "m256_abs_epi16                  20    10     8       8"
+  "m256_cmpgt_epi16                10    10     8       8"
+  "m256_hadamard16_epi16          200    48    44      40"
+  "m256_add_epi16_bulk             24    24    90      90"
+  "m256_sub_epi16_bulk             24    24    90      90"
+  "m256_adds_epi16_bulk            20    20    90      90"
+  "m256_subs_epu8_bulk             20    20    90      90"
+  "m256_xor_epi64_bulk             24    24    90      90"
+  "m256_sign_epi16_bulk            36    20    90      90"
+  "m256_hadamard16_epi16_bulk    1950    60   240     100"
+  "m256_popcount_si256_bulk        60    64    44      40"
+  "m256_xor_popcount_epi64_bulk    70    66    44      44"
+  "expr_abs_sub                    24    24    12      12")
+
+# Exceptions to (c), as tier:function. SSE2 has no vector popcount, and so the plain popcounts call
+# __popcountdi2 once per 64-bit lane.
+set(scalar_loops_allowed plain:m256_popcount_si256_bulk plain:m256_xor_popcount_epi64_bulk)
+
+# Functions that may have scalar loops, but only alongside a vectorised one. GCC vectorises the plain
+# bulk Hadamard transform across eight vectors at a time, and transforms the last n % 8 vectors (or
+# all of them, if a and c overlap) one at a time, with scalar code.
+set(scalar_remainders_allowed plain:m256_hadamard16_epi16_bulk)
+
+foreach(var OBJDUMP OBJECT TIER)
+  if(NOT DEFINED ${var})
+    message(FATAL_ERROR "codegen.cmake: ${var} must be set")
+  endif()
+endforeach()
+
+list(FIND tiers ${TIER} column)
+if(column EQUAL -1)
+  message(FATAL_ERROR "codegen.cmake: unknown tier ${TIER}, expected one of ${tiers}")
+endif()
+math(EXPR column "${column} + 1")
+
+execute_process(COMMAND ${OBJDUMP} -d --no-show-raw-insn ${OBJECT}
+                OUTPUT_VARIABLE dump
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "codegen.cmake: ${OBJDUMP} failed on ${OBJECT}")
+endif()
+
+# Split the disassembly into one list entry per line. The dump doesn't contain any semicolons that
+# matter to us, but they would split lines up, so they're removed first.
+string(REPLACE ";" "" dump "${dump}")
+string(REPLACE "\n" ";" lines "${dump}")
+
+# Collect, for each wrapper: its instruction count, the addresses of its vector instructions, its
+# loops (as pairs of start and end addresses) and its disassembly.
+set(functions "")
+set(name "")
+foreach(line IN LISTS lines)
+  if(line MATCHES "^[0-9a-f]+ <codegen_([A-Za-z0-9_]+)>:$")
+    set(name ${CMAKE_MATCH_1})
+    list(APPEND functions ${name})
+    set(${name}_count 0)
+    set(${name}_vector "")
+    set(${name}_loops "")
+    set(${name}_text "")
+  elseif(name AND line MATCHES "^ *([0-9a-f]+):\t([a-z0-9]+) *(.*)$")
+    set(address ${CMAKE_MATCH_1})
+    set(mnemonic ${CMAKE_MATCH_2})
+    set(operands "${CMAKE_MATCH_3}")
+    string(APPEND ${name}_text "${line}\n")
+    # Padding after the return doesn't count.
+    if(line MATCHES "nop|int3")
+      continue()
+    endif()
+
+    math(EXPR ${name}_count "${${name}_count} + 1")
+    math(EXPR at "0x${address}")
+    if(operands MATCHES "%[xyz]mm")
+      list(APPEND ${name}_vector ${at})
+    endif()
+    if(mnemonic MATCHES "^(j|loop)" AND operands MATCHES "^([0-9a-f]+) <")
+      math(EXPR target "0x${CMAKE_MATCH_1}")
+      if(target LESS_EQUAL at)
+        list(APPEND ${name}_loops "${target}-${at}")
+      endif()
+    endif()
+  elseif(line STREQUAL "")
+    set(name "")
+  endif()
+endforeach()
+
+set(failures 0)
+set(checked "")
+foreach(row IN LISTS budgets)
+  string(REGEX MATCHALL "[^ ]+" fields "${row}")
+  list(GET fields 0 function)
+  list(GET fields ${column} budget)
+  list(APPEND checked ${function})
+
+  list(FIND functions ${function} found)
+  if(found EQUAL -1)
+    message(SEND_ERROR "codegen_${function} isn't in ${OBJECT}")
+    math(EXPR failures "${failures} + 1")
+    continue()
+  endif()
+
+  set(problems "")
+  if(${function}_count GREATER budget)
+    list(APPEND problems "${${function}_count} instructions, over the budget of ${budget}")
+  endif()
+  if(${function}_loops AND NOT function MATCHES "_bulk$")
+    list(APPEND problems "contains a loop")
+  endif()
+  set(scalar_loops 0)
+  set(vector_loops 0)
+  foreach(loop IN LISTS ${function}_loops)
+    string(REPLACE "-" ";" bounds ${loop})
+    list(GET bounds 0 begin)
+    list(GET bounds 1 end)
+    set(vectorised FALSE)
+    foreach(at IN LISTS ${function}_vector)
+      if(at GREATER_EQUAL begin AND at LESS_EQUAL end)
+        set(vectorised TRUE)
+        break()
+      endif()
+    endforeach()
+    if(vectorised)
+      math(EXPR vector_loops "${vector_loops} + 1")
+    else()
+      math(EXPR scalar_loops "${scalar_loops} + 1")
+    endif()
+  endforeach()
+  if(scalar_loops GREATER 0 AND NOT "${TIER}:${function}" IN_LIST scalar_loops_allowed)
+    if(NOT ("${TIER}:${function}" IN_LIST scalar_remainders_allowed AND vector_loops GREATER 0))
+      list(APPEND problems "contains a scalar loop")
+    endif()
+  endif()
+
+  if(problems)
+    string(REPLACE ";" ", " problems "${problems}")
+    message(SEND_ERROR "${TIER}: ${function}: ${problems}\n${${function}_text}")
+    math(EXPR failures "${failures} + 1")
+  else()
+    message(STATUS "${TIER}: ${function}: ${${function}_count} instructions (budget ${budget})")
+  endif()
+endforeach()
+
+foreach(function IN LISTS functions)
+  list(FIND checked ${function} found)
+  if(found EQUAL -1)
+    message(SEND_ERROR "codegen_${function} doesn't have a budget in codegen.cmake")
+    math(EXPR failures "${failures} + 1")
+  endif()
+endforeach()
+
+if(failures GREATER 0)
+  message(FATAL_ERROR "${TIER}: ${failures} codegen check(s) failed")
+endif()
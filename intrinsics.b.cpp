@@ -0,0 +1,932 @@
+#include "intrinsics.hpp"
+#include "benchmark/benchmark.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/***
+ * Intrinsics.b.cpp.
+ * This file contains the benchmarks for each of the methods in the intrinsics.hpp file. Every
+ * operation is measured in two ways:
+ *
+ * 1) Throughput: the operation is applied to `n` independent pairs of inputs, so the CPU is free to
+ *    overlap as many operations as it likes. This is reported as items (operations) per second.
+ * 2) Latency: the operation is applied to its own output, so each call has to wait for the last
+ *    one. The benchmark keeps the result opaque to the compiler on each iteration, so the reported
+ *    time includes a store-forwarding round trip: this is the same for every function and every
+ *    compiler, so it's fine for spotting regressions, but it isn't a cycle-exact latency.
+ *
+ * Each operation is benchmarked via the public function (suffixed /inline), which uses the tier
+ * selected at compile time, and via a dispatch table bound to each tier that the running machine
+ * supports (suffixed /plain, /sse, /avx2 or /avx512). The /inline benchmarks are the ones to watch
+ * for code generation regressions, as that's where the compiler gets to see everything: the
+ * dispatched variants pay for an indirect call, but let a single binary compare every tier.
+ *
+ * The compile-time tier and the compiler are recorded in the benchmark context, so e.g
+ *
+ * ./runIntrinsicsBench --benchmark_out=avx2.json --benchmark_out_format=json
+ *
+ * produces a file that can be compared directly against the same run under a different compiler.
+ */
+
+namespace
+{
+using epi8x32  = CPP_INTRIN::epi8x32;
+using epi16x16 = CPP_INTRIN::epi16x16;
+using epi32x8  = CPP_INTRIN::epi32x8;
+using epi64x4  = CPP_INTRIN::epi64x4;
+using epi8x64  = CPP_INTRIN::epi8x64;
+using epi16x32 = CPP_INTRIN::epi16x32;
+using epi64x8  = CPP_INTRIN::epi64x8;
+
+// The number of independent operations per throughput iteration. Each operand is 8KiB, and so
+// the working set for the binary operations fits comfortably inside L1.
+constexpr size_t n = 256;
+
+// The count for the runtime-count shifts. This is deliberately not const.
+unsigned shift_count = 3;
+
+template <typename T> T random_vector()
+{
+  T out;
+  for (auto &elem : out)
+  {
+    elem = static_cast<typename T::value_type>(rand());
+  }
+  return out;
+}
+
+template <typename T> std::vector<T> random_vectors(const size_t size)
+{
+  std::vector<T> out(size);
+  for (auto &vec : out)
+  {
+    vec = random_vector<T>();
+  }
+  return out;
+}
+
+// The tables for the gathers and the 64-byte lookups. The gather indices are masked with
+// gather_mask, so the whole table (4KiB for the 32-bit gather) stays in L1.
+constexpr int32_t gather_mask = 1023;
+
+template <typename T> std::vector<T> random_table(const size_t size)
+{
+  std::vector<T> out(size);
+  for (auto &elem : out)
+  {
+    elem = static_cast<T>(rand());
+  }
+  return out;
+}
+
+const auto gather_table32 = random_table<int32_t>(size_t(gather_mask) + 1);
+const auto gather_table64 = random_table<int64_t>(size_t(gather_mask) + 1);
+const auto lut_table64    = random_vector<epi8x64>();
+
+epi32x8 gather_index(const epi32x8 &a)
+{
+  epi32x8 out;
+  for (unsigned i = 0; i < 8; i++)
+  {
+    out[i] = a[i] & gather_mask;
+  }
+  return out;
+}
+
+__uint128_t random_u128()
+{
+  return (static_cast<__uint128_t>(static_cast<uint64_t>(rand())) << 64) |
+         static_cast<__uint128_t>(static_cast<uint64_t>(rand()));
+}
+
+template <typename T, typename Op> void binary_throughput(benchmark::State &state, Op op)
+{
+  const auto a = random_vectors<T>(n);
+  const auto b = random_vectors<T>(n);
+  std::vector<T> c(n);
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      c[i] = op(a[i], b[i]);
+    }
+    benchmark::DoNotOptimize(c.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+template <typename T, typename Op> void binary_latency(benchmark::State &state, Op op)
+{
+  T a       = random_vector<T>();
+  const T b = random_vector<T>();
+  for (auto _ : state)
+  {
+    a = op(a, b);
+    benchmark::DoNotOptimize(a);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename T, typename Op> void unary_throughput(benchmark::State &state, Op op)
+{
+  const auto a = random_vectors<T>(n);
+  std::vector<T> c(n);
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      c[i] = op(a[i]);
+    }
+    benchmark::DoNotOptimize(c.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+template <typename T, typename Op> void unary_latency(benchmark::State &state, Op op)
+{
+  T a = random_vector<T>();
+  for (auto _ : state)
+  {
+    a = op(a);
+    benchmark::DoNotOptimize(a);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Operations that return a scalar (e.g m256_testz_si256) can't be chained, so we only measure
+// their throughput.
+template <typename T, typename Op> void scalar_throughput(benchmark::State &state, Op op)
+{
+  const auto a = random_vectors<T>(n);
+  const auto b = random_vectors<T>(n);
+  for (auto _ : state)
+  {
+    unsigned count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      count += static_cast<unsigned>(op(a[i], b[i]));
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+template <typename Op> void broadcast_throughput(benchmark::State &state, Op op)
+{
+  std::vector<__uint128_t> a(n);
+  for (auto &value : a)
+  {
+    value = random_u128();
+  }
+  std::vector<epi16x16> c(n);
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      c[i] = op(a[i]);
+    }
+    benchmark::DoNotOptimize(c.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+template <typename Op> void extract_throughput(benchmark::State &state, Op op)
+{
+  std::vector<__uint128_t> a(n);
+  for (auto &value : a)
+  {
+    value = random_u128();
+  }
+  std::vector<int64_t> c(n);
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      c[i] = op(a[i]);
+    }
+    benchmark::DoNotOptimize(c.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+// The bulk kernels are measured over state.range(0) vectors, and are reported in bytes per second
+// over the two inputs and the output.
+template <typename T, typename Op> void bulk_throughput(benchmark::State &state, Op op)
+{
+  const auto size = static_cast<size_t>(state.range(0));
+  const auto a    = random_vectors<T>(size);
+  const auto b    = random_vectors<T>(size);
+  std::vector<T> c(size);
+  for (auto _ : state)
+  {
+    op(a.data(), b.data(), c.data(), size);
+    benchmark::DoNotOptimize(c.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size * 3 * sizeof(T)));
+}
+
+// The bulk reductions (e.g m256_xor_popcount_epi64_bulk) are given a and b, and are reported in
+// bytes per second over both inputs.
+template <typename T, typename Op> void bulk_reduce_throughput(benchmark::State &state, Op op)
+{
+  const auto size = static_cast<size_t>(state.range(0));
+  const auto a    = random_vectors<T>(size);
+  const auto b    = random_vectors<T>(size);
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(op(a.data(), b.data(), size));
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size * 2 * sizeof(T)));
+}
+
+// get_randomness both reads and writes its state, so the latency benchmark is the natural one. The
+// throughput benchmark interleaves four independent generators.
+template <typename Op> void get_randomness_latency(benchmark::State &state, Op op)
+{
+  __uint128_t s1 = random_u128(), s2 = random_u128();
+  for (auto _ : state)
+  {
+    s1 = op(s1, s2);
+    benchmark::DoNotOptimize(s1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Op> void get_randomness_throughput(benchmark::State &state, Op op)
+{
+  __uint128_t s1[4], s2[4], out[4];
+  for (unsigned i = 0; i < 4; i++)
+  {
+    s1[i] = random_u128();
+    s2[i] = random_u128();
+  }
+
+  for (auto _ : state)
+  {
+    for (unsigned i = 0; i < 4; i++)
+    {
+      out[i] = op(s1[i], s2[i]);
+    }
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetItemsProcessed(state.iterations() * 4);
+}
+
+// Filling a buffer of random vectors, in bytes per second. The baseline is the pattern that
+// RandomGenerator replaces: one get_randomness call per vector, broadcast to both halves.
+void random_fill_baseline(benchmark::State &state)
+{
+  const auto size = static_cast<size_t>(state.range(0));
+  std::vector<epi16x16> c(size);
+  __uint128_t s1 = random_u128(), s2 = random_u128();
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < size; i++)
+    {
+      s1   = CPP_INTRIN::get_randomness(s1, s2);
+      c[i] = CPP_INTRIN::m256_broadcastsi128_si256(s1);
+    }
+    benchmark::DoNotOptimize(c.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size * sizeof(epi16x16)));
+}
+
+void random_fill_throughput(benchmark::State &state,
+                            const CPP_INTRIN::RandomGenerator::Backend backend)
+{
+  const auto size = static_cast<size_t>(state.range(0));
+  std::vector<epi16x16> c(size);
+  CPP_INTRIN::RandomGenerator rng(static_cast<uint64_t>(rand()), backend);
+  for (auto _ : state)
+  {
+    rng.fill(c.data(), size);
+    benchmark::DoNotOptimize(c.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size * sizeof(epi16x16)));
+}
+
+// Bucketing a database of vectors, in vectors per second. The arguments are the number of
+// buckets per vector and the number of threads in the pool.
+void bucketer_throughput(benchmark::State &state, const unsigned codes)
+{
+  constexpr size_t size = 1 << 16;
+  const auto k          = static_cast<unsigned>(state.range(0));
+  const auto threads    = static_cast<unsigned>(state.range(1));
+  std::vector<epi16x16> db(size);
+  CPP_INTRIN::RandomGenerator rng(static_cast<uint64_t>(rand()));
+  rng.fill(db.data(), size);
+  for (auto &v : db)
+  {
+    v = CPP_INTRIN::m256_srai_epi16<7>(v);
+  }
+
+  const CPP_INTRIN::Bucketer bucketer(codes, static_cast<uint64_t>(rand()));
+  std::vector<uint32_t> out(size * k);
+  CPP_INTRIN::ThreadPool pool(threads);
+  for (auto _ : state)
+  {
+    bucketer.hash_bulk(db.data(), size, out.data(), k, pool);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(size));
+}
+
+// Running a bulk kernel over a large array on a pool, in bytes per second. The arguments are the
+// number of vectors and the number of threads in the pool.
+void parallel_add_throughput(benchmark::State &state)
+{
+  const auto size = static_cast<size_t>(state.range(0));
+  std::vector<epi16x16> a(size), b(size), c(size);
+  CPP_INTRIN::ThreadPool pool(static_cast<unsigned>(state.range(1)));
+  for (auto _ : state)
+  {
+    CPP_INTRIN::parallel_bulk(CPP_INTRIN::m256_add_epi16_bulk, a.data(), b.data(), c.data(), size,
+                              pool);
+    benchmark::DoNotOptimize(c.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size * sizeof(epi16x16)));
+}
+
+// A pass over a large database, in bytes per second: this is dominated by cache and TLB misses,
+// which is what huge pages are for. The baseline is the same pass over a std::vector.
+void store_pass_baseline(benchmark::State &state)
+{
+  const auto size = static_cast<size_t>(state.range(0));
+  std::vector<epi64x4> db(size);
+  CPP_INTRIN::RandomGenerator(1).fill(db.data(), size);
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(CPP_INTRIN::m256_popcount_si256_bulk(db.data(), size));
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size * sizeof(epi64x4)));
+}
+
+void store_pass_throughput(benchmark::State &state, const bool huge_pages)
+{
+  const auto size = static_cast<size_t>(state.range(0));
+  CPP_INTRIN::VectorStore<epi64x4> db(size, huge_pages);
+  db.resize(size);
+  CPP_INTRIN::RandomGenerator(1).fill(db.data(), size);
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(CPP_INTRIN::m256_popcount_si256_bulk(db.data(), size));
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size * sizeof(epi64x4)));
+}
+
+// Opening a saved database and making one pass over it, in bytes per second. Without populate,
+// only the pages that the pass touches are read, as the pass touches them.
+void file_pass_throughput(benchmark::State &state, const bool populate)
+{
+  const auto size        = static_cast<size_t>(state.range(0));
+  const std::string path = "intrinsics_bench.vec";
+  {
+    CPP_INTRIN::VectorStore<epi64x4> db(size);
+    db.resize(size);
+    CPP_INTRIN::RandomGenerator(1).fill(db.data(), size);
+    CPP_INTRIN::VectorFile<epi64x4>::save(path, db);
+  }
+
+  for (auto _ : state)
+  {
+    const CPP_INTRIN::VectorFile<epi64x4> db(path, populate);
+    benchmark::DoNotOptimize(CPP_INTRIN::m256_popcount_si256_bulk(db.data(), db.size()));
+  }
+  std::remove(path.c_str());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size * sizeof(epi64x4)));
+}
+
+template <typename T, typename Op> void register_binary(const std::string &name, Op op)
+{
+  benchmark::RegisterBenchmark((name + "/throughput").c_str(), binary_throughput<T, Op>, op);
+  benchmark::RegisterBenchmark((name + "/latency").c_str(), binary_latency<T, Op>, op);
+}
+
+template <typename T, typename Op> void register_unary(const std::string &name, Op op)
+{
+  benchmark::RegisterBenchmark((name + "/throughput").c_str(), unary_throughput<T, Op>, op);
+  benchmark::RegisterBenchmark((name + "/latency").c_str(), unary_latency<T, Op>, op);
+}
+
+template <typename T, typename Op> void register_bulk(const std::string &name, Op op)
+{
+  benchmark::RegisterBenchmark(name.c_str(), bulk_throughput<T, Op>, op)
+      ->RangeMultiplier(16)
+      ->Range(16, 16 << 12);
+}
+
+template <typename T, typename Op> void register_bulk_reduce(const std::string &name, Op op)
+{
+  benchmark::RegisterBenchmark(name.c_str(), bulk_reduce_throughput<T, Op>, op)
+      ->RangeMultiplier(16)
+      ->Range(16, 16 << 12);
+}
+
+const char *isa_name(const CPP_INTRIN::ISA isa)
+{
+  switch (isa)
+  {
+  case CPP_INTRIN::ISA::neon:
+    return "neon";
+  case CPP_INTRIN::ISA::avx512:
+    return "avx512";
+  case CPP_INTRIN::ISA::avx2:
+    return "avx2";
+  case CPP_INTRIN::ISA::sse:
+    return "sse";
+  default:
+    return "plain";
+  }
+}
+
+// The tier that the public functions were compiled for. This mirrors the ladders in intrinsics.hpp.
+const char *compile_tier()
+{
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+  return "avx512";
+#elif defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSE4_1__)
+  return "sse4.1";
+#elif defined(__SSSE3__)
+  return "ssse3";
+#elif CPP_INTRIN_NEON
+  return "neon";
+#else
+  return "plain";
+#endif
+}
+
+// Every non-templated operation takes the same shape, so we register them via these macros: the
+// first registers the public function, and the second registers the pointer out of `table`.
+#define ARGS_binary a, b
+#define ARGS_unary a
+#define BENCH_INLINE(kind, T, op, ...)                                                             \
+  register_##kind<T>(#op "/inline", [](__VA_ARGS__) { return CPP_INTRIN::op(ARGS_##kind); })
+#define BENCH_TABLE(kind, T, op) register_##kind<T>(std::string(#op "/") + name, table.op)
+
+// The bulk kernels all share a signature, so the public functions are registered via this macro.
+#define BENCH_BULK_INLINE(T, op)                                                                   \
+  register_bulk<T>(#op "/inline", [](const T *a, const T *b, T *c, const size_t size) {            \
+    CPP_INTRIN::op(a, b, c, size);                                                                 \
+  })
+
+// The scalar operations are given as an expression over a and b: m256_and_testz_si256 takes three
+// arguments, so we benchmark it as m256_and_testz_si256(a, b, a).
+#define BENCH_SCALAR_INLINE(T, op, ...)                                                            \
+  benchmark::RegisterBenchmark(#op "/inline/throughput", [](benchmark::State &state) {             \
+    scalar_throughput<T>(state, [](const T &a, const T &b) { return __VA_ARGS__; });               \
+  })
+#define BENCH_SCALAR_TABLE(T, op, ...)                                                             \
+  benchmark::RegisterBenchmark((#op "/" + name + "/throughput").c_str(),                           \
+                               [table](benchmark::State &state) {                                  \
+                                 scalar_throughput<T>(state, [&table](const T &a, const T &b) {    \
+                                   return __VA_ARGS__;                                             \
+                                 });                                                               \
+                               })
+
+// The bulk reductions are also given as an expression, over a, b and size.
+#define BENCH_BULK_REDUCE_INLINE(T, op, ...)                                                       \
+  register_bulk_reduce<T>(#op "/inline",                                                           \
+                          [](const T *a, const T *b, const size_t size) { return __VA_ARGS__; })
+#define BENCH_BULK_REDUCE_TABLE(T, op, ...)                                                        \
+  register_bulk_reduce<T>(#op "/" + name, [table](const T *a, const T *b, const size_t size) {     \
+    return __VA_ARGS__;                                                                            \
+  })
+
+// The templated operations are benchmarked for a single, representative immediate.
+#define BENCH_IMM_INLINE(T, op, imm)                                                               \
+  register_unary<T>(#op "<" #imm ">/inline", [](const T &a) { return CPP_INTRIN::op<imm>(a); })
+#define BENCH_IMM_TABLE(T, op, imm)                                                                \
+  register_unary<T>(std::string(#op "<" #imm ">/") + name,                                         \
+                    [table](const T &a) { return table.op<imm>(a); })
+
+void register_inline()
+{
+  BENCH_INLINE(binary, epi16x16, m256_hadd_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi64x4, m256_xor_epi64, const epi64x4 &a, const epi64x4 &b);
+  BENCH_INLINE(binary, epi64x4, m256_or_epi64, const epi64x4 &a, const epi64x4 &b);
+  BENCH_INLINE(binary, epi64x4, m256_and_epi64, const epi64x4 &a, const epi64x4 &b);
+  BENCH_INLINE(binary, epi16x16, m256_and_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_cmpgt_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi8x32, m256_cmpeq_epi8, const epi8x32 &a, const epi8x32 &b);
+  BENCH_INLINE(binary, epi16x16, m256_cmpeq_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi8x32, m256_cmpgt_epi8, const epi8x32 &a, const epi8x32 &b);
+  BENCH_INLINE(binary, epi8x32, m256_cmplt_epi8, const epi8x32 &a, const epi8x32 &b);
+  BENCH_INLINE(binary, epi16x16, m256_cmplt_epi16, const epi16x16 &a, const epi16x16 &b);
+  // m256_blendv_epi8 takes three arguments, so, as with m256_and_testz_si256, we reuse a as mask.
+  register_binary<epi8x32>("m256_blendv_epi8/inline", [](const epi8x32 &a, const epi8x32 &b) {
+    return CPP_INTRIN::m256_blendv_epi8(a, b, a);
+  });
+  BENCH_INLINE(binary, epi8x32, m256_shuffle_epi8, const epi8x32 &a, const epi8x32 &b);
+  BENCH_INLINE(binary, epi16x16, m256_shuffle_epi8_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_add_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_sub_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_adds_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_subs_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_mullo_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_mulhi_epi16, const epi16x16 &a, const epi16x16 &b);
+  // m256_madd_epi16 returns 32-bit lanes, so we view them as 16-bit lanes: this lets the latency
+  // benchmark feed the result back in. The view costs a copy through the table, however.
+  register_binary<epi16x16>("m256_madd_epi16/inline", [](const epi16x16 &a, const epi16x16 &b) {
+    return CPP_INTRIN::m256_madd_epi16(a, b).epi16();
+  });
+  BENCH_INLINE(binary, epi16x16, m256_adds_epu16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_subs_epu16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi8x32, m256_adds_epu8, const epi8x32 &a, const epi8x32 &b);
+  BENCH_INLINE(binary, epi8x32, m256_subs_epu8, const epi8x32 &a, const epi8x32 &b);
+  BENCH_INLINE(binary, epi16x16, m256_sign_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(unary, epi16x16, m256_abs_epi16, const epi16x16 &a);
+  BENCH_INLINE(binary, epi16x16, m256_subabs_epi16, const epi16x16 &a, const epi16x16 &b);
+
+  BENCH_INLINE(binary, epi16x32, m512_add_epi16, const epi16x32 &a, const epi16x32 &b);
+  BENCH_INLINE(binary, epi16x32, m512_sub_epi16, const epi16x32 &a, const epi16x32 &b);
+  BENCH_INLINE(binary, epi16x32, m512_sign_epi16, const epi16x32 &a, const epi16x32 &b);
+  BENCH_INLINE(unary, epi16x32, m512_abs_epi16, const epi16x32 &a);
+  BENCH_INLINE(binary, epi64x8, m512_and_epi64, const epi64x8 &a, const epi64x8 &b);
+  BENCH_INLINE(binary, epi64x8, m512_xor_epi64, const epi64x8 &a, const epi64x8 &b);
+  BENCH_INLINE(binary, epi8x64, m512_shuffle_epi8, const epi8x64 &a, const epi8x64 &b);
+  BENCH_INLINE(binary, epi16x32, m512_cmpgt_epi16, const epi16x32 &a, const epi16x32 &b);
+
+  BENCH_IMM_INLINE(epi64x4, m256_permute4x64_epi64, 0x4E);
+  BENCH_IMM_INLINE(epi64x8, m512_permute4x64_epi64, 0x4E);
+  BENCH_IMM_INLINE(epi16x16, m256_permute4x64_epi16, 0x4E);
+  BENCH_IMM_INLINE(epi16x16, m256_slli_epi16, 3);
+  BENCH_IMM_INLINE(epi16x16, m256_srli_epi16, 3);
+  BENCH_IMM_INLINE(epi16x16, m256_srai_epi16, 3);
+  // The runtime-count shifts use the same count as the templated ones above, but read from a
+  // variable, and so the compiler can't turn it back into an immediate.
+  register_unary<epi16x16>("m256_sll_epi16/inline", [](const epi16x16 &a) {
+    return CPP_INTRIN::m256_sll_epi16(a, shift_count);
+  });
+  register_unary<epi16x16>("m256_srl_epi16/inline", [](const epi16x16 &a) {
+    return CPP_INTRIN::m256_srl_epi16(a, shift_count);
+  });
+  // Compress keeps the negative lanes, so the mask depends on the data, as it would after a filter.
+  register_unary<epi16x16>("m256_compress_epi16/inline", [](const epi16x16 &a) {
+    return CPP_INTRIN::m256_compress_epi16(a, CPP_INTRIN::m256_movemask_epi16(a));
+  });
+  BENCH_INLINE(binary, epi32x8, m256_permutevar8x32_epi32, const epi32x8 &a, const epi32x8 &b);
+  // The gathers read from a fixed table, so each index has to be masked into it first.
+  register_unary<epi32x8>("m256_i32gather_epi32/inline", [](const epi32x8 &a) {
+    return CPP_INTRIN::m256_i32gather_epi32(gather_table32.data(), gather_index(a));
+  });
+  register_unary<epi32x8>("m256_i32gather_epi64/inline", [](const epi32x8 &a) {
+    return CPP_INTRIN::m256_i32gather_epi64(gather_table64.data(), gather_index(a)).epi32();
+  });
+  BENCH_INLINE(binary, epi8x32, m256_lut32_epi8, const epi8x32 &a, const epi8x32 &b);
+  BENCH_INLINE(binary, epi16x16, m256_lut16_epi16, const epi16x16 &a, const epi16x16 &b);
+  register_unary<epi8x32>("m256_lut64_epi8/inline", [](const epi8x32 &a) {
+    return CPP_INTRIN::m256_lut64_epi8(lut_table64, a);
+  });
+  register_unary<epi16x16>("m256_lut32_epi16/inline", [](const epi16x16 &a) {
+    return CPP_INTRIN::m256_lut32_epi16(lut_table64.epi16(), a);
+  });
+  BENCH_INLINE(binary, epi32x8, m256_sllv_epi32, const epi32x8 &a, const epi32x8 &b);
+  BENCH_INLINE(binary, epi32x8, m256_srlv_epi32, const epi32x8 &a, const epi32x8 &b);
+  BENCH_INLINE(binary, epi64x4, m256_sllv_epi64, const epi64x4 &a, const epi64x4 &b);
+  BENCH_INLINE(binary, epi64x4, m256_srlv_epi64, const epi64x4 &a, const epi64x4 &b);
+  BENCH_INLINE(unary, epi16x16, m256_hadamard16_epi16, const epi16x16 &a);
+  BENCH_INLINE(unary, epi16x32, m512_hadamard32_epi16, const epi16x32 &a);
+  // The chain of hadd, sign and permute that m256_hadamard16_epi16 replaces.
+  register_unary<epi16x16>("m256_hadamard16_epi16/hadd_chain", [](const epi16x16 &a) {
+    const epi16x16 alternate = std::array<int16_t, 16>{1, -1, 1, -1, 1, -1, 1, -1,
+                                                       1, -1, 1, -1, 1, -1, 1, -1};
+    const epi16x16 halves = std::array<int16_t, 16>{1, 1, 1, 1, 1, 1, 1, 1,
+                                                    -1, -1, -1, -1, -1, -1, -1, -1};
+    epi16x16 x = a;
+    for (unsigned i = 0; i < 3; i++)
+    {
+      x = CPP_INTRIN::m256_hadd_epi16(x, CPP_INTRIN::m256_sign_epi16(x, alternate));
+    }
+    return CPP_INTRIN::m256_add_epi16(CPP_INTRIN::m256_sign_epi16(x, halves),
+                                      CPP_INTRIN::m256_permute4x64_epi16<0x4E>(x));
+  });
+
+  BENCH_BULK_INLINE(epi16x16, m256_add_epi16_bulk);
+  BENCH_BULK_INLINE(epi16x16, m256_sub_epi16_bulk);
+  BENCH_BULK_INLINE(epi16x16, m256_adds_epi16_bulk);
+  BENCH_BULK_INLINE(epi16x16, m256_subs_epi16_bulk);
+  BENCH_BULK_INLINE(epi16x16, m256_adds_epu16_bulk);
+  BENCH_BULK_INLINE(epi16x16, m256_subs_epu16_bulk);
+  BENCH_BULK_INLINE(epi8x32, m256_adds_epu8_bulk);
+  BENCH_BULK_INLINE(epi8x32, m256_subs_epu8_bulk);
+  BENCH_BULK_INLINE(epi64x4, m256_xor_epi64_bulk);
+  BENCH_BULK_INLINE(epi16x16, m256_sign_epi16_bulk);
+  register_bulk<epi16x16>("m256_hadamard16_epi16_bulk/inline",
+                          [](const epi16x16 *a, const epi16x16 *, epi16x16 *c, const size_t size) {
+                            CPP_INTRIN::m256_hadamard16_epi16_bulk(a, c, size);
+                          });
+  // A copy of a into c, via ordinary and non-temporal stores (b is unused).
+  register_bulk<epi16x16>("m256_storeu_si256/inline", [](const epi16x16 *a, const epi16x16 *,
+                                                         epi16x16 *c, const size_t size) {
+    for (size_t i = 0; i < size; i++)
+    {
+      CPP_INTRIN::m256_storeu_si256(c[i].data(), CPP_INTRIN::m256_loadu_si256(a[i].data()));
+    }
+  });
+  register_bulk<epi16x16>("m256_stream_si256/inline", [](const epi16x16 *a, const epi16x16 *,
+                                                         epi16x16 *c, const size_t size) {
+    for (size_t i = 0; i < size; i++)
+    {
+      CPP_INTRIN::m256_stream_si256(c[i].data(), CPP_INTRIN::m256_loadu_si256(a[i].data()));
+    }
+    CPP_INTRIN::stream_fence();
+  });
+
+  BENCH_SCALAR_INLINE(epi16x16, m256_testz_si256, CPP_INTRIN::m256_testz_si256(a, b));
+  BENCH_SCALAR_INLINE(epi16x32, m512_testz_si512, CPP_INTRIN::m512_testz_si512(a, b));
+  BENCH_SCALAR_INLINE(epi16x16, m256_cmpgt_epi16_mask, CPP_INTRIN::m256_cmpgt_epi16_mask(a, b));
+  BENCH_SCALAR_INLINE(epi16x32, m512_cmpgt_epi16_mask, CPP_INTRIN::m512_cmpgt_epi16_mask(a, b));
+  BENCH_SCALAR_INLINE(epi16x16, m256_and_testz_si256, CPP_INTRIN::m256_and_testz_si256(a, b, a));
+  BENCH_SCALAR_INLINE(epi8x32, m256_movemask_epi8, CPP_INTRIN::m256_movemask_epi8(a));
+  BENCH_SCALAR_INLINE(epi16x16, m256_movemask_epi16, CPP_INTRIN::m256_movemask_epi16(a));
+  BENCH_SCALAR_INLINE(epi16x16, m256_reduce_add_epi16, CPP_INTRIN::m256_reduce_add_epi16(a));
+  BENCH_SCALAR_INLINE(epi16x16, m256_reduce_min_epi16, CPP_INTRIN::m256_reduce_min_epi16(a));
+  BENCH_SCALAR_INLINE(epi16x16, m256_reduce_max_epi16, CPP_INTRIN::m256_reduce_max_epi16(a));
+  BENCH_SCALAR_INLINE(epi16x16, m256_reduce_argmax_epi16, CPP_INTRIN::m256_reduce_argmax_epi16(a));
+  BENCH_SCALAR_INLINE(epi64x4, m256_xor_popcount_epi64, CPP_INTRIN::m256_xor_popcount_epi64(a, b));
+  BENCH_SCALAR_INLINE(epi16x16, m256_hadd_reduce_epi16, CPP_INTRIN::m256_hadd_reduce_epi16(a, b));
+  BENCH_SCALAR_INLINE(epi64x4, m256_popcount_si256, CPP_INTRIN::m256_popcount_si256(a));
+  BENCH_INLINE(unary, epi8x32, m256_popcount_epi8, const epi8x32 &a);
+  BENCH_INLINE(unary, epi64x4, m256_popcount_epi64, const epi64x4 &a);
+
+  BENCH_BULK_REDUCE_INLINE(epi64x4, m256_popcount_si256_bulk,
+                           CPP_INTRIN::m256_popcount_si256_bulk(a, size));
+  BENCH_BULK_REDUCE_INLINE(epi64x4, m256_xor_popcount_epi64_bulk,
+                           CPP_INTRIN::m256_xor_popcount_epi64_bulk(a, b, size));
+  benchmark::RegisterBenchmark(
+      "m256_broadcastsi128_si256/inline/throughput", [](benchmark::State &state) {
+        broadcast_throughput(
+            state, [](const __uint128_t a) { return CPP_INTRIN::m256_broadcastsi128_si256(a); });
+      });
+  benchmark::RegisterBenchmark(
+      "mm_extract_epi64<1>/inline/throughput", [](benchmark::State &state) {
+        extract_throughput(state,
+                           [](const __uint128_t a) { return CPP_INTRIN::mm_extract_epi64<1>(a); });
+      });
+  BENCH_INLINE(binary, epi16x16, m256_unpacklo_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi16x16, m256_unpackhi_epi16, const epi16x16 &a, const epi16x16 &b);
+  BENCH_INLINE(binary, epi32x8, m256_unpacklo_epi32, const epi32x8 &a, const epi32x8 &b);
+  BENCH_INLINE(binary, epi32x8, m256_unpackhi_epi32, const epi32x8 &a, const epi32x8 &b);
+  BENCH_SCALAR_INLINE(epi16x16, m256_extract_epi16, CPP_INTRIN::m256_extract_epi16<11>(a));
+  BENCH_SCALAR_INLINE(epi64x4, m256_extract_epi64, CPP_INTRIN::m256_extract_epi64<3>(a));
+  // Building a vector from the low halves of a and b is the usual use of extract and insert.
+  register_binary<epi16x16>("m256_inserti128_si256<1>/inline",
+                            [](const epi16x16 &a, const epi16x16 &b) {
+                              return CPP_INTRIN::m256_inserti128_si256<1>(
+                                  a, CPP_INTRIN::m256_extracti128_si256<0>(b));
+                            });
+  const auto get_randomness = [](__uint128_t &s1, __uint128_t &s2) {
+    return CPP_INTRIN::get_randomness(s1, s2);
+  };
+  benchmark::RegisterBenchmark("get_randomness/inline/throughput",
+                               get_randomness_throughput<decltype(get_randomness)>,
+                               get_randomness);
+  benchmark::RegisterBenchmark("get_randomness/inline/latency",
+                               get_randomness_latency<decltype(get_randomness)>, get_randomness);
+
+  // The two runtime choices for dispatch().get_randomness.
+  using Rand = __uint128_t (*)(__uint128_t &, __uint128_t &);
+  benchmark::RegisterBenchmark("get_randomness/plain/throughput", get_randomness_throughput<Rand>,
+                               &CPP_INTRIN::Plain::get_randomness);
+  benchmark::RegisterBenchmark("get_randomness/plain/latency", get_randomness_latency<Rand>,
+                               &CPP_INTRIN::Plain::get_randomness);
+#if CPP_INTRIN_X86
+  if (CPP_INTRIN::detect_aes())
+  {
+    benchmark::RegisterBenchmark("get_randomness/aes/throughput", get_randomness_throughput<Rand>,
+                                 &CPP_INTRIN::AES::get_randomness);
+    benchmark::RegisterBenchmark("get_randomness/aes/latency", get_randomness_latency<Rand>,
+                                 &CPP_INTRIN::AES::get_randomness);
+  }
+#endif
+
+  benchmark::RegisterBenchmark("random_fill/baseline", random_fill_baseline)
+      ->RangeMultiplier(16)
+      ->Range(16, 16 << 12);
+  using Backend = CPP_INTRIN::RandomGenerator::Backend;
+  benchmark::RegisterBenchmark("random_fill/xorshift", random_fill_throughput, Backend::xorshift)
+      ->RangeMultiplier(16)
+      ->Range(16, 16 << 12);
+  if (CPP_INTRIN::detect_aes())
+  {
+    benchmark::RegisterBenchmark("random_fill/aes", random_fill_throughput, Backend::aes)
+        ->RangeMultiplier(16)
+        ->Range(16, 16 << 12);
+  }
+  if (CPP_INTRIN::detect_vaes())
+  {
+    benchmark::RegisterBenchmark("random_fill/vaes", random_fill_throughput, Backend::vaes)
+        ->RangeMultiplier(16)
+        ->Range(16, 16 << 12);
+  }
+
+  for (const unsigned codes : {1u, 2u})
+  {
+    benchmark::RegisterBenchmark(("bucketer/codes:" + std::to_string(codes)).c_str(),
+                                 bucketer_throughput, codes)
+        ->ArgsProduct({{1, 4}, {1, 4}})
+        ->ArgNames({"k", "threads"})
+        ->UseRealTime();
+  }
+  benchmark::RegisterBenchmark("vector_store/baseline", store_pass_baseline)->Arg(1 << 21);
+  benchmark::RegisterBenchmark("vector_store/pages", store_pass_throughput, false)->Arg(1 << 21);
+  benchmark::RegisterBenchmark("vector_store/huge_pages", store_pass_throughput, true)->Arg(1 << 21);
+  benchmark::RegisterBenchmark("vector_file/lazy", file_pass_throughput, false)->Arg(1 << 21);
+  benchmark::RegisterBenchmark("vector_file/populate", file_pass_throughput, true)->Arg(1 << 21);
+  benchmark::RegisterBenchmark("parallel_bulk/m256_add_epi16_bulk", parallel_add_throughput)
+      ->ArgsProduct({{1 << 16, 1 << 20}, {1, 4}})
+      ->ArgNames({"size", "threads"})
+      ->UseRealTime();
+}
+
+void register_table(const CPP_INTRIN::Dispatch &table)
+{
+  const std::string name = isa_name(table.isa);
+
+  BENCH_TABLE(binary, epi16x16, m256_hadd_epi16);
+  BENCH_TABLE(binary, epi64x4, m256_xor_epi64);
+  BENCH_TABLE(binary, epi64x4, m256_or_epi64);
+  BENCH_TABLE(binary, epi64x4, m256_and_epi64);
+  BENCH_TABLE(binary, epi16x16, m256_and_epi16);
+  BENCH_TABLE(binary, epi16x16, m256_cmpgt_epi16);
+  BENCH_TABLE(binary, epi8x32, m256_cmpeq_epi8);
+  BENCH_TABLE(binary, epi16x16, m256_cmpeq_epi16);
+  BENCH_TABLE(binary, epi8x32, m256_cmpgt_epi8);
+  BENCH_TABLE(binary, epi8x32, m256_cmplt_epi8);
+  BENCH_TABLE(binary, epi16x16, m256_cmplt_epi16);
+  register_binary<epi8x32>("m256_blendv_epi8/" + name, [table](const epi8x32 &a, const epi8x32 &b) {
+    return table.m256_blendv_epi8(a, b, a);
+  });
+  BENCH_TABLE(binary, epi8x32, m256_shuffle_epi8);
+  BENCH_TABLE(binary, epi16x16, m256_add_epi16);
+  BENCH_TABLE(binary, epi16x16, m256_sub_epi16);
+  BENCH_TABLE(binary, epi16x16, m256_adds_epi16);
+  BENCH_TABLE(binary, epi16x16, m256_subs_epi16);
+  BENCH_TABLE(binary, epi16x16, m256_mullo_epi16);
+  BENCH_TABLE(binary, epi16x16, m256_mulhi_epi16);
+  register_binary<epi16x16>("m256_madd_epi16/" + name,
+                            [table](const epi16x16 &a, const epi16x16 &b) {
+                              return table.m256_madd_epi16(a, b).epi16();
+                            });
+  BENCH_TABLE(binary, epi16x16, m256_adds_epu16);
+  BENCH_TABLE(binary, epi16x16, m256_subs_epu16);
+  BENCH_TABLE(binary, epi8x32, m256_adds_epu8);
+  BENCH_TABLE(binary, epi8x32, m256_subs_epu8);
+  BENCH_TABLE(binary, epi16x16, m256_sign_epi16);
+  BENCH_TABLE(unary, epi16x16, m256_abs_epi16);
+  BENCH_TABLE(binary, epi16x16, m256_subabs_epi16);
+
+  BENCH_TABLE(binary, epi16x32, m512_add_epi16);
+  BENCH_TABLE(binary, epi16x32, m512_sub_epi16);
+  BENCH_TABLE(binary, epi16x32, m512_sign_epi16);
+  BENCH_TABLE(unary, epi16x32, m512_abs_epi16);
+  BENCH_TABLE(binary, epi64x8, m512_and_epi64);
+  BENCH_TABLE(binary, epi64x8, m512_xor_epi64);
+  BENCH_TABLE(binary, epi8x64, m512_shuffle_epi8);
+  BENCH_TABLE(binary, epi16x32, m512_cmpgt_epi16);
+
+  BENCH_IMM_TABLE(epi64x4, m256_permute4x64_epi64, 0x4E);
+  BENCH_IMM_TABLE(epi64x8, m512_permute4x64_epi64, 0x4E);
+  BENCH_IMM_TABLE(epi16x16, m256_permute4x64_epi16, 0x4E);
+  BENCH_IMM_TABLE(epi16x16, m256_slli_epi16, 3);
+  BENCH_IMM_TABLE(epi16x16, m256_srli_epi16, 3);
+  BENCH_IMM_TABLE(epi16x16, m256_srai_epi16, 3);
+  register_unary<epi16x16>("m256_sll_epi16/" + name, [table](const epi16x16 &a) {
+    return table.m256_sll_epi16(a, shift_count);
+  });
+  register_unary<epi16x16>("m256_srl_epi16/" + name, [table](const epi16x16 &a) {
+    return table.m256_srl_epi16(a, shift_count);
+  });
+  register_unary<epi16x16>("m256_compress_epi16/" + name, [table](const epi16x16 &a) {
+    return table.m256_compress_epi16(a, table.m256_movemask_epi16(a));
+  });
+  BENCH_TABLE(binary, epi32x8, m256_permutevar8x32_epi32);
+  register_unary<epi32x8>("m256_i32gather_epi32/" + name, [table](const epi32x8 &a) {
+    return table.m256_i32gather_epi32(gather_table32.data(), gather_index(a));
+  });
+  register_unary<epi32x8>("m256_i32gather_epi64/" + name, [table](const epi32x8 &a) {
+    return table.m256_i32gather_epi64(gather_table64.data(), gather_index(a)).epi32();
+  });
+  BENCH_TABLE(binary, epi8x32, m256_lut32_epi8);
+  BENCH_TABLE(binary, epi16x16, m256_lut16_epi16);
+  register_unary<epi8x32>("m256_lut64_epi8/" + name, [table](const epi8x32 &a) {
+    return table.m256_lut64_epi8(lut_table64, a);
+  });
+  register_unary<epi16x16>("m256_lut32_epi16/" + name, [table](const epi16x16 &a) {
+    return table.m256_lut32_epi16(lut_table64.epi16(), a);
+  });
+  BENCH_TABLE(binary, epi32x8, m256_sllv_epi32);
+  BENCH_TABLE(binary, epi32x8, m256_srlv_epi32);
+  BENCH_TABLE(binary, epi64x4, m256_sllv_epi64);
+  BENCH_TABLE(binary, epi64x4, m256_srlv_epi64);
+  BENCH_TABLE(unary, epi16x16, m256_hadamard16_epi16);
+  BENCH_TABLE(unary, epi16x32, m512_hadamard32_epi16);
+
+  BENCH_TABLE(bulk, epi16x16, m256_add_epi16_bulk);
+  BENCH_TABLE(bulk, epi16x16, m256_sub_epi16_bulk);
+  BENCH_TABLE(bulk, epi16x16, m256_adds_epi16_bulk);
+  BENCH_TABLE(bulk, epi16x16, m256_subs_epi16_bulk);
+  BENCH_TABLE(bulk, epi16x16, m256_adds_epu16_bulk);
+  BENCH_TABLE(bulk, epi16x16, m256_subs_epu16_bulk);
+  BENCH_TABLE(bulk, epi8x32, m256_adds_epu8_bulk);
+  BENCH_TABLE(bulk, epi8x32, m256_subs_epu8_bulk);
+  BENCH_TABLE(bulk, epi64x4, m256_xor_epi64_bulk);
+  BENCH_TABLE(bulk, epi16x16, m256_sign_epi16_bulk);
+  register_bulk<epi16x16>("m256_hadamard16_epi16_bulk/" + name,
+                          [table](const epi16x16 *a, const epi16x16 *, epi16x16 *c,
+                                  const size_t size) {
+                            table.m256_hadamard16_epi16_bulk(a, c, size);
+                          });
+  register_bulk<epi16x16>("m256_stream_si256/" + name,
+                          [table](const epi16x16 *a, const epi16x16 *, epi16x16 *c,
+                                  const size_t size) {
+                            for (size_t i = 0; i < size; i++)
+                            {
+                              table.m256_stream_si256(c[i].data(),
+                                                      table.m256_loadu_si256(a[i].data()));
+                            }
+                            table.stream_fence();
+                          });
+
+  BENCH_SCALAR_TABLE(epi16x16, m256_testz_si256, table.m256_testz_si256(a, b));
+  BENCH_SCALAR_TABLE(epi16x32, m512_testz_si512, table.m512_testz_si512(a, b));
+  BENCH_SCALAR_TABLE(epi16x16, m256_cmpgt_epi16_mask, table.m256_cmpgt_epi16_mask(a, b));
+  BENCH_SCALAR_TABLE(epi16x32, m512_cmpgt_epi16_mask, table.m512_cmpgt_epi16_mask(a, b));
+  BENCH_SCALAR_TABLE(epi16x16, m256_and_testz_si256, table.m256_and_testz_si256(a, b, a));
+  BENCH_SCALAR_TABLE(epi16x16, m256_movemask_epi16, table.m256_movemask_epi16(a));
+  BENCH_SCALAR_TABLE(epi64x4, m256_xor_popcount_epi64, table.m256_xor_popcount_epi64(a, b));
+  BENCH_SCALAR_TABLE(epi16x16, m256_hadd_reduce_epi16, table.m256_hadd_reduce_epi16(a, b));
+  BENCH_SCALAR_TABLE(epi8x32, m256_movemask_epi8, table.m256_movemask_epi8(a));
+  BENCH_SCALAR_TABLE(epi16x16, m256_reduce_add_epi16, table.m256_reduce_add_epi16(a));
+  BENCH_SCALAR_TABLE(epi16x16, m256_reduce_min_epi16, table.m256_reduce_min_epi16(a));
+  BENCH_SCALAR_TABLE(epi16x16, m256_reduce_max_epi16, table.m256_reduce_max_epi16(a));
+  BENCH_SCALAR_TABLE(epi16x16, m256_reduce_argmax_epi16, table.m256_reduce_argmax_epi16(a));
+  BENCH_SCALAR_TABLE(epi64x4, m256_popcount_si256, table.m256_popcount_si256(a));
+  BENCH_TABLE(unary, epi8x32, m256_popcount_epi8);
+  BENCH_TABLE(unary, epi64x4, m256_popcount_epi64);
+
+  BENCH_BULK_REDUCE_TABLE(epi64x4, m256_popcount_si256_bulk,
+                          table.m256_popcount_si256_bulk(a, size));
+  BENCH_BULK_REDUCE_TABLE(epi64x4, m256_xor_popcount_epi64_bulk,
+                          table.m256_xor_popcount_epi64_bulk(a, b, size));
+  benchmark::RegisterBenchmark(("m256_broadcastsi128_si256/" + name + "/throughput").c_str(),
+                               broadcast_throughput<decltype(table.m256_broadcastsi128_si256)>,
+                               table.m256_broadcastsi128_si256);
+  benchmark::RegisterBenchmark(
+      ("mm_extract_epi64<1>/" + name + "/throughput").c_str(), [table](benchmark::State &state) {
+        extract_throughput(state,
+                           [&table](const __uint128_t a) { return table.mm_extract_epi64<1>(a); });
+      });
+  BENCH_TABLE(binary, epi16x16, m256_unpacklo_epi16);
+  BENCH_TABLE(binary, epi16x16, m256_unpackhi_epi16);
+  BENCH_TABLE(binary, epi32x8, m256_unpacklo_epi32);
+  BENCH_TABLE(binary, epi32x8, m256_unpackhi_epi32);
+  BENCH_SCALAR_TABLE(epi16x16, m256_extract_epi16, table.m256_extract_epi16<11>(a));
+  BENCH_SCALAR_TABLE(epi64x4, m256_extract_epi64, table.m256_extract_epi64<3>(a));
+  register_binary<epi16x16>("m256_inserti128_si256<1>/" + name,
+                            [table](const epi16x16 &a, const epi16x16 &b) {
+                              return table.m256_inserti128_si256<1>(
+                                  a, table.m256_extracti128_si256<0>(b));
+                            });
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  register_inline();
+  // We only register the tiers that this machine can actually run.
+  for (unsigned isa = 0; isa <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); isa++)
+  {
+    const auto tier = static_cast<CPP_INTRIN::ISA>(isa);
+    if (CPP_INTRIN::clamp_isa(tier) == tier)
+    {
+      register_table(CPP_INTRIN::make_dispatch(tier));
+    }
+  }
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+  {
+    return 1;
+  }
+
+  benchmark::AddCustomContext("cpp_intrin_compile_tier", compile_tier());
+  benchmark::AddCustomContext("cpp_intrin_detected_tier", isa_name(CPP_INTRIN::detect_isa()));
+  benchmark::AddCustomContext("compiler", __VERSION__);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include "intrinsics.hpp"
+
+/***
+ * Intrinsics.c.cpp.
+ * This file contains the code generation checks. Many of the functions in intrinsics.hpp don't
+ * use intrinsics on some (or all) tiers, because the compiler vectorises the plain C++ version
+ * well enough on its own. That's a claim about the compiler rather than about our code, and so it
+ * can silently stop being true when the compiler changes.
+ *
+ * Each function below wraps one public function, so that it's compiled exactly as it would be in
+ * a caller. CMakeLists.txt compiles this file once for each set of ISA flags, and codegen.cmake
+ * disassembles the result and checks each wrapper against the budgets listed there. A wrapper
+ * fails if it's longer than its budget, if it contains a loop where it shouldn't (an operation on
+ * a single vector should be straight-line code), or if it contains a loop without any vector
+ * instructions. Either of the latter means that the compiler fell back to scalar code.
+ *
+ * The wrappers take their inputs through pointers and store their result with m256_storeu_si256,
+ * so that the calling convention doesn't depend on the ISA flags. We don't assign the result
+ * through the pointer instead: GCC 12 splits that copy up, which would add a stack round trip to
+ * every wrapper that has nothing to do with the function being checked.
+ */
+
+// Each wrapper is declared and then defined, with C linkage so that codegen.cmake can find it in
+// the disassembly by name.
+#define CODEGEN_UNARY(name, type)                                                                  \
+  extern "C" void codegen_##name(const type *a, type *c) noexcept;                                 \
+  extern "C" void codegen_##name(const type *a, type *c) noexcept                                  \
+  {                                                                                                \
+    CPP_INTRIN::m256_storeu_si256(c->data(), CPP_INTRIN::name(*a));                                \
+  }
+
+#define CODEGEN_UNARY_IMM(name, imm, type)                                                         \
+  extern "C" void codegen_##name(const type *a, type *c) noexcept;                                 \
+  extern "C" void codegen_##name(const type *a, type *c) noexcept                                  \
+  {                                                                                                \
+    CPP_INTRIN::m256_storeu_si256(c->data(), CPP_INTRIN::name<imm>(*a));                           \
+  }
+
+#define CODEGEN_BINARY(name, type)                                                                 \
+  extern "C" void codegen_##name(const type *a, const type *b, type *c) noexcept;                  \
+  extern "C" void codegen_##name(const type *a, const type *b, type *c) noexcept                   \
+  {                                                                                                \
+    CPP_INTRIN::m256_storeu_si256(c->data(), CPP_INTRIN::name(*a, *b));                            \
+  }
+
+#define CODEGEN_BULK_BINARY(name, type)                                                            \
+  extern "C" void codegen_##name(const type *a, const type *b, type *c, size_t n) noexcept;        \
+  extern "C" void codegen_##name(const type *a, const type *b, type *c, size_t n) noexcept         \
+  {                                                                                                \
+    CPP_INTRIN::name(a, b, c, n);                                                                  \
+  }
+
+#define CODEGEN_BULK_UNARY(name, type)                                                             \
+  extern "C" void codegen_##name(const type *a, type *c, size_t n) noexcept;                       \
+  extern "C" void codegen_##name(const type *a, type *c, size_t n) noexcept                        \
+  {                                                                                                \
+    CPP_INTRIN::name(a, c, n);                                                                     \
+  }
+
+using epi8x32  = CPP_INTRIN::epi8x32;
+using epi16x16 = CPP_INTRIN::epi16x16;
+using epi64x4  = CPP_INTRIN::epi64x4;
+
+// The bitwise operations, which are plain C++ on every tier.
+CODEGEN_BINARY(m256_xor_epi64, epi64x4)
+CODEGEN_BINARY(m256_or_epi64, epi64x4)
+CODEGEN_BINARY(m256_and_epi64, epi64x4)
+CODEGEN_BINARY(m256_and_epi16, epi16x16)
+
+// The lane-wise arithmetic, which is plain C++ on every tier.
+CODEGEN_BINARY(m256_add_epi16, epi16x16)
+CODEGEN_BINARY(m256_sub_epi16, epi16x16)
+CODEGEN_BINARY(m256_mullo_epi16, epi16x16)
+CODEGEN_BINARY(m256_mulhi_epi16, epi16x16)
+CODEGEN_UNARY_IMM(m256_slli_epi16, 3, epi16x16)
+CODEGEN_UNARY_IMM(m256_srli_epi16, 3, epi16x16)
+CODEGEN_UNARY_IMM(m256_srai_epi16, 3, epi16x16)
+
+// These use intrinsics on most tiers, and plain C++ that should vectorise on the rest.
+CODEGEN_BINARY(m256_sign_epi16, epi16x16)
+CODEGEN_UNARY(m256_abs_epi16, epi16x16)
+CODEGEN_BINARY(m256_cmpgt_epi16, epi16x16)
+CODEGEN_UNARY(m256_hadamard16_epi16, epi16x16)
+
+// The bulk kernels are loops, but each iteration should be vector code.
+CODEGEN_BULK_BINARY(m256_add_epi16_bulk, epi16x16)
+CODEGEN_BULK_BINARY(m256_sub_epi16_bulk, epi16x16)
+CODEGEN_BULK_BINARY(m256_adds_epi16_bulk, epi16x16)
+CODEGEN_BULK_BINARY(m256_subs_epu8_bulk, epi8x32)
+CODEGEN_BULK_BINARY(m256_xor_epi64_bulk, epi64x4)
+CODEGEN_BULK_BINARY(m256_sign_epi16_bulk, epi16x16)
+CODEGEN_BULK_UNARY(m256_hadamard16_epi16_bulk, epi16x16)
+
+// The bulk popcounts return a count rather than vectors.
+extern "C" void codegen_m256_popcount_si256_bulk(const epi64x4 *a, uint64_t *c, size_t n) noexcept;
+extern "C" void codegen_m256_popcount_si256_bulk(const epi64x4 *a, uint64_t *c, size_t n) noexcept
+{
+  *c = CPP_INTRIN::m256_popcount_si256_bulk(a, n);
+}
+
+extern "C" void codegen_m256_xor_popcount_epi64_bulk(const epi64x4 *a, const epi64x4 *b,
+                                                     uint64_t *c, size_t n) noexcept;
+extern "C" void codegen_m256_xor_popcount_epi64_bulk(const epi64x4 *a, const epi64x4 *b,
+                                                     uint64_t *c, size_t n) noexcept
+{
+  *c = CPP_INTRIN::m256_xor_popcount_epi64_bulk(a, b, n);
+}
+
+// The expression templates evaluate the whole chain in one plain C++ loop over the lanes.
+extern "C" void codegen_expr_abs_sub(const epi16x16 *a, const epi16x16 *b, epi16x16 *c) noexcept;
+extern "C" void codegen_expr_abs_sub(const epi16x16 *a, const epi16x16 *b, epi16x16 *c) noexcept
+{
+  using E = CPP_INTRIN::Expr;
+  CPP_INTRIN::m256_storeu_si256(c->data(), E::eval(E::abs(E::sub(*a, *b))));
+}
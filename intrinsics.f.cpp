@@ -0,0 +1,583 @@
+#include "intrinsics.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/***
+ * Differential fuzzing of the tiers. The unit tests check each operation against a handful of
+ * hand-picked inputs, and are compiled once per instruction set. This harness instead compiles
+ * every tier into a single binary (via the dispatch tables), runs each operation on the same
+ * random inputs on every tier that the running machine supports, and compares the outputs bit for
+ * bit against the plain C++ tier, which is the reference semantics.
+ *
+ * A quarter of the lanes of every input are edge values (0, 1, -1, the minimum and maximum of the
+ * lane type, and their neighbours), so that e.g INT16_MIN turns up in m256_abs_epi16 and
+ * m256_sign_epi16 in most calls. Inputs only depend on the seed, so a mismatch can be reproduced
+ * exactly. For each operation and tier this prints the time per call (through the dispatch table)
+ * and the number of mismatches, along with the first mismatching input. The exit code is non-zero
+ * if anything mismatched. For the single-vector operations the time is mostly the call and the
+ * copies in and out: it's a sanity check, and intrinsics.b.cpp is the place for precise numbers.
+ *
+ * Usage: ./runIntrinsicsFuzz [calls per operation, default 2^20] [seed, default 1]
+ *
+ * get_randomness (whose AES-NI version is a different generator by design) and stream_fence
+ * aren't compared.
+ */
+
+namespace
+{
+using Dispatch = CPP_INTRIN::Dispatch;
+using ISA      = CPP_INTRIN::ISA;
+using epi8x32  = CPP_INTRIN::epi8x32;
+using epi16x16 = CPP_INTRIN::epi16x16;
+using epi32x8  = CPP_INTRIN::epi32x8;
+using epi64x4  = CPP_INTRIN::epi64x4;
+using epi8x64  = CPP_INTRIN::epi8x64;
+using epi16x32 = CPP_INTRIN::epi16x32;
+using epi64x8  = CPP_INTRIN::epi64x8;
+
+// The number of inputs that are generated, and then run on every tier, at a time.
+constexpr size_t batch = 4096;
+// The bulk operations run on up to this many vectors.
+constexpr size_t bulk_size = 19;
+
+// splitmix64.
+struct Rng
+{
+  uint64_t state;
+
+  uint64_t next() noexcept
+  {
+    uint64_t z = (state += 0x9E3779B97F4A7C15);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+  }
+};
+
+template <typename E> E random_lane(Rng &rng) noexcept
+{
+  using limits     = std::numeric_limits<E>;
+  const uint64_t r = rng.next();
+  if (r % 4 != 0)
+  {
+    return static_cast<E>(r >> 32);
+  }
+  const E edges[] = {E(0),
+                     E(1),
+                     static_cast<E>(-1),
+                     limits::min(),
+                     limits::max(),
+                     static_cast<E>(limits::min() + 1),
+                     static_cast<E>(limits::max() - 1)};
+  return edges[(r >> 8) % 7];
+}
+
+// The randomise overloads fill an input of each type. They're declared in dependency order, as
+// the containers call the overloads for their elements.
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value>::type randomise(T &x, Rng &rng) noexcept
+{
+  x = random_lane<T>(rng);
+}
+
+void randomise(__uint128_t &x, Rng &rng) noexcept
+{
+  x = (__uint128_t(rng.next()) << 64) | rng.next();
+}
+
+template <typename E> void randomise(CPP_INTRIN::Vec256<E> &v, Rng &rng) noexcept
+{
+  for (auto &lane : v)
+  {
+    lane = random_lane<E>(rng);
+  }
+}
+
+template <typename E> void randomise(CPP_INTRIN::Vec512<E> &v, Rng &rng) noexcept
+{
+  for (auto &lane : v)
+  {
+    lane = random_lane<E>(rng);
+  }
+}
+
+template <typename T, size_t n> void randomise(std::array<T, n> &a, Rng &rng) noexcept
+{
+  for (auto &x : a)
+  {
+    randomise(x, rng);
+  }
+}
+
+template <typename... T> void randomise(std::tuple<T...> &t, Rng &rng) noexcept
+{
+  std::apply([&](auto &...x) noexcept { (randomise(x, rng), ...); }, t);
+}
+
+template <typename T> std::string hex(const T &x)
+{
+  const auto *const bytes = reinterpret_cast<const unsigned char *>(&x);
+  std::string out;
+  char digits[4];
+  for (size_t i = 0; i < sizeof(T); i++)
+  {
+    std::snprintf(digits, sizeof(digits), "%02x", bytes[i]);
+    out += (i != 0 && i % 8 == 0) ? " " : "";
+    out += digits;
+  }
+  return out;
+}
+
+// A single operation under test. Each case owns a batch of inputs and the outputs that each tier
+// produced for them.
+struct Case
+{
+  explicit Case(std::string name_) : name{std::move(name_)} {}
+  virtual ~Case() = default;
+
+  // Replaces the inputs with a new batch.
+  virtual void generate(Rng &rng) = 0;
+  // Runs the batch on `table`, keeping the outputs in `slot`, and returns the time taken in ns.
+  virtual double run(const Dispatch &table, size_t slot) = 0;
+  // Returns the number of outputs in `slot` that differ from those in `reference`. The first
+  // mismatch is described in `report` (if it's empty).
+  virtual size_t compare(size_t slot, size_t reference, std::string &report) const = 0;
+
+  std::string name;
+};
+
+template <typename In, typename Out, typename Gen, typename Op> struct FuzzCase final : Case
+{
+  FuzzCase(std::string name_, const Gen &gen_, const Op &op_, const size_t slots)
+      : Case{std::move(name_)}, gen{gen_}, op{op_}, inputs(batch), outputs(slots)
+  {
+    for (auto &out : outputs)
+    {
+      out.resize(batch);
+    }
+  }
+
+  void generate(Rng &rng) override
+  {
+    for (auto &in : inputs)
+    {
+      gen(in, rng);
+    }
+  }
+
+  double run(const Dispatch &table, const size_t slot) override
+  {
+    auto &out        = outputs[slot];
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < batch; i++)
+    {
+      out[i] = static_cast<Stored>(op(table, inputs[i]));
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+  }
+
+  size_t compare(const size_t slot, const size_t reference, std::string &report) const override
+  {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < batch; i++)
+    {
+      if (std::memcmp(&outputs[slot][i], &outputs[reference][i], sizeof(Stored)) == 0)
+      {
+        continue;
+      }
+      if (mismatches++ == 0 && report.empty())
+      {
+        report = "  input:    " + hex(inputs[i]) + "\n  expected: " + hex(outputs[reference][i]) +
+                 "\n  actual:   " + hex(outputs[slot][i]) + "\n";
+      }
+    }
+    return mismatches;
+  }
+
+  // std::vector<bool> isn't a container of bools, so those are kept as bytes instead.
+  using Stored = typename std::conditional<std::is_same<Out, bool>::value, uint8_t, Out>::type;
+
+  Gen gen;
+  Op op;
+  std::vector<In> inputs;
+  std::vector<std::vector<Stored>> outputs;
+};
+
+using Cases = std::vector<std::unique_ptr<Case>>;
+
+// Adds a case whose inputs are of type In, filled by gen(in, rng), and whose output is
+// op(table, in).
+template <typename In, typename Gen, typename Op>
+void add(Cases &cases, const size_t slots, std::string name, const Gen &gen, const Op &op)
+{
+  using Out = decltype(op(std::declval<const Dispatch &>(), std::declval<const In &>()));
+  static_assert(std::is_trivially_copyable<Out>::value, "Error: outputs are compared bytewise.");
+  cases.emplace_back(new FuzzCase<In, Out, Gen, Op>(std::move(name), gen, op, slots));
+}
+
+template <typename In, typename Op>
+void add(Cases &cases, const size_t slots, std::string name, const Op &op)
+{
+  add<In>(cases, slots, std::move(name), [](In &in, Rng &rng) { randomise(in, rng); }, op);
+}
+
+// Adds a case for an operation that takes its inputs by value (or const reference). fixup (if
+// given) adjusts each random input, e.g to make an interesting result more likely.
+template <typename R, typename... Args, typename Fixup>
+void add_op(Cases &cases, const size_t slots, std::string name, R (*Dispatch::*member)(Args...),
+            const Fixup &fixup)
+{
+  using In = std::tuple<std::decay_t<Args>...>;
+  add<In>(
+      cases, slots, std::move(name),
+      [fixup](In &in, Rng &rng) {
+        randomise(in, rng);
+        fixup(in, rng);
+      },
+      [member](const Dispatch &table, const In &in) { return std::apply(table.*member, in); });
+}
+
+template <typename R, typename... Args>
+void add_op(Cases &cases, const size_t slots, std::string name, R (*Dispatch::*member)(Args...))
+{
+  add_op(cases, slots, std::move(name), member, [](auto &, Rng &) {});
+}
+
+// Random inputs almost never AND to zero, so half of the time we clear the bits of the last input
+// that are set in all of the others.
+template <typename V> void clear_common(const V &common, V &last, Rng &rng) noexcept
+{
+  if (rng.next() % 2 == 0)
+  {
+    for (size_t i = 0; i < last.size(); i++)
+    {
+      last[i] &= ~common[i];
+    }
+  }
+}
+
+// The gathers read from these tables.
+std::array<int32_t, 64> gather32;
+std::array<int64_t, 64> gather64;
+
+#define FUZZ_OP(op) add_op(cases, slots, #op, &Dispatch::op)
+
+#define FUZZ_BULK_BINARY(T, op)                                                                    \
+  add<std::tuple<std::array<T, bulk_size>, std::array<T, bulk_size>, uint8_t>>(                    \
+      cases, slots, #op, [](const Dispatch &table, const auto &in) {                              \
+        std::array<T, bulk_size> c{};                                                              \
+        table.op(std::get<0>(in).data(), std::get<1>(in).data(), c.data(),                         \
+                 std::get<2>(in) % (bulk_size + 1));                                               \
+        return c;                                                                                  \
+      })
+
+#define FUZZ_TEMPLATE(T, op, imm8)                                                                 \
+  add<T>(cases, slots, #op "<" #imm8 ">", [](const Dispatch &table, const T &in) {                \
+    return table.template op<imm8>(in);                                                            \
+  })
+
+Cases make_cases(const size_t slots)
+{
+  Cases cases;
+
+  FUZZ_OP(m256_hadd_epi16);
+  FUZZ_OP(m256_xor_epi64);
+  FUZZ_OP(m256_or_epi64);
+  FUZZ_OP(m256_and_epi64);
+  FUZZ_OP(m256_and_epi16);
+  FUZZ_OP(m256_cmpgt_epi16);
+  FUZZ_OP(m256_cmpeq_epi8);
+  FUZZ_OP(m256_cmpeq_epi16);
+  FUZZ_OP(m256_cmpgt_epi8);
+  FUZZ_OP(m256_cmplt_epi8);
+  FUZZ_OP(m256_cmplt_epi16);
+  FUZZ_OP(m256_blendv_epi8);
+  FUZZ_OP(m256_movemask_epi8);
+  FUZZ_OP(m256_movemask_epi16);
+  FUZZ_OP(m256_compress_epi16);
+  FUZZ_OP(m256_permutevar8x32_epi32);
+  FUZZ_OP(m256_lut32_epi8);
+  FUZZ_OP(m256_lut64_epi8);
+  FUZZ_OP(m256_lut16_epi16);
+  FUZZ_OP(m256_lut32_epi16);
+  FUZZ_OP(m256_hadamard16_epi16);
+  FUZZ_OP(m512_hadamard32_epi16);
+  FUZZ_OP(m256_sll_epi16);
+  FUZZ_OP(m256_srl_epi16);
+  FUZZ_OP(m256_sllv_epi32);
+  FUZZ_OP(m256_srlv_epi32);
+  FUZZ_OP(m256_sllv_epi64);
+  FUZZ_OP(m256_srlv_epi64);
+  FUZZ_OP(m256_mullo_epi16);
+  FUZZ_OP(m256_mulhi_epi16);
+  FUZZ_OP(m256_madd_epi16);
+  FUZZ_OP(m256_shuffle_epi8);
+  FUZZ_OP(m256_add_epi16);
+  FUZZ_OP(m256_sub_epi16);
+  FUZZ_OP(m256_sign_epi16);
+  FUZZ_OP(m256_abs_epi16);
+  FUZZ_OP(m256_broadcastsi128_si256);
+  FUZZ_OP(m256_unpacklo_epi16);
+  FUZZ_OP(m256_unpackhi_epi16);
+  FUZZ_OP(m256_unpacklo_epi32);
+  FUZZ_OP(m256_unpackhi_epi32);
+  FUZZ_OP(m256_subabs_epi16);
+  FUZZ_OP(m256_xor_popcount_epi64);
+  FUZZ_OP(m256_hadd_reduce_epi16);
+  FUZZ_OP(m256_reduce_add_epi16);
+  FUZZ_OP(m256_reduce_min_epi16);
+  FUZZ_OP(m256_reduce_max_epi16);
+  FUZZ_OP(m256_reduce_argmax_epi16);
+  FUZZ_OP(m256_popcount_epi8);
+  FUZZ_OP(m256_popcount_epi64);
+  FUZZ_OP(m256_popcount_si256);
+  FUZZ_OP(m512_add_epi16);
+  FUZZ_OP(m512_sub_epi16);
+  FUZZ_OP(m512_sign_epi16);
+  FUZZ_OP(m512_abs_epi16);
+  FUZZ_OP(m512_and_epi64);
+  FUZZ_OP(m512_or_epi64);
+  FUZZ_OP(m512_xor_epi64);
+  FUZZ_OP(m512_shuffle_epi8);
+  FUZZ_OP(m512_cmpgt_epi16);
+  FUZZ_OP(m256_cmpgt_epi16_mask);
+  FUZZ_OP(m512_cmpgt_epi16_mask);
+  FUZZ_OP(m256_adds_epi16);
+  FUZZ_OP(m256_subs_epi16);
+  FUZZ_OP(m256_adds_epu16);
+  FUZZ_OP(m256_subs_epu16);
+  FUZZ_OP(m256_adds_epu8);
+  FUZZ_OP(m256_subs_epu8);
+
+  add_op(cases, slots, "m256_testz_si256", &Dispatch::m256_testz_si256, [](auto &in, Rng &rng) {
+    clear_common(std::get<0>(in), std::get<1>(in), rng);
+  });
+  add_op(cases, slots, "m512_testz_si512", &Dispatch::m512_testz_si512, [](auto &in, Rng &rng) {
+    clear_common(std::get<0>(in), std::get<1>(in), rng);
+  });
+  add_op(cases, slots, "m256_and_testz_si256", &Dispatch::m256_and_testz_si256,
+         [](auto &in, Rng &rng) {
+           epi16x16 common;
+           for (unsigned i = 0; i < 16; i++)
+           {
+             common[i] = std::get<0>(in)[i] & std::get<1>(in)[i];
+           }
+           clear_common(common, std::get<2>(in), rng);
+         });
+
+  // The operations that take pointers. The gather indices are kept in range of their tables.
+  add<epi32x8>(
+      cases, slots, "m256_i32gather_epi32",
+      [](epi32x8 &idx, Rng &rng) {
+        for (auto &i : idx)
+        {
+          i = static_cast<int32_t>(rng.next() % gather32.size());
+        }
+      },
+      [](const Dispatch &table, const epi32x8 &idx) {
+        return table.m256_i32gather_epi32(gather32.data(), idx);
+      });
+  add<epi32x8>(
+      cases, slots, "m256_i32gather_epi64",
+      [](epi32x8 &idx, Rng &rng) {
+        for (auto &i : idx)
+        {
+          i = static_cast<int32_t>(rng.next() % gather64.size());
+        }
+      },
+      [](const Dispatch &table, const epi32x8 &idx) {
+        return table.m256_i32gather_epi64(gather64.data(), idx);
+      });
+
+  add<std::tuple<std::array<int32_t, 8>, epi32x8>>(
+      cases, slots, "m256_maskload_epi32", [](const Dispatch &table, const auto &in) {
+        return table.m256_maskload_epi32(std::get<0>(in).data(), std::get<1>(in));
+      });
+  add<std::tuple<std::array<int64_t, 4>, epi64x4>>(
+      cases, slots, "m256_maskload_epi64", [](const Dispatch &table, const auto &in) {
+        return table.m256_maskload_epi64(std::get<0>(in).data(), std::get<1>(in));
+      });
+  add<std::tuple<std::array<int32_t, 8>, epi32x8, epi32x8>>(
+      cases, slots, "m256_maskstore_epi32", [](const Dispatch &table, const auto &in) {
+        auto out = std::get<0>(in);
+        table.m256_maskstore_epi32(out.data(), std::get<1>(in), std::get<2>(in));
+        return out;
+      });
+  add<std::tuple<std::array<int64_t, 4>, epi64x4, epi64x4>>(
+      cases, slots, "m256_maskstore_epi64", [](const Dispatch &table, const auto &in) {
+        auto out = std::get<0>(in);
+        table.m256_maskstore_epi64(out.data(), std::get<1>(in), std::get<2>(in));
+        return out;
+      });
+
+  add<std::array<epi16x16, 4>>(
+      cases, slots, "m256_hadamard64_epi16", [](const Dispatch &table, const auto &in) {
+        std::array<epi16x16, 4> c;
+        table.m256_hadamard64_epi16(in.data(), c.data());
+        return c;
+      });
+
+  FUZZ_BULK_BINARY(epi16x16, m256_add_epi16_bulk);
+  FUZZ_BULK_BINARY(epi16x16, m256_sub_epi16_bulk);
+  FUZZ_BULK_BINARY(epi64x4, m256_xor_epi64_bulk);
+  FUZZ_BULK_BINARY(epi16x16, m256_sign_epi16_bulk);
+  FUZZ_BULK_BINARY(epi16x16, m256_adds_epi16_bulk);
+  FUZZ_BULK_BINARY(epi16x16, m256_subs_epi16_bulk);
+  FUZZ_BULK_BINARY(epi16x16, m256_adds_epu16_bulk);
+  FUZZ_BULK_BINARY(epi16x16, m256_subs_epu16_bulk);
+  FUZZ_BULK_BINARY(epi8x32, m256_adds_epu8_bulk);
+  FUZZ_BULK_BINARY(epi8x32, m256_subs_epu8_bulk);
+
+  add<std::tuple<std::array<epi16x16, bulk_size>, uint8_t>>(
+      cases, slots, "m256_hadamard16_epi16_bulk", [](const Dispatch &table, const auto &in) {
+        std::array<epi16x16, bulk_size> c{};
+        table.m256_hadamard16_epi16_bulk(std::get<0>(in).data(), c.data(),
+                                         std::get<1>(in) % (bulk_size + 1));
+        return c;
+      });
+  add<std::tuple<std::array<epi64x4, bulk_size>, uint8_t>>(
+      cases, slots, "m256_popcount_si256_bulk", [](const Dispatch &table, const auto &in) {
+        return table.m256_popcount_si256_bulk(std::get<0>(in).data(),
+                                              std::get<1>(in) % (bulk_size + 1));
+      });
+  add<std::tuple<std::array<epi64x4, bulk_size>, std::array<epi64x4, bulk_size>, uint8_t>>(
+      cases, slots, "m256_xor_popcount_epi64_bulk", [](const Dispatch &table, const auto &in) {
+        return table.m256_xor_popcount_epi64_bulk(std::get<0>(in).data(), std::get<1>(in).data(),
+                                                  std::get<2>(in) % (bulk_size + 1));
+      });
+
+  // The templated operations, for a spread of immediates.
+  FUZZ_TEMPLATE(epi64x4, m256_permute4x64_epi64, 0);
+  FUZZ_TEMPLATE(epi64x4, m256_permute4x64_epi64, 27);
+  FUZZ_TEMPLATE(epi64x4, m256_permute4x64_epi64, 78);
+  FUZZ_TEMPLATE(epi64x4, m256_permute4x64_epi64, 114);
+  FUZZ_TEMPLATE(epi64x8, m512_permute4x64_epi64, 27);
+  FUZZ_TEMPLATE(epi64x8, m512_permute4x64_epi64, 114);
+  FUZZ_TEMPLATE(epi16x16, m256_slli_epi16, 0);
+  FUZZ_TEMPLATE(epi16x16, m256_slli_epi16, 1);
+  FUZZ_TEMPLATE(epi16x16, m256_slli_epi16, 15);
+  FUZZ_TEMPLATE(epi16x16, m256_srli_epi16, 0);
+  FUZZ_TEMPLATE(epi16x16, m256_srli_epi16, 1);
+  FUZZ_TEMPLATE(epi16x16, m256_srli_epi16, 15);
+  FUZZ_TEMPLATE(epi16x16, m256_srai_epi16, 0);
+  FUZZ_TEMPLATE(epi16x16, m256_srai_epi16, 1);
+  FUZZ_TEMPLATE(epi16x16, m256_srai_epi16, 15);
+  FUZZ_TEMPLATE(__uint128_t, mm_extract_epi64, 0);
+  FUZZ_TEMPLATE(__uint128_t, mm_extract_epi64, 1);
+  FUZZ_TEMPLATE(epi16x16, m256_extract_epi16, 0);
+  FUZZ_TEMPLATE(epi16x16, m256_extract_epi16, 7);
+  FUZZ_TEMPLATE(epi16x16, m256_extract_epi16, 8);
+  FUZZ_TEMPLATE(epi16x16, m256_extract_epi16, 15);
+  FUZZ_TEMPLATE(epi64x4, m256_extract_epi64, 0);
+  FUZZ_TEMPLATE(epi64x4, m256_extract_epi64, 3);
+  FUZZ_TEMPLATE(epi16x16, m256_extracti128_si256, 0);
+  FUZZ_TEMPLATE(epi16x16, m256_extracti128_si256, 1);
+  add<std::tuple<epi16x16, __uint128_t>>(
+      cases, slots, "m256_inserti128_si256<0>", [](const Dispatch &table, const auto &in) {
+        return table.template m256_inserti128_si256<0>(std::get<0>(in), std::get<1>(in));
+      });
+  add<std::tuple<epi16x16, __uint128_t>>(
+      cases, slots, "m256_inserti128_si256<1>", [](const Dispatch &table, const auto &in) {
+        return table.template m256_inserti128_si256<1>(std::get<0>(in), std::get<1>(in));
+      });
+
+  // The loads and stores, at every offset into a buffer.
+  add<std::tuple<std::array<int16_t, 32>, uint8_t>>(
+      cases, slots, "m256_loadu_si256", [](const Dispatch &table, const auto &in) {
+        return table.m256_loadu_si256(std::get<0>(in).data() + std::get<1>(in) % 17);
+      });
+  add<std::tuple<epi16x16, uint8_t>>(
+      cases, slots, "m256_storeu_si256", [](const Dispatch &table, const auto &in) {
+        std::array<int16_t, 32> out{};
+        table.m256_storeu_si256(out.data() + std::get<1>(in) % 17, std::get<0>(in));
+        return out;
+      });
+  add<epi16x16>(cases, slots, "m256_stream_si256", [](const Dispatch &table, const auto &in) {
+    epi16x16 out;
+    table.m256_stream_si256(out.data(), in);
+    return out;
+  });
+
+  return cases;
+}
+
+const char *tier_name(const ISA isa) noexcept
+{
+  switch (isa)
+  {
+  case ISA::neon:
+    return "neon";
+  case ISA::avx512:
+    return "avx512";
+  case ISA::avx2:
+    return "avx2";
+  case ISA::sse:
+    return "sse";
+  default:
+    return "plain";
+  }
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  const uint64_t calls = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : uint64_t(1) << 20;
+  const uint64_t seed  = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+  const uint64_t batches = (calls + batch - 1) / batch;
+
+  // The reference is always the plain C++ tier. Tiers from the other architecture are skipped.
+  std::vector<Dispatch> tables{Dispatch::bind<CPP_INTRIN::Plain>(ISA::plain)};
+  for (unsigned isa = 0; isa <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); isa++)
+  {
+    const auto tier = static_cast<ISA>(isa);
+    if (CPP_INTRIN::clamp_isa(tier) == tier)
+    {
+      tables.push_back(CPP_INTRIN::make_dispatch(tier));
+    }
+  }
+
+  Rng rng{seed};
+  randomise(gather32, rng);
+  randomise(gather64, rng);
+
+  std::printf("%-36s %-8s %10s %12s\n", "operation", "tier", "ns/call", "mismatches");
+  size_t failures = 0;
+  for (const auto &c : make_cases(tables.size()))
+  {
+    std::vector<double> ns(tables.size());
+    std::vector<size_t> mismatches(tables.size());
+    std::vector<std::string> reports(tables.size());
+    for (uint64_t b = 0; b < batches; b++)
+    {
+      c->generate(rng);
+      for (size_t t = 0; t < tables.size(); t++)
+      {
+        ns[t] += c->run(tables[t], t);
+      }
+      for (size_t t = 1; t < tables.size(); t++)
+      {
+        mismatches[t] += c->compare(t, 0, reports[t]);
+      }
+    }
+
+    for (size_t t = 1; t < tables.size(); t++)
+    {
+      std::printf("%-36s %-8s %10.2f %12zu\n", c->name.c_str(), tier_name(tables[t].isa),
+                  ns[t] / static_cast<double>(batches * batch), mismatches[t]);
+      std::fputs(reports[t].c_str(), stdout);
+      failures += mismatches[t];
+    }
+  }
+
+  std::printf("%zu mismatches in %llu calls per operation and tier (seed %llu)\n", failures,
+              static_cast<unsigned long long>(batches * batch),
+              static_cast<unsigned long long>(seed));
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
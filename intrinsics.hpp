@@ -1,13 +1,68 @@
 #ifndef _INCLUDED_INTRINSICS__
 #define _INCLUDED_INTRINSICS__
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <climits>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <immintrin.h>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <new>
 #include <numeric>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * CPP_INTRIN_X86 and CPP_INTRIN_NEON say which native back-ends can be compiled. Everything that
+ * uses the x86 intrinsics (the SSE, AVX2, AVX512, VPOPCNTDQ and AES tiers, and the CPUID-based
+ * detection) is only compiled if CPP_INTRIN_X86 is set, and the NEON tier is only compiled on
+ * AArch64. Either can be predefined to override the detection below.
+ */
+#ifndef CPP_INTRIN_X86
+#if defined(__x86_64__) || defined(__i386__)
+#define CPP_INTRIN_X86 1
+#else
+#define CPP_INTRIN_X86 0
+#endif
+#endif
+
+#ifndef CPP_INTRIN_NEON
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define CPP_INTRIN_NEON 1
+#else
+#define CPP_INTRIN_NEON 0
+#endif
+#endif
+
+#if CPP_INTRIN_X86
+#include <immintrin.h>
+#endif
+#if CPP_INTRIN_NEON
+#include <arm_neon.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /***
  * Intrinsics. This header file provides a collection of hand-written versions
@@ -23,9 +78,19 @@
  * intrinsics themselves. These are only resolved if the relevant macro (e.g
  * __AVX2__) are present at compile-time: this means that the intrinsics will be
  * used if available, but in all other cases we fall back to the manual C++
- * implementation. Note: this header set does absolutely no checking to see if
- * the runtime platform supports these intrinsics. This may be added later if
- * necessary.
+ * implementation.
+ *
+ * Each implementation lives in a "tier" struct (Plain, SSE and AVX2). The
+ * public functions pick the best tier at compile-time, exactly as described
+ * above. The SSE and AVX2 tiers are compiled via function-level target
+ * attributes, so they exist in every binary regardless of the -m flags used: this
+ * means that a binary built for the lowest common ISA can still pick the AVX2
+ * kernels at runtime. This is what the dispatch() table at the bottom of this
+ * file does: it checks CPUID once and binds each operation to the best tier
+ * that the running machine supports.
+ *
+ * On AArch64 there is a NEON tier instead, which the public functions use in
+ * place of the plain C++ versions. The x86 tiers are not compiled there.
  *
  * All of these functions live inside the CPP_INTRIN struct. This is a struct to
  * prevent arbitrary extensions at a future location -- it's easier to have them
@@ -41,6 +106,84 @@
  * having a code-base that's littered with the already reserved underscores.
  */
 
+/**
+ * These macros mark a function as being compiled for a particular instruction set, regardless of
+ * the flags passed to the compiler. A function marked this way may only be called if the running
+ * CPU supports the instruction set: the tier structs below are only ever called either from a
+ * public function that has checked the corresponding macro, or via the runtime dispatch table.
+ */
+#define CPP_INTRIN_TARGET_SSE2 __attribute__((target("sse2")))
+#define CPP_INTRIN_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define CPP_INTRIN_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define CPP_INTRIN_TARGET_AVX2 __attribute__((target("avx2")))
+#define CPP_INTRIN_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl")))
+#define CPP_INTRIN_TARGET_AVX512_VPOPCNTDQ __attribute__((target("avx512vpopcntdq,avx512vl")))
+#define CPP_INTRIN_TARGET_AES __attribute__((target("aes")))
+#define CPP_INTRIN_TARGET_VAES __attribute__((target("vaes,aes,avx2")))
+
+// GCC 11 and Clang 9 onwards provide __builtin_bit_cast, which we use for the lane views on Vec256.
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_bit_cast)
+#define CPP_INTRIN_HAS_BIT_CAST 1
+#endif
+#endif
+
+#ifndef CPP_INTRIN_HAS_BIT_CAST
+#define CPP_INTRIN_HAS_BIT_CAST 0
+#endif
+
+/**
+ * CPP_INTRIN_INSTRUMENT turns on the hot-path instrumentation described at CPP_INTRIN::Instrument.
+ * If it's set to 1, every public function records how often it's called, how many cycles it takes
+ * and which tier it used. It's off by default, in which case CPP_INTRIN_PROBE expands to nothing
+ * and the public functions compile exactly as before.
+ */
+#ifndef CPP_INTRIN_INSTRUMENT
+#define CPP_INTRIN_INSTRUMENT 0
+#endif
+
+#if CPP_INTRIN_INSTRUMENT
+#define CPP_INTRIN_PROBE(tier, name)                                                               \
+  static CPP_INTRIN::Instrument::Site &cpp_intrin_site =                                           \
+      CPP_INTRIN::Instrument::site(#name, #tier);                                                  \
+  const CPP_INTRIN::Instrument::Probe cpp_intrin_probe(cpp_intrin_site)
+#else
+#define CPP_INTRIN_PROBE(tier, name) static_cast<void>(0)
+#endif
+
+/**
+ * CPP_INTRIN_HAS_CONSTEXPR says whether the element-wise, shuffle and lane functions (e.g
+ * m256_sign_epi16, m256_shuffle_epi8 and m256_permute4x64_epi64) can be used in constant
+ * expressions, e.g to build masks at compile-time. Those functions are marked CPP_INTRIN_CONSTEXPR,
+ * and start by checking CPP_INTRIN_CONSTANT_EVALUATED(): during constant evaluation they use the
+ * Plain tier (which is constexpr), and otherwise they pick their tier exactly as before. This needs
+ * __builtin_is_constant_evaluated (the builtin behind C++20's std::is_constant_evaluated), and
+ * __builtin_bit_cast for the lane views.
+ *
+ * The probes that CPP_INTRIN_INSTRUMENT adds are static locals, which a constexpr function can't
+ * have: so an instrumented build doesn't get the constexpr functions.
+ */
+#ifndef CPP_INTRIN_HAS_CONSTEXPR
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated) && CPP_INTRIN_HAS_BIT_CAST &&                  \
+    !CPP_INTRIN_INSTRUMENT
+#define CPP_INTRIN_HAS_CONSTEXPR 1
+#endif
+#endif
+#endif
+
+#ifndef CPP_INTRIN_HAS_CONSTEXPR
+#define CPP_INTRIN_HAS_CONSTEXPR 0
+#endif
+
+#if CPP_INTRIN_HAS_CONSTEXPR
+#define CPP_INTRIN_CONSTEXPR constexpr
+#define CPP_INTRIN_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+#define CPP_INTRIN_CONSTEXPR
+#define CPP_INTRIN_CONSTANT_EVALUATED() false
+#endif
+
 struct CPP_INTRIN
 {
   /**
@@ -100,6 +243,252 @@ struct CPP_INTRIN
     constexpr static uint8_t int8_first_quad_shift = 4;
   };
 
+  /***
+   * Vec256. This is the vector type that every function in this file accepts and returns. It is
+   * exactly a std::array of 32 bytes' worth of T, except that it is guaranteed to be aligned on a
+   * 32-byte boundary. This matters: a plain std::array<int16_t, 16> is only guaranteed to be
+   * 2-byte aligned, which means that the aligned loads and stores (e.g _mm256_load_si256) may
+   * fault, and the unaligned ones may be split across two cache lines. With this type, every load
+   * and store in this file is aligned, and every vector occupies exactly half a cache line.
+   *
+   * Since Vec256 is derived from std::array, it can be used anywhere a std::array can be (indexing,
+   * iterators, comparisons and so on). It can also be implicitly constructed from a std::array:
+   * this means that existing code that passes std::arrays into these functions still works, at
+   * the cost of a copy into an aligned temporary. If you care about that copy, use Vec256 directly.
+   *
+   * Note that the default constructor deliberately leaves the contents uninitialised, exactly as a
+   * std::array does.
+   *
+   * The same 256 bits can be viewed as any lane width via as<U>() (or the epi8(), epi16(), epi32()
+   * and epi64() shorthands). Intel's intrinsics treat __m256i as untyped bits, so e.g
+   * _mm256_permute4x64_epi64 is perfectly happy to permute a vector of 16-bit integers: these views
+   * give us the same flexibility. They're implemented via __builtin_bit_cast (the builtin behind
+   * C++20's std::bit_cast), falling back to memcpy on compilers that don't have it: these are the
+   * only aliasing-safe ways to reinterpret an object in C++ (a reinterpret_cast'd reference would
+   * violate strict aliasing). This isn't a real copy: the compiler treats the cast as a register
+   * rename, so e.g m256_permute4x64_epi64<imm8>(a.epi64()).epi16() compiles to a single vpermq.
+   * The memcpy fallback is also correct, but older compilers may spill it to the stack. Only the
+   * __builtin_bit_cast version can be used in a constant expression.
+   */
+  template <typename T> struct alignas(32) Vec256 : public std::array<T, 32 / sizeof(T)>
+  {
+    static_assert(std::is_integral<T>::value, "Error: Vec256 only holds integers.");
+    using array_type = std::array<T, 32 / sizeof(T)>;
+
+    Vec256() noexcept = default;
+    constexpr Vec256(const array_type &other) noexcept : array_type(other) {}
+
+    template <typename U> inline constexpr Vec256<U> as() const noexcept
+    {
+#if CPP_INTRIN_HAS_BIT_CAST
+      return __builtin_bit_cast(Vec256<U>, *this);
+#else
+      Vec256<U> out;
+      std::memcpy(&out, this, sizeof(out));
+      return out;
+#endif
+    }
+
+    inline constexpr Vec256<int8_t> epi8() const noexcept { return as<int8_t>(); }
+    inline constexpr Vec256<int16_t> epi16() const noexcept { return as<int16_t>(); }
+    inline constexpr Vec256<int32_t> epi32() const noexcept { return as<int32_t>(); }
+    inline constexpr Vec256<int64_t> epi64() const noexcept { return as<int64_t>(); }
+  };
+
+  using epi8x32  = Vec256<int8_t>;
+  using epi16x16 = Vec256<int16_t>;
+  using epi32x8  = Vec256<int32_t>;
+  using epi64x4  = Vec256<int64_t>;
+
+  static_assert(sizeof(epi16x16) == 32 && alignof(epi16x16) == 32,
+                "Error: Vec256 must be exactly one aligned 256-bit vector.");
+
+  /***
+   * Vec512. This is the 512-bit counterpart of Vec256, used by the m512_* functions. It is aligned
+   * on a 64-byte boundary, so each vector occupies exactly one cache line. It has the same lane
+   * views as Vec256, and it can also be split into (and rebuilt from) its two 256-bit halves: this
+   * is how the m512_* functions are implemented on machines without AVX-512.
+   */
+  template <typename T> struct alignas(64) Vec512 : public std::array<T, 64 / sizeof(T)>
+  {
+    static_assert(std::is_integral<T>::value, "Error: Vec512 only holds integers.");
+    using array_type = std::array<T, 64 / sizeof(T)>;
+    using half_type  = Vec256<T>;
+
+    Vec512() noexcept = default;
+    constexpr Vec512(const array_type &other) noexcept : array_type(other) {}
+
+    template <typename U> inline constexpr Vec512<U> as() const noexcept
+    {
+#if CPP_INTRIN_HAS_BIT_CAST
+      return __builtin_bit_cast(Vec512<U>, *this);
+#else
+      Vec512<U> out;
+      std::memcpy(&out, this, sizeof(out));
+      return out;
+#endif
+    }
+
+    inline constexpr Vec512<int8_t> epi8() const noexcept { return as<int8_t>(); }
+    inline constexpr Vec512<int16_t> epi16() const noexcept { return as<int16_t>(); }
+    inline constexpr Vec512<int32_t> epi32() const noexcept { return as<int32_t>(); }
+    inline constexpr Vec512<int64_t> epi64() const noexcept { return as<int64_t>(); }
+
+    // lo() returns the lower 256 bits, and hi() the upper 256 bits.
+    inline half_type lo() const noexcept
+    {
+      half_type out;
+      std::memcpy(&out, this->data(), sizeof(out));
+      return out;
+    }
+
+    inline half_type hi() const noexcept
+    {
+      half_type out;
+      std::memcpy(&out, this->data() + out.size(), sizeof(out));
+      return out;
+    }
+
+    static inline Vec512 join(const half_type &lo, const half_type &hi) noexcept
+    {
+      Vec512 out;
+      std::memcpy(out.data(), lo.data(), sizeof(lo));
+      std::memcpy(out.data() + lo.size(), hi.data(), sizeof(hi));
+      return out;
+    }
+  };
+
+  using epi8x64  = Vec512<int8_t>;
+  using epi16x32 = Vec512<int16_t>;
+  using epi32x16 = Vec512<int32_t>;
+  using epi64x8  = Vec512<int64_t>;
+
+  static_assert(sizeof(epi16x32) == 64 && alignof(epi16x32) == 64,
+                "Error: Vec512 must be exactly one aligned 512-bit vector.");
+
+  /***
+   * ShuffleMasks. m256_shuffle_epi8 is only as useful as the control vectors that are passed to it,
+   * and building those at runtime costs both time and registers. The functions below are all
+   * constexpr, and so they can be used to build controls at compile-time, e.g
+   *
+   * constexpr auto reverse = CPP_INTRIN::ShuffleMasks::reverse_epi16();
+   * const auto out         = CPP_INTRIN::m256_shuffle_epi8(a.epi8(), reverse).epi16();
+   *
+   * puts the control in .rodata, exactly as if it had been written out by hand. Since
+   * _mm256_shuffle_epi8 shuffles each 128-bit half independently, each control is described for a
+   * single half and is then applied to both: make_epi8 takes the byte that each output byte comes
+   * from, and make_epi16 takes the 16-bit lane that each output lane comes from. In both cases a
+   * negative index (e.g ShuffleMasks::zero) zeroes the output instead.
+   *
+   * This struct also holds the lookup table behind m256_compress_epi16: compress_epi16_lut()[mask]
+   * is the control that packs the 16-bit lanes of a half whose bit is set in mask to the front of
+   * that half, zeroing the rest. The table is 4KiB, and it's built at compile-time. These are all
+   * functions (rather than constants) because a constexpr member can't be initialised using
+   * functions of a class that hasn't been completely defined yet, as CPP_INTRIN hasn't here.
+   */
+  struct ShuffleMasks
+  {
+    // Any index with the top bit set zeroes the output byte. This is also out of range for NEON's
+    // vqtbl1q_u8, which gives zero for it too.
+    constexpr static int8_t zero = INT8_MIN;
+
+    static constexpr epi8x32 make_epi8(const std::array<int8_t, 16> &control) noexcept
+    {
+      std::array<int8_t, 32> out{};
+      for (unsigned i = 0; i < 16; i++)
+      {
+        out[i]      = (control[i] < 0) ? zero : static_cast<int8_t>(control[i] & 0x0F);
+        out[i + 16] = out[i];
+      }
+      return out;
+    }
+
+    static constexpr epi8x32 make_epi16(const std::array<int8_t, 8> &lanes) noexcept
+    {
+      std::array<int8_t, 16> control{};
+      for (unsigned i = 0; i < 8; i++)
+      {
+        const bool off     = lanes[i] < 0;
+        control[2 * i]     = off ? zero : static_cast<int8_t>(2 * (lanes[i] & 7));
+        control[2 * i + 1] = off ? zero : static_cast<int8_t>(2 * (lanes[i] & 7) + 1);
+      }
+      return make_epi8(control);
+    }
+
+    // Reverses the order of the bytes (resp. 16-bit lanes) in each half.
+    static constexpr epi8x32 reverse_epi8() noexcept
+    {
+      return make_epi8({15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0});
+    }
+
+    static constexpr epi8x32 reverse_epi16() noexcept
+    {
+      return make_epi16({7, 6, 5, 4, 3, 2, 1, 0});
+    }
+
+    // Swaps each pair of adjacent 16-bit lanes, i.e lane 2i with lane 2i + 1.
+    static constexpr epi8x32 swap_adjacent_epi16() noexcept
+    {
+      return make_epi16({1, 0, 3, 2, 5, 4, 7, 6});
+    }
+
+    // Reverses the byte order of each 16-, 32- or 64-bit lane, e.g to convert from big-endian.
+    static constexpr epi8x32 bswap_epi16() noexcept
+    {
+      return make_epi8({1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14});
+    }
+
+    static constexpr epi8x32 bswap_epi32() noexcept
+    {
+      return make_epi8({3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12});
+    }
+
+    static constexpr epi8x32 bswap_epi64() noexcept
+    {
+      return make_epi8({7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8});
+    }
+
+    // The control for a single half that packs the lanes set in mask to the front.
+    static constexpr std::array<int8_t, 16> compress_epi16_control(const unsigned mask) noexcept
+    {
+      std::array<int8_t, 16> control{};
+      unsigned pos = 0;
+      for (unsigned i = 0; i < 8; i++)
+      {
+        if (mask & (1u << i))
+        {
+          control[2 * pos]     = static_cast<int8_t>(2 * i);
+          control[2 * pos + 1] = static_cast<int8_t>(2 * i + 1);
+          pos++;
+        }
+      }
+      for (unsigned i = 2 * pos; i < 16; i++)
+      {
+        control[i] = zero;
+      }
+      return control;
+    }
+
+    using CompressTable = std::array<std::array<int8_t, 16>, 256>;
+
+    static constexpr CompressTable make_compress_epi16_lut() noexcept
+    {
+      CompressTable table{};
+      for (unsigned mask = 0; mask < 256; mask++)
+      {
+        table[mask] = compress_epi16_control(mask);
+      }
+      return table;
+    }
+
+    static inline const CompressTable &compress_epi16_lut() noexcept
+    {
+      // Each entry is loaded as a single vector, so we align the table.
+      alignas(64) static constexpr CompressTable table = make_compress_epi16_lut();
+      return table;
+    }
+  };
+
   /**
    * e_sign. Implements the signum function in a branchless fashion on the input value,
    * value.
@@ -139,48 +528,28 @@ struct CPP_INTRIN
    * intrinsics. In particular, this function:
    *
    * a) If __AVX2__ is defined, it uses the AVX256 function _mm256_hadd_epi16.
-   * b) If __AVX2__ is not defined, but __SSE3__ is, it uses the _mm_hadd_epi16
+   * b) If __AVX2__ is not defined, but __SSSE3__ is, it uses the _mm_hadd_epi16
    * function twice. c) Otherwise, use the hand-written variant.
    *
-   * This checking is done solely at compile-time.
-   * TODO Does this make sense? Maybe we could afford one CPUID check elsewhere?
+   * This checking is done solely at compile-time. If you need to pick the tier at runtime, use
+   * dispatch().m256_hadd_epi16 instead.
    */
-  static inline std::array<int16_t, 16> m256_hadd_epi16(const std::array<int16_t, 16> &a,
-                                                        const std::array<int16_t, 16> &b) noexcept
+  static inline epi16x16 m256_hadd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
   {
-    std::array<int16_t, 16> c;
     // Note; this is compile-time dispatch.
-    // This function also makes use of reinterpret cast: the C++ standard dictates that
-    // these should not generate extra machine instructions, so there's no overhead here.
 #if defined(__AVX2__)
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&c),
-                       _mm256_hadd_epi16(*reinterpret_cast<const __m256i *>(&a),
-                                         *reinterpret_cast<const __m256i *>(&b)));
-#elif defined(__SSE3__)
-    // Split the input arrays into two, separate chunks.
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c),
-                    _mm_hadd_epi16(*reinterpret_cast<const __m128i *>(&a),
-                                   *reinterpret_cast<const __m128i *>(&b)));
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
-                    _mm_hadd_epi16(*reinterpret_cast<const __m128i *>(&a[8]),
-                                   *reinterpret_cast<const __m128i *>(&b[8])));
+    CPP_INTRIN_PROBE(AVX2, m256_hadd_epi16);
+    return AVX2::m256_hadd_epi16(a, b);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_hadd_epi16);
+    return SSE::m256_hadd_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_hadd_epi16);
+    return NEON::m256_hadd_epi16(a, b);
 #else
-    // A clever compiler will unroll this into two separate batches of mov instructions:
-    // this just makes it easier to check the semantics.
-    for (unsigned int i = 0; i < 16; i += 8)
-    {
-      c[i + 0] = a[i + 0] + a[i + 1];
-      c[i + 1] = a[i + 2] + a[i + 3];
-      c[i + 2] = a[i + 4] + a[i + 5];
-      c[i + 3] = a[i + 6] + a[i + 7];
-      c[i + 4] = b[i + 0] + b[i + 1];
-      c[i + 5] = b[i + 2] + b[i + 3];
-      c[i + 6] = b[i + 4] + b[i + 5];
-      c[i + 7] = b[i + 6] + b[i + 7];
-    }
-
+    CPP_INTRIN_PROBE(Plain, m256_hadd_epi16);
+    return Plain::m256_hadd_epi16(a, b);
 #endif
-    return c;
   }
 
   /***
@@ -195,16 +564,10 @@ struct CPP_INTRIN
    * case. As gcc 10.2 has no trouble producing vectorised object code for this
    * function, we do not explicitly delegate to the intrinsics.
    */
-  static inline std::array<int64_t, 4> m256_xor_epi64(const std::array<int64_t, 4> &a,
-                                                      const std::array<int64_t, 4> &b)
+  static inline CPP_INTRIN_CONSTEXPR epi64x4 m256_xor_epi64(const epi64x4 &a, const epi64x4 &b)
   {
-    std::array<int64_t, 4> c;
-    // Simply xor them together!
-    for (unsigned i = 0; i < 4; i++)
-    {
-      c[i] = a[i] ^ b[i];
-    }
-    return c;
+    CPP_INTRIN_PROBE(Plain, m256_xor_epi64);
+    return Plain::m256_xor_epi64(a, b);
   }
 
   /***
@@ -221,20 +584,18 @@ struct CPP_INTRIN
    * As gcc 10.2 has no trouble producing vectorised object code for this function, we do not
    * explicitly delegate to the intrinsics.
    */
-  static inline std::array<int64_t, 4> m256_or_epi64(const std::array<int64_t, 4> &a,
-                                                     const std::array<int64_t, 4> &b) noexcept
+  static inline CPP_INTRIN_CONSTEXPR epi64x4
+  m256_or_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
   {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_or_epi64(a, b);
+    }
     // Function pre-condition: we check that a != b because that would be the equivalent
     // of a no-op
     assert(a != b);
-
-    std::array<int64_t, 4> c;
-    // Simply OR them together!
-    for (unsigned i = 0; i < 4; i++)
-    {
-      c[i] = a[i] | b[i];
-    }
-    return c;
+    CPP_INTRIN_PROBE(Plain, m256_or_epi64);
+    return Plain::m256_or_epi64(a, b);
   }
 
   /***
@@ -251,32 +612,25 @@ struct CPP_INTRIN
    * As gcc 10.2 has no trouble producing vectorised object code for this function, we do not
    * explicitly delegate to the intrinsics.
    */
-  static inline std::array<int64_t, 4> m256_and_epi64(const std::array<int64_t, 4> &a,
-                                                      const std::array<int64_t, 4> &b) noexcept
+  static inline CPP_INTRIN_CONSTEXPR epi64x4
+  m256_and_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
   {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_and_epi64(a, b);
+    }
     // Function pre-condition: we check that a != b because that would be the equivalent of a
     // no-op.
     assert(a != b);
-
-    std::array<int64_t, 4> c;
-    // Simply AND them together!
-    for (unsigned i = 0; i < 4; i++)
-    {
-      c[i] = a[i] & b[i];
-    }
-    return c;
+    CPP_INTRIN_PROBE(Plain, m256_and_epi64);
+    return Plain::m256_and_epi64(a, b);
   }
 
-  static inline std::array<int16_t, 16> m256_and_epi16(const std::array<int16_t, 16> &a,
-                                                       const std::array<int16_t, 16> &b) noexcept
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_and_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
   {
-    std::array<int16_t, 16> c;
-    // Simply AND them together!
-    for (unsigned i = 0; i < 16; i++)
-    {
-      c[i] = a[i] & b[i];
-    }
-    return c;
+    CPP_INTRIN_PROBE(Plain, m256_and_epi16);
+    return Plain::m256_and_epi16(a, b);
   }
 
   /***
@@ -302,606 +656,10435 @@ struct CPP_INTRIN
    * c) Otherwise, use the hand-written variant. This does generate vectorised
    * code, but it isn't quite one instruction.
    */
-  static inline std::array<int16_t, 16> m256_cmpgt_epi16(const std::array<int16_t, 16> &a,
-                                                         const std::array<int16_t, 16> &b) noexcept
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_cmpgt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
   {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_cmpgt_epi16(a, b);
+    }
     // Note: this isn't strictly necessary, but it'd be faster just
     // to zero-out the whole array and so we disallow it.
     // If you want to zero out the whole array, then you can use s256_xor_epi64
     // or similar.
     assert(a != b);
-    std::array<int16_t, 16> c;
 #ifdef __AVX2__
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&c),
-                       _mm256_cmpgt_epi16(*reinterpret_cast<const __m256i *>(&a),
-                                          *reinterpret_cast<const __m256i *>(&b)));
+    CPP_INTRIN_PROBE(AVX2, m256_cmpgt_epi16);
+    return AVX2::m256_cmpgt_epi16(a, b);
 #elif defined(__SSE2__)
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c),
-                    _mm_cmpgt_epi16(*reinterpret_cast<const __m128i *>(&a),
-                                    *reinterpret_cast<const __m128i *>(&b)));
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
-                    _mm_cmpgt_epi16(*reinterpret_cast<const __m128i *>(&a[8]),
-                                    *reinterpret_cast<const __m128i *>(&b[8])));
+    CPP_INTRIN_PROBE(SSE, m256_cmpgt_epi16);
+    return SSE::m256_cmpgt_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_cmpgt_epi16);
+    return NEON::m256_cmpgt_epi16(a, b);
 #else
-    // A sensible compiler will unroll this and produce somewhat good vectorised
-    // code, but not quite optimal code (as of GCC 10.2).
-    for (unsigned int i = 0; i < 16; i++)
-    {
-      // This works as follows:
-      // a[i] > b[i] evaluates to 0 or 1.
-      // If 0, then c[i] = 0.
-      // If 1, then c[i] = 0xFFFF,
-      // which matches the semantics of cmpgt_epi16 exactly.
-      c[i] = (a[i] > b[i]) * 0xFFFF;
-    }
+    CPP_INTRIN_PROBE(Plain, m256_cmpgt_epi16);
+    return Plain::m256_cmpgt_epi16(a, b);
 #endif
-    return c;
   }
 
-  /**
-   * m256_shuffle_epi8.
-   *
-   * This function accepts to array references, a and b. It shuffle the bytes in
-   * a according to the mask in b and returns the result, denoted as c.
-   *
-   * This corresponds exactly to the behaviour of _mm256_shuffle_epi8.
-   *
-   * The best way to understand
-   * what this function does is to view it as applying _mm_shuffle_epi8 twice:
-   * once to the lower lane of a, and once to the upper lane of a. The
-   * description of this function can be found at:
-   * https://software.intel.com/sites/landingpage/IntrinsicsGuide/#text=shuffle_epi8&expand=5153.
-   *
-   * This function will only work if a and b are not equal.
-   *
-   * As GCC 10.2 has trouble producing vectorised
-   * object code for this function (see https://godbolt.org/z/419Whz),
-   * where possible we delegate to the relevant
-   * intrinsics. In particular, this function:
+  /***
+   * Comparisons and selection. The comparisons below return a vector whose lanes are all ones where
+   * the comparison holds and all zeros elsewhere, exactly as _mm256_cmpgt_epi16 does. These masks
+   * can then be used with the bitwise operations, with m256_blendv_epi8 to select between two
+   * vectors, or with m256_movemask_epi8 to get a bitmask: e.g the index of the first lane of a that
+   * equals b is __builtin_ctz(m256_movemask_epi8(m256_cmpeq_epi8(a, b))), provided there is one.
    *
-   * a) If __AVX2__ is defined, it uses the AVX256 function _mm256_shuffle_epi8.
-   * b) If __AVX2__ is not defined, but __SSE2__ is, it uses the
-   * _mm_shuffle_epi8 function twice.
-   * c) Otherwise, use the hand-written
-   * variant.
+   * a) If __AVX2__ is defined, each is a single AVX2 instruction. AVX2 has no "less than"
+   *    comparison, so cmplt swaps the arguments of cmpgt.
+   * b) If __AVX2__ is not defined, but __SSE2__ is, we use the SSE2 versions over each half.
+   *    m256_blendv_epi8 needs SSE4.1 instead.
+   * c) On NEON, we use the NEON comparisons and vbslq over each half.
+   * d) Otherwise, we use the hand-written loops, which GCC vectorises.
    */
-  static inline std::array<int8_t, 32> m256_shuffle_epi8(const std::array<int8_t, 32> &a,
-                                                         const std::array<int8_t, 32> &b) noexcept
-  {
-    // Correctness pre-conditions.
-    assert(a != b);
-    std::array<int8_t, 32> c;
-
-#ifdef __AVX2__
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&c),
-                       _mm256_shuffle_epi8(*reinterpret_cast<const __m256i *>(&a),
-                                           *reinterpret_cast<const __m256i *>(&b)));
-#elif defined(__SSE3__)
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c[0]),
-                    _mm_shuffle_epi8(*reinterpret_cast<const __m128i *>(&a[0]),
-                                     *reinterpret_cast<const __m128i *>(&b[0])));
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c[16]),
-                    _mm_shuffle_epi8(*reinterpret_cast<const __m128i *>(&a[16]),
-                                     *reinterpret_cast<const __m128i *>(&b[16])));
-#else
-    // This loop would be nicer written as two separate loops,
-    // but we're hoping to build a pattern that a sensible compiler
-    // can recognise as reasonable (i.e something that tightly matches to
-    // the _mm256_shuffle_epi8 semantics)
-
-    // This function has weird semantics, because the _mm256_shuffle_epi8 is
-    // a single-lane shuffle. Essentially, it does not allow you to move across
-    // 2 128-bit chunks at once: instead, the shuffle is localised to each
-    // 128-bit vector. This means it is faster, but also weird.
-    //
-    // The algorithm at
-    // https://software.intel.com/sites/landingpage/IntrinsicsGuide/#text=_mm256_shuffle_epi8&expand=5156
-    // is somewhat descriptive: our variant is similar, but it's entirely
-    // branchless with a sensible compiler. Originally we used the branchy
-    // version like the original algorithm, but it generated very poor object
-    // code. The idea is as follows: view b as an array of bytes of size 32. If
-    // the leading bit of some byte b[i] is not set, we skip it (i.e we set the
-    // index c[i] = 0). Otherwise, we set c[i] = a[pos], where pos consists of
-    // the final 4 bits of b[i]. Note that this is only 4 bits, because we have
-    // at most 16 options to choose from, and so we need exactly 4 bits. The
-    // same is true for the second part: it's just shifted by 16 (i.e over the
-    // other lane). You can write this as two one-liners if you'd prefer, but
-    // this is somewhat neater. and the object code is approximately the same.
-
-    // The (1^(...)) trick is a trick for negating the final bit of the number.
-    // Here's how it works: if flag == 0 then the shift gives 1: 1-1  = 0, and so the
-    // ^ gives 1. By contrast, if flag == 1 then the shift gives 2: 2-1 = 1, and so the ^ gives 0.
-    // This can be generalised to n-many bits by changing the 1 to n.
-    for (unsigned int i = 0; i < 16; i++)
-    {
-      const int16_t flag = (b[i] & 0x80) >> 7;
-      assert(flag == 0 || flag == 1);
-      const unsigned pos = b[i] & 0x0F;
-      c[i]               = int8_t((1 ^ ((1u << flag) - 1))) * a[pos];
-
-      const unsigned flag2 = (b[i + 16] & 0x80) >> 7;
-      assert(flag2 == 0 || flag2 == 1);
-
-      const unsigned pos2 = b[i + 16] & 0x0F;
-      c[i + 16]           = int8_t((1 ^ ((1u << flag2) - 1))) * a[pos2 + 16];
-    }
-#endif
-    return c;
-  }
-
-  static inline std::array<int16_t, 16> m256_shuffle_epi8_epi16(const std::array<int16_t, 16> &a,
-                                                                const std::array<int16_t, 16> &b)
-  {
-    // Correctness pre-conditions.
-    assert(a != b);
-    std::array<int16_t, 16> c;
 
+  /**
+   * m256_cmpeq_epi8. For all i: c[i] = (a[i] == b[i]) ? -1 : 0. This mimics _mm256_cmpeq_epi8.
+   */
+  static inline epi8x32 m256_cmpeq_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+  {
 #ifdef __AVX2__
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&c),
-                       _mm256_shuffle_epi8(*reinterpret_cast<const __m256i *>(&a),
-                                           *reinterpret_cast<const __m256i *>(&b)));
-#elif defined(__SSE3__)
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c),
-                    _mm_shuffle_epi8(*reinterpret_cast<const __m128i *>(&a),
-                                     *reinterpret_cast<const __m128i *>(&b)));
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
-                    _mm_shuffle_epi8(*reinterpret_cast<const __m128i *>(&a[8]),
-                                     *reinterpret_cast<const __m128i *>(&b[8])));
+    CPP_INTRIN_PROBE(AVX2, m256_cmpeq_epi8);
+    return AVX2::m256_cmpeq_epi8(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_cmpeq_epi8);
+    return SSE::m256_cmpeq_epi8(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_cmpeq_epi8);
+    return NEON::m256_cmpeq_epi8(a, b);
 #else
-    std::array<int8_t, 32> d;
-    std::array<int8_t, 32> e;
-    // This actually just moves from a register into
-    std::memcpy(&d, &a, sizeof(int16_t) * 16);
-    std::memcpy(&e, &b, sizeof(int16_t) * 16);
-    auto temp = m256_shuffle_epi8(d, e);
-    std::memcpy(&c, &temp, sizeof(int16_t) * 16);
+    CPP_INTRIN_PROBE(Plain, m256_cmpeq_epi8);
+    return Plain::m256_cmpeq_epi8(a, b);
 #endif
-    return c;
   }
 
-  /***
-   * m256_add_epi16. This function accepts 2 array references, a and b, and pairwises sums a and b,
-   * returning the result, denoted as c. This function exactly mimics the _mm256_add_epi16 function.
-   * In particular, after this function is called, c
-   * has the following layout: For all i = 0, ..., 15: c[i] = a[i] + b[i]
-   *
-   * This function appears to be trivially vectorisable on GCC 10.2, and as a
-   * result we do not introduce other intrinsics into this function.
+  /**
+   * m256_cmpeq_epi16. For all i: c[i] = (a[i] == b[i]) ? -1 : 0. This mimics _mm256_cmpeq_epi16.
    */
-  static std::array<int16_t, 16> m256_add_epi16(const std::array<int16_t, 16> &a,
-                                                const std::array<int16_t, 16> &b) noexcept
+  static inline epi16x16 m256_cmpeq_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
   {
-    std::array<int16_t, 16> c;
-    // Note; this very trivial for-loop should be trivial for the compiler to
-    // optimise, especially if it knows the size of the arrays ahead of time
-    // (which it does!)
-    for (unsigned int i = 0; i < 16; i++)
-    {
-      c[i] = a[i] + b[i];
-    }
-    return c;
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_cmpeq_epi16);
+    return AVX2::m256_cmpeq_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_cmpeq_epi16);
+    return SSE::m256_cmpeq_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_cmpeq_epi16);
+    return NEON::m256_cmpeq_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_cmpeq_epi16);
+    return Plain::m256_cmpeq_epi16(a, b);
+#endif
   }
 
-  /***
-   * m256_testz_si256.
+  /**
+   * m256_cmpgt_epi8. For all i: c[i] = (a[i] > b[i]) ? -1 : 0. This mimics _mm256_cmpgt_epi8.
    */
-  static bool m256_testz_si256(const std::array<int16_t, 16> &a, const std::array<int16_t, 16> &b)
+  static inline epi8x32 m256_cmpgt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
   {
 #ifdef __AVX2__
-    return _mm256_testz_si256(*reinterpret_cast<const __m256i *>(&a[0]),
-                              *reinterpret_cast<const __m256i *>(&b[0]));
+    CPP_INTRIN_PROBE(AVX2, m256_cmpgt_epi8);
+    return AVX2::m256_cmpgt_epi8(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_cmpgt_epi8);
+    return SSE::m256_cmpgt_epi8(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_cmpgt_epi8);
+    return NEON::m256_cmpgt_epi8(a, b);
 #else
-    const auto c = m256_and_epi16(a, b);
-    // Sum and pop-cnt all of the elements in c.
-    // Note: builtin_popcountl will compile to a CPU instruction iff SSE4.2 or later
-    // is available, but if not the compiler has its own dedicated software routines
-    // for this.
-    unsigned total0 = 0, total1 = 0, total2 = 0, total3 = 0;
-    for (unsigned i = 0; i < 16; i += 4)
-    {
-      total0 += static_cast<unsigned>(__builtin_popcountl(static_cast<uint16_t>(c[i + 0])));
-      total1 += static_cast<unsigned>(__builtin_popcountl(static_cast<uint16_t>(c[i + 1])));
-      total2 += static_cast<unsigned>(__builtin_popcountl(static_cast<uint16_t>(c[i + 2])));
-      total3 += static_cast<unsigned>(__builtin_popcountl(static_cast<uint16_t>(c[i + 3])));
-    }
-
-    return (total0 + total1 + total2 + total3) == 0;
+    CPP_INTRIN_PROBE(Plain, m256_cmpgt_epi8);
+    return Plain::m256_cmpgt_epi8(a, b);
 #endif
   }
 
-  /***
-   * m256_sub_epi16. This function accepts 2 array references, a and b, and pairwises sums a and b,
-   * returning the result, denoted as c. This function exactly mimics the _mm256_add_epi16 function.
-   * In particular, after this function is called, c
-   * has the following layout: For all i = 0, ..., 15: c[i] = a[i] - b[i]
-   *
-   * This function appears to be trivially vectorisable on GCC 10.2, and as a
-   * result we do not introduce other intrinsics into this function.
+  /**
+   * m256_cmplt_epi8. For all i: c[i] = (a[i] < b[i]) ? -1 : 0. This mimics _mm256_cmplt_epi8.
    */
-  static std::array<int16_t, 16> m256_sub_epi16(const std::array<int16_t, 16> &a,
-                                                const std::array<int16_t, 16> &b) noexcept
+  static inline epi8x32 m256_cmplt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
   {
-    std::array<int16_t, 16> c;
-    // Note; this very trivial for-loop should be trivial for the compiler to
-    // optimise, especially if it knows the size of the arrays ahead of time
-    // (which it does!)
-    for (unsigned int i = 0; i < 16; i++)
-    {
-      c[i] = a[i] - b[i];
-    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_cmplt_epi8);
+    return AVX2::m256_cmplt_epi8(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_cmplt_epi8);
+    return SSE::m256_cmplt_epi8(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_cmplt_epi8);
+    return NEON::m256_cmplt_epi8(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_cmplt_epi8);
+    return Plain::m256_cmplt_epi8(a, b);
+#endif
+  }
 
-    return c;
+  /**
+   * m256_cmplt_epi16. For all i: c[i] = (a[i] < b[i]) ? -1 : 0. This mimics _mm256_cmplt_epi16.
+   */
+  static inline epi16x16 m256_cmplt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_cmplt_epi16);
+    return AVX2::m256_cmplt_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_cmplt_epi16);
+    return SSE::m256_cmplt_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_cmplt_epi16);
+    return NEON::m256_cmplt_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_cmplt_epi16);
+    return Plain::m256_cmplt_epi16(a, b);
+#endif
   }
 
   /**
-   * s256_sign_epi16.
-   * Applies a negation to the packed signed 16-bit integers in a according to
-   * the elements in b and returns the result in an array c.
-   *
-   * More particularly: for any i in [0 ... 15], after this function is called c
-   * contains the following:
-   *
-   * c[i] = a[i]  if b[i] > 0
-   * c[i] = 0     if b[i] == 0
-   * c[i] = -a[i] otherwise
-   *
-   * You can view this as a signed inclusion.
-   *
-   * Because GCC 10.2 seems to struggle with producing the right object code (see
-   * https://godbolt.org/z/3nasvK), we provide an AVX2 overload if it is defined by the compiler. In
-   * particular: a) if __AVX2__ is defined, we use the _mm256_sign_epi16
-   * intrinsic. b) else if __SSE3__ is defined, we use the _mm_sign_epi16
-   * intrinsic over each half of a and b.
-   * c) else, we use use our hand-written
-   * version.
-   *
-   * Note: our hand-written version is not bad. Rather cleverly, the compiler will vectorise the
-   * call to e_sign and apply it across all of the masks and then applies a multiplication. However,
-   * it's not quite as short as the _mm256_sign_epi16 version.
+   * m256_blendv_epi8. For all i: c[i] = (mask[i] < 0) ? b[i] : a[i]. In other words, the top bit of
+   * each byte of mask selects between a (if clear) and b (if set). This mimics _mm256_blendv_epi8.
    */
-  static inline std::array<int16_t, 16> m256_sign_epi16(const std::array<int16_t, 16> &a,
-                                                        const std::array<int16_t, 16> &b) noexcept
+  static inline epi8x32 m256_blendv_epi8(const epi8x32 &a, const epi8x32 &b,
+                                         const epi8x32 &mask) noexcept
   {
-    // pre-conditions for the function to work.
-    assert(a != b);
-    std::array<int16_t, 16> c;
 #ifdef __AVX2__
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&c),
-                       _mm256_sign_epi16(*reinterpret_cast<const __m256i *>(&a),
-                                         *reinterpret_cast<const __m256i *>(&b)));
-#elif defined(__SSE3__)
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c),
-                    _mm_sign_epi16(*reinterpret_cast<const __m128i *>(&a),
-                                   *reinterpret_cast<const __m128i *>(&b)));
-    _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
-                    _mm_sign_epi16(*reinterpret_cast<const __m128i *>(&a[8]),
-                                   *reinterpret_cast<const __m128i *>(&b[8])));
+    CPP_INTRIN_PROBE(AVX2, m256_blendv_epi8);
+    return AVX2::m256_blendv_epi8(a, b, mask);
+#elif defined(__SSE4_1__)
+    CPP_INTRIN_PROBE(SSE, m256_blendv_epi8);
+    return SSE::m256_blendv_epi8(a, b, mask);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_blendv_epi8);
+    return NEON::m256_blendv_epi8(a, b, mask);
 #else
-    // This function is rather simple: we extract the signs of each b[i] and
-    // multiply a[i] by them.
-    for (unsigned int i = 0; i < 16; i++)
-    {
-      c[i] = a[i] * e_sign(b[i]);
-    }
+    CPP_INTRIN_PROBE(Plain, m256_blendv_epi8);
+    return Plain::m256_blendv_epi8(a, b, mask);
 #endif
-    return c;
   }
 
   /**
-   * m256_permute4x64_epi64. Permutes the array a according to the bitmask imm8
-   * and returns the result, denoted as b. This corresponds exactly to the _mm256_permute4x64_epi64
-   * intrinsic.
-   *
-   * Because GCC 10.2 seems to struggle with producing the right object code(see
-   * https://godbolt.org/z/jGb46h), we provide an AVX2 overload if it is defined by the compiler. In
-   * particular: a) if __AVX2__ is defined, we use the _mm256_permute4x64_epi64
-   * intrinsic. b) else, we use our hand-written version.
-   *
-   * Implementor's notes: this function relies on
-   * binary literals. This feature was only officially available in standard C++
-   * in C++14 and later. However, this has been implemented in GCC for far
-   * longer than this.
+   * m256_movemask_epi8. Returns a bitmask whose bit i is the top bit of a[i]. This mimics
+   * _mm256_movemask_epi8, except that the result is unsigned.
    */
-  template <int8_t imm8>
-  static std::array<int64_t, 4> m256_permute4x64_epi64(const std::array<int64_t, 4> &a) noexcept
-  {
-    // As in the contract, the size needs to be 4.
-    std::array<int64_t, 4> b;
-#ifdef __AVX2__
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&b),
-                       _mm256_permute4x64_epi64(*reinterpret_cast<const __m256i *>(&a), imm8));
-#else
-    // This function works as follows: grabs the index from each of the bytes of
-    // imm8 We isolate these bytes by bitwise ops, and then shift if necessary
-    // Note; these are constexpr variables, which means that these masks are
-    // computed at compile-time. As a result, this is just a series of mov
-    // instructions, which occur at a rate of approximately 4 per clock: a
-    // clever compiler will interleave these movs to hide the latency.
-    constexpr unsigned zero =
-        (imm8 & BitPatterns::int8_zero_pair_mask) >> BitPatterns::int8_zero_pair_shift;
-    constexpr unsigned first =
-        (imm8 & BitPatterns::int8_first_pair_mask) >> BitPatterns::int8_first_pair_shift;
-    constexpr unsigned second =
-        (imm8 & BitPatterns::int8_second_pair_mask) >> BitPatterns::int8_second_pair_shift;
-    // This doesn't require a shift because the bytes are already in the
-    // bottom-most byte.
-    constexpr unsigned third =
-        (imm8 & BitPatterns::int8_third_pair_mask) >> BitPatterns::int8_third_pair_shift;
-
-    // These asserts are just to make sure that the code statically does the
-    // right thing.
-    static_assert(zero < 4, "Error: zero >= size.");
-    static_assert(first < 4, "Error: first >= size.");
-    static_assert(second < 4, "Error: second >= size.");
-    static_assert(third < 4, "Error: third >= size.");
-
-    // Finally, we do the permutation and return.
-    b[0] = a[zero];
-    b[1] = a[first];
-    b[2] = a[second];
-    b[3] = a[third];
-#endif
-    return b;
-  }
-
-  /***
-   * m256_permute4x64_epi16. This function is a special wrapper around the
-   * permutation function, moving each element around under the control of the
-   * immediate imm8. Because C++ has slightly different aliasing rules to the
-   * Intel intrinsics, it's often necessary to convert between array types to
-   * get the desired semantics. This is a real pain, because it requires
-   * allocations and that'll slow down the code dramatically.
+  static inline uint32_t m256_movemask_epi8(const epi8x32 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_movemask_epi8);
+    return AVX2::m256_movemask_epi8(a);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_movemask_epi8);
+    return SSE::m256_movemask_epi8(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_movemask_epi8);
+    return NEON::m256_movemask_epi8(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_movemask_epi8);
+    return Plain::m256_movemask_epi8(a);
+#endif
+  }
+
+  /**
+   * m256_movemask_epi16. Returns a bitmask whose bit i is the top bit of a[i]: e.g
+   * m256_movemask_epi16(m256_cmpgt_epi16(a, b)) has bit i set if a[i] > b[i]. The top 16 bits are
+   * always zero. There is no _mm256_movemask_epi16: with AVX2, this is a pack and a movemask.
+   */
+  static inline uint32_t m256_movemask_epi16(const epi16x16 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_movemask_epi16);
+    return AVX2::m256_movemask_epi16(a);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_movemask_epi16);
+    return SSE::m256_movemask_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_movemask_epi16);
+    return NEON::m256_movemask_epi16(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_movemask_epi16);
+    return Plain::m256_movemask_epi16(a);
+#endif
+  }
+
+  /**
+   * m256_compress_epi16. Packs the lanes of a whose bit is set in mask into the bottom lanes of the
+   * result (in order), and zeroes the rest. Only the bottom 16 bits of mask are used. This mimics
+   * _mm256_maskz_compress_epi16 from AVX512-VBMI2, and it's the building block for stream
+   * compaction: e.g to keep the lanes of a that are greater than b,
    *
-   * As a result, for this one special case we define a different wrapper, which
-   * allows us to do 64-bit operations on a 16-bit vector. This treats each
-   * batch of 4 16-bit entries as one larger 64-bit entry. The semantics are
-   * exactly the same as permute4x64_epi64.
+   * const uint32_t keep = m256_movemask_epi16(m256_cmpgt_epi16(a, b));
+   * m256_storeu_si256(out, m256_compress_epi16(a, keep));
+   * out += __builtin_popcount(keep);
    *
-   * Similarly to above, we add an AVX2 guard. In particular, if __AVX2__ is defined, we use
-   * the _mm256_permute4x64_epi64 instruction. Otherwise we just use our handwritten variant.
+   * a) If __AVX2__ or __SSSE3__ is defined, each half is compressed with a single pshufb, using
+   *    the control from ShuffleMasks::compress_epi16_lut(). The top half is then written directly
+   *    after the lanes kept from the bottom.
+   * b) On NEON, we do the same with vqtbl1q_u8.
+   * c) Otherwise, we use the hand-written loop.
    */
-  template <int8_t imm8>
-  static std::array<int16_t, 16> m256_permute4x64_epi16(const std::array<int16_t, 16> &a)
+  static inline epi16x16 m256_compress_epi16(const epi16x16 &a, const uint32_t mask) noexcept
   {
-    // If the right intrinsic is available, we just use that.
-    // The intrinsics, being a circuit, isn't as tightly constrained as we are!
-    std::array<int16_t, 16> b;
 #ifdef __AVX2__
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&b),
-                       _mm256_permute4x64_epi64(*reinterpret_cast<const __m256i *>(&a[0]), imm8));
+    CPP_INTRIN_PROBE(AVX2, m256_compress_epi16);
+    return AVX2::m256_compress_epi16(a, mask);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_compress_epi16);
+    return SSE::m256_compress_epi16(a, mask);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_compress_epi16);
+    return NEON::m256_compress_epi16(a, mask);
 #else
-    // Do the same as in permute4x64_epi64: produce the masks.
-    // Here we do something different though: we use each mask as an indicator
-    // for which stride of 4 16-bit entries we want.
-    constexpr unsigned zero =
-        4 * ((imm8 & BitPatterns::int8_zero_pair_mask) >> BitPatterns::int8_zero_pair_shift);
-    constexpr unsigned first =
-        4 * ((imm8 & BitPatterns::int8_first_pair_mask) >> BitPatterns::int8_first_pair_shift);
-    constexpr unsigned second =
-        4 * ((imm8 & BitPatterns::int8_second_pair_mask) >> BitPatterns::int8_second_pair_shift);
-    // This doesn't require a shift because the bytes are already in the
-    // bottom-most byte.
-    constexpr unsigned third =
-        4 * ((imm8 & BitPatterns::int8_third_pair_mask) >> BitPatterns::int8_third_pair_shift);
+    CPP_INTRIN_PROBE(Plain, m256_compress_epi16);
+    return Plain::m256_compress_epi16(a, mask);
+#endif
+  }
 
-    // These asserts are just to make sure that the code statically does the
-    // right thing.
-    static_assert(zero < 16, "Error: zero >= 16.");
-    static_assert(first < 16, "Error: first >= 16.");
-    static_assert(second < 16, "Error: second >=16.");
-    static_assert(third < 16, "Error: third >= 16.");
+  /***
+   * Runtime-variable permutes and shifts. m256_permute4x64_epi64, m256_slli_epi16 and
+   * m256_srli_epi16 take their control as a template parameter, because the underlying instructions
+   * encode it as an immediate. That's no good if the permutation or shift is only known at runtime:
+   * the caller has to switch over every instantiation. The functions below take the control as an
+   * ordinary argument instead, and so a single copy of each covers every count.
+   *
+   * a) If __AVX2__ is defined, each is a single AVX2 instruction.
+   * b) If __AVX2__ is not defined, but __SSE2__ is, m256_sll_epi16 and m256_srl_epi16 use the SSE2
+   *    shift-by-register over each half. SSE has neither a lane-crossing permute nor per-lane
+   *    shifts, so the others use the hand-written loops.
+   * c) On NEON, the shifts use vshlq over each half (which shifts right for negative counts). The
+   *    permute turns each index into four byte indices, and looks them up with vqtbl2q_u8.
+   * d) Otherwise, we use the hand-written loops.
+   *
+   * Just as with the immediate forms, a count that is at least the width of a lane produces zero.
+   */
 
-    b[0] = a[zero + 0];
-    b[1] = a[zero + 1];
-    b[2] = a[zero + 2];
-    b[3] = a[zero + 3];
+  /**
+   * m256_permutevar8x32_epi32. For all i: c[i] = a[idx[i] & 7]. Only the bottom 3 bits of each
+   * index are used. This mimics _mm256_permutevar8x32_epi32.
+   */
+  static inline epi32x8 m256_permutevar8x32_epi32(const epi32x8 &a, const epi32x8 &idx) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_permutevar8x32_epi32);
+    return AVX2::m256_permutevar8x32_epi32(a, idx);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_permutevar8x32_epi32);
+    return NEON::m256_permutevar8x32_epi32(a, idx);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_permutevar8x32_epi32);
+    return Plain::m256_permutevar8x32_epi32(a, idx);
+#endif
+  }
 
-    b[4] = a[first + 0];
-    b[5] = a[first + 1];
-    b[6] = a[first + 2];
-    b[7] = a[first + 3];
+  /**
+   * m256_sll_epi16. Shifts each int16_t in a to the left by count positions, shifting in zeros.
+   * If count > 15, the result is zero. This is the runtime counterpart of m256_slli_epi16, and it
+   * mimics _mm256_sll_epi16 (which takes its count in a register).
+   */
+  static inline epi16x16 m256_sll_epi16(const epi16x16 &a, const unsigned count) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_sll_epi16);
+    return AVX2::m256_sll_epi16(a, count);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_sll_epi16);
+    return SSE::m256_sll_epi16(a, count);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_sll_epi16);
+    return NEON::m256_sll_epi16(a, count);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_sll_epi16);
+    return Plain::m256_sll_epi16(a, count);
+#endif
+  }
 
-    b[8]  = a[second + 0];
-    b[9]  = a[second + 1];
-    b[10] = a[second + 2];
-    b[11] = a[second + 3];
+  /**
+   * m256_srl_epi16. Shifts each int16_t in a to the right by count positions, shifting in zeros
+   * (regardless of sign).
+   * If count > 15, the result is zero. This is the runtime counterpart of m256_srli_epi16, and it
+   * mimics _mm256_srl_epi16 (which takes its count in a register).
+   */
+  static inline epi16x16 m256_srl_epi16(const epi16x16 &a, const unsigned count) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_srl_epi16);
+    return AVX2::m256_srl_epi16(a, count);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_srl_epi16);
+    return SSE::m256_srl_epi16(a, count);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_srl_epi16);
+    return NEON::m256_srl_epi16(a, count);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_srl_epi16);
+    return Plain::m256_srl_epi16(a, count);
+#endif
+  }
 
-    b[12] = a[third + 0];
-    b[13] = a[third + 1];
-    b[14] = a[third + 2];
-    b[15] = a[third + 3];
+  /**
+   * m256_sllv_epi32. For all i: shifts a[i] to the left by count[i] positions, shifting in zeros.
+   * Each count is treated as unsigned, and counts > 31 give zero. This mimics _mm256_sllv_epi32.
+   */
+  static inline epi32x8 m256_sllv_epi32(const epi32x8 &a, const epi32x8 &count) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_sllv_epi32);
+    return AVX2::m256_sllv_epi32(a, count);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_sllv_epi32);
+    return NEON::m256_sllv_epi32(a, count);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_sllv_epi32);
+    return Plain::m256_sllv_epi32(a, count);
+#endif
+  }
 
+  /**
+   * m256_srlv_epi32. For all i: shifts a[i] to the right by count[i] positions, shifting in zeros.
+   * Each count is treated as unsigned, and counts > 31 give zero. This mimics _mm256_srlv_epi32.
+   */
+  static inline epi32x8 m256_srlv_epi32(const epi32x8 &a, const epi32x8 &count) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_srlv_epi32);
+    return AVX2::m256_srlv_epi32(a, count);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_srlv_epi32);
+    return NEON::m256_srlv_epi32(a, count);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_srlv_epi32);
+    return Plain::m256_srlv_epi32(a, count);
 #endif
-    return b;
   }
 
   /**
-   * m256_slli_epi16. Given an array reference, a, we shift each int16_t in a by to the left by
-   * imm8 many positions. If imm8 > 16, we replace by zeros. This corresponds exactly to the
-   * _mm256_slli_epi16 intrinsic.
-   * GCC 10.2 compiles this exactly to the right intrinsic, so there's no need for any clever
-   * tricks.
+   * m256_sllv_epi64. For all i: shifts a[i] to the left by count[i] positions, shifting in zeros.
+   * Each count is treated as unsigned, and counts > 63 give zero. This mimics _mm256_sllv_epi64.
    */
-  template <int8_t imm8>
-  static inline std::array<int16_t, 16> m256_slli_epi16(const std::array<int16_t, 16> &a) noexcept
+  static inline epi64x4 m256_sllv_epi64(const epi64x4 &a, const epi64x4 &count) noexcept
   {
-    std::array<int16_t, 16> b;
-    // Because left-shift is well-defined, the compiler will actually just implement
-    // this as either two 128-bit shifts or one 256-bit shift. In other words, this is
-    // an easy thing for the compiler to optimise.
-    // Note; this will cause constants to exist in your instruction cache. This is because
-    // imm8 needs to be an immediate for this to compile properly. If you do not know why this
-    // matters, don't worry. (short answer: bigger entry -- fewer entries -- not great). But, this
-    // is unfixable.
-    for (unsigned int i = 0; i < 16; i++)
-    {
-      b[i] = a[i] << imm8;
-    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_sllv_epi64);
+    return AVX2::m256_sllv_epi64(a, count);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_sllv_epi64);
+    return NEON::m256_sllv_epi64(a, count);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_sllv_epi64);
+    return Plain::m256_sllv_epi64(a, count);
+#endif
+  }
 
-    return b;
+  /**
+   * m256_srlv_epi64. For all i: shifts a[i] to the right by count[i] positions, shifting in zeros.
+   * Each count is treated as unsigned, and counts > 63 give zero. This mimics _mm256_srlv_epi64.
+   */
+  static inline epi64x4 m256_srlv_epi64(const epi64x4 &a, const epi64x4 &count) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_srlv_epi64);
+    return AVX2::m256_srlv_epi64(a, count);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_srlv_epi64);
+    return NEON::m256_srlv_epi64(a, count);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_srlv_epi64);
+    return Plain::m256_srlv_epi64(a, count);
+#endif
   }
 
   /**
-   * m256_srli_epi16. Given an array reference, a, we shift each int16_t in a by to the right by
-   * imm8 many positions. If imm8 > 16, we replace by zeros. This corresponds exactly to the
-   * _mm256_slli_epi16 intrinsic.
-   * GCC 10.2 compiles this exactly to the right intrinsic, so there's no need for any clever
-   * tricks.
+   * m256_shuffle_epi8.
+   *
+   * This function accepts to array references, a and b. It shuffle the bytes in
+   * a according to the mask in b and returns the result, denoted as c.
+   *
+   * This corresponds exactly to the behaviour of _mm256_shuffle_epi8.
+   *
+   * The best way to understand
+   * what this function does is to view it as applying _mm_shuffle_epi8 twice:
+   * once to the lower lane of a, and once to the upper lane of a. The
+   * description of this function can be found at:
+   * https://software.intel.com/sites/landingpage/IntrinsicsGuide/#text=shuffle_epi8&expand=5153.
+   *
+   * This function will only work if a and b are not equal.
+   *
+   * As GCC 10.2 has trouble producing vectorised
+   * object code for this function (see https://godbolt.org/z/419Whz),
+   * where possible we delegate to the relevant
+   * intrinsics. In particular, this function:
+   *
+   * a) If __AVX2__ is defined, it uses the AVX256 function _mm256_shuffle_epi8.
+   * b) If __AVX2__ is not defined, but __SSSE3__ is, it uses the
+   * _mm_shuffle_epi8 function twice.
+   * c) Otherwise, use the hand-written
+   * variant.
    */
-  template <int8_t imm8>
-  static inline std::array<int16_t, 16> m256_srli_epi16(const std::array<int16_t, 16> &a) noexcept
+  static inline CPP_INTRIN_CONSTEXPR epi8x32
+  m256_shuffle_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
   {
-    std::array<int16_t, 16> b;
-    // Right-shift is not well-defined for signed values.
-    //
-    // In particular,
-    // the C and C++ standards take the view that shifting a value should not change its sign.
-    // This means that here we need to explicitly tell the compiler that we want to shift in 0s
-    // by throwing away the 'signedness' for the shift operation. If we don't do this, then the
-    // compiler *will* generate vectorised code, but the semantics of the operation are completely
-    // different (i.e the leading bits now depend on the sign).
-    // This is the sort of bug that would be nigh-on impossible to find, so this
-    // comment is meant to draw your attention to it.
-    for (unsigned int i = 0; i < 16; i++)
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
     {
-      b[i] = static_cast<int16_t>((static_cast<uint16_t>(a[i]) >> imm8));
+      return Plain::m256_shuffle_epi8(a, b);
     }
-    return b;
+    // Correctness pre-conditions.
+    assert(a != b);
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_shuffle_epi8);
+    return AVX2::m256_shuffle_epi8(a, b);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_shuffle_epi8);
+    return SSE::m256_shuffle_epi8(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_shuffle_epi8);
+    return NEON::m256_shuffle_epi8(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_shuffle_epi8);
+    return Plain::m256_shuffle_epi8(a, b);
+#endif
   }
 
   /**
-   * m256_abs_epi16. This function accepts an array reference, a, and applies the abs function
-   * to each 16-bit integer in a, returning the result (denoted as b).
+   * m256_shuffle_epi8_epi16. This is m256_shuffle_epi8 applied to the byte views of a and b: it's
+   * kept for source compatibility with code that stores its masks as 16-bit integers.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_shuffle_epi8_epi16(const epi16x16 &a, const epi16x16 &b)
+  {
+    return m256_shuffle_epi8(a.epi8(), b.epi8()).epi16();
+  }
+
+  /***
+   * Gathers and table lookups. These read one table entry per lane, where the entry is picked by
+   * the corresponding lane of an index vector. Without them, looking up per-lane entries means
+   * extracting each index to a scalar, loading, and rebuilding the vector.
    *
-   * This exactly mimics the _mm256_abs_epi16 intrinsic.
-   * In particular, for each i = (0, 15) we have that b[i] = abs(a[i]) upon return.
-   * Since GCC 10.2 appears to have issues generating the right object code
-   * (see https://godbolt.org/z/7YnKfo), we provide AVX2 and SSE3 intrinsic delegation.
-   * a) If __AVX2__ is defined, we use the _mm256_abs_epi16 intrinsics.
-   * b) If not, and if __SSSE4__ is defined, we use the _mm_abs_epi16 over each lane of a.
-   * c) If not, we use the hand-rolled version as explained below.
+   * - m256_i32gather_epi32 and m256_i32gather_epi64 read from an arbitrary table in memory. The
+   *   indices are in elements (not bytes), and they must all be in bounds. With AVX2 these are
+   *   single vpgatherdd/vpgatherdq instructions, but note that hardware gathers are slow on many
+   *   microarchitectures (they're microcoded on AMD before Zen 4): they save instructions rather
+   *   than loads.
+   * - The m256_lut* functions look up entries in a small table that is held in registers, and so
+   *   they never touch memory. Each uses the bottom bits of its indices, exactly as
+   *   m256_permutevar8x32_epi32 does, so an out-of-range index wraps around. m256_lut32_epi8 and
+   *   m256_lut64_epi8 look up bytes in a 32- or 64-byte table, and m256_lut16_epi16 and
+   *   m256_lut32_epi16 look up int16_ts in a 16- or 32-entry table (i.e 32 or 64 bytes).
    *
+   * a) If __AVX2__ or __SSSE3__ is defined, each 16-byte chunk of the table is looked up with a
+   *    single pshufb (m256_shuffle_epi8), and the chunks are merged: so a 32-byte table costs two
+   *    shuffles, and a 64-byte table four. This is much faster than a gather for tables this small.
+   *    The gathers need AVX2, and use the hand-written loops otherwise.
+   * b) On NEON, the lookups use vqtbl2q_u8 and vqtbl4q_u8, which read 32- and 64-byte tables
+   *    directly. NEON has no gather, so the gathers use the hand-written loops.
+   * c) With AVX-512, the epi16 lookups are a single vpermw or vpermt2w instead.
+   * d) Otherwise, we use the hand-written loops.
+   */
+
+  /**
+   * m256_i32gather_epi32. For all i: c[i] = base[idx[i]]. This mimics
+   * _mm256_i32gather_epi32(base, idx, 4).
    */
-  static inline std::array<int16_t, 16> m256_abs_epi16(const std::array<int16_t, 16> &a) noexcept
+  static inline epi32x8 m256_i32gather_epi32(const int32_t *base, const epi32x8 &idx) noexcept
   {
-    std::array<int16_t, 16> b;
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_i32gather_epi32);
+    return AVX2::m256_i32gather_epi32(base, idx);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_i32gather_epi32);
+    return Plain::m256_i32gather_epi32(base, idx);
+#endif
+  }
 
+  /**
+   * m256_i32gather_epi64. For all i in {0, 1, 2, 3}: c[i] = base[idx[i]]. Only the bottom four
+   * lanes of idx are used. This mimics _mm256_i32gather_epi64(base, idx, 8), which takes its
+   * indices in a 128-bit register.
+   */
+  static inline epi64x4 m256_i32gather_epi64(const int64_t *base, const epi32x8 &idx) noexcept
+  {
 #ifdef __AVX2__
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&b[0]),
-                       _mm256_abs_epi16(*reinterpret_cast<const __m256i *>(&a[0])));
-#elif defined(__SSE3__)
-    _mm_store_si128(reinterpret_cast<__m128i *>(&b[0]),
-                    _mm_abs_epi16(*reinterpret_cast<const __m128i *>(&a[0])));
-    _mm_store_si128(reinterpret_cast<__m128i *>(&b[8]),
-                    _mm_abs_epi16(*reinterpret_cast<const __m128i *>(&a[8])));
+    CPP_INTRIN_PROBE(AVX2, m256_i32gather_epi64);
+    return AVX2::m256_i32gather_epi64(base, idx);
 #else
+    CPP_INTRIN_PROBE(Plain, m256_i32gather_epi64);
+    return Plain::m256_i32gather_epi64(base, idx);
+#endif
+  }
 
-    // This is a branchless implementation of the ABS function.
-    // The idea is taken from the following excellent blog post:
-    // https://hbfs.wordpress.com/2008/08/05/branchless-equivalents-of-simple-functions/
-    // The idea is that you can generate a mask that represents the sign-bit of the function
-    // by using the behaviour of the shift. You can do the same thing by using type-punning in
-    // unions, but the C++ standard disallows that.
-    //
-    // The point is this: if a[i] is positive, then the leading bit is 0: so the shift
-    // generates an all zero mask. This means the second line does nothing.
-    // By contrast, if a[i] is negative, then the shift generates the all 1 mask.
-    // When xoring against this, we will get the two's complement of a[i]: subtracting
-    // sign-extend in this context implicitly converts it to 1, which is exactly how you
-    // convert between two's complement numbers. Cool, eh?
-    // BTW: this is branchless because the if would have maximum entropy (i.e it's a 50/50 chance
-    // if your number is positive or negative -- not fun.)
-    for (unsigned int i = 0; i < 16; i++)
-    {
-      const int16_t signed_extend = a[i] >> (CHAR_BIT * sizeof(int16_t) - 1);
-      b[i]                        = (a[i] ^ signed_extend) - signed_extend;
-    }
+  /**
+   * m256_lut32_epi8. For all i: c[i] = table[idx[i] & 31].
+   */
+  static inline epi8x32 m256_lut32_epi8(const epi8x32 &table, const epi8x32 &idx) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_lut32_epi8);
+    return AVX2::m256_lut32_epi8(table, idx);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_lut32_epi8);
+    return SSE::m256_lut32_epi8(table, idx);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_lut32_epi8);
+    return NEON::m256_lut32_epi8(table, idx);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_lut32_epi8);
+    return Plain::m256_lut32_epi8(table, idx);
 #endif
-    return b;
   }
 
   /**
-   * get_randomness. This function is not SIMD in nature: instead, given two sources of randomness,
-   * gstate_1 and g_state2, it produces a 128-bit random value.
+   * m256_lut64_epi8. For all i: c[i] = table[idx[i] & 63].
+   */
+  static inline epi8x32 m256_lut64_epi8(const epi8x64 &table, const epi8x32 &idx) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_lut64_epi8);
+    return AVX2::m256_lut64_epi8(table, idx);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_lut64_epi8);
+    return SSE::m256_lut64_epi8(table, idx);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_lut64_epi8);
+    return NEON::m256_lut64_epi8(table, idx);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_lut64_epi8);
+    return Plain::m256_lut64_epi8(table, idx);
+#endif
+  }
+
+  /**
+   * m256_lut16_epi16. For all i: c[i] = table[idx[i] & 15].
+   */
+  static inline epi16x16 m256_lut16_epi16(const epi16x16 &table, const epi16x16 &idx) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m256_lut16_epi16);
+    return AVX512::m256_lut16_epi16(table, idx);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_lut16_epi16);
+    return AVX2::m256_lut16_epi16(table, idx);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_lut16_epi16);
+    return SSE::m256_lut16_epi16(table, idx);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_lut16_epi16);
+    return NEON::m256_lut16_epi16(table, idx);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_lut16_epi16);
+    return Plain::m256_lut16_epi16(table, idx);
+#endif
+  }
+
+  /**
+   * m256_lut32_epi16. For all i: c[i] = table[idx[i] & 31].
+   */
+  static inline epi16x16 m256_lut32_epi16(const epi16x32 &table, const epi16x16 &idx) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m256_lut32_epi16);
+    return AVX512::m256_lut32_epi16(table, idx);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_lut32_epi16);
+    return AVX2::m256_lut32_epi16(table, idx);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_lut32_epi16);
+    return SSE::m256_lut32_epi16(table, idx);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_lut32_epi16);
+    return NEON::m256_lut32_epi16(table, idx);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_lut32_epi16);
+    return Plain::m256_lut32_epi16(table, idx);
+#endif
+  }
+
+  /***
+   * Walsh-Hadamard transforms. These compute the (unnormalised) Walsh-Hadamard transform of a
+   * block of int16_t lanes, i.e c = H * a, where H[i][j] = (-1)^popcount(i & j). This is the
+   * Sylvester ordering: c[0] is the sum of all of the lanes, and c[1] is the alternating sum.
+   * Applying a transform twice multiplies by the block size, and so each output is a sum of up to
+   * n inputs: the arithmetic wraps around on overflow, exactly as m256_add_epi16 does.
    *
-   * In it's naive form, this is based on Lehmer's generator, which is (arguably) the simplest
-   * random number generator that can pass the Big Crush tests. It's also remarkably simple
-   * to write -- see e.g
-   * https://lemire.me/blog/2019/03/19/the-fastest-conventional-random-number-generator-that-can-pass-big-crush/
+   * - m256_hadamard16_epi16 transforms the 16 lanes of a single vector.
+   * - m512_hadamard32_epi16 transforms the 32 lanes of a Vec512.
+   * - m256_hadamard64_epi16 transforms the 64 lanes of a[0], ..., a[3] (with a[0] holding lanes 0
+   *   to 15, and so on), and writes them to c[0], ..., c[3]. c may be the same as a.
+   * - m256_hadamard16_epi16_bulk transforms each of n vectors on its own, like the other bulk
+   *   kernels.
    *
-   * However, in some situations it can be a little bit slow compared to the available alternatives.
-   * As a result -- and where applicable -- we delegate to the aes_enc function, which is really
-   * fast, to produce randomness. This trick was first brought to my attention by working on
-   * https://github.com/lducas/AVX2-BDGL-bucketer.
+   * Chaining m256_hadd_epi16, m256_sign_epi16 and m256_permute4x64_epi16 into a butterfly network
+   * works, but each vphaddw is three uops, two of which are shuffles. Here each stage of the
+   * butterfly is a single shuffle, a sign change and an add.
    *
-   * WARNING WARNING WARNING: this should _not_ be used for any situation
-   * where you need true randomness. It may be fast -- it may even appear reasonable --
-   * but please, don't use this for anything that needs anything sensible.
-   * Here we *just* use it for speed: it's fast and small, but beyond that there's no reason
-   * to use it. You have been warned.
+   * a) If __AVX2__ is defined, each stage is one in-lane shuffle (or vpermq, for the last stage),
+   *    one vpsignw and one vpaddw. The 32- and 64-point transforms transform each register and then
+   *    add and subtract the registers.
+   * b) If __SSSE3__ is defined, the same sequence runs on each 128-bit half.
+   * c) On NEON, each stage is a vrev or vext followed by a single vmla.
+   * d) With AVX-512, the 32- and 64-point transforms work on whole 512-bit registers, and the
+   *    bulk version transforms two vectors per register. m256_hadamard16_epi16 uses AVX2.
+   * e) Otherwise, we use a butterfly loop that GCC and Clang vectorise.
    */
-  static inline __uint128_t get_randomness(__uint128_t &gstate_1, __uint128_t &gstate_2) noexcept
+
+  /**
+   * m256_hadamard16_epi16. Returns H * a, the 16-point Walsh-Hadamard transform of a.
+   */
+  static inline epi16x16 m256_hadamard16_epi16(const epi16x16 &a) noexcept
   {
-    __uint128_t out;
-#ifdef __AES_NI__
-    _mm_store_si128(reinterpret_cast<__m128i *>(&out),
-                    _mm_aesenc_si128(*reinterpret_cast<__m128i *>(&gstate_1),
-                                     *reinterpret_cast<__m128i *>(&gstate_2)));
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_hadamard16_epi16);
+    return AVX2::m256_hadamard16_epi16(a);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_hadamard16_epi16);
+    return SSE::m256_hadamard16_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_hadamard16_epi16);
+    return NEON::m256_hadamard16_epi16(a);
 #else
-    gstate_1 *= 0xda942042e4dd85b5;
-    gstate_2 *= 0xda942042e4dd85b5;
-    out = (gstate_1 << 64) | (gstate_2 >> 64);
+    CPP_INTRIN_PROBE(Plain, m256_hadamard16_epi16);
+    return Plain::m256_hadamard16_epi16(a);
 #endif
-    return out;
   }
 
   /**
-   * m256_broadcastsi128_si256. Given a uint128_t `value` as input, this function returns an array,
-   * `a`, where a[0:7] = value and a[8:15] = value. This is exactly the same semantics as the
-   * __mm256_broadcastsi128_si256 intrinsic.
-   *
-   * GCC 10.2 has trouble producing vectorised code for this function: see e.g
-   * https://godbolt.org/z/covYEd. As a result, similarly to elsewhere in this file, we delegate to
-   * the appropriate intrinsics where available: a) If __AVX2__ is defined, we use the
-   * _mm256_broadcastsi128_si256 intrinsic. b) If __AVX2__ is not defined, but __SSE2__ is, we use
-   * two _mm_store_si128 instructions over the upper and lower halves of a. c) Otherwise we use our
-   * hand-rolled version.
+   * m512_hadamard32_epi16. Returns H * a, the 32-point Walsh-Hadamard transform of a.
    */
-  static inline std::array<int16_t, 16> m256_broadcastsi128_si256(const __uint128_t value)
+  static inline epi16x32 m512_hadamard32_epi16(const epi16x32 &a) noexcept
   {
-    std::array<int16_t, 16> a;
-#ifdef __AVX2__
-    _mm256_store_si256(reinterpret_cast<__m256i *>(&a[0]),
-                       _mm256_broadcastsi128_si256(reinterpret_cast<__m128i>(value)));
-#elif defined(__SSE2__)
-    _mm_store_si128(reinterpret_cast<__m128i *>(&a[0]), reinterpret_cast<__m128i>(value));
-    _mm_store_si128(reinterpret_cast<__m128i *>(&a[8]), reinterpret_cast<__m128i>(value));
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_hadamard32_epi16);
+    return AVX512::m512_hadamard32_epi16(a);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_hadamard32_epi16);
+    return AVX2::m512_hadamard32_epi16(a);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m512_hadamard32_epi16);
+    return SSE::m512_hadamard32_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_hadamard32_epi16);
+    return NEON::m512_hadamard32_epi16(a);
 #else
-    // the simplest way to do this is just to use an memcpy.
-    // GCC compiles this to 4 mov instructions, which is exactly the behaviour we want.
-    std::memcpy(&a[0], &value, sizeof(value));
-    std::memcpy(&a[8], &value, sizeof(value));
+    CPP_INTRIN_PROBE(Plain, m512_hadamard32_epi16);
+    return Plain::m512_hadamard32_epi16(a);
 #endif
-    return a;
   }
 
   /**
-   * mm_extract_epi64. Given a uint128_t `value` as input and a template parameter `pos`, this
-   * function returns the 64-bit in value[pos*64:(pos*64) + 63]. This compiles down into a
-   * a series of shifts and xors, which is relatively fast.
+   * m256_hadamard64_epi16. Writes the 64-point Walsh-Hadamard transform of the lanes of a[0], ...,
+   * a[3] to c[0], ..., c[3].
+   */
+  static inline void m256_hadamard64_epi16(const epi16x16 *a, epi16x16 *c) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m256_hadamard64_epi16);
+    AVX512::m256_hadamard64_epi16(a, c);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_hadamard64_epi16);
+    AVX2::m256_hadamard64_epi16(a, c);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_hadamard64_epi16);
+    SSE::m256_hadamard64_epi16(a, c);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_hadamard64_epi16);
+    NEON::m256_hadamard64_epi16(a, c);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_hadamard64_epi16);
+    Plain::m256_hadamard64_epi16(a, c);
+#endif
+  }
+
+  static inline void m256_hadamard64_epi16(epi16x16 *a) noexcept { m256_hadamard64_epi16(a, a); }
+
+  /**
+   * m256_hadamard16_epi16_bulk. For all i in [0, n): c[i] = m256_hadamard16_epi16(a[i]).
+   */
+  static inline void m256_hadamard16_epi16_bulk(const epi16x16 *a, epi16x16 *c,
+                                                const size_t n) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m256_hadamard16_epi16_bulk);
+    AVX512::m256_hadamard16_epi16_bulk(a, c, n);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_hadamard16_epi16_bulk);
+    AVX2::m256_hadamard16_epi16_bulk(a, c, n);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_hadamard16_epi16_bulk);
+    SSE::m256_hadamard16_epi16_bulk(a, c, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_hadamard16_epi16_bulk);
+    NEON::m256_hadamard16_epi16_bulk(a, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_hadamard16_epi16_bulk);
+    Plain::m256_hadamard16_epi16_bulk(a, c, n);
+#endif
+  }
+
+  static inline void m256_hadamard16_epi16_bulk(epi16x16 *a, const size_t n) noexcept
+  {
+    m256_hadamard16_epi16_bulk(a, a, n);
+  }
+
+  /***
+   * m256_add_epi16. This function accepts 2 array references, a and b, and pairwises sums a and b,
+   * returning the result, denoted as c. This function exactly mimics the _mm256_add_epi16 function.
+   * In particular, after this function is called, c
+   * has the following layout: For all i = 0, ..., 15: c[i] = a[i] + b[i]
    *
-   * GCC 10.2 generates decent code (see lines 8 and 9 of https://godbolt.org/z/9nEcEe), but it
-   * isn't quite the vectorised instructions we'd like. As a result, we delegate to the pextract
-   * intrinsic if it's available. This intrinsic is available if SSE4.1 is available.
+   * This function appears to be trivially vectorisable on GCC 10.2, and as a
+   * result we do not introduce other intrinsics into this function.
    */
-  template <unsigned pos> static inline int64_t mm_extract_epi64(const __uint128_t value)
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_add_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+    CPP_INTRIN_PROBE(Plain, m256_add_epi16);
+    return Plain::m256_add_epi16(a, b);
+  }
+
+  /***
+   * m256_testz_si256. This function accepts two array references, a and b, and returns true if
+   * (a & b) is all zeros, and false otherwise. This exactly mimics the _mm256_testz_si256
+   * function.
+   *
+   * a) If __AVX2__ is defined, it uses the _mm256_testz_si256 intrinsic.
+   * b) If __AVX2__ is not defined, but __SSE4_1__ is, it uses _mm_testz_si128 over each lane.
+   * c) Otherwise, use the hand-written variant.
+   */
+  static bool m256_testz_si256(const epi16x16 &a, const epi16x16 &b)
   {
-#ifdef __AVX__  // SSE4.1 doesn't have a supported macro: the lowest other macro is AVX.
-    return static_cast<int64_t>(_mm_extract_epi64(reinterpret_cast<__m128i>(value), pos));
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_testz_si256);
+    return AVX2::m256_testz_si256(a, b);
+#elif defined(__SSE4_1__)
+    CPP_INTRIN_PROBE(SSE, m256_testz_si256);
+    return SSE::m256_testz_si256(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_testz_si256);
+    return NEON::m256_testz_si256(a, b);
 #else
-    return (value >> (pos * 64)) & 0xFFFFFFFFFFFFFFFF;
+    CPP_INTRIN_PROBE(Plain, m256_testz_si256);
+    return Plain::m256_testz_si256(a, b);
 #endif
   }
+
+  /***
+   * m256_sub_epi16. This function accepts 2 array references, a and b, and pairwises sums a and b,
+   * returning the result, denoted as c. This function exactly mimics the _mm256_add_epi16 function.
+   * In particular, after this function is called, c
+   * has the following layout: For all i = 0, ..., 15: c[i] = a[i] - b[i]
+   *
+   * This function appears to be trivially vectorisable on GCC 10.2, and as a
+   * result we do not introduce other intrinsics into this function.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_sub_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+    CPP_INTRIN_PROBE(Plain, m256_sub_epi16);
+    return Plain::m256_sub_epi16(a, b);
+  }
+
+  /***
+   * Saturating arithmetic. The functions below add or subtract lane-wise, but clamp each result to
+   * the range of the lane type rather than wrapping around: e.g m256_adds_epi16 of 32767 and 1 is
+   * 32767, whereas m256_add_epi16 gives -32768. This is useful when accumulating scores, as it
+   * removes the compare and blend that would otherwise be needed after every step.
+   *
+   * The epu variants treat the lanes as unsigned, exactly as the corresponding Intel intrinsics do:
+   * they accept and return the same (signed) array types as the other functions, so e.g -1 is
+   * treated as 65535 by m256_adds_epu16.
+   *
+   * a) If __AVX2__ is defined, each maps to a single AVX2 instruction (e.g vpaddsw).
+   * b) If __AVX2__ is not defined, but __SSE2__ is, we use the SSE2 version over each half.
+   * c) On NEON we use the saturating instructions (e.g vqaddq_s16) over each half.
+   * d) Otherwise, we compute the exact result in a wider type and clamp it. This is branchless.
+   */
+
+  /***
+   * m256_adds_epi16. For all i: c[i] = a[i] + b[i], clamped to [-32768, 32767].
+   * The lanes are signed 16-bit integers. This exactly mimics the _mm256_adds_epi16 intrinsic.
+   */
+  static inline epi16x16 m256_adds_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epi16);
+    return AVX2::m256_adds_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_adds_epi16);
+    return SSE::m256_adds_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_adds_epi16);
+    return NEON::m256_adds_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_adds_epi16);
+    return Plain::m256_adds_epi16(a, b);
+#endif
+  }
+
+  /***
+   * m256_subs_epi16. For all i: c[i] = a[i] - b[i], clamped to [-32768, 32767].
+   * The lanes are signed 16-bit integers. This exactly mimics the _mm256_subs_epi16 intrinsic.
+   */
+  static inline epi16x16 m256_subs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epi16);
+    return AVX2::m256_subs_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_subs_epi16);
+    return SSE::m256_subs_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_subs_epi16);
+    return NEON::m256_subs_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_subs_epi16);
+    return Plain::m256_subs_epi16(a, b);
+#endif
+  }
+
+  /***
+   * m256_adds_epu16. For all i: c[i] = a[i] + b[i], clamped to [0, 65535].
+   * The lanes are unsigned 16-bit integers. This exactly mimics the _mm256_adds_epu16 intrinsic.
+   */
+  static inline epi16x16 m256_adds_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epu16);
+    return AVX2::m256_adds_epu16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_adds_epu16);
+    return SSE::m256_adds_epu16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_adds_epu16);
+    return NEON::m256_adds_epu16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_adds_epu16);
+    return Plain::m256_adds_epu16(a, b);
+#endif
+  }
+
+  /***
+   * m256_subs_epu16. For all i: c[i] = a[i] - b[i], clamped to [0, 65535].
+   * The lanes are unsigned 16-bit integers. This exactly mimics the _mm256_subs_epu16 intrinsic.
+   */
+  static inline epi16x16 m256_subs_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epu16);
+    return AVX2::m256_subs_epu16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_subs_epu16);
+    return SSE::m256_subs_epu16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_subs_epu16);
+    return NEON::m256_subs_epu16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_subs_epu16);
+    return Plain::m256_subs_epu16(a, b);
+#endif
+  }
+
+  /***
+   * m256_adds_epu8. For all i: c[i] = a[i] + b[i], clamped to [0, 255].
+   * The lanes are unsigned 8-bit integers. This exactly mimics the _mm256_adds_epu8 intrinsic.
+   */
+  static inline epi8x32 m256_adds_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epu8);
+    return AVX2::m256_adds_epu8(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_adds_epu8);
+    return SSE::m256_adds_epu8(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_adds_epu8);
+    return NEON::m256_adds_epu8(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_adds_epu8);
+    return Plain::m256_adds_epu8(a, b);
+#endif
+  }
+
+  /***
+   * m256_subs_epu8. For all i: c[i] = a[i] - b[i], clamped to [0, 255].
+   * The lanes are unsigned 8-bit integers. This exactly mimics the _mm256_subs_epu8 intrinsic.
+   */
+  static inline epi8x32 m256_subs_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epu8);
+    return AVX2::m256_subs_epu8(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_subs_epu8);
+    return SSE::m256_subs_epu8(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_subs_epu8);
+    return NEON::m256_subs_epu8(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_subs_epu8);
+    return Plain::m256_subs_epu8(a, b);
+#endif
+  }
+
+  /**
+   * s256_sign_epi16.
+   * Applies a negation to the packed signed 16-bit integers in a according to
+   * the elements in b and returns the result in an array c.
+   *
+   * More particularly: for any i in [0 ... 15], after this function is called c
+   * contains the following:
+   *
+   * c[i] = a[i]  if b[i] > 0
+   * c[i] = 0     if b[i] == 0
+   * c[i] = -a[i] otherwise
+   *
+   * You can view this as a signed inclusion.
+   *
+   * Because GCC 10.2 seems to struggle with producing the right object code (see
+   * https://godbolt.org/z/3nasvK), we provide an AVX2 overload if it is defined by the compiler. In
+   * particular: a) if __AVX2__ is defined, we use the _mm256_sign_epi16
+   * intrinsic. b) else if __SSSE3__ is defined, we use the _mm_sign_epi16
+   * intrinsic over each half of a and b.
+   * c) else, we use use our hand-written
+   * version.
+   *
+   * Note: our hand-written version is not bad. Rather cleverly, the compiler will vectorise the
+   * call to e_sign and apply it across all of the masks and then applies a multiplication. However,
+   * it's not quite as short as the _mm256_sign_epi16 version.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_sign_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_sign_epi16(a, b);
+    }
+    // pre-conditions for the function to work.
+    assert(a != b);
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_sign_epi16);
+    return AVX2::m256_sign_epi16(a, b);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_sign_epi16);
+    return SSE::m256_sign_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_sign_epi16);
+    return NEON::m256_sign_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_sign_epi16);
+    return Plain::m256_sign_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m256_permute4x64_epi64. Permutes the array a according to the bitmask imm8
+   * and returns the result, denoted as b. This corresponds exactly to the _mm256_permute4x64_epi64
+   * intrinsic.
+   *
+   * Because GCC 10.2 seems to struggle with producing the right object code(see
+   * https://godbolt.org/z/jGb46h), we provide an AVX2 overload if it is defined by the compiler. In
+   * particular: a) if __AVX2__ is defined, we use the _mm256_permute4x64_epi64
+   * intrinsic. b) else, we use our hand-written version.
+   *
+   * Implementor's notes: this function relies on
+   * binary literals. This feature was only officially available in standard C++
+   * in C++14 and later. However, this has been implemented in GCC for far
+   * longer than this.
+   */
+  template <int8_t imm8>
+  static inline CPP_INTRIN_CONSTEXPR epi64x4 m256_permute4x64_epi64(const epi64x4 &a) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::template m256_permute4x64_epi64<imm8>(a);
+    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_permute4x64_epi64);
+    return AVX2::template m256_permute4x64_epi64<imm8>(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_permute4x64_epi64);
+    return Plain::template m256_permute4x64_epi64<imm8>(a);
+#endif
+  }
+
+  /***
+   * m256_permute4x64_epi16. This function is a thin wrapper around the
+   * permutation function, moving each element around under the control of the
+   * immediate imm8. This treats each batch of 4 16-bit entries as one larger 64-bit entry: the
+   * semantics are exactly the same as permute4x64_epi64.
+   *
+   * Historically this needed a separate implementation, because converting between array types
+   * required a copy. With the views on Vec256 that's no longer true, and so this is literally
+   * m256_permute4x64_epi64 applied to the 64-bit view of a. We keep it for source compatibility.
+   */
+  template <int8_t imm8>
+  static inline CPP_INTRIN_CONSTEXPR epi16x16 m256_permute4x64_epi16(const epi16x16 &a)
+  {
+    return m256_permute4x64_epi64<imm8>(a.epi64()).epi16();
+  }
+
+  /**
+   * m256_slli_epi16. Given an array reference, a, we shift each int16_t in a by to the left by
+   * imm8 many positions. If imm8 > 16, we replace by zeros. This corresponds exactly to the
+   * _mm256_slli_epi16 intrinsic.
+   * GCC 10.2 compiles this exactly to the right intrinsic, so there's no need for any clever
+   * tricks.
+   */
+  template <int8_t imm8>
+  static inline CPP_INTRIN_CONSTEXPR epi16x16 m256_slli_epi16(const epi16x16 &a) noexcept
+  {
+    CPP_INTRIN_PROBE(Plain, m256_slli_epi16);
+    return Plain::template m256_slli_epi16<imm8>(a);
+  }
+
+  /**
+   * m256_srli_epi16. Given an array reference, a, we shift each int16_t in a by to the right by
+   * imm8 many positions. If imm8 > 16, we replace by zeros. This corresponds exactly to the
+   * _mm256_slli_epi16 intrinsic.
+   * GCC 10.2 compiles this exactly to the right intrinsic, so there's no need for any clever
+   * tricks.
+   */
+  template <int8_t imm8>
+  static inline CPP_INTRIN_CONSTEXPR epi16x16 m256_srli_epi16(const epi16x16 &a) noexcept
+  {
+    CPP_INTRIN_PROBE(Plain, m256_srli_epi16);
+    return Plain::template m256_srli_epi16<imm8>(a);
+  }
+
+  /**
+   * m256_srai_epi16. Given an array reference, a, we shift each int16_t in a to the right by imm8
+   * many positions, shifting in copies of the sign bit. If imm8 > 15, each lane becomes 0 or -1,
+   * depending on its sign. This corresponds exactly to the _mm256_srai_epi16 intrinsic.
+   * As with m256_srli_epi16, GCC compiles this exactly to the right intrinsic.
+   */
+  template <int8_t imm8>
+  static inline CPP_INTRIN_CONSTEXPR epi16x16 m256_srai_epi16(const epi16x16 &a) noexcept
+  {
+    CPP_INTRIN_PROBE(Plain, m256_srai_epi16);
+    return Plain::template m256_srai_epi16<imm8>(a);
+  }
+
+  /***
+   * Multiplication. These are the building blocks of fixed-point arithmetic: m256_mullo_epi16 keeps
+   * the low 16 bits of each product, m256_mulhi_epi16 keeps the high 16 bits, and m256_madd_epi16
+   * multiplies into 32 bits and adds adjacent pairs of products. The latter is the workhorse of
+   * int16 dot products: summing the madds of two arrays (in 32-bit lanes) and reducing once at the
+   * end does 16 multiplies and 8 adds in a single instruction per vector.
+   *
+   * GCC vectorises m256_mullo_epi16 and m256_mulhi_epi16 into a single pmullw and pmulhw (or their
+   * AVX2 equivalents), and so, exactly as with m256_add_epi16, we just use the hand-written loops.
+   * GCC doesn't spot the pairwise add in m256_madd_epi16, however, and so:
+   * a) If __AVX2__ is defined, m256_madd_epi16 uses _mm256_madd_epi16.
+   * b) If __AVX2__ is not defined, but __SSE2__ is, we use _mm_madd_epi16 over each half.
+   * c) On NEON, we widen the products with vmull_s16 and add adjacent pairs with vpaddq_s32.
+   * d) Otherwise, we use the hand-written loop.
+   */
+
+  /**
+   * m256_mullo_epi16. For all i: c[i] is the low 16 bits of a[i] * b[i]. This is the same for
+   * signed and unsigned inputs. This mimics _mm256_mullo_epi16.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_mullo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+    CPP_INTRIN_PROBE(Plain, m256_mullo_epi16);
+    return Plain::m256_mullo_epi16(a, b);
+  }
+
+  /**
+   * m256_mulhi_epi16. For all i: c[i] is the high 16 bits of the 32-bit product a[i] * b[i], i.e
+   * (a[i] * b[i]) >> 16. This mimics _mm256_mulhi_epi16.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_mulhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+    CPP_INTRIN_PROBE(Plain, m256_mulhi_epi16);
+    return Plain::m256_mulhi_epi16(a, b);
+  }
+
+  /**
+   * m256_madd_epi16. For all i in [0, 8): c[i] = a[2i] * b[2i] + a[2i + 1] * b[2i + 1], where the
+   * products and the sum are 32-bit. The sum only overflows if all four inputs are INT16_MIN, in
+   * which case it wraps around to INT32_MIN. This mimics _mm256_madd_epi16.
+   */
+  static inline epi32x8 m256_madd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_madd_epi16);
+    return AVX2::m256_madd_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_madd_epi16);
+    return SSE::m256_madd_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_madd_epi16);
+    return NEON::m256_madd_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_madd_epi16);
+    return Plain::m256_madd_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m256_abs_epi16. This function accepts an array reference, a, and applies the abs function
+   * to each 16-bit integer in a, returning the result (denoted as b).
+   *
+   * This exactly mimics the _mm256_abs_epi16 intrinsic.
+   * In particular, for each i = (0, 15) we have that b[i] = abs(a[i]) upon return.
+   * Since GCC 10.2 appears to have issues generating the right object code
+   * (see https://godbolt.org/z/7YnKfo), we provide AVX2 and SSE3 intrinsic delegation.
+   * a) If __AVX2__ is defined, we use the _mm256_abs_epi16 intrinsics.
+   * b) If not, and if __SSSE3__ is defined, we use the _mm_abs_epi16 over each lane of a.
+   * c) If not, we use the hand-rolled version as explained in Plain::m256_abs_epi16.
+   *
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi16x16 m256_abs_epi16(const epi16x16 &a) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_abs_epi16(a);
+    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_abs_epi16);
+    return AVX2::m256_abs_epi16(a);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_abs_epi16);
+    return SSE::m256_abs_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_abs_epi16);
+    return NEON::m256_abs_epi16(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_abs_epi16);
+    return Plain::m256_abs_epi16(a);
+#endif
+  }
+
+  /**
+   * get_randomness. This function is not SIMD in nature: instead, given two sources of randomness,
+   * gstate_1 and g_state2, it produces a 128-bit random value.
+   *
+   * In it's naive form, this is based on Lehmer's generator, which is (arguably) the simplest
+   * random number generator that can pass the Big Crush tests. It's also remarkably simple
+   * to write -- see e.g
+   * https://lemire.me/blog/2019/03/19/the-fastest-conventional-random-number-generator-that-can-pass-big-crush/
+   *
+   * However, in some situations it can be a little bit slow compared to the available alternatives.
+   * As a result -- and where applicable -- we delegate to the aes_enc function, which is really
+   * fast, to produce randomness. This trick was first brought to my attention by working on
+   * https://github.com/lducas/AVX2-BDGL-bucketer. The AES path is used if __AES__ is defined (i.e
+   * with -maes or an -march that implies it): dispatch().get_randomness picks it at runtime
+   * instead. In the AES path gstate_2 acts as the round key: gstate_1 is advanced by one round of
+   * aesenc, and the output is the new gstate_1 xored with the key, so repeated calls produce a
+   * fresh value each time.
+   *
+   * WARNING WARNING WARNING: this should _not_ be used for any situation
+   * where you need true randomness. It may be fast -- it may even appear reasonable --
+   * but please, don't use this for anything that needs anything sensible.
+   * Here we *just* use it for speed: it's fast and small, but beyond that there's no reason
+   * to use it. You have been warned.
+   */
+  static inline __uint128_t get_randomness(__uint128_t &gstate_1, __uint128_t &gstate_2) noexcept
+  {
+#ifdef __AES__
+    CPP_INTRIN_PROBE(AES, get_randomness);
+    return AES::get_randomness(gstate_1, gstate_2);
+#else
+    CPP_INTRIN_PROBE(Plain, get_randomness);
+    return Plain::get_randomness(gstate_1, gstate_2);
+#endif
+  }
+
+  /**
+   * m256_broadcastsi128_si256. Given a uint128_t `value` as input, this function returns an array,
+   * `a`, where a[0:7] = value and a[8:15] = value. This is exactly the same semantics as the
+   * __mm256_broadcastsi128_si256 intrinsic.
+   *
+   * GCC 10.2 has trouble producing vectorised code for this function: see e.g
+   * https://godbolt.org/z/covYEd. As a result, similarly to elsewhere in this file, we delegate to
+   * the appropriate intrinsics where available: a) If __AVX2__ is defined, we use the
+   * _mm256_broadcastsi128_si256 intrinsic. b) If __AVX2__ is not defined, but __SSE2__ is, we use
+   * two _mm_store_si128 instructions over the upper and lower halves of a. c) Otherwise we use our
+   * hand-rolled version.
+   */
+  static inline epi16x16 m256_broadcastsi128_si256(const __uint128_t value)
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_broadcastsi128_si256);
+    return AVX2::m256_broadcastsi128_si256(value);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_broadcastsi128_si256);
+    return SSE::m256_broadcastsi128_si256(value);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_broadcastsi128_si256);
+    return NEON::m256_broadcastsi128_si256(value);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_broadcastsi128_si256);
+    return Plain::m256_broadcastsi128_si256(value);
+#endif
+  }
+
+  /**
+   * mm_extract_epi64. Given a uint128_t `value` as input and a template parameter `pos`, this
+   * function returns the 64-bit in value[pos*64:(pos*64) + 63]. This compiles down into a
+   * a series of shifts and xors, which is relatively fast.
+   *
+   * GCC 10.2 generates decent code (see lines 8 and 9 of https://godbolt.org/z/9nEcEe), but it
+   * isn't quite the vectorised instructions we'd like. As a result, we delegate to the pextract
+   * intrinsic if it's available. This intrinsic is available if SSE4.1 is available.
+   */
+  template <unsigned pos> static inline int64_t mm_extract_epi64(const __uint128_t value)
+  {
+#ifdef __SSE4_1__
+    CPP_INTRIN_PROBE(SSE, mm_extract_epi64);
+    return SSE::template mm_extract_epi64<pos>(value);
+#else
+    CPP_INTRIN_PROBE(Plain, mm_extract_epi64);
+    return Plain::template mm_extract_epi64<pos>(value);
+#endif
+  }
+
+  /***
+   * Lanes and interleaving. The functions above treat a Vec256 as a single unit, but transposes
+   * and similar shuffles need to split a vector into its two 128-bit halves, put one back, or
+   * interleave two vectors. Doing this with memcpy (or by indexing the array) forces the vector
+   * through memory, and then the next wide load stalls on store forwarding. These functions keep
+   * the data in registers where the tier allows it:
+   *
+   * - m256_extracti128_si256 and m256_inserti128_si256 read and replace one 128-bit half.
+   * - m256_extract_epi16 and m256_extract_epi64 read a single lane.
+   * - m256_unpacklo_epi16/epi32 and m256_unpackhi_epi16/epi32 interleave the low (resp. high)
+   *   lanes of a and b. As with the intrinsics, this happens within each 128-bit half: the low
+   *   lanes are those in the bottom half of each 128-bit half, not of the whole vector.
+   *
+   * a) If __AVX2__ is defined, each is the matching AVX2 intrinsic.
+   * b) If __AVX2__ is not defined, but __SSE2__ is, the unpacks use the SSE2 versions over each
+   *    half.
+   * c) On AArch64 the unpacks use vzip1q and vzip2q over each half, which interleave in exactly
+   *    the same way. Otherwise, we use the hand-written loops.
+   * The extracts and inserts only ever touch one half, and so below AVX2 they're ordinary loads
+   * and stores of part of the array: that's also what GCC generates for the 128-bit intrinsics
+   * here, so we use the plain versions.
+   */
+
+  /**
+   * m256_extracti128_si256. Returns the 128-bit half of a selected by pos, i.e
+   * a[pos*128:(pos*128) + 127]. This mimics _mm256_extracti128_si256.
+   */
+  template <unsigned pos, typename T>
+  static inline __uint128_t m256_extracti128_si256(const Vec256<T> &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_extracti128_si256);
+    return AVX2::template m256_extracti128_si256<pos, T>(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_extracti128_si256);
+    return Plain::template m256_extracti128_si256<pos, T>(a);
+#endif
+  }
+
+  /**
+   * m256_inserti128_si256. Returns a copy of a, with the 128-bit half selected by pos replaced by
+   * b. This mimics _mm256_inserti128_si256.
+   */
+  template <unsigned pos, typename T>
+  static inline Vec256<T> m256_inserti128_si256(const Vec256<T> &a, const __uint128_t b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_inserti128_si256);
+    return AVX2::template m256_inserti128_si256<pos, T>(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_inserti128_si256);
+    return Plain::template m256_inserti128_si256<pos, T>(a, b);
+#endif
+  }
+
+  /**
+   * m256_extract_epi16. Returns a[pos]. This mimics _mm256_extract_epi16, except that the lane is
+   * returned as an int16_t (the intrinsic zero-extends it to an int).
+   */
+  template <unsigned pos>
+  static inline CPP_INTRIN_CONSTEXPR int16_t m256_extract_epi16(const epi16x16 &a) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::template m256_extract_epi16<pos>(a);
+    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_extract_epi16);
+    return AVX2::template m256_extract_epi16<pos>(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_extract_epi16);
+    return Plain::template m256_extract_epi16<pos>(a);
+#endif
+  }
+
+  /**
+   * m256_extract_epi64. Returns a[pos]. This mimics _mm256_extract_epi64.
+   */
+  template <unsigned pos>
+  static inline CPP_INTRIN_CONSTEXPR int64_t m256_extract_epi64(const epi64x4 &a) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::template m256_extract_epi64<pos>(a);
+    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_extract_epi64);
+    return AVX2::template m256_extract_epi64<pos>(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_extract_epi64);
+    return Plain::template m256_extract_epi64<pos>(a);
+#endif
+  }
+
+  /**
+   * m256_unpacklo_epi16. For each 128-bit half h (i.e h = 0 and h = 8) and all i in [0, 4):
+   * c[h + 2i] = a[h + i] and c[h + 2i + 1] = b[h + i]. This mimics _mm256_unpacklo_epi16.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_unpacklo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_unpacklo_epi16(a, b);
+    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_unpacklo_epi16);
+    return AVX2::m256_unpacklo_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_unpacklo_epi16);
+    return SSE::m256_unpacklo_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_unpacklo_epi16);
+    return NEON::m256_unpacklo_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_unpacklo_epi16);
+    return Plain::m256_unpacklo_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m256_unpackhi_epi16. For each 128-bit half h (i.e h = 0 and h = 8) and all i in [0, 4):
+   * c[h + 2i] = a[h + 4 + i] and c[h + 2i + 1] = b[h + 4 + i]. This mimics
+   * _mm256_unpackhi_epi16.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi16x16
+  m256_unpackhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_unpackhi_epi16(a, b);
+    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_unpackhi_epi16);
+    return AVX2::m256_unpackhi_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_unpackhi_epi16);
+    return SSE::m256_unpackhi_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_unpackhi_epi16);
+    return NEON::m256_unpackhi_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_unpackhi_epi16);
+    return Plain::m256_unpackhi_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m256_unpacklo_epi32. For each 128-bit half h (i.e h = 0 and h = 4) and all i in [0, 2):
+   * c[h + 2i] = a[h + i] and c[h + 2i + 1] = b[h + i]. This mimics _mm256_unpacklo_epi32.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi32x8
+  m256_unpacklo_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_unpacklo_epi32(a, b);
+    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_unpacklo_epi32);
+    return AVX2::m256_unpacklo_epi32(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_unpacklo_epi32);
+    return SSE::m256_unpacklo_epi32(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_unpacklo_epi32);
+    return NEON::m256_unpacklo_epi32(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_unpacklo_epi32);
+    return Plain::m256_unpacklo_epi32(a, b);
+#endif
+  }
+
+  /**
+   * m256_unpackhi_epi32. For each 128-bit half h (i.e h = 0 and h = 4) and all i in [0, 2):
+   * c[h + 2i] = a[h + 2 + i] and c[h + 2i + 1] = b[h + 2 + i]. This mimics
+   * _mm256_unpackhi_epi32.
+   */
+  static inline CPP_INTRIN_CONSTEXPR epi32x8
+  m256_unpackhi_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+  {
+    if (CPP_INTRIN_CONSTANT_EVALUATED())
+    {
+      return Plain::m256_unpackhi_epi32(a, b);
+    }
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_unpackhi_epi32);
+    return AVX2::m256_unpackhi_epi32(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_unpackhi_epi32);
+    return SSE::m256_unpackhi_epi32(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_unpackhi_epi32);
+    return NEON::m256_unpackhi_epi32(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_unpackhi_epi32);
+    return Plain::m256_unpackhi_epi32(a, b);
+#endif
+  }
+
+  /***
+   * Fused operations. Our hot loops repeatedly chain a handful of operations together, e.g
+   * m256_abs_epi16(m256_sub_epi16(a, b)). On the AVX2 path the compiler fuses these on its own, but
+   * the fallback paths materialise each intermediate vector before the next operation runs. The
+   * functions below do the whole chain in a single pass instead. For arbitrary element-wise chains,
+   * see Expr below.
+   */
+
+  /**
+   * m256_subabs_epi16. Returns the lane-wise absolute difference of a and b, i.e for all i = 0,
+   * ..., 15: c[i] = abs(a[i] - b[i]). As with m256_abs_epi16 and m256_sub_epi16, the subtraction
+   * wraps and abs(-32768) = -32768, so this is exactly m256_abs_epi16(m256_sub_epi16(a, b)).
+   */
+  static inline epi16x16 m256_subabs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_subabs_epi16);
+    return AVX2::m256_subabs_epi16(a, b);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_subabs_epi16);
+    return SSE::m256_subabs_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_subabs_epi16);
+    return NEON::m256_subabs_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_subabs_epi16);
+    return Plain::m256_subabs_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m256_and_testz_si256. Returns true if (a & b & c) is all zeros, i.e exactly
+   * m256_testz_si256(m256_and_epi16(a, b), c).
+   */
+  static inline bool m256_and_testz_si256(const epi16x16 &a,
+                                          const epi16x16 &b,
+                                          const epi16x16 &c) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_and_testz_si256);
+    return AVX2::m256_and_testz_si256(a, b, c);
+#elif defined(__SSE4_1__)
+    CPP_INTRIN_PROBE(SSE, m256_and_testz_si256);
+    return SSE::m256_and_testz_si256(a, b, c);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_and_testz_si256);
+    return NEON::m256_and_testz_si256(a, b, c);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_and_testz_si256);
+    return Plain::m256_and_testz_si256(a, b, c);
+#endif
+  }
+
+  /**
+   * m256_xor_popcount_epi64. Returns the number of set bits in (a ^ b), i.e the Hamming distance
+   * between a and b viewed as 256-bit strings.
+   */
+  static inline unsigned m256_xor_popcount_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_xor_popcount_epi64);
+    return AVX2::m256_xor_popcount_epi64(a, b);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_xor_popcount_epi64);
+    return SSE::m256_xor_popcount_epi64(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_xor_popcount_epi64);
+    return NEON::m256_xor_popcount_epi64(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_xor_popcount_epi64);
+    return Plain::m256_xor_popcount_epi64(a, b);
+#endif
+  }
+
+  /**
+   * m256_hadd_reduce_epi16. Returns the sum of every lane of m256_hadd_epi16(a, b) modulo 2^16,
+   * which is the same as the (wrapping) sum of every lane of a and b. This avoids building the
+   * horizontally-added vector at all.
+   */
+  static inline int16_t m256_hadd_reduce_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_hadd_reduce_epi16);
+    return AVX2::m256_hadd_reduce_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_hadd_reduce_epi16);
+    return SSE::m256_hadd_reduce_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_hadd_reduce_epi16);
+    return NEON::m256_hadd_reduce_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_hadd_reduce_epi16);
+    return Plain::m256_hadd_reduce_epi16(a, b);
+#endif
+  }
+
+  /***
+   * Horizontal reductions. These reduce all 16 lanes of a single vector to a scalar. Unlike
+   * m256_hadd_epi16, which only adds adjacent pairs within each 128-bit lane, these reduce across
+   * the whole vector. Each uses the cheapest shuffle tree for the tier:
+   *
+   * a) If __AVX2__ is defined, we first combine the two 128-bit lanes, and then
+   * b) if __SSE4_1__ is defined, we use phminposuw (_mm_minpos_epu16) for min and max, which
+   *    reduces 8 unsigned lanes in a single instruction: the signed order is mapped onto the
+   *    unsigned order by flipping the sign bit (for min) or every other bit (for max). The sum
+   *    only needs SSE2: pmaddwd against ones widens it to 32 bits, followed by two shuffles.
+   * c) On NEON we use the across-vector instructions (e.g vmaxvq_s16) over the combined halves.
+   * d) Otherwise, we use the hand-written loops.
+   */
+
+  /**
+   * m256_reduce_add_epi16. Returns the sum of all 16 lanes of a. The sum is computed in 32 bits, so
+   * unlike m256_hadd_reduce_epi16 it can't overflow.
+   */
+  static inline int32_t m256_reduce_add_epi16(const epi16x16 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_reduce_add_epi16);
+    return AVX2::m256_reduce_add_epi16(a);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_reduce_add_epi16);
+    return SSE::m256_reduce_add_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_reduce_add_epi16);
+    return NEON::m256_reduce_add_epi16(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_reduce_add_epi16);
+    return Plain::m256_reduce_add_epi16(a);
+#endif
+  }
+
+  /**
+   * m256_reduce_min_epi16. Returns the smallest of the 16 (signed) lanes of a.
+   */
+  static inline int16_t m256_reduce_min_epi16(const epi16x16 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_reduce_min_epi16);
+    return AVX2::m256_reduce_min_epi16(a);
+#elif defined(__SSE4_1__)
+    CPP_INTRIN_PROBE(SSE, m256_reduce_min_epi16);
+    return SSE::m256_reduce_min_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_reduce_min_epi16);
+    return NEON::m256_reduce_min_epi16(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_reduce_min_epi16);
+    return Plain::m256_reduce_min_epi16(a);
+#endif
+  }
+
+  /**
+   * m256_reduce_max_epi16. Returns the largest of the 16 (signed) lanes of a.
+   */
+  static inline int16_t m256_reduce_max_epi16(const epi16x16 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_reduce_max_epi16);
+    return AVX2::m256_reduce_max_epi16(a);
+#elif defined(__SSE4_1__)
+    CPP_INTRIN_PROBE(SSE, m256_reduce_max_epi16);
+    return SSE::m256_reduce_max_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_reduce_max_epi16);
+    return NEON::m256_reduce_max_epi16(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_reduce_max_epi16);
+    return Plain::m256_reduce_max_epi16(a);
+#endif
+  }
+
+  /**
+   * m256_reduce_argmax_epi16. Returns the index of the largest (signed) lane of a. If several lanes
+   * hold the maximum, this returns the lowest of their indices. This is computed as the maximum,
+   * followed by a comparison against it and a count of the trailing zeros of the resulting mask.
+   */
+  static inline unsigned m256_reduce_argmax_epi16(const epi16x16 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_reduce_argmax_epi16);
+    return AVX2::m256_reduce_argmax_epi16(a);
+#elif defined(__SSE4_1__)
+    CPP_INTRIN_PROBE(SSE, m256_reduce_argmax_epi16);
+    return SSE::m256_reduce_argmax_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_reduce_argmax_epi16);
+    return NEON::m256_reduce_argmax_epi16(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_reduce_argmax_epi16);
+    return Plain::m256_reduce_argmax_epi16(a);
+#endif
+  }
+
+  /***
+   * Population counts. These count the set bits in a vector, which is the core of the Hamming
+   * distance computations used in e.g sieving. The AVX2 and SSSE3 implementations use the nibble
+   * lookup technique described by Muła, Kurz and Lemire (https://arxiv.org/abs/1611.07612): each
+   * byte is split into its two nibbles, and the bit count of each nibble is looked up in a 16-entry
+   * table via a single m256_shuffle_epi8. The per-byte counts are then summed into 64-bit lanes
+   * with psadbw. If AVX512-VPOPCNTDQ and AVX512-VL are enabled at compile-time, we use vpopcntq
+   * instead.
+   */
+
+  /**
+   * m256_popcount_epi8. Returns c, where c[i] is the number of set bits in a[i] for all i = 0, ...,
+   * 31.
+   */
+  static inline epi8x32 m256_popcount_epi8(const epi8x32 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_popcount_epi8);
+    return AVX2::m256_popcount_epi8(a);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_popcount_epi8);
+    return SSE::m256_popcount_epi8(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_popcount_epi8);
+    return NEON::m256_popcount_epi8(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_popcount_epi8);
+    return Plain::m256_popcount_epi8(a);
+#endif
+  }
+
+  /**
+   * m256_popcount_epi64. Returns c, where c[i] is the number of set bits in a[i] for all i = 0,
+   * ..., 3.
+   */
+  static inline epi64x4 m256_popcount_epi64(const epi64x4 &a) noexcept
+  {
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(VPOPCNTDQ, m256_popcount_epi64);
+    return VPOPCNTDQ::m256_popcount_epi64(a);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_popcount_epi64);
+    return AVX2::m256_popcount_epi64(a);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_popcount_epi64);
+    return SSE::m256_popcount_epi64(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_popcount_epi64);
+    return NEON::m256_popcount_epi64(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_popcount_epi64);
+    return Plain::m256_popcount_epi64(a);
+#endif
+  }
+
+  /**
+   * m256_popcount_si256. Returns the number of set bits in all of a.
+   */
+  static inline unsigned m256_popcount_si256(const epi64x4 &a) noexcept
+  {
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(VPOPCNTDQ, m256_popcount_si256);
+    return VPOPCNTDQ::m256_popcount_si256(a);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_popcount_si256);
+    return AVX2::m256_popcount_si256(a);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_popcount_si256);
+    return SSE::m256_popcount_si256(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_popcount_si256);
+    return NEON::m256_popcount_si256(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_popcount_si256);
+    return Plain::m256_popcount_si256(a);
+#endif
+  }
+
+  /***
+   * 512-bit operations. The m512_* functions below are the 512-bit counterparts of the m256_*
+   * functions above, and they accept and return the Vec512 types. Each one mimics the matching
+   * Intel intrinsic: e.g m512_add_epi16 behaves exactly as _mm512_add_epi16 does. Where the
+   * Intel instruction works within 128-bit or 256-bit lanes, so does ours.
+   *
+   * The tier is picked at compile time in the usual way. With AVX512-BW and AVX512-VL we use the
+   * 512-bit instructions directly. Otherwise, each function is applied to the two 256-bit halves:
+   * this uses two AVX2 instructions where AVX2 is available, and the SSE, NEON or plain
+   * implementations of the m256_* function otherwise. If you need to pick the tier at runtime, use
+   * the dispatch().m512_* pointers instead: these include an AVX-512 tier.
+   */
+
+  /**
+   * m512_add_epi16. Returns c, where c[i] = a[i] + b[i] for all i in [0, 32). Like
+   * m256_add_epi16, the addition wraps around on overflow.
+   */
+  static inline epi16x32 m512_add_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_add_epi16);
+    return AVX512::m512_add_epi16(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_add_epi16);
+    return AVX2::m512_add_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_add_epi16);
+    return SSE::m512_add_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_add_epi16);
+    return NEON::m512_add_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_add_epi16);
+    return Plain::m512_add_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m512_sub_epi16. Returns c, where c[i] = a[i] - b[i] for all i in [0, 32).
+   */
+  static inline epi16x32 m512_sub_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_sub_epi16);
+    return AVX512::m512_sub_epi16(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_sub_epi16);
+    return AVX2::m512_sub_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_sub_epi16);
+    return SSE::m512_sub_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_sub_epi16);
+    return NEON::m512_sub_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_sub_epi16);
+    return Plain::m512_sub_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m512_sign_epi16. Returns c, where c[i] = a[i] * e_sign(b[i]), exactly as m256_sign_epi16.
+   * AVX-512 has no vpsignw: instead, the AVX-512 version negates a under the mask of negative
+   * b lanes, and then zeroes the lanes where b is zero, via two masked instructions.
+   */
+  static inline epi16x32 m512_sign_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_sign_epi16);
+    return AVX512::m512_sign_epi16(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_sign_epi16);
+    return AVX2::m512_sign_epi16(a, b);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m512_sign_epi16);
+    return SSE::m512_sign_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_sign_epi16);
+    return NEON::m512_sign_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_sign_epi16);
+    return Plain::m512_sign_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m512_abs_epi16. Returns c, where c[i] = |a[i]| for all i in [0, 32). As with
+   * m256_abs_epi16, the absolute value of INT16_MIN is INT16_MIN.
+   */
+  static inline epi16x32 m512_abs_epi16(const epi16x32 &a) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_abs_epi16);
+    return AVX512::m512_abs_epi16(a);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_abs_epi16);
+    return AVX2::m512_abs_epi16(a);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m512_abs_epi16);
+    return SSE::m512_abs_epi16(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_abs_epi16);
+    return NEON::m512_abs_epi16(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_abs_epi16);
+    return Plain::m512_abs_epi16(a);
+#endif
+  }
+
+  /**
+   * m512_and_epi64, m512_or_epi64 and m512_xor_epi64. These return the bitwise and, or and xor
+   * of a and b respectively, mimicking _mm512_and_si512, _mm512_or_si512 and _mm512_xor_si512.
+   */
+  static inline epi64x8 m512_and_epi64(const epi64x8 &a, const epi64x8 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_and_epi64);
+    return AVX512::m512_and_epi64(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_and_epi64);
+    return AVX2::m512_and_epi64(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_and_epi64);
+    return SSE::m512_and_epi64(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_and_epi64);
+    return NEON::m512_and_epi64(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_and_epi64);
+    return Plain::m512_and_epi64(a, b);
+#endif
+  }
+
+  static inline epi64x8 m512_or_epi64(const epi64x8 &a, const epi64x8 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_or_epi64);
+    return AVX512::m512_or_epi64(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_or_epi64);
+    return AVX2::m512_or_epi64(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_or_epi64);
+    return SSE::m512_or_epi64(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_or_epi64);
+    return NEON::m512_or_epi64(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_or_epi64);
+    return Plain::m512_or_epi64(a, b);
+#endif
+  }
+
+  static inline epi64x8 m512_xor_epi64(const epi64x8 &a, const epi64x8 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_xor_epi64);
+    return AVX512::m512_xor_epi64(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_xor_epi64);
+    return AVX2::m512_xor_epi64(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_xor_epi64);
+    return SSE::m512_xor_epi64(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_xor_epi64);
+    return NEON::m512_xor_epi64(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_xor_epi64);
+    return Plain::m512_xor_epi64(a, b);
+#endif
+  }
+
+  /**
+   * m512_shuffle_epi8. Shuffles the bytes of a according to b within each 128-bit lane, exactly
+   * as _mm512_shuffle_epi8 does: this is m256_shuffle_epi8 applied to each 256-bit half.
+   */
+  static inline epi8x64 m512_shuffle_epi8(const epi8x64 &a, const epi8x64 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_shuffle_epi8);
+    return AVX512::m512_shuffle_epi8(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_shuffle_epi8);
+    return AVX2::m512_shuffle_epi8(a, b);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m512_shuffle_epi8);
+    return SSE::m512_shuffle_epi8(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_shuffle_epi8);
+    return NEON::m512_shuffle_epi8(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_shuffle_epi8);
+    return Plain::m512_shuffle_epi8(a, b);
+#endif
+  }
+
+  /**
+   * m512_permute4x64_epi64. Permutes the 64-bit lanes of each 256-bit half of a according to
+   * imm8: i.e both halves are permuted exactly as m256_permute4x64_epi64<imm8> would. This
+   * mimics _mm512_permutex_epi64, which is the closest AVX-512 analogue of vpermq.
+   */
+  template <int8_t imm8> static inline epi64x8 m512_permute4x64_epi64(const epi64x8 &a) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_permute4x64_epi64);
+    return AVX512::template m512_permute4x64_epi64<imm8>(a);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_permute4x64_epi64);
+    return AVX2::template m512_permute4x64_epi64<imm8>(a);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_permute4x64_epi64);
+    return SSE::template m512_permute4x64_epi64<imm8>(a);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_permute4x64_epi64);
+    return NEON::template m512_permute4x64_epi64<imm8>(a);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_permute4x64_epi64);
+    return Plain::template m512_permute4x64_epi64<imm8>(a);
+#endif
+  }
+
+  /**
+   * m512_testz_si512. Returns true if a & b is zero, and false otherwise. This mimics
+   * _mm512_test_epi64_mask(a, b) == 0, as AVX-512 has no direct counterpart of vptest.
+   */
+  static inline bool m512_testz_si512(const epi16x32 &a, const epi16x32 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_testz_si512);
+    return AVX512::m512_testz_si512(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_testz_si512);
+    return AVX2::m512_testz_si512(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_testz_si512);
+    return SSE::m512_testz_si512(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_testz_si512);
+    return NEON::m512_testz_si512(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_testz_si512);
+    return Plain::m512_testz_si512(a, b);
+#endif
+  }
+
+  /**
+   * m512_cmpgt_epi16. Returns c, where c[i] = -1 if a[i] > b[i] and 0 otherwise. AVX-512 only
+   * compares into mask registers, so the AVX-512 version expands the mask with vpmovm2w: if you
+   * only need the result as a bitmask, use m512_cmpgt_epi16_mask instead.
+   */
+  static inline epi16x32 m512_cmpgt_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_cmpgt_epi16);
+    return AVX512::m512_cmpgt_epi16(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_cmpgt_epi16);
+    return AVX2::m512_cmpgt_epi16(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_cmpgt_epi16);
+    return SSE::m512_cmpgt_epi16(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_cmpgt_epi16);
+    return NEON::m512_cmpgt_epi16(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_cmpgt_epi16);
+    return Plain::m512_cmpgt_epi16(a, b);
+#endif
+  }
+
+  /**
+   * m256_cmpgt_epi16_mask and m512_cmpgt_epi16_mask. These return a bitmask whose bit i is set if
+   * and only if a[i] > b[i], mimicking _mm256_cmpgt_epi16_mask and _mm512_cmpgt_epi16_mask. With
+   * AVX512-BW and VL the comparison writes straight into a mask register. Without them, this is
+   * the vector comparison followed by a pack (to one byte per lane) and a movemask.
+   */
+  static inline uint16_t m256_cmpgt_epi16_mask(const epi16x16 &a, const epi16x16 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m256_cmpgt_epi16_mask);
+    return AVX512::m256_cmpgt_epi16_mask(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_cmpgt_epi16_mask);
+    return AVX2::m256_cmpgt_epi16_mask(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_cmpgt_epi16_mask);
+    return SSE::m256_cmpgt_epi16_mask(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_cmpgt_epi16_mask);
+    return NEON::m256_cmpgt_epi16_mask(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_cmpgt_epi16_mask);
+    return Plain::m256_cmpgt_epi16_mask(a, b);
+#endif
+  }
+
+  static inline uint32_t m512_cmpgt_epi16_mask(const epi16x32 &a, const epi16x32 &b) noexcept
+  {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(AVX512, m512_cmpgt_epi16_mask);
+    return AVX512::m512_cmpgt_epi16_mask(a, b);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m512_cmpgt_epi16_mask);
+    return AVX2::m512_cmpgt_epi16_mask(a, b);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m512_cmpgt_epi16_mask);
+    return SSE::m512_cmpgt_epi16_mask(a, b);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m512_cmpgt_epi16_mask);
+    return NEON::m512_cmpgt_epi16_mask(a, b);
+#else
+    CPP_INTRIN_PROBE(Plain, m512_cmpgt_epi16_mask);
+    return Plain::m512_cmpgt_epi16_mask(a, b);
+#endif
+  }
+
+  /***
+   * Loads and stores. Every other function in this file works on a Vec256, and so data that lives
+   * somewhere else (e.g in a memory-mapped file) would first need to be copied into one. These
+   * functions instead read and write directly from and to arbitrary pointers:
+   *
+   * - m256_loadu_si256 and m256_storeu_si256 read and write 32 bytes at any alignment.
+   * - m256_stream_si256 writes 32 bytes with a non-temporal store, which bypasses the cache. This
+   *   is useful when writing large outputs that won't be read again soon, as they would otherwise
+   *   evict everything else from the cache. The destination must be 32-byte aligned. Streaming
+   *   stores are weakly ordered, so call stream_fence() once you're done and before any other
+   *   thread reads the output.
+   * - m256_maskload_epi32 and m256_maskload_epi64 only read the lanes whose mask has its top bit
+   *   set, and zero the rest: the other lanes are never touched, and so they can lie past the end
+   *   of an array (or of a mapping). This is how to handle the tail of an array without reading
+   *   out of bounds. m256_maskstore_epi32 and m256_maskstore_epi64 are the corresponding stores.
+   *
+   * a) If __AVX2__ is defined, each is a single AVX2 instruction.
+   * b) If __AVX2__ is not defined, but __SSE2__ is, the loads and stores use the SSE2 versions over
+   *    each half. SSE has no masked loads, so those use the hand-written loops.
+   * c) Otherwise (including on NEON), we use memcpy and the hand-written loops. memcpy compiles to
+   *    ordinary vector loads and stores (e.g vld1q on NEON), and so there is no non-temporal store
+   *    here. NEON has no masked loads or stores either, so those stay as loops over the lanes.
+   */
+
+  /**
+   * m256_loadu_si256. Returns the 32 bytes starting at ptr, which need not be aligned. This mimics
+   * _mm256_loadu_si256.
+   */
+  template <typename T> static inline Vec256<T> m256_loadu_si256(const T *ptr) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_loadu_si256);
+    return AVX2::template m256_loadu_si256<T>(ptr);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_loadu_si256);
+    return SSE::template m256_loadu_si256<T>(ptr);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_loadu_si256);
+    return Plain::template m256_loadu_si256<T>(ptr);
+#endif
+  }
+
+  /**
+   * m256_storeu_si256. Writes a to the 32 bytes starting at ptr, which need not be aligned. This
+   * mimics _mm256_storeu_si256.
+   */
+  template <typename T> static inline void m256_storeu_si256(T *ptr, const Vec256<T> &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_storeu_si256);
+    AVX2::template m256_storeu_si256<T>(ptr, a);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_storeu_si256);
+    SSE::template m256_storeu_si256<T>(ptr, a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_storeu_si256);
+    Plain::template m256_storeu_si256<T>(ptr, a);
+#endif
+  }
+
+  /**
+   * m256_stream_si256. Writes a to the 32 bytes starting at ptr, bypassing the cache. ptr must be
+   * 32-byte aligned. This mimics _mm256_stream_si256.
+   */
+  template <typename T> static inline void m256_stream_si256(T *ptr, const Vec256<T> &a) noexcept
+  {
+    assert(reinterpret_cast<uintptr_t>(ptr) % 32 == 0);
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_stream_si256);
+    AVX2::template m256_stream_si256<T>(ptr, a);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_stream_si256);
+    SSE::template m256_stream_si256<T>(ptr, a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_stream_si256);
+    Plain::template m256_stream_si256<T>(ptr, a);
+#endif
+  }
+
+  /**
+   * stream_fence. Orders every preceding non-temporal store before any later store. This mimics
+   * _mm_sfence: on tiers without non-temporal stores, it's a release fence.
+   */
+  static inline void stream_fence() noexcept
+  {
+#ifdef __SSE2__
+    CPP_INTRIN_PROBE(SSE, stream_fence);
+    SSE::stream_fence();
+#else
+    CPP_INTRIN_PROBE(Plain, stream_fence);
+    Plain::stream_fence();
+#endif
+  }
+
+  /**
+   * m256_maskload_epi32. For all i: c[i] = (mask[i] < 0) ? ptr[i] : 0. ptr[i] is only read if
+   * mask[i] < 0. This mimics _mm256_maskload_epi32.
+   */
+  static inline epi32x8 m256_maskload_epi32(const int32_t *ptr, const epi32x8 &mask) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_maskload_epi32);
+    return AVX2::m256_maskload_epi32(ptr, mask);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_maskload_epi32);
+    return Plain::m256_maskload_epi32(ptr, mask);
+#endif
+  }
+
+  /**
+   * m256_maskload_epi64. For all i: c[i] = (mask[i] < 0) ? ptr[i] : 0. ptr[i] is only read if
+   * mask[i] < 0. This mimics _mm256_maskload_epi64.
+   */
+  static inline epi64x4 m256_maskload_epi64(const int64_t *ptr, const epi64x4 &mask) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_maskload_epi64);
+    return AVX2::m256_maskload_epi64(ptr, mask);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_maskload_epi64);
+    return Plain::m256_maskload_epi64(ptr, mask);
+#endif
+  }
+
+  /**
+   * m256_maskstore_epi32. For all i: if mask[i] < 0, then ptr[i] = a[i]. The other lanes of ptr
+   * are never touched. This mimics _mm256_maskstore_epi32.
+   */
+  static inline void m256_maskstore_epi32(int32_t *ptr, const epi32x8 &mask,
+                                          const epi32x8 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_maskstore_epi32);
+    AVX2::m256_maskstore_epi32(ptr, mask, a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_maskstore_epi32);
+    Plain::m256_maskstore_epi32(ptr, mask, a);
+#endif
+  }
+
+  /**
+   * m256_maskstore_epi64. For all i: if mask[i] < 0, then ptr[i] = a[i]. The other lanes of ptr
+   * are never touched. This mimics _mm256_maskstore_epi64.
+   */
+  static inline void m256_maskstore_epi64(int64_t *ptr, const epi64x4 &mask,
+                                          const epi64x4 &a) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_maskstore_epi64);
+    AVX2::m256_maskstore_epi64(ptr, mask, a);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_maskstore_epi64);
+    Plain::m256_maskstore_epi64(ptr, mask, a);
+#endif
+  }
+
+  /***
+   * Bulk kernels. The functions below apply a single operation over n contiguous vectors, i.e
+   * for all i in [0, n): c[i] = op(a[i], b[i]). Calling e.g m256_add_epi16 in a loop means that
+   * each iteration copies its inputs and outputs through std::arrays on the stack: keeping the
+   * loop inside the library lets the compiler keep everything in registers and unroll across
+   * iterations.
+   *
+   * Each function has an out-of-place form, where the results are written to c, and an in-place
+   * form, where the results overwrite a. The out-of-place form allows c == a (but no other overlap
+   * between c and the inputs): this is how the in-place form is implemented.
+   *
+   * As with the single-vector functions, we select the tier at compile-time: the same kernels are
+   * available via dispatch() for runtime selection.
+   */
+
+  /***
+   * m256_add_epi16_bulk. For all i in [0, n): c[i] = m256_add_epi16(a[i], b[i]).
+   */
+  static inline void m256_add_epi16_bulk(const epi16x16 *a,
+                                         const epi16x16 *b,
+                                         epi16x16 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_add_epi16_bulk);
+    AVX2::m256_add_epi16_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_add_epi16_bulk);
+    Plain::m256_add_epi16_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_add_epi16_bulk(epi16x16 *a, const epi16x16 *b, const size_t n) noexcept
+  {
+    m256_add_epi16_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_sub_epi16_bulk. For all i in [0, n): c[i] = m256_sub_epi16(a[i], b[i]).
+   */
+  static inline void m256_sub_epi16_bulk(const epi16x16 *a,
+                                         const epi16x16 *b,
+                                         epi16x16 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_sub_epi16_bulk);
+    AVX2::m256_sub_epi16_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_sub_epi16_bulk);
+    Plain::m256_sub_epi16_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_sub_epi16_bulk(epi16x16 *a, const epi16x16 *b, const size_t n) noexcept
+  {
+    m256_sub_epi16_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_adds_epi16_bulk. For all i in [0, n): c[i] = m256_adds_epi16(a[i], b[i]).
+   */
+  static inline void
+  m256_adds_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epi16_bulk);
+    AVX2::m256_adds_epi16_bulk(a, b, c, n);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_adds_epi16_bulk);
+    SSE::m256_adds_epi16_bulk(a, b, c, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_adds_epi16_bulk);
+    NEON::m256_adds_epi16_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_adds_epi16_bulk);
+    Plain::m256_adds_epi16_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_adds_epi16_bulk(epi16x16 *a, const epi16x16 *b, const size_t n) noexcept
+  {
+    m256_adds_epi16_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_subs_epi16_bulk. For all i in [0, n): c[i] = m256_subs_epi16(a[i], b[i]).
+   */
+  static inline void
+  m256_subs_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epi16_bulk);
+    AVX2::m256_subs_epi16_bulk(a, b, c, n);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_subs_epi16_bulk);
+    SSE::m256_subs_epi16_bulk(a, b, c, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_subs_epi16_bulk);
+    NEON::m256_subs_epi16_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_subs_epi16_bulk);
+    Plain::m256_subs_epi16_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_subs_epi16_bulk(epi16x16 *a, const epi16x16 *b, const size_t n) noexcept
+  {
+    m256_subs_epi16_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_adds_epu16_bulk. For all i in [0, n): c[i] = m256_adds_epu16(a[i], b[i]).
+   */
+  static inline void
+  m256_adds_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epu16_bulk);
+    AVX2::m256_adds_epu16_bulk(a, b, c, n);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_adds_epu16_bulk);
+    SSE::m256_adds_epu16_bulk(a, b, c, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_adds_epu16_bulk);
+    NEON::m256_adds_epu16_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_adds_epu16_bulk);
+    Plain::m256_adds_epu16_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_adds_epu16_bulk(epi16x16 *a, const epi16x16 *b, const size_t n) noexcept
+  {
+    m256_adds_epu16_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_subs_epu16_bulk. For all i in [0, n): c[i] = m256_subs_epu16(a[i], b[i]).
+   */
+  static inline void
+  m256_subs_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epu16_bulk);
+    AVX2::m256_subs_epu16_bulk(a, b, c, n);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_subs_epu16_bulk);
+    SSE::m256_subs_epu16_bulk(a, b, c, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_subs_epu16_bulk);
+    NEON::m256_subs_epu16_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_subs_epu16_bulk);
+    Plain::m256_subs_epu16_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_subs_epu16_bulk(epi16x16 *a, const epi16x16 *b, const size_t n) noexcept
+  {
+    m256_subs_epu16_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_adds_epu8_bulk. For all i in [0, n): c[i] = m256_adds_epu8(a[i], b[i]).
+   */
+  static inline void
+  m256_adds_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epu8_bulk);
+    AVX2::m256_adds_epu8_bulk(a, b, c, n);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_adds_epu8_bulk);
+    SSE::m256_adds_epu8_bulk(a, b, c, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_adds_epu8_bulk);
+    NEON::m256_adds_epu8_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_adds_epu8_bulk);
+    Plain::m256_adds_epu8_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_adds_epu8_bulk(epi8x32 *a, const epi8x32 *b, const size_t n) noexcept
+  {
+    m256_adds_epu8_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_subs_epu8_bulk. For all i in [0, n): c[i] = m256_subs_epu8(a[i], b[i]).
+   */
+  static inline void
+  m256_subs_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epu8_bulk);
+    AVX2::m256_subs_epu8_bulk(a, b, c, n);
+#elif defined(__SSE2__)
+    CPP_INTRIN_PROBE(SSE, m256_subs_epu8_bulk);
+    SSE::m256_subs_epu8_bulk(a, b, c, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_subs_epu8_bulk);
+    NEON::m256_subs_epu8_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_subs_epu8_bulk);
+    Plain::m256_subs_epu8_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_subs_epu8_bulk(epi8x32 *a, const epi8x32 *b, const size_t n) noexcept
+  {
+    m256_subs_epu8_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_xor_epi64_bulk. For all i in [0, n): c[i] = m256_xor_epi64(a[i], b[i]).
+   */
+  static inline void m256_xor_epi64_bulk(const epi64x4 *a,
+                                         const epi64x4 *b, epi64x4 *c,
+                                         const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_xor_epi64_bulk);
+    AVX2::m256_xor_epi64_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_xor_epi64_bulk);
+    Plain::m256_xor_epi64_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_xor_epi64_bulk(epi64x4 *a, const epi64x4 *b, const size_t n) noexcept
+  {
+    m256_xor_epi64_bulk(a, b, a, n);
+  }
+
+  /***
+   * m256_sign_epi16_bulk. For all i in [0, n): c[i] = m256_sign_epi16(a[i], b[i]).
+   * Unlike m256_sign_epi16, we don't check that a[i] != b[i]: that check would cost more than the
+   * operation itself.
+   */
+  static inline void m256_sign_epi16_bulk(const epi16x16 *a,
+                                          const epi16x16 *b,
+                                          epi16x16 *c, const size_t n) noexcept
+  {
+#ifdef __AVX2__
+    CPP_INTRIN_PROBE(AVX2, m256_sign_epi16_bulk);
+    AVX2::m256_sign_epi16_bulk(a, b, c, n);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_sign_epi16_bulk);
+    SSE::m256_sign_epi16_bulk(a, b, c, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_sign_epi16_bulk);
+    NEON::m256_sign_epi16_bulk(a, b, c, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_sign_epi16_bulk);
+    Plain::m256_sign_epi16_bulk(a, b, c, n);
+#endif
+  }
+
+  static inline void m256_sign_epi16_bulk(epi16x16 *a, const epi16x16 *b, const size_t n) noexcept
+  {
+    m256_sign_epi16_bulk(a, b, a, n);
+  }
+
+  /**
+   * m256_popcount_si256_bulk. Returns the total number of set bits in a[0], ..., a[n-1]. Unlike
+   * summing m256_popcount_si256 over each vector, this keeps the running counts in a vector
+   * register and only reduces them once at the end.
+   */
+  static inline uint64_t m256_popcount_si256_bulk(const epi64x4 *a, const size_t n) noexcept
+  {
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(VPOPCNTDQ, m256_popcount_si256_bulk);
+    return VPOPCNTDQ::m256_popcount_si256_bulk(a, n);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_popcount_si256_bulk);
+    return AVX2::m256_popcount_si256_bulk(a, n);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_popcount_si256_bulk);
+    return SSE::m256_popcount_si256_bulk(a, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_popcount_si256_bulk);
+    return NEON::m256_popcount_si256_bulk(a, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_popcount_si256_bulk);
+    return Plain::m256_popcount_si256_bulk(a, n);
+#endif
+  }
+
+  /**
+   * m256_xor_popcount_epi64_bulk. Returns the sum over all i in [0, n) of
+   * m256_xor_popcount_epi64(a[i], b[i]), i.e the Hamming distance between the two arrays.
+   */
+  static inline uint64_t
+  m256_xor_popcount_epi64_bulk(const epi64x4 *a, const epi64x4 *b, const size_t n) noexcept
+  {
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(VPOPCNTDQ, m256_xor_popcount_epi64_bulk);
+    return VPOPCNTDQ::m256_xor_popcount_epi64_bulk(a, b, n);
+#elif defined(__AVX2__)
+    CPP_INTRIN_PROBE(AVX2, m256_xor_popcount_epi64_bulk);
+    return AVX2::m256_xor_popcount_epi64_bulk(a, b, n);
+#elif defined(__SSSE3__)
+    CPP_INTRIN_PROBE(SSE, m256_xor_popcount_epi64_bulk);
+    return SSE::m256_xor_popcount_epi64_bulk(a, b, n);
+#elif CPP_INTRIN_NEON
+    CPP_INTRIN_PROBE(NEON, m256_xor_popcount_epi64_bulk);
+    return NEON::m256_xor_popcount_epi64_bulk(a, b, n);
+#else
+    CPP_INTRIN_PROBE(Plain, m256_xor_popcount_epi64_bulk);
+    return Plain::m256_xor_popcount_epi64_bulk(a, b, n);
+#endif
+  }
+
+#ifdef __AVX2__
+  /***
+   * Register-resident API. Every operation above takes and returns Vec256 objects, which live in
+   * memory as far as the language is concerned. When everything is inlined GCC and Clang are
+   * usually able to keep chained operations in registers anyway, but they aren't obliged to: at
+   * low optimisation levels, or across a call that isn't inlined, each intermediate is stored to
+   * the stack and reloaded, which costs a store-forwarding round trip per operation.
+   *
+   * If __AVX2__ is defined we also provide an overload of each operation that accepts and returns
+   * __m256i by value, e.g:
+   *
+   * const __m256i a = CPP_INTRIN::to_m256i(x), b = CPP_INTRIN::to_m256i(y);
+   * const __m256i c = CPP_INTRIN::m256_abs_epi16(CPP_INTRIN::m256_sub_epi16(a, b));
+   * const auto out  = CPP_INTRIN::from_m256i<int16_t>(c);
+   *
+   * Here the intermediate is passed in a YMM register. We only provide these for AVX2, as a
+   * __m256i can't be passed in a register without AVX: the Vec256 API is the portable one, and
+   * the AVX2 implementations of that API are layered on top of these overloads.
+   */
+  template <typename T> static inline __m256i to_m256i(const Vec256<T> &a) noexcept
+  {
+    return AVX2::to_m256i(a);
+  }
+
+  template <typename T> static inline Vec256<T> from_m256i(const __m256i a) noexcept
+  {
+    return AVX2::template from_m256i<T>(a);
+  }
+
+  static inline __m256i m256_hadd_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_hadd_epi16);
+    return AVX2::m256_hadd_epi16(a, b);
+  }
+
+  static inline __m256i m256_xor_epi64(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_xor_epi64);
+    return AVX2::m256_xor_epi64(a, b);
+  }
+
+  static inline __m256i m256_or_epi64(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_or_epi64);
+    return AVX2::m256_or_epi64(a, b);
+  }
+
+  static inline __m256i m256_and_epi64(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_and_epi64);
+    return AVX2::m256_and_epi64(a, b);
+  }
+
+  static inline __m256i m256_and_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_and_epi16);
+    return AVX2::m256_and_epi16(a, b);
+  }
+
+  static inline __m256i m256_cmpgt_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_cmpgt_epi16);
+    return AVX2::m256_cmpgt_epi16(a, b);
+  }
+
+  static inline __m256i m256_cmpeq_epi8(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_cmpeq_epi8);
+    return AVX2::m256_cmpeq_epi8(a, b);
+  }
+
+  static inline __m256i m256_cmpeq_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_cmpeq_epi16);
+    return AVX2::m256_cmpeq_epi16(a, b);
+  }
+
+  static inline __m256i m256_cmpgt_epi8(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_cmpgt_epi8);
+    return AVX2::m256_cmpgt_epi8(a, b);
+  }
+
+  static inline __m256i m256_cmplt_epi8(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_cmplt_epi8);
+    return AVX2::m256_cmplt_epi8(a, b);
+  }
+
+  static inline __m256i m256_cmplt_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_cmplt_epi16);
+    return AVX2::m256_cmplt_epi16(a, b);
+  }
+
+  static inline __m256i
+  m256_blendv_epi8(const __m256i a, const __m256i b, const __m256i mask) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_blendv_epi8);
+    return AVX2::m256_blendv_epi8(a, b, mask);
+  }
+
+  static inline uint32_t m256_movemask_epi8(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_movemask_epi8);
+    return AVX2::m256_movemask_epi8(a);
+  }
+
+  static inline uint32_t m256_movemask_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_movemask_epi16);
+    return AVX2::m256_movemask_epi16(a);
+  }
+
+  static inline __m256i m256_compress_epi16(const __m256i a, const uint32_t mask) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_compress_epi16);
+    return AVX2::m256_compress_epi16(a, mask);
+  }
+
+  static inline __m256i m256_permutevar8x32_epi32(const __m256i a, const __m256i idx) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_permutevar8x32_epi32);
+    return AVX2::m256_permutevar8x32_epi32(a, idx);
+  }
+
+  static inline __m256i m256_i32gather_epi32(const int32_t *base, const __m256i idx) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_i32gather_epi32);
+    return AVX2::m256_i32gather_epi32(base, idx);
+  }
+
+  static inline __m256i m256_i32gather_epi64(const int64_t *base, const __m256i idx) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_i32gather_epi64);
+    return AVX2::m256_i32gather_epi64(base, idx);
+  }
+
+  static inline __m256i m256_lut32_epi8(const __m256i table, const __m256i idx) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_lut32_epi8);
+    return AVX2::m256_lut32_epi8(table, idx);
+  }
+
+  static inline __m256i m256_lut16_epi16(const __m256i table, const __m256i idx) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_lut16_epi16);
+    return AVX2::m256_lut16_epi16(table, idx);
+  }
+
+  static inline __m256i m256_hadamard16_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_hadamard16_epi16);
+    return AVX2::m256_hadamard16_epi16(a);
+  }
+
+  static inline __m256i m256_sll_epi16(const __m256i a, const unsigned count) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_sll_epi16);
+    return AVX2::m256_sll_epi16(a, count);
+  }
+
+  static inline __m256i m256_srl_epi16(const __m256i a, const unsigned count) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_srl_epi16);
+    return AVX2::m256_srl_epi16(a, count);
+  }
+
+  static inline __m256i m256_sllv_epi32(const __m256i a, const __m256i count) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_sllv_epi32);
+    return AVX2::m256_sllv_epi32(a, count);
+  }
+
+  static inline __m256i m256_srlv_epi32(const __m256i a, const __m256i count) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_srlv_epi32);
+    return AVX2::m256_srlv_epi32(a, count);
+  }
+
+  static inline __m256i m256_sllv_epi64(const __m256i a, const __m256i count) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_sllv_epi64);
+    return AVX2::m256_sllv_epi64(a, count);
+  }
+
+  static inline __m256i m256_srlv_epi64(const __m256i a, const __m256i count) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_srlv_epi64);
+    return AVX2::m256_srlv_epi64(a, count);
+  }
+
+  static inline __m256i m256_shuffle_epi8(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_shuffle_epi8);
+    return AVX2::m256_shuffle_epi8(a, b);
+  }
+
+  static inline __m256i m256_shuffle_epi8_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_shuffle_epi8_epi16);
+    return AVX2::m256_shuffle_epi8(a, b);
+  }
+
+  static inline __m256i m256_add_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_add_epi16);
+    return AVX2::m256_add_epi16(a, b);
+  }
+
+  static inline __m256i m256_sub_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_sub_epi16);
+    return AVX2::m256_sub_epi16(a, b);
+  }
+
+  static inline __m256i m256_adds_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epi16);
+    return AVX2::m256_adds_epi16(a, b);
+  }
+
+  static inline __m256i m256_subs_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epi16);
+    return AVX2::m256_subs_epi16(a, b);
+  }
+
+  static inline __m256i m256_adds_epu16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epu16);
+    return AVX2::m256_adds_epu16(a, b);
+  }
+
+  static inline __m256i m256_subs_epu16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epu16);
+    return AVX2::m256_subs_epu16(a, b);
+  }
+
+  static inline __m256i m256_adds_epu8(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_adds_epu8);
+    return AVX2::m256_adds_epu8(a, b);
+  }
+
+  static inline __m256i m256_subs_epu8(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_subs_epu8);
+    return AVX2::m256_subs_epu8(a, b);
+  }
+
+  static inline __m256i m256_sign_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_sign_epi16);
+    return AVX2::m256_sign_epi16(a, b);
+  }
+
+  static inline bool m256_testz_si256(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_testz_si256);
+    return AVX2::m256_testz_si256(a, b);
+  }
+
+  template <int8_t imm8> static inline __m256i m256_permute4x64_epi64(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_permute4x64_epi64);
+    return AVX2::template m256_permute4x64_epi64<imm8>(a);
+  }
+
+  template <int8_t imm8> static inline __m256i m256_permute4x64_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_permute4x64_epi16);
+    return AVX2::template m256_permute4x64_epi64<imm8>(a);
+  }
+
+  template <int8_t imm8> static inline __m256i m256_slli_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_slli_epi16);
+    return AVX2::template m256_slli_epi16<imm8>(a);
+  }
+
+  template <int8_t imm8> static inline __m256i m256_srli_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_srli_epi16);
+    return AVX2::template m256_srli_epi16<imm8>(a);
+  }
+
+  template <int8_t imm8> static inline __m256i m256_srai_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_srai_epi16);
+    return AVX2::template m256_srai_epi16<imm8>(a);
+  }
+
+  static inline __m256i m256_mullo_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_mullo_epi16);
+    return AVX2::m256_mullo_epi16(a, b);
+  }
+
+  static inline __m256i m256_mulhi_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_mulhi_epi16);
+    return AVX2::m256_mulhi_epi16(a, b);
+  }
+
+  static inline __m256i m256_madd_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_madd_epi16);
+    return AVX2::m256_madd_epi16(a, b);
+  }
+
+  static inline __m256i m256_abs_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_abs_epi16);
+    return AVX2::m256_abs_epi16(a);
+  }
+
+  static inline __m256i m256_broadcastsi128_si256(const __m128i value) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_broadcastsi128_si256);
+    return AVX2::m256_broadcastsi128_si256(value);
+  }
+
+  template <unsigned pos> static inline int64_t mm_extract_epi64(const __m128i value) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, mm_extract_epi64);
+    return AVX2::template mm_extract_epi64<pos>(value);
+  }
+
+  template <unsigned pos> static inline __m128i m256_extracti128_si256(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_extracti128_si256);
+    return AVX2::template m256_extracti128_si256<pos>(a);
+  }
+
+  template <unsigned pos>
+  static inline __m256i m256_inserti128_si256(const __m256i a, const __m128i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_inserti128_si256);
+    return AVX2::template m256_inserti128_si256<pos>(a, b);
+  }
+
+  template <unsigned pos> static inline int16_t m256_extract_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_extract_epi16);
+    return AVX2::template m256_extract_epi16<pos>(a);
+  }
+
+  template <unsigned pos> static inline int64_t m256_extract_epi64(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_extract_epi64);
+    return AVX2::template m256_extract_epi64<pos>(a);
+  }
+
+  static inline __m256i m256_unpacklo_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_unpacklo_epi16);
+    return AVX2::m256_unpacklo_epi16(a, b);
+  }
+
+  static inline __m256i m256_unpackhi_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_unpackhi_epi16);
+    return AVX2::m256_unpackhi_epi16(a, b);
+  }
+
+  static inline __m256i m256_unpacklo_epi32(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_unpacklo_epi32);
+    return AVX2::m256_unpacklo_epi32(a, b);
+  }
+
+  static inline __m256i m256_unpackhi_epi32(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_unpackhi_epi32);
+    return AVX2::m256_unpackhi_epi32(a, b);
+  }
+
+  static inline __m256i m256_subabs_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_subabs_epi16);
+    return AVX2::m256_subabs_epi16(a, b);
+  }
+
+  static inline bool
+  m256_and_testz_si256(const __m256i a, const __m256i b, const __m256i c) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_and_testz_si256);
+    return AVX2::m256_and_testz_si256(a, b, c);
+  }
+
+  static inline unsigned m256_xor_popcount_epi64(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_xor_popcount_epi64);
+    return AVX2::m256_xor_popcount_epi64(a, b);
+  }
+
+  static inline int16_t m256_hadd_reduce_epi16(const __m256i a, const __m256i b) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_hadd_reduce_epi16);
+    return AVX2::m256_hadd_reduce_epi16(a, b);
+  }
+
+  static inline int32_t m256_reduce_add_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_reduce_add_epi16);
+    return AVX2::m256_reduce_add_epi16(a);
+  }
+
+  static inline int16_t m256_reduce_min_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_reduce_min_epi16);
+    return AVX2::m256_reduce_min_epi16(a);
+  }
+
+  static inline int16_t m256_reduce_max_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_reduce_max_epi16);
+    return AVX2::m256_reduce_max_epi16(a);
+  }
+
+  static inline unsigned m256_reduce_argmax_epi16(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_reduce_argmax_epi16);
+    return AVX2::m256_reduce_argmax_epi16(a);
+  }
+
+  static inline __m256i m256_popcount_epi8(const __m256i a) noexcept
+  {
+    CPP_INTRIN_PROBE(AVX2, m256_popcount_epi8);
+    return AVX2::m256_popcount_epi8(a);
+  }
+
+  static inline __m256i m256_popcount_epi64(const __m256i a) noexcept
+  {
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(VPOPCNTDQ, m256_popcount_epi64);
+    return VPOPCNTDQ::m256_popcount_epi64(a);
+#else
+    CPP_INTRIN_PROBE(AVX2, m256_popcount_epi64);
+    return AVX2::m256_popcount_epi64(a);
+#endif
+  }
+
+  static inline unsigned m256_popcount_si256(const __m256i a) noexcept
+  {
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    CPP_INTRIN_PROBE(VPOPCNTDQ, m256_popcount_si256);
+    return VPOPCNTDQ::m256_popcount_si256(a);
+#else
+    CPP_INTRIN_PROBE(AVX2, m256_popcount_si256);
+    return AVX2::m256_popcount_si256(a);
+#endif
+  }
+#endif
+
+  /***
+   * Expr. This struct is a small expression-template layer over the element-wise 16-bit
+   * operations. Rather than computing each operation into a vector and passing that on to the next
+   * one, the functions in Expr build a description of the whole chain, which is only evaluated when
+   * it's passed to one of eval, testz or reduce_add. Evaluation is a single loop over the 16 lanes,
+   * with the whole chain applied to each lane in turn, and so no intermediate vectors are ever
+   * materialised. For example:
+   *
+   * using E = CPP_INTRIN::Expr;
+   * const auto c    = E::eval(E::abs(E::sub(a, b)));        // m256_abs_epi16(m256_sub_epi16(a, b))
+   * const bool zero = E::testz(E::bit_and(E::bit_and(a, b), c)); // m256_and_testz_si256(a, b, c)
+   *
+   * The evaluation loop is plain C++, so it's available on every tier: the compiler is free to
+   * vectorise it with whatever instruction set is enabled. Each lane is computed with exactly the
+   * same semantics as the corresponding Plain operation.
+   *
+   * Leaves hold a reference to their vector, exactly like the arguments to every other function in
+   * this file: this means that an expression must be evaluated while its inputs are still alive,
+   * which is easiest to guarantee by building and evaluating it in the same statement. We tried
+   * storing copies instead, but GCC 12 then spills every leaf to the stack before evaluating.
+   * Leaves can also only be built from Vec256 objects: a std::array would first need
+   * to be converted into a temporary, which would be destroyed before the expression is evaluated.
+   *
+   * Only the lane-wise operations are provided here: operations that move data between lanes (e.g
+   * m256_hadd_epi16 or m256_shuffle_epi8) can't be evaluated one lane at a time.
+   */
+  struct Expr
+  {
+    struct Leaf
+    {
+      const epi16x16 &value;
+      int16_t operator[](const unsigned i) const noexcept
+      {
+        return value[i];
+      }
+    };
+
+    template <typename F, typename A> struct Unary
+    {
+      A a;
+      int16_t operator[](const unsigned i) const noexcept
+      {
+        return F::apply(a[i]);
+      }
+    };
+
+    template <typename F, typename A, typename B> struct Binary
+    {
+      A a;
+      B b;
+      int16_t operator[](const unsigned i) const noexcept
+      {
+        return F::apply(a[i], b[i]);
+      }
+    };
+
+    // These are the per-lane operations. Each mirrors the matching Plain implementation.
+    struct AddOp
+    {
+      static inline int16_t apply(const int16_t a, const int16_t b) noexcept
+      {
+        return static_cast<int16_t>(a + b);
+      }
+    };
+
+    struct SubOp
+    {
+      static inline int16_t apply(const int16_t a, const int16_t b) noexcept
+      {
+        return static_cast<int16_t>(a - b);
+      }
+    };
+
+    struct AndOp
+    {
+      static inline int16_t apply(const int16_t a, const int16_t b) noexcept
+      {
+        return a & b;
+      }
+    };
+
+    struct OrOp
+    {
+      static inline int16_t apply(const int16_t a, const int16_t b) noexcept
+      {
+        return a | b;
+      }
+    };
+
+    struct XorOp
+    {
+      static inline int16_t apply(const int16_t a, const int16_t b) noexcept
+      {
+        return a ^ b;
+      }
+    };
+
+    struct SignOp
+    {
+      static inline int16_t apply(const int16_t a, const int16_t b) noexcept
+      {
+        return static_cast<int16_t>(a * e_sign(b));
+      }
+    };
+
+    struct CmpgtOp
+    {
+      static inline int16_t apply(const int16_t a, const int16_t b) noexcept
+      {
+        return (a > b) ? -1 : 0;
+      }
+    };
+
+    struct AbsOp
+    {
+      static inline int16_t apply(const int16_t a) noexcept
+      {
+        const int16_t signed_extend = a >> (CHAR_BIT * sizeof(int16_t) - 1);
+        return static_cast<int16_t>((a ^ signed_extend) - signed_extend);
+      }
+    };
+
+    // wrap turns a vector into a leaf, and passes any other expression through unchanged.
+    static inline Leaf wrap(const epi16x16 &a) noexcept
+    {
+      return Leaf{a};
+    }
+
+    static inline Leaf wrap(const std::array<int16_t, 16> &) noexcept = delete;
+
+    static inline Leaf wrap(const Leaf &a) noexcept
+    {
+      return a;
+    }
+
+    template <typename F, typename A> static inline Unary<F, A> wrap(const Unary<F, A> &a) noexcept
+    {
+      return a;
+    }
+
+    template <typename F, typename A, typename B>
+    static inline Binary<F, A, B> wrap(const Binary<F, A, B> &a) noexcept
+    {
+      return a;
+    }
+
+    template <typename F, typename A, typename B>
+    using binary_t =
+        Binary<F, decltype(wrap(std::declval<A>())), decltype(wrap(std::declval<B>()))>;
+
+    template <typename F, typename A>
+    using unary_t = Unary<F, decltype(wrap(std::declval<A>()))>;
+
+    template <typename A, typename B>
+    static inline binary_t<AddOp, A, B> add(const A &a, const B &b) noexcept
+    {
+      return {wrap(a), wrap(b)};
+    }
+
+    template <typename A, typename B>
+    static inline binary_t<SubOp, A, B> sub(const A &a, const B &b) noexcept
+    {
+      return {wrap(a), wrap(b)};
+    }
+
+    template <typename A, typename B>
+    static inline binary_t<AndOp, A, B> bit_and(const A &a, const B &b) noexcept
+    {
+      return {wrap(a), wrap(b)};
+    }
+
+    template <typename A, typename B>
+    static inline binary_t<OrOp, A, B> bit_or(const A &a, const B &b) noexcept
+    {
+      return {wrap(a), wrap(b)};
+    }
+
+    template <typename A, typename B>
+    static inline binary_t<XorOp, A, B> bit_xor(const A &a, const B &b) noexcept
+    {
+      return {wrap(a), wrap(b)};
+    }
+
+    template <typename A, typename B>
+    static inline binary_t<SignOp, A, B> sign(const A &a, const B &b) noexcept
+    {
+      return {wrap(a), wrap(b)};
+    }
+
+    template <typename A, typename B>
+    static inline binary_t<CmpgtOp, A, B> cmpgt(const A &a, const B &b) noexcept
+    {
+      return {wrap(a), wrap(b)};
+    }
+
+    template <typename A> static inline unary_t<AbsOp, A> abs(const A &a) noexcept
+    {
+      return {wrap(a)};
+    }
+
+    // eval. Evaluates `e` into a vector.
+    template <typename E> static inline epi16x16 eval(const E &e) noexcept
+    {
+      const auto expr = wrap(e);
+      epi16x16 out;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        out[i] = expr[i];
+      }
+      return out;
+    }
+
+    // testz. Returns true if every lane of `e` is zero.
+    template <typename E> static inline bool testz(const E &e) noexcept
+    {
+      const auto expr = wrap(e);
+      int16_t total   = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        total |= expr[i];
+      }
+      return total == 0;
+    }
+
+    // reduce_add. Returns the wrapping sum of every lane of `e`.
+    template <typename E> static inline int16_t reduce_add(const E &e) noexcept
+    {
+      const auto expr = wrap(e);
+      uint16_t total  = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        total = static_cast<uint16_t>(total + static_cast<uint16_t>(expr[i]));
+      }
+      return static_cast<int16_t>(total);
+    }
+  };
+
+  /***
+   * Plain. This struct contains the hand-written C++ implementation of every operation above.
+   * These are exactly the fallbacks that the public functions use when the relevant intrinsics
+   * aren't available at compile-time. Because these are written in plain C++ they can be compiled
+   * for any platform, and they're also the reference semantics for the other tiers.
+   */
+  struct Plain
+  {
+    static inline epi16x16 m256_hadd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      // A clever compiler will unroll this into two separate batches of mov instructions:
+      // this just makes it easier to check the semantics.
+      for (unsigned int i = 0; i < 16; i += 8)
+      {
+        c[i + 0] = a[i + 0] + a[i + 1];
+        c[i + 1] = a[i + 2] + a[i + 3];
+        c[i + 2] = a[i + 4] + a[i + 5];
+        c[i + 3] = a[i + 6] + a[i + 7];
+        c[i + 4] = b[i + 0] + b[i + 1];
+        c[i + 5] = b[i + 2] + b[i + 3];
+        c[i + 6] = b[i + 4] + b[i + 5];
+        c[i + 7] = b[i + 6] + b[i + 7];
+      }
+      return c;
+    }
+
+    static inline constexpr epi64x4 m256_xor_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      epi64x4 c{};
+      // Simply xor them together!
+      for (unsigned i = 0; i < 4; i++)
+      {
+        c[i] = a[i] ^ b[i];
+      }
+      return c;
+    }
+
+    static inline constexpr epi64x4 m256_or_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      epi64x4 c{};
+      // Simply OR them together!
+      for (unsigned i = 0; i < 4; i++)
+      {
+        c[i] = a[i] | b[i];
+      }
+      return c;
+    }
+
+    static inline constexpr epi64x4 m256_and_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      epi64x4 c{};
+      // Simply AND them together!
+      for (unsigned i = 0; i < 4; i++)
+      {
+        c[i] = a[i] & b[i];
+      }
+      return c;
+    }
+
+    static inline constexpr epi16x16 m256_and_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c{};
+      // Simply AND them together!
+      for (unsigned i = 0; i < 16; i++)
+      {
+        c[i] = a[i] & b[i];
+      }
+      return c;
+    }
+
+    static inline constexpr epi16x16
+    m256_cmpgt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c{};
+      // A sensible compiler will unroll this and produce somewhat good vectorised
+      // code, but not quite optimal code (as of GCC 10.2).
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        // This works as follows:
+        // a[i] > b[i] evaluates to 0 or 1.
+        // If 0, then c[i] = 0.
+        // If 1, then c[i] = 0xFFFF,
+        // which matches the semantics of cmpgt_epi16 exactly.
+        c[i] = (a[i] > b[i]) * 0xFFFF;
+      }
+      return c;
+    }
+
+    static inline epi8x32 m256_cmpeq_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        c[i] = static_cast<int8_t>(-int(a[i] == b[i]));
+      }
+      return c;
+    }
+
+    static inline epi16x16 m256_cmpeq_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        c[i] = static_cast<int16_t>(-int(a[i] == b[i]));
+      }
+      return c;
+    }
+
+    static inline epi8x32 m256_cmpgt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        c[i] = static_cast<int8_t>(-int(a[i] > b[i]));
+      }
+      return c;
+    }
+
+    static inline epi8x32 m256_cmplt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        c[i] = static_cast<int8_t>(-int(a[i] < b[i]));
+      }
+      return c;
+    }
+
+    static inline epi16x16 m256_cmplt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        c[i] = static_cast<int16_t>(-int(a[i] < b[i]));
+      }
+      return c;
+    }
+
+    static inline epi8x32 m256_blendv_epi8(const epi8x32 &a, const epi8x32 &b,
+                                           const epi8x32 &mask) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        // GCC 12 doesn't vectorise this loop if it's written with a ternary, so instead we
+        // broadcast the top bit of each byte and select with bitwise operations.
+        const int8_t select = static_cast<int8_t>(mask[i] >> 7);
+        c[i]                = static_cast<int8_t>((a[i] & ~select) | (b[i] & select));
+      }
+      return c;
+    }
+
+    static inline uint32_t m256_movemask_epi8(const epi8x32 &a) noexcept
+    {
+      uint32_t mask = 0;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        mask |= uint32_t(static_cast<uint8_t>(a[i]) >> 7) << i;
+      }
+      return mask;
+    }
+
+    static inline uint32_t m256_movemask_epi16(const epi16x16 &a) noexcept
+    {
+      uint32_t mask = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        mask |= uint32_t(static_cast<uint16_t>(a[i]) >> 15) << i;
+      }
+      return mask;
+    }
+
+    static inline epi16x16 m256_compress_epi16(const epi16x16 &a, const uint32_t mask) noexcept
+    {
+      // We write every lane, but only advance past the ones we keep: this is branch-free, and
+      // the write is always in bounds, as pos <= i.
+      epi16x16 c;
+      unsigned pos = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        c[pos] = a[i];
+        pos += (mask >> i) & 1;
+      }
+      for (unsigned i = pos; i < 16; i++)
+      {
+        c[i] = 0;
+      }
+      return c;
+    }
+
+    static inline epi32x8 m256_permutevar8x32_epi32(const epi32x8 &a, const epi32x8 &idx) noexcept
+    {
+      epi32x8 c;
+      for (unsigned i = 0; i < 8; i++)
+      {
+        c[i] = a[idx[i] & 7];
+      }
+      return c;
+    }
+
+    static inline epi32x8 m256_i32gather_epi32(const int32_t *base, const epi32x8 &idx) noexcept
+    {
+      epi32x8 c;
+      for (unsigned i = 0; i < 8; i++)
+      {
+        c[i] = base[idx[i]];
+      }
+      return c;
+    }
+
+    static inline epi64x4 m256_i32gather_epi64(const int64_t *base, const epi32x8 &idx) noexcept
+    {
+      epi64x4 c;
+      for (unsigned i = 0; i < 4; i++)
+      {
+        c[i] = base[idx[i]];
+      }
+      return c;
+    }
+
+    static inline epi8x32 m256_lut32_epi8(const epi8x32 &table, const epi8x32 &idx) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        c[i] = table[idx[i] & 31];
+      }
+      return c;
+    }
+
+    static inline epi8x32 m256_lut64_epi8(const epi8x64 &table, const epi8x32 &idx) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        c[i] = table[idx[i] & 63];
+      }
+      return c;
+    }
+
+    static inline epi16x16 m256_lut16_epi16(const epi16x16 &table, const epi16x16 &idx) noexcept
+    {
+      epi16x16 c;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        c[i] = table[idx[i] & 15];
+      }
+      return c;
+    }
+
+    static inline epi16x16 m256_lut32_epi16(const epi16x32 &table, const epi16x16 &idx) noexcept
+    {
+      epi16x16 c;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        c[i] = table[idx[i] & 31];
+      }
+      return c;
+    }
+
+    // One stage of the Walsh-Hadamard transform of the n lanes starting at x: the butterflies
+    // between lanes that are h apart. The arithmetic is done on uint16_t, so that it wraps around
+    // without undefined behaviour.
+    template <unsigned n, unsigned h>
+    static inline void hadamard_stage_epi16(int16_t *const x) noexcept
+    {
+      for (unsigned i = 0; i < n; i += 2 * h)
+      {
+        for (unsigned j = i; j < i + h; j++)
+        {
+          const auto u = static_cast<uint16_t>(x[j]);
+          const auto v = static_cast<uint16_t>(x[j + h]);
+          x[j]         = static_cast<int16_t>(static_cast<uint16_t>(u + v));
+          x[j + h]     = static_cast<int16_t>(static_cast<uint16_t>(u - v));
+        }
+      }
+    }
+
+    // The Walsh-Hadamard transform of the n lanes starting at x, in place. Each stage is
+    // instantiated separately, so that all of its loop bounds are constants, which lets GCC
+    // vectorise the stages. With h as a loop variable instead, GCC 12 emits the whole transform
+    // as a scalar loop, which is around three times slower: the codegen checks in intrinsics.c.cpp
+    // catch this.
+    template <unsigned n, unsigned... s>
+    static inline void hadamard_epi16(int16_t *const x,
+                                      std::integer_sequence<unsigned, s...>) noexcept
+    {
+      (hadamard_stage_epi16<n, 1u << s>(x), ...);
+    }
+
+    template <unsigned n> static inline void hadamard_epi16(int16_t *const x) noexcept
+    {
+      static_assert(n != 0 && (n & (n - 1)) == 0, "n must be a power of two");
+      constexpr auto stages = static_cast<unsigned>(__builtin_ctz(n));
+      hadamard_epi16<n>(x, std::make_integer_sequence<unsigned, stages>{});
+    }
+
+    static inline epi16x16 m256_hadamard16_epi16(const epi16x16 &a) noexcept
+    {
+      epi16x16 c = a;
+      hadamard_epi16<16>(c.data());
+      return c;
+    }
+
+    static inline epi16x32 m512_hadamard32_epi16(const epi16x32 &a) noexcept
+    {
+      epi16x32 c = a;
+      hadamard_epi16<32>(c.data());
+      return c;
+    }
+
+    // The four vectors are separate objects, so we can't index across them: the transform runs on
+    // a copy of their lanes in a single array instead, as m512_hadamard32_epi16 does. GCC turns the
+    // copies into vector loads and stores.
+    static inline void m256_hadamard64_epi16(const epi16x16 *a, epi16x16 *c) noexcept
+    {
+      int16_t x[64];
+      for (unsigned i = 0; i < 4; i++)
+      {
+        std::memcpy(x + 16 * i, a[i].data(), sizeof(a[i]));
+      }
+      hadamard_epi16<64>(x);
+      for (unsigned i = 0; i < 4; i++)
+      {
+        std::memcpy(c[i].data(), x + 16 * i, sizeof(c[i]));
+      }
+    }
+
+    static inline void m256_hadamard16_epi16_bulk(const epi16x16 *a, epi16x16 *c,
+                                                  const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_hadamard16_epi16(a[i]);
+      }
+    }
+
+    // Large counts give zero, and so we deal with them up front: this keeps the loops free of
+    // branches. As with m256_srli_epi16, we shift unsigned values. GCC vectorises these by widening
+    // each lane to 32 bits (the shift happens after integer promotion), which is why the SSE2 and
+    // AVX2 versions use the shift-by-register intrinsics instead.
+    static inline epi16x16 m256_sll_epi16(const epi16x16 &a, const unsigned count) noexcept
+    {
+      epi16x16 c{};
+      if (count > 15)
+      {
+        return c;
+      }
+      for (unsigned i = 0; i < 16; i++)
+      {
+        c[i] = static_cast<int16_t>(static_cast<uint16_t>(a[i]) << count);
+      }
+      return c;
+    }
+
+    static inline epi16x16 m256_srl_epi16(const epi16x16 &a, const unsigned count) noexcept
+    {
+      epi16x16 c{};
+      if (count > 15)
+      {
+        return c;
+      }
+      for (unsigned i = 0; i < 16; i++)
+      {
+        c[i] = static_cast<int16_t>(static_cast<uint16_t>(a[i]) >> count);
+      }
+      return c;
+    }
+
+    // The mask zeroes lanes whose count is too large, and the masked count keeps the shift
+    // defined: these are branch-free, which lets GCC vectorise the loops.
+    static inline epi32x8 m256_sllv_epi32(const epi32x8 &a, const epi32x8 &count) noexcept
+    {
+      epi32x8 c;
+      for (unsigned i = 0; i < 8; i++)
+      {
+        const uint32_t n = static_cast<uint32_t>(count[i]);
+        c[i] = static_cast<int32_t>((static_cast<uint32_t>(a[i]) << (n & 31)) & -uint32_t(n < 32));
+      }
+      return c;
+    }
+
+    static inline epi32x8 m256_srlv_epi32(const epi32x8 &a, const epi32x8 &count) noexcept
+    {
+      epi32x8 c;
+      for (unsigned i = 0; i < 8; i++)
+      {
+        const uint32_t n = static_cast<uint32_t>(count[i]);
+        c[i] = static_cast<int32_t>((static_cast<uint32_t>(a[i]) >> (n & 31)) & -uint32_t(n < 32));
+      }
+      return c;
+    }
+
+    static inline epi64x4 m256_sllv_epi64(const epi64x4 &a, const epi64x4 &count) noexcept
+    {
+      epi64x4 c;
+      for (unsigned i = 0; i < 4; i++)
+      {
+        const uint64_t n = static_cast<uint64_t>(count[i]);
+        c[i] = static_cast<int64_t>((static_cast<uint64_t>(a[i]) << (n & 63)) & -uint64_t(n < 64));
+      }
+      return c;
+    }
+
+    static inline epi64x4 m256_srlv_epi64(const epi64x4 &a, const epi64x4 &count) noexcept
+    {
+      epi64x4 c;
+      for (unsigned i = 0; i < 4; i++)
+      {
+        const uint64_t n = static_cast<uint64_t>(count[i]);
+        c[i] = static_cast<int64_t>((static_cast<uint64_t>(a[i]) >> (n & 63)) & -uint64_t(n < 64));
+      }
+      return c;
+    }
+
+    static inline constexpr epi8x32 m256_shuffle_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c{};
+      // This loop would be nicer written as two separate loops,
+      // but we're hoping to build a pattern that a sensible compiler
+      // can recognise as reasonable (i.e something that tightly matches to
+      // the _mm256_shuffle_epi8 semantics)
+
+      // This function has weird semantics, because the _mm256_shuffle_epi8 is
+      // a single-lane shuffle. Essentially, it does not allow you to move across
+      // 2 128-bit chunks at once: instead, the shuffle is localised to each
+      // 128-bit vector. This means it is faster, but also weird.
+      //
+      // The algorithm at
+      // https://software.intel.com/sites/landingpage/IntrinsicsGuide/#text=_mm256_shuffle_epi8&expand=5156
+      // is somewhat descriptive: our variant is similar, but it's entirely
+      // branchless with a sensible compiler. Originally we used the branchy
+      // version like the original algorithm, but it generated very poor object
+      // code. The idea is as follows: view b as an array of bytes of size 32. If
+      // the leading bit of some byte b[i] is not set, we skip it (i.e we set the
+      // index c[i] = 0). Otherwise, we set c[i] = a[pos], where pos consists of
+      // the final 4 bits of b[i]. Note that this is only 4 bits, because we have
+      // at most 16 options to choose from, and so we need exactly 4 bits. The
+      // same is true for the second part: it's just shifted by 16 (i.e over the
+      // other lane). You can write this as two one-liners if you'd prefer, but
+      // this is somewhat neater. and the object code is approximately the same.
+
+      // The (1^(...)) trick is a trick for negating the final bit of the number.
+      // Here's how it works: if flag == 0 then the shift gives 1: 1-1  = 0, and so the
+      // ^ gives 1. By contrast, if flag == 1 then the shift gives 2: 2-1 = 1, and so the ^ gives 0.
+      // This can be generalised to n-many bits by changing the 1 to n.
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        const int16_t flag = (b[i] & 0x80) >> 7;
+        assert(flag == 0 || flag == 1);
+        const unsigned pos = b[i] & 0x0F;
+        c[i]               = int8_t((1 ^ ((1u << flag) - 1))) * a[pos];
+
+        const unsigned flag2 = (b[i + 16] & 0x80) >> 7;
+        assert(flag2 == 0 || flag2 == 1);
+
+        const unsigned pos2 = b[i + 16] & 0x0F;
+        c[i + 16]           = int8_t((1 ^ ((1u << flag2) - 1))) * a[pos2 + 16];
+      }
+      return c;
+    }
+
+    static inline constexpr epi16x16 m256_add_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c{};
+      // Note; this very trivial for-loop should be trivial for the compiler to
+      // optimise, especially if it knows the size of the arrays ahead of time
+      // (which it does!)
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        c[i] = a[i] + b[i];
+      }
+      return c;
+    }
+
+    static inline bool m256_testz_si256(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      // We only care whether any bit of (a & b) is set, not how many there are: so rather than
+      // a popcount, we just or the lanes together. This is a single pass that GCC vectorises.
+      int16_t total = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        total |= a[i] & b[i];
+      }
+      return total == 0;
+    }
+
+    static inline constexpr epi16x16 m256_sub_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c{};
+      // Note; this very trivial for-loop should be trivial for the compiler to
+      // optimise, especially if it knows the size of the arrays ahead of time
+      // (which it does!)
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        c[i] = a[i] - b[i];
+      }
+
+      return c;
+    }
+
+    // The saturating operations compute the exact result as an int32_t and clamp it to the range of
+    // U, which is the type that the lanes are interpreted as. There are no branches, and so GCC
+    // vectorises the loops.
+    template <typename U> static inline U saturate(const int32_t x) noexcept
+    {
+      constexpr int32_t lo = std::numeric_limits<U>::min();
+      constexpr int32_t hi = std::numeric_limits<U>::max();
+      return static_cast<U>(std::min(std::max(x, lo), hi));
+    }
+
+    static inline epi16x16 m256_adds_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        const int32_t x = int32_t(int16_t(a[i])) + int16_t(b[i]);
+        c[i]            = static_cast<int16_t>(saturate<int16_t>(x));
+      }
+      return c;
+    }
+
+    static inline epi16x16 m256_subs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        const int32_t x = int32_t(int16_t(a[i])) - int16_t(b[i]);
+        c[i]            = static_cast<int16_t>(saturate<int16_t>(x));
+      }
+      return c;
+    }
+
+    static inline epi16x16 m256_adds_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        const int32_t x = int32_t(uint16_t(a[i])) + uint16_t(b[i]);
+        c[i]            = static_cast<int16_t>(saturate<uint16_t>(x));
+      }
+      return c;
+    }
+
+    static inline epi16x16 m256_subs_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        const int32_t x = int32_t(uint16_t(a[i])) - uint16_t(b[i]);
+        c[i]            = static_cast<int16_t>(saturate<uint16_t>(x));
+      }
+      return c;
+    }
+
+    static inline epi8x32 m256_adds_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        const int32_t x = int32_t(uint8_t(a[i])) + uint8_t(b[i]);
+        c[i]            = static_cast<int8_t>(saturate<uint8_t>(x));
+      }
+      return c;
+    }
+
+    static inline epi8x32 m256_subs_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        const int32_t x = int32_t(uint8_t(a[i])) - uint8_t(b[i]);
+        c[i]            = static_cast<int8_t>(saturate<uint8_t>(x));
+      }
+      return c;
+    }
+
+    static inline constexpr epi16x16 m256_sign_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c{};
+      // This function is rather simple: we extract the signs of each b[i] and
+      // multiply a[i] by them.
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        c[i] = a[i] * e_sign(b[i]);
+      }
+      return c;
+    }
+
+    template <int8_t imm8>
+    static inline constexpr epi64x4
+    m256_permute4x64_epi64(const epi64x4 &a) noexcept
+    {
+      // As in the contract, the size needs to be 4.
+      epi64x4 b{};
+      // This function works as follows: grabs the index from each of the bytes of
+      // imm8 We isolate these bytes by bitwise ops, and then shift if necessary
+      // Note; these are constexpr variables, which means that these masks are
+      // computed at compile-time. As a result, this is just a series of mov
+      // instructions, which occur at a rate of approximately 4 per clock: a
+      // clever compiler will interleave these movs to hide the latency.
+      constexpr unsigned zero =
+          (imm8 & BitPatterns::int8_zero_pair_mask) >> BitPatterns::int8_zero_pair_shift;
+      constexpr unsigned first =
+          (imm8 & BitPatterns::int8_first_pair_mask) >> BitPatterns::int8_first_pair_shift;
+      constexpr unsigned second =
+          (imm8 & BitPatterns::int8_second_pair_mask) >> BitPatterns::int8_second_pair_shift;
+      // This doesn't require a shift because the bytes are already in the
+      // bottom-most byte.
+      constexpr unsigned third =
+          (imm8 & BitPatterns::int8_third_pair_mask) >> BitPatterns::int8_third_pair_shift;
+
+      // These asserts are just to make sure that the code statically does the
+      // right thing.
+      static_assert(zero < 4, "Error: zero >= size.");
+      static_assert(first < 4, "Error: first >= size.");
+      static_assert(second < 4, "Error: second >= size.");
+      static_assert(third < 4, "Error: third >= size.");
+
+      // Finally, we do the permutation and return.
+      b[0] = a[zero];
+      b[1] = a[first];
+      b[2] = a[second];
+      b[3] = a[third];
+      return b;
+    }
+
+    template <int8_t imm8>
+    static inline constexpr epi16x16 m256_slli_epi16(const epi16x16 &a) noexcept
+    {
+      epi16x16 b{};
+      // Because left-shift is well-defined, the compiler will actually just implement
+      // this as either two 128-bit shifts or one 256-bit shift. In other words, this is
+      // an easy thing for the compiler to optimise.
+      // Note; this will cause constants to exist in your instruction cache. This is because
+      // imm8 needs to be an immediate for this to compile properly. If you do not know why this
+      // matters, don't worry. (short answer: bigger entry -- fewer entries -- not great). But,
+      // this is unfixable.
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        // The shift is done on the unsigned value: shifting a negative value left is undefined
+        // before C++20, and so it isn't allowed in a constant expression.
+        b[i] = static_cast<int16_t>(static_cast<uint32_t>(static_cast<uint16_t>(a[i])) << imm8);
+      }
+
+      return b;
+    }
+
+    template <int8_t imm8>
+    static inline constexpr epi16x16 m256_srli_epi16(const epi16x16 &a) noexcept
+    {
+      epi16x16 b{};
+      // Right-shift is not well-defined for signed values.
+      //
+      // In particular,
+      // the C and C++ standards take the view that shifting a value should not change its sign.
+      // This means that here we need to explicitly tell the compiler that we want to shift in 0s
+      // by throwing away the 'signedness' for the shift operation. If we don't do this, then the
+      // compiler *will* generate vectorised code, but the semantics of the operation are
+      // completely different (i.e the leading bits now depend on the sign). This is the sort of
+      // bug that would be nigh-on impossible to find, so this comment is meant to draw your
+      // attention to it.
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        b[i] = static_cast<int16_t>((static_cast<uint16_t>(a[i]) >> imm8));
+      }
+      return b;
+    }
+
+    template <int8_t imm8>
+    static inline constexpr epi16x16 m256_srai_epi16(const epi16x16 &a) noexcept
+    {
+      // Unlike m256_srli_epi16, here we want the sign to be shifted in, which is exactly what
+      // shifting a signed value does (this is guaranteed from C++20, and GCC has always done it).
+      // Shifts by more than 15 behave like a shift by 15, just as with the intrinsic: clamping
+      // also means we never shift by more than the width of the type.
+      constexpr unsigned count = static_cast<uint8_t>(imm8);
+      constexpr unsigned shift = (count > 15) ? 15 : count;
+      epi16x16 b{};
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        b[i] = static_cast<int16_t>(a[i] >> shift);
+      }
+      return b;
+    }
+
+    static inline constexpr epi16x16 m256_mullo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      // The product of two int16_ts always fits inside the int that they're promoted to, so this
+      // can't overflow: we just keep the bottom half.
+      epi16x16 c{};
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        c[i] = static_cast<int16_t>(a[i] * b[i]);
+      }
+      return c;
+    }
+
+    static inline constexpr epi16x16 m256_mulhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c{};
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        c[i] = static_cast<int16_t>((int32_t(a[i]) * int32_t(b[i])) >> 16);
+      }
+      return c;
+    }
+
+    static inline epi32x8 m256_madd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      // Each product fits inside an int32_t, but their sum might not: we add them as unsigned
+      // values so that the sum wraps around (as the intrinsic does) rather than overflowing.
+      epi32x8 c;
+      for (unsigned int i = 0; i < 8; i++)
+      {
+        c[i] = static_cast<int32_t>(static_cast<uint32_t>(a[2 * i] * b[2 * i]) +
+                                    static_cast<uint32_t>(a[2 * i + 1] * b[2 * i + 1]));
+      }
+      return c;
+    }
+
+    template <typename T> static inline Vec256<T> m256_loadu_si256(const T *ptr) noexcept
+    {
+      // memcpy is the only portable way to read an object from an arbitrarily aligned pointer:
+      // the compiler turns this into a single unaligned load (or two, on 128-bit machines).
+      Vec256<T> out;
+      std::memcpy(&out, ptr, sizeof(out));
+      return out;
+    }
+
+    template <typename T> static inline void m256_storeu_si256(T *ptr, const Vec256<T> &a) noexcept
+    {
+      std::memcpy(ptr, &a, sizeof(a));
+    }
+
+    template <typename T> static inline void m256_stream_si256(T *ptr, const Vec256<T> &a) noexcept
+    {
+      // There's no portable non-temporal store, so this is just an ordinary store.
+      std::memcpy(ptr, &a, sizeof(a));
+    }
+
+    static inline void stream_fence() noexcept
+    {
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // The masked-off lanes must not be read (they may be past the end of a mapping), and so we
+    // can't load all of ptr and then select: the compiler won't introduce the loads either.
+    static inline epi32x8 m256_maskload_epi32(const int32_t *ptr, const epi32x8 &mask) noexcept
+    {
+      epi32x8 c;
+      for (unsigned i = 0; i < 8; i++)
+      {
+        c[i] = (mask[i] < 0) ? ptr[i] : 0;
+      }
+      return c;
+    }
+
+    static inline epi64x4 m256_maskload_epi64(const int64_t *ptr, const epi64x4 &mask) noexcept
+    {
+      epi64x4 c;
+      for (unsigned i = 0; i < 4; i++)
+      {
+        c[i] = (mask[i] < 0) ? ptr[i] : 0;
+      }
+      return c;
+    }
+
+    static inline void m256_maskstore_epi32(int32_t *ptr, const epi32x8 &mask,
+                                            const epi32x8 &a) noexcept
+    {
+      for (unsigned i = 0; i < 8; i++)
+      {
+        if (mask[i] < 0)
+        {
+          ptr[i] = a[i];
+        }
+      }
+    }
+
+    static inline void m256_maskstore_epi64(int64_t *ptr, const epi64x4 &mask,
+                                            const epi64x4 &a) noexcept
+    {
+      for (unsigned i = 0; i < 4; i++)
+      {
+        if (mask[i] < 0)
+        {
+          ptr[i] = a[i];
+        }
+      }
+    }
+
+    static inline constexpr epi16x16 m256_abs_epi16(const epi16x16 &a) noexcept
+    {
+      epi16x16 b{};
+      // This is a branchless implementation of the ABS function.
+      // The idea is taken from the following excellent blog post:
+      // https://hbfs.wordpress.com/2008/08/05/branchless-equivalents-of-simple-functions/
+      // The idea is that you can generate a mask that represents the sign-bit of the function
+      // by using the behaviour of the shift. You can do the same thing by using type-punning in
+      // unions, but the C++ standard disallows that.
+      //
+      // The point is this: if a[i] is positive, then the leading bit is 0: so the shift
+      // generates an all zero mask. This means the second line does nothing.
+      // By contrast, if a[i] is negative, then the shift generates the all 1 mask.
+      // When xoring against this, we will get the two's complement of a[i]: subtracting
+      // sign-extend in this context implicitly converts it to 1, which is exactly how you
+      // convert between two's complement numbers. Cool, eh?
+      // BTW: this is branchless because the if would have maximum entropy (i.e it's a 50/50
+      // chance if your number is positive or negative -- not fun.)
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        const int16_t signed_extend = a[i] >> (CHAR_BIT * sizeof(int16_t) - 1);
+        b[i]                        = (a[i] ^ signed_extend) - signed_extend;
+      }
+      return b;
+    }
+
+    static inline epi16x16
+    m256_broadcastsi128_si256(const __uint128_t value) noexcept
+    {
+      epi16x16 a;
+      // the simplest way to do this is just to use an memcpy.
+      // GCC compiles this to 4 mov instructions, which is exactly the behaviour we want.
+      std::memcpy(&a[0], &value, sizeof(value));
+      std::memcpy(&a[8], &value, sizeof(value));
+      return a;
+    }
+
+    template <unsigned pos> static inline int64_t mm_extract_epi64(const __uint128_t value) noexcept
+    {
+      return (value >> (pos * 64)) & 0xFFFFFFFFFFFFFFFF;
+    }
+
+    template <unsigned pos, typename T>
+    static inline __uint128_t m256_extracti128_si256(const Vec256<T> &a) noexcept
+    {
+      static_assert(pos < 2, "Error: pos >= 2.");
+      __uint128_t b;
+      // As with m256_broadcastsi128_si256, memcpy compiles to a single 128-bit load.
+      std::memcpy(&b, &a[pos * 16 / sizeof(T)], sizeof(b));
+      return b;
+    }
+
+    template <unsigned pos, typename T>
+    static inline Vec256<T> m256_inserti128_si256(const Vec256<T> &a, const __uint128_t b) noexcept
+    {
+      static_assert(pos < 2, "Error: pos >= 2.");
+      Vec256<T> c = a;
+      std::memcpy(&c[pos * 16 / sizeof(T)], &b, sizeof(b));
+      return c;
+    }
+
+    template <unsigned pos>
+    static inline constexpr int16_t m256_extract_epi16(const epi16x16 &a) noexcept
+    {
+      static_assert(pos < 16, "Error: pos >= size.");
+      return a[pos];
+    }
+
+    template <unsigned pos>
+    static inline constexpr int64_t m256_extract_epi64(const epi64x4 &a) noexcept
+    {
+      static_assert(pos < 4, "Error: pos >= size.");
+      return a[pos];
+    }
+
+    // The unpacks interleave within each 128-bit half: `half` selects the low (0) or high (1)
+    // lanes of each half, and these alternate between a and b in the output.
+    template <unsigned half, typename T>
+    static inline constexpr Vec256<T> unpack(const Vec256<T> &a, const Vec256<T> &b) noexcept
+    {
+      constexpr unsigned lanes = 16 / sizeof(T);
+      constexpr unsigned first = half * lanes / 2;
+      Vec256<T> c{};
+      for (unsigned int h = 0; h < 2 * lanes; h += lanes)
+      {
+        for (unsigned int i = 0; i < lanes / 2; i++)
+        {
+          c[h + 2 * i]     = a[h + first + i];
+          c[h + 2 * i + 1] = b[h + first + i];
+        }
+      }
+      return c;
+    }
+
+    static inline constexpr epi16x16
+    m256_unpacklo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return unpack<0>(a, b);
+    }
+
+    static inline constexpr epi16x16
+    m256_unpackhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return unpack<1>(a, b);
+    }
+
+    static inline constexpr epi32x8 m256_unpacklo_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+    {
+      return unpack<0>(a, b);
+    }
+
+    static inline constexpr epi32x8 m256_unpackhi_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+    {
+      return unpack<1>(a, b);
+    }
+
+    static inline epi16x16 m256_subabs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      // This is exactly the branchless abs from m256_abs_epi16, applied to a[i] - b[i].
+      for (unsigned int i = 0; i < 16; i++)
+      {
+        const int16_t diff          = static_cast<int16_t>(a[i] - b[i]);
+        const int16_t signed_extend = diff >> (CHAR_BIT * sizeof(int16_t) - 1);
+        c[i]                        = (diff ^ signed_extend) - signed_extend;
+      }
+      return c;
+    }
+
+    static inline bool
+    m256_and_testz_si256(const epi16x16 &a, const epi16x16 &b, const epi16x16 &c) noexcept
+    {
+      // We don't need a popcount here: we only care whether any bit survives, so we just
+      // accumulate with an or.
+      int16_t total = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        total |= a[i] & b[i] & c[i];
+      }
+      return total == 0;
+    }
+
+    static inline unsigned m256_xor_popcount_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      unsigned total = 0;
+      for (unsigned i = 0; i < 4; i++)
+      {
+        total += static_cast<unsigned>(__builtin_popcountll(static_cast<uint64_t>(a[i] ^ b[i])));
+      }
+      return total;
+    }
+
+    static inline int16_t m256_hadd_reduce_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      // We sum in unsigned arithmetic so that the wrap-around is well-defined.
+      uint16_t total = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        total = static_cast<uint16_t>(total + static_cast<uint16_t>(a[i]) +
+                                      static_cast<uint16_t>(b[i]));
+      }
+      return static_cast<int16_t>(total);
+    }
+
+    static inline int32_t m256_reduce_add_epi16(const epi16x16 &a) noexcept
+    {
+      int32_t total = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        total += a[i];
+      }
+      return total;
+    }
+
+    static inline int16_t m256_reduce_min_epi16(const epi16x16 &a) noexcept
+    {
+      return *std::min_element(a.cbegin(), a.cend());
+    }
+
+    static inline int16_t m256_reduce_max_epi16(const epi16x16 &a) noexcept
+    {
+      return *std::max_element(a.cbegin(), a.cend());
+    }
+
+    static inline unsigned m256_reduce_argmax_epi16(const epi16x16 &a) noexcept
+    {
+      // std::max_element returns the first of several equal maxima, which is what we want.
+      return static_cast<unsigned>(std::max_element(a.cbegin(), a.cend()) - a.cbegin());
+    }
+
+    // Note: __builtin_popcount compiles to a CPU instruction iff POPCNT is enabled, but if not the
+    // compiler has its own dedicated software routines for this.
+    static inline epi8x32 m256_popcount_epi8(const epi8x32 &a) noexcept
+    {
+      epi8x32 c;
+      for (unsigned i = 0; i < 32; i++)
+      {
+        c[i] = static_cast<int8_t>(__builtin_popcount(static_cast<uint8_t>(a[i])));
+      }
+      return c;
+    }
+
+    static inline epi64x4 m256_popcount_epi64(const epi64x4 &a) noexcept
+    {
+      epi64x4 c;
+      for (unsigned i = 0; i < 4; i++)
+      {
+        c[i] = __builtin_popcountll(static_cast<uint64_t>(a[i]));
+      }
+      return c;
+    }
+
+    static inline unsigned m256_popcount_si256(const epi64x4 &a) noexcept
+    {
+      unsigned total = 0;
+      for (unsigned i = 0; i < 4; i++)
+      {
+        total += static_cast<unsigned>(__builtin_popcountll(static_cast<uint64_t>(a[i])));
+      }
+      return total;
+    }
+
+    // The bulk kernels compute each output vector into a temporary before storing it. Written over
+    // the flattened elements instead, GCC can't rule out c partially overlapping a or b, and so it
+    // adds a runtime overlap check with a scalar fallback loop. That fallback is also taken when c
+    // is exactly a (e.g via the in-place overloads), if the call isn't inlined.
+    static inline void m256_add_epi16_bulk(const epi16x16 *a,
+                                           const epi16x16 *b,
+                                           epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_add_epi16(a[i], b[i]);
+      }
+    }
+
+    static inline void m256_sub_epi16_bulk(const epi16x16 *a,
+                                           const epi16x16 *b,
+                                           epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_sub_epi16(a[i], b[i]);
+      }
+    }
+
+    static inline void
+    m256_adds_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_adds_epi16(a[i], b[i]);
+      }
+    }
+
+    static inline void
+    m256_subs_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_subs_epi16(a[i], b[i]);
+      }
+    }
+
+    static inline void
+    m256_adds_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_adds_epu16(a[i], b[i]);
+      }
+    }
+
+    static inline void
+    m256_subs_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_subs_epu16(a[i], b[i]);
+      }
+    }
+
+    static inline void
+    m256_adds_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_adds_epu8(a[i], b[i]);
+      }
+    }
+
+    static inline void
+    m256_subs_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_subs_epu8(a[i], b[i]);
+      }
+    }
+
+    static inline void m256_xor_epi64_bulk(const epi64x4 *a,
+                                           const epi64x4 *b,
+                                           epi64x4 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_xor_epi64(a[i], b[i]);
+      }
+    }
+
+    static inline void m256_sign_epi16_bulk(const epi16x16 *a,
+                                            const epi16x16 *b,
+                                            epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_sign_epi16(a[i], b[i]);
+      }
+    }
+
+    static inline uint64_t m256_popcount_si256_bulk(const epi64x4 *a, const size_t n) noexcept
+    {
+      uint64_t total = 0;
+      for (size_t i = 0; i < n; i++)
+      {
+        for (unsigned j = 0; j < 4; j++)
+        {
+          total += static_cast<uint64_t>(__builtin_popcountll(static_cast<uint64_t>(a[i][j])));
+        }
+      }
+      return total;
+    }
+
+    static inline uint64_t
+    m256_xor_popcount_epi64_bulk(const epi64x4 *a, const epi64x4 *b, const size_t n) noexcept
+    {
+      uint64_t total = 0;
+      for (size_t i = 0; i < n; i++)
+      {
+        for (unsigned j = 0; j < 4; j++)
+        {
+          const auto diff = static_cast<uint64_t>(a[i][j] ^ b[i][j]);
+          total += static_cast<uint64_t>(__builtin_popcountll(diff));
+        }
+      }
+      return total;
+    }
+
+    // The 512-bit operations are just the 256-bit ones applied to each half.
+    static inline epi16x32 m512_add_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(m256_add_epi16(a.lo(), b.lo()), m256_add_epi16(a.hi(), b.hi()));
+    }
+
+    static inline epi16x32 m512_sub_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(m256_sub_epi16(a.lo(), b.lo()), m256_sub_epi16(a.hi(), b.hi()));
+    }
+
+    static inline epi16x32 m512_sign_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(m256_sign_epi16(a.lo(), b.lo()), m256_sign_epi16(a.hi(), b.hi()));
+    }
+
+    static inline epi16x32 m512_abs_epi16(const epi16x32 &a) noexcept
+    {
+      return epi16x32::join(m256_abs_epi16(a.lo()), m256_abs_epi16(a.hi()));
+    }
+
+    static inline epi64x8 m512_and_epi64(const epi64x8 &a, const epi64x8 &b) noexcept
+    {
+      return epi64x8::join(m256_and_epi64(a.lo(), b.lo()), m256_and_epi64(a.hi(), b.hi()));
+    }
+
+    static inline epi64x8 m512_or_epi64(const epi64x8 &a, const epi64x8 &b) noexcept
+    {
+      return epi64x8::join(m256_or_epi64(a.lo(), b.lo()), m256_or_epi64(a.hi(), b.hi()));
+    }
+
+    static inline epi64x8 m512_xor_epi64(const epi64x8 &a, const epi64x8 &b) noexcept
+    {
+      return epi64x8::join(m256_xor_epi64(a.lo(), b.lo()), m256_xor_epi64(a.hi(), b.hi()));
+    }
+
+    static inline epi8x64 m512_shuffle_epi8(const epi8x64 &a, const epi8x64 &b) noexcept
+    {
+      return epi8x64::join(m256_shuffle_epi8(a.lo(), b.lo()), m256_shuffle_epi8(a.hi(), b.hi()));
+    }
+
+    template <int8_t imm8> static inline epi64x8 m512_permute4x64_epi64(const epi64x8 &a) noexcept
+    {
+      return epi64x8::join(m256_permute4x64_epi64<imm8>(a.lo()),
+                           m256_permute4x64_epi64<imm8>(a.hi()));
+    }
+
+    static inline bool m512_testz_si512(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return m256_testz_si256(a.lo(), b.lo()) && m256_testz_si256(a.hi(), b.hi());
+    }
+
+    static inline epi16x32 m512_cmpgt_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(m256_cmpgt_epi16(a.lo(), b.lo()), m256_cmpgt_epi16(a.hi(), b.hi()));
+    }
+
+    static inline uint16_t m256_cmpgt_epi16_mask(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      unsigned mask = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        mask |= unsigned(a[i] > b[i]) << i;
+      }
+      return static_cast<uint16_t>(mask);
+    }
+
+    static inline uint32_t m512_cmpgt_epi16_mask(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return uint32_t(m256_cmpgt_epi16_mask(a.lo(), b.lo())) |
+             (uint32_t(m256_cmpgt_epi16_mask(a.hi(), b.hi())) << 16);
+    }
+
+    static inline __uint128_t get_randomness(__uint128_t &gstate_1, __uint128_t &gstate_2) noexcept
+    {
+      gstate_1 *= 0xda942042e4dd85b5;
+      gstate_2 *= 0xda942042e4dd85b5;
+      return (gstate_1 << 64) | (gstate_2 >> 64);
+    }
+  };
+
+#if CPP_INTRIN_NEON
+  /***
+   * NEON. This struct contains the AArch64 NEON implementations, which operate over two 128-bit
+   * halves exactly as the SSE implementations do. NEON is always available on AArch64, so unlike
+   * the x86 tiers nothing here needs a target attribute or a runtime check.
+   *
+   * As with the x86 tiers, the element-wise operations (add, sub, mullo, mulhi, the bitwise
+   * operations, the immediate shifts, and their bulk and m512 forms) are left to the compiler,
+   * which vectorises the plain loops well: these are inherited from Plain, as are the permutes and
+   * extracts that take an immediate (m256_permute4x64_epi64, m256_extract_epi16 and so on), and
+   * the unaligned loads and stores (memcpy is already a vld1q or vst1q). The rest of Plain is used
+   * on purpose, as NEON has nothing better: the gathers and the masked loads and stores (NEON has
+   * neither), m256_stream_si256 and stream_fence (there's no intrinsic for a non-temporal store),
+   * and get_randomness. Everything else is implemented here.
+   *
+   * Two of the operations that are implemented here are worth describing:
+   *
+   * 1) _mm256_hadd_epi16 adds adjacent pairs from a and then from b within each 128-bit lane:
+   *    this is exactly vpaddq_s16 over each half.
+   * 2) _mm256_shuffle_epi8 zeroes a byte if the top bit of its index is set, and otherwise uses the
+   *    low 4 bits. vqtbl1q_u8 zeroes any byte whose index is 16 or more, so masking the index with
+   *    0x8F gives exactly the same result.
+   */
+  struct NEON : public Plain
+  {
+    static inline int16x8_t lo_s16(const epi16x16 &a) noexcept { return vld1q_s16(a.data()); }
+    static inline int16x8_t hi_s16(const epi16x16 &a) noexcept { return vld1q_s16(a.data() + 8); }
+    static inline int64x2_t lo_s64(const epi64x4 &a) noexcept { return vld1q_s64(a.data()); }
+    static inline int64x2_t hi_s64(const epi64x4 &a) noexcept { return vld1q_s64(a.data() + 2); }
+
+    static inline epi16x16 join_s16(const int16x8_t lo, const int16x8_t hi) noexcept
+    {
+      epi16x16 out;
+      vst1q_s16(out.data(), lo);
+      vst1q_s16(out.data() + 8, hi);
+      return out;
+    }
+
+    static inline epi64x4 join_s64(const int64x2_t lo, const int64x2_t hi) noexcept
+    {
+      epi64x4 out;
+      vst1q_s64(out.data(), lo);
+      vst1q_s64(out.data() + 2, hi);
+      return out;
+    }
+
+    static inline epi16x16 m256_hadd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s16(vpaddq_s16(lo_s16(a), lo_s16(b)), vpaddq_s16(hi_s16(a), hi_s16(b)));
+    }
+
+    static inline int16_t m256_hadd_reduce_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const int16x8_t sum_a = vaddq_s16(lo_s16(a), hi_s16(a));
+      return vaddvq_s16(vaddq_s16(sum_a, vaddq_s16(lo_s16(b), hi_s16(b))));
+    }
+
+    static inline epi16x16 m256_cmpgt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s16(vreinterpretq_s16_u16(vcgtq_s16(lo_s16(a), lo_s16(b))),
+                      vreinterpretq_s16_u16(vcgtq_s16(hi_s16(a), hi_s16(b))));
+    }
+
+    static inline uint8x16_t shuffle_u8(const uint8x16_t a, const uint8x16_t b) noexcept
+    {
+      return vqtbl1q_u8(a, vandq_u8(b, vdupq_n_u8(0x8F)));
+    }
+
+    static inline epi8x32 m256_shuffle_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      const uint8_t *in_a = reinterpret_cast<const uint8_t *>(a.data());
+      const uint8_t *in_b = reinterpret_cast<const uint8_t *>(b.data());
+      epi8x32 out;
+      uint8_t *dst = reinterpret_cast<uint8_t *>(out.data());
+      vst1q_u8(dst, shuffle_u8(vld1q_u8(in_a), vld1q_u8(in_b)));
+      vst1q_u8(dst + 16, shuffle_u8(vld1q_u8(in_a + 16), vld1q_u8(in_b + 16)));
+      return out;
+    }
+
+    // The vector is all zeros if and only if its largest 32-bit lane is zero.
+    static inline bool is_zero(const int16x8_t a) noexcept
+    {
+      return vmaxvq_u32(vreinterpretq_u32_s16(a)) == 0;
+    }
+
+    static inline bool m256_testz_si256(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return is_zero(
+          vorrq_s16(vandq_s16(lo_s16(a), lo_s16(b)), vandq_s16(hi_s16(a), hi_s16(b))));
+    }
+
+    // NEON has no psignw: we negate where b is negative, and then clear where b is zero.
+    static inline int16x8_t sign_s16(const int16x8_t a, const int16x8_t b) noexcept
+    {
+      const int16x8_t negated = vbslq_s16(vcltzq_s16(b), vnegq_s16(a), a);
+      return vbicq_s16(negated, vreinterpretq_s16_u16(vceqzq_s16(b)));
+    }
+
+    static inline epi16x16 m256_sign_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s16(sign_s16(lo_s16(a), lo_s16(b)), sign_s16(hi_s16(a), hi_s16(b)));
+    }
+
+    static inline void m256_sign_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c,
+                                            const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_sign_epi16(a[i], b[i]);
+      }
+    }
+
+    static inline epi16x16 m256_abs_epi16(const epi16x16 &a) noexcept
+    {
+      return join_s16(vabsq_s16(lo_s16(a)), vabsq_s16(hi_s16(a)));
+    }
+
+    static inline epi16x16 m256_broadcastsi128_si256(const __uint128_t value) noexcept
+    {
+      const uint8_t *const in = reinterpret_cast<const uint8_t *>(&value);
+      const int16x8_t half    = vreinterpretq_s16_u8(vld1q_u8(in));
+      return join_s16(half, half);
+    }
+
+    static inline epi16x16 m256_unpacklo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s16(vzip1q_s16(lo_s16(a), lo_s16(b)), vzip1q_s16(hi_s16(a), hi_s16(b)));
+    }
+
+    static inline epi16x16 m256_unpackhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s16(vzip2q_s16(lo_s16(a), lo_s16(b)), vzip2q_s16(hi_s16(a), hi_s16(b)));
+    }
+
+    static inline epi32x8 m256_unpacklo_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+    {
+      return join_s32(vzip1q_s32(lo_s32(a), lo_s32(b)), vzip1q_s32(hi_s32(a), hi_s32(b)));
+    }
+
+    static inline epi32x8 m256_unpackhi_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+    {
+      return join_s32(vzip2q_s32(lo_s32(a), lo_s32(b)), vzip2q_s32(hi_s32(a), hi_s32(b)));
+    }
+
+    static inline epi16x16 m256_subabs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s16(vabsq_s16(vsubq_s16(lo_s16(a), lo_s16(b))),
+                      vabsq_s16(vsubq_s16(hi_s16(a), hi_s16(b))));
+    }
+
+    static inline bool m256_and_testz_si256(const epi16x16 &a, const epi16x16 &b,
+                                            const epi16x16 &c) noexcept
+    {
+      const int16x8_t lo = vandq_s16(vandq_s16(lo_s16(a), lo_s16(b)), lo_s16(c));
+      const int16x8_t hi = vandq_s16(vandq_s16(hi_s16(a), hi_s16(b)), hi_s16(c));
+      return is_zero(vorrq_s16(lo, hi));
+    }
+
+    // vcntq_u8 counts the bits in each byte: the wider counts are pairwise widening adds of that.
+    static inline uint64x2_t popcount_u64(const int64x2_t a) noexcept
+    {
+      return vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vcntq_u8(vreinterpretq_u8_s64(a)))));
+    }
+
+    static inline unsigned popcount_total(const int64x2_t a) noexcept
+    {
+      // Each half has at most 128 set bits, so the sum fits in the widened 16-bit lanes.
+      return vaddvq_u16(vpaddlq_u8(vcntq_u8(vreinterpretq_u8_s64(a))));
+    }
+
+    static inline epi8x32 m256_popcount_epi8(const epi8x32 &a) noexcept
+    {
+      epi8x32 out;
+      vst1q_s8(out.data(), vcntq_s8(vld1q_s8(a.data())));
+      vst1q_s8(out.data() + 16, vcntq_s8(vld1q_s8(a.data() + 16)));
+      return out;
+    }
+
+    static inline epi64x4 m256_popcount_epi64(const epi64x4 &a) noexcept
+    {
+      return join_s64(vreinterpretq_s64_u64(popcount_u64(lo_s64(a))),
+                      vreinterpretq_s64_u64(popcount_u64(hi_s64(a))));
+    }
+
+    static inline unsigned m256_popcount_si256(const epi64x4 &a) noexcept
+    {
+      return popcount_total(lo_s64(a)) + popcount_total(hi_s64(a));
+    }
+
+    static inline unsigned m256_xor_popcount_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      return popcount_total(veorq_s64(lo_s64(a), lo_s64(b))) +
+             popcount_total(veorq_s64(hi_s64(a), hi_s64(b)));
+    }
+
+    // The bulk versions keep 64-bit running counts, and only reduce them at the end. Each byte of
+    // the two halves has at most 8 set bits, so their byte counts are added before widening.
+    static inline uint64x2_t popcount_u64(const int64x2_t lo, const int64x2_t hi) noexcept
+    {
+      const uint8x16_t bytes =
+          vaddq_u8(vcntq_u8(vreinterpretq_u8_s64(lo)), vcntq_u8(vreinterpretq_u8_s64(hi)));
+      return vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(bytes)));
+    }
+
+    static inline uint64_t m256_popcount_si256_bulk(const epi64x4 *a, const size_t n) noexcept
+    {
+      uint64x2_t total = vdupq_n_u64(0);
+      for (size_t i = 0; i < n; i++)
+      {
+        total = vaddq_u64(total, popcount_u64(lo_s64(a[i]), hi_s64(a[i])));
+      }
+      return vaddvq_u64(total);
+    }
+
+    static inline uint64_t
+    m256_xor_popcount_epi64_bulk(const epi64x4 *a, const epi64x4 *b, const size_t n) noexcept
+    {
+      uint64x2_t total = vdupq_n_u64(0);
+      for (size_t i = 0; i < n; i++)
+      {
+        const int64x2_t lo = veorq_s64(lo_s64(a[i]), lo_s64(b[i]));
+        const int64x2_t hi = veorq_s64(hi_s64(a[i]), hi_s64(b[i]));
+        total              = vaddq_u64(total, popcount_u64(lo, hi));
+      }
+      return vaddvq_u64(total);
+    }
+
+    // The saturating operations work on each half of each vector: the single-vector versions are
+    // just the bulk versions with n = 1.
+    static inline void
+    m256_adds_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const int16_t *in_a = a[i].data();
+        const int16_t *in_b = b[i].data();
+        int16_t *out        = c[i].data();
+        for (unsigned h = 0; h < 2; h++)
+        {
+          vst1q_s16(out + 8 * h, vqaddq_s16(vld1q_s16(in_a + 8 * h), vld1q_s16(in_b + 8 * h)));
+        }
+      }
+    }
+
+    static inline epi16x16 m256_adds_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      m256_adds_epi16_bulk(&a, &b, &c, 1);
+      return c;
+    }
+
+    static inline void
+    m256_subs_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const int16_t *in_a = a[i].data();
+        const int16_t *in_b = b[i].data();
+        int16_t *out        = c[i].data();
+        for (unsigned h = 0; h < 2; h++)
+        {
+          vst1q_s16(out + 8 * h, vqsubq_s16(vld1q_s16(in_a + 8 * h), vld1q_s16(in_b + 8 * h)));
+        }
+      }
+    }
+
+    static inline epi16x16 m256_subs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      m256_subs_epi16_bulk(&a, &b, &c, 1);
+      return c;
+    }
+
+    static inline void
+    m256_adds_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const uint16_t *in_a = reinterpret_cast<const uint16_t *>(a[i].data());
+        const uint16_t *in_b = reinterpret_cast<const uint16_t *>(b[i].data());
+        uint16_t *out        = reinterpret_cast<uint16_t *>(c[i].data());
+        for (unsigned h = 0; h < 2; h++)
+        {
+          vst1q_u16(out + 8 * h, vqaddq_u16(vld1q_u16(in_a + 8 * h), vld1q_u16(in_b + 8 * h)));
+        }
+      }
+    }
+
+    static inline epi16x16 m256_adds_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      m256_adds_epu16_bulk(&a, &b, &c, 1);
+      return c;
+    }
+
+    static inline void
+    m256_subs_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const uint16_t *in_a = reinterpret_cast<const uint16_t *>(a[i].data());
+        const uint16_t *in_b = reinterpret_cast<const uint16_t *>(b[i].data());
+        uint16_t *out        = reinterpret_cast<uint16_t *>(c[i].data());
+        for (unsigned h = 0; h < 2; h++)
+        {
+          vst1q_u16(out + 8 * h, vqsubq_u16(vld1q_u16(in_a + 8 * h), vld1q_u16(in_b + 8 * h)));
+        }
+      }
+    }
+
+    static inline epi16x16 m256_subs_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      m256_subs_epu16_bulk(&a, &b, &c, 1);
+      return c;
+    }
+
+    static inline void
+    m256_adds_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const uint8_t *in_a = reinterpret_cast<const uint8_t *>(a[i].data());
+        const uint8_t *in_b = reinterpret_cast<const uint8_t *>(b[i].data());
+        uint8_t *out        = reinterpret_cast<uint8_t *>(c[i].data());
+        for (unsigned h = 0; h < 2; h++)
+        {
+          vst1q_u8(out + 16 * h, vqaddq_u8(vld1q_u8(in_a + 16 * h), vld1q_u8(in_b + 16 * h)));
+        }
+      }
+    }
+
+    static inline epi8x32 m256_adds_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c;
+      m256_adds_epu8_bulk(&a, &b, &c, 1);
+      return c;
+    }
+
+    static inline void
+    m256_subs_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const uint8_t *in_a = reinterpret_cast<const uint8_t *>(a[i].data());
+        const uint8_t *in_b = reinterpret_cast<const uint8_t *>(b[i].data());
+        uint8_t *out        = reinterpret_cast<uint8_t *>(c[i].data());
+        for (unsigned h = 0; h < 2; h++)
+        {
+          vst1q_u8(out + 16 * h, vqsubq_u8(vld1q_u8(in_a + 16 * h), vld1q_u8(in_b + 16 * h)));
+        }
+      }
+    }
+
+    static inline epi8x32 m256_subs_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c;
+      m256_subs_epu8_bulk(&a, &b, &c, 1);
+      return c;
+    }
+
+    static inline int32_t m256_reduce_add_epi16(const epi16x16 &a) noexcept
+    {
+      return vaddlvq_s16(lo_s16(a)) + vaddlvq_s16(hi_s16(a));
+    }
+
+    static inline int16_t m256_reduce_min_epi16(const epi16x16 &a) noexcept
+    {
+      return vminvq_s16(vminq_s16(lo_s16(a), hi_s16(a)));
+    }
+
+    static inline int16_t m256_reduce_max_epi16(const epi16x16 &a) noexcept
+    {
+      return vmaxvq_s16(vmaxq_s16(lo_s16(a), hi_s16(a)));
+    }
+
+    // The index of the first maximum is the smallest index among the lanes that equal the maximum:
+    // every other lane is replaced by 16, which is larger than any index.
+    static inline unsigned m256_reduce_argmax_epi16(const epi16x16 &a) noexcept
+    {
+      static constexpr uint16_t index[16] = {0, 1, 2,  3,  4,  5,  6,  7,
+                                             8, 9, 10, 11, 12, 13, 14, 15};
+      const int16x8_t lo    = lo_s16(a);
+      const int16x8_t hi    = hi_s16(a);
+      const int16x8_t max   = vdupq_n_s16(vmaxvq_s16(vmaxq_s16(lo, hi)));
+      const uint16x8_t none = vdupq_n_u16(16);
+      const uint16x8_t lo_i = vbslq_u16(vceqq_s16(lo, max), vld1q_u16(index), none);
+      const uint16x8_t hi_i = vbslq_u16(vceqq_s16(hi, max), vld1q_u16(index + 8), none);
+      return vminvq_u16(vminq_u16(lo_i, hi_i));
+    }
+
+    static inline int8x16_t lo_s8(const epi8x32 &a) noexcept { return vld1q_s8(a.data()); }
+    static inline int8x16_t hi_s8(const epi8x32 &a) noexcept { return vld1q_s8(a.data() + 16); }
+
+    static inline epi8x32 join_s8(const int8x16_t lo, const int8x16_t hi) noexcept
+    {
+      epi8x32 out;
+      vst1q_s8(out.data(), lo);
+      vst1q_s8(out.data() + 16, hi);
+      return out;
+    }
+
+    static inline epi8x32 m256_cmpeq_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return join_s8(vreinterpretq_s8_u8(vceqq_s8(lo_s8(a), lo_s8(b))),
+                     vreinterpretq_s8_u8(vceqq_s8(hi_s8(a), hi_s8(b))));
+    }
+
+    static inline epi16x16 m256_cmpeq_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s16(vreinterpretq_s16_u16(vceqq_s16(lo_s16(a), lo_s16(b))),
+                     vreinterpretq_s16_u16(vceqq_s16(hi_s16(a), hi_s16(b))));
+    }
+
+    static inline epi8x32 m256_cmpgt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return join_s8(vreinterpretq_s8_u8(vcgtq_s8(lo_s8(a), lo_s8(b))),
+                     vreinterpretq_s8_u8(vcgtq_s8(hi_s8(a), hi_s8(b))));
+    }
+
+    static inline epi8x32 m256_cmplt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return join_s8(vreinterpretq_s8_u8(vcltq_s8(lo_s8(a), lo_s8(b))),
+                     vreinterpretq_s8_u8(vcltq_s8(hi_s8(a), hi_s8(b))));
+    }
+
+    static inline epi16x16 m256_cmplt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s16(vreinterpretq_s16_u16(vcltq_s16(lo_s16(a), lo_s16(b))),
+                     vreinterpretq_s16_u16(vcltq_s16(hi_s16(a), hi_s16(b))));
+    }
+
+    static inline epi8x32 m256_blendv_epi8(const epi8x32 &a, const epi8x32 &b,
+                                           const epi8x32 &mask) noexcept
+    {
+      return join_s8(vbslq_s8(vcltzq_s8(lo_s8(mask)), lo_s8(b), lo_s8(a)),
+                     vbslq_s8(vcltzq_s8(hi_s8(mask)), hi_s8(b), hi_s8(a)));
+    }
+
+    // NEON has no movemask. Instead, we isolate the top bit of each byte, shift the bit of byte i
+    // into position i % 8, and then add across each 8-byte half: the bits don't overlap, so the sum
+    // is the mask.
+    static inline uint32_t movemask_u8(const int8x16_t a) noexcept
+    {
+      static constexpr int8_t shifts[16] = {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7};
+      const uint8x16_t bits = vshlq_u8(vshrq_n_u8(vreinterpretq_u8_s8(a), 7), vld1q_s8(shifts));
+      return uint32_t(vaddv_u8(vget_low_u8(bits))) | (uint32_t(vaddv_u8(vget_high_u8(bits))) << 8);
+    }
+
+    static inline uint32_t m256_movemask_epi8(const epi8x32 &a) noexcept
+    {
+      return movemask_u8(lo_s8(a)) | (movemask_u8(hi_s8(a)) << 16);
+    }
+
+    static inline uint32_t m256_movemask_epi16(const epi16x16 &a) noexcept
+    {
+      // The top byte of each lane holds its sign bit.
+      return movemask_u8(vcombine_s8(vshrn_n_s16(lo_s16(a), 8), vshrn_n_s16(hi_s16(a), 8)));
+    }
+
+    static inline int16x8_t compress_s16(const int16x8_t a, const unsigned mask) noexcept
+    {
+      const auto &lut = ShuffleMasks::compress_epi16_lut();
+      return vreinterpretq_s16_u8(
+          vqtbl1q_u8(vreinterpretq_u8_s16(a), vreinterpretq_u8_s8(vld1q_s8(lut[mask].data()))));
+    }
+
+    static inline epi16x16 m256_compress_epi16(const epi16x16 &a, const uint32_t mask) noexcept
+    {
+      // This is exactly the SSSE3 version: see SSE::compress_halves.
+      const unsigned m = mask & 0xFF;
+      epi16x16 c;
+      vst1q_s16(c.data(), compress_s16(lo_s16(a), m));
+      vst1q_s16(c.data() + 8, vdupq_n_s16(0));
+      vst1q_s16(c.data() + __builtin_popcount(m), compress_s16(hi_s16(a), (mask >> 8) & 0xFF));
+      return c;
+    }
+
+    // vqtbl2q_u8 and vqtbl4q_u8 look up bytes in a 32- or 64-byte table, giving zero for any index
+    // past the end. The indices are masked first, so that they wrap around instead.
+    static inline uint8x16_t tbl_u8(const uint8x16x2_t &t, const uint8x16_t idx) noexcept
+    {
+      return vqtbl2q_u8(t, idx);
+    }
+
+    static inline uint8x16_t tbl_u8(const uint8x16x4_t &t, const uint8x16_t idx) noexcept
+    {
+      return vqtbl4q_u8(t, idx);
+    }
+
+    template <typename Table>
+    static inline epi8x32 lut_u8(const Table &t, const epi8x32 &idx, const uint8_t mask) noexcept
+    {
+      const uint8x16_t m  = vdupq_n_u8(mask);
+      const uint8x16_t lo = vandq_u8(vreinterpretq_u8_s8(lo_s8(idx)), m);
+      const uint8x16_t hi = vandq_u8(vreinterpretq_u8_s8(hi_s8(idx)), m);
+      return join_s8(vreinterpretq_s8_u8(tbl_u8(t, lo)), vreinterpretq_s8_u8(tbl_u8(t, hi)));
+    }
+
+    // Each 32-bit index i becomes the byte indices 4 * (i & 7) + {0, 1, 2, 3}, which vqtbl2q_u8
+    // then looks up in both halves of a at once.
+    static inline uint8x16_t permute_control_u8(const int32x4_t idx) noexcept
+    {
+      const uint32x4_t lane = vshlq_n_u32(vandq_u32(vreinterpretq_u32_s32(idx), vdupq_n_u32(7)), 2);
+      return vreinterpretq_u8_u32(vmlaq_n_u32(vdupq_n_u32(0x03020100), lane, 0x01010101));
+    }
+
+    static inline epi32x8 m256_permutevar8x32_epi32(const epi32x8 &a, const epi32x8 &idx) noexcept
+    {
+      const uint8x16x2_t t = {{vreinterpretq_u8_s32(lo_s32(a)), vreinterpretq_u8_s32(hi_s32(a))}};
+      return join_s32(vreinterpretq_s32_u8(vqtbl2q_u8(t, permute_control_u8(lo_s32(idx)))),
+                      vreinterpretq_s32_u8(vqtbl2q_u8(t, permute_control_u8(hi_s32(idx)))));
+    }
+
+    static inline uint8x16x2_t load_u8x2(const int8_t *const table) noexcept
+    {
+      const uint8_t *in = reinterpret_cast<const uint8_t *>(table);
+      return uint8x16x2_t{{vld1q_u8(in), vld1q_u8(in + 16)}};
+    }
+
+    static inline uint8x16x4_t load_u8x4(const int8_t *const table) noexcept
+    {
+      const uint8_t *in = reinterpret_cast<const uint8_t *>(table);
+      return uint8x16x4_t{{vld1q_u8(in), vld1q_u8(in + 16), vld1q_u8(in + 32), vld1q_u8(in + 48)}};
+    }
+
+    // Lane j of an int16_t table is bytes 2j and 2j + 1, i.e 0x0202 * j + 0x0100 as a 16-bit lane.
+    static inline epi8x32 lut_control_epi16(const epi16x16 &idx, const int16_t index_mask) noexcept
+    {
+      const int16x8_t m     = vdupq_n_s16(index_mask);
+      const int16x8_t scale = vdupq_n_s16(0x0202);
+      const int16x8_t base  = vdupq_n_s16(0x0100);
+      return join_s16(vmlaq_s16(base, vandq_s16(lo_s16(idx), m), scale),
+                      vmlaq_s16(base, vandq_s16(hi_s16(idx), m), scale))
+          .epi8();
+    }
+
+    static inline epi8x32 m256_lut32_epi8(const epi8x32 &table, const epi8x32 &idx) noexcept
+    {
+      return lut_u8(load_u8x2(table.data()), idx, 31);
+    }
+
+    static inline epi8x32 m256_lut64_epi8(const epi8x64 &table, const epi8x32 &idx) noexcept
+    {
+      return lut_u8(load_u8x4(table.data()), idx, 63);
+    }
+
+    static inline epi16x16 m256_lut16_epi16(const epi16x16 &table, const epi16x16 &idx) noexcept
+    {
+      return lut_u8(load_u8x2(table.epi8().data()), lut_control_epi16(idx, 15), 31).epi16();
+    }
+
+    static inline epi16x16 m256_lut32_epi16(const epi16x32 &table, const epi16x16 &idx) noexcept
+    {
+      return lut_u8(load_u8x4(table.epi8().data()), lut_control_epi16(idx, 31), 63).epi16();
+    }
+
+    // The 8-point Walsh-Hadamard transform of x. Each stage swaps the lanes h apart (with vrev or
+    // vext) and then computes swapped + x * signs, where signs[i] is -1 if bit h of i is set: this
+    // gives x[i] + x[i ^ h] in the bottom lane of each pair, and x[i ^ h] - x[i] in the top.
+    static inline int16x8_t hadamard8_s16(int16x8_t x) noexcept
+    {
+      static constexpr int16_t signs[3][8] = {{1, -1, 1, -1, 1, -1, 1, -1},
+                                              {1, 1, -1, -1, 1, 1, -1, -1},
+                                              {1, 1, 1, 1, -1, -1, -1, -1}};
+      x = vmlaq_s16(vrev32q_s16(x), x, vld1q_s16(signs[0]));
+      x = vmlaq_s16(vreinterpretq_s16_s32(vrev64q_s32(vreinterpretq_s32_s16(x))), x,
+                    vld1q_s16(signs[1]));
+      return vmlaq_s16(vextq_s16(x, x, 4), x, vld1q_s16(signs[2]));
+    }
+
+    // The Walsh-Hadamard transform of the 8 * n lanes in x: each register is transformed on its
+    // own, and then the butterflies between registers are just adds and subtracts.
+    template <unsigned n> static inline void hadamard_s16(int16x8_t (&x)[n]) noexcept
+    {
+      for (auto &v : x)
+      {
+        v = hadamard8_s16(v);
+      }
+      for (unsigned h = 1; h < n; h *= 2)
+      {
+        for (unsigned i = 0; i < n; i += 2 * h)
+        {
+          for (unsigned j = i; j < i + h; j++)
+          {
+            const int16x8_t u = x[j], v = x[j + h];
+            x[j]              = vaddq_s16(u, v);
+            x[j + h]          = vsubq_s16(u, v);
+          }
+        }
+      }
+    }
+
+    static inline epi16x16 m256_hadamard16_epi16(const epi16x16 &a) noexcept
+    {
+      int16x8_t x[2] = {lo_s16(a), hi_s16(a)};
+      hadamard_s16(x);
+      return join_s16(x[0], x[1]);
+    }
+
+    static inline epi16x32 m512_hadamard32_epi16(const epi16x32 &a) noexcept
+    {
+      int16x8_t x[4];
+      for (unsigned i = 0; i < 4; i++)
+      {
+        x[i] = vld1q_s16(a.data() + 8 * i);
+      }
+      hadamard_s16(x);
+      epi16x32 c;
+      for (unsigned i = 0; i < 4; i++)
+      {
+        vst1q_s16(c.data() + 8 * i, x[i]);
+      }
+      return c;
+    }
+
+    static inline void m256_hadamard64_epi16(const epi16x16 *a, epi16x16 *c) noexcept
+    {
+      int16x8_t x[8];
+      for (unsigned i = 0; i < 4; i++)
+      {
+        x[2 * i]     = lo_s16(a[i]);
+        x[2 * i + 1] = hi_s16(a[i]);
+      }
+      hadamard_s16(x);
+      for (unsigned i = 0; i < 4; i++)
+      {
+        c[i] = join_s16(x[2 * i], x[2 * i + 1]);
+      }
+    }
+
+    static inline void m256_hadamard16_epi16_bulk(const epi16x16 *a, epi16x16 *c,
+                                                  const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        c[i] = m256_hadamard16_epi16(a[i]);
+      }
+    }
+
+    static inline int32x4_t lo_s32(const epi32x8 &a) noexcept { return vld1q_s32(a.data()); }
+    static inline int32x4_t hi_s32(const epi32x8 &a) noexcept { return vld1q_s32(a.data() + 4); }
+
+    static inline epi32x8 join_s32(const int32x4_t lo, const int32x4_t hi) noexcept
+    {
+      epi32x8 out;
+      vst1q_s32(out.data(), lo);
+      vst1q_s32(out.data() + 4, hi);
+      return out;
+    }
+
+    // vshlq shifts each lane left by a signed count (and so right by a negative one), producing
+    // zero once the count reaches the lane width. However, it only reads the bottom byte of each
+    // count: a count of 256 would shift by nothing. We therefore clamp the counts to the lane width
+    // before using them.
+    static inline int16x8_t shl_u16(const int16x8_t a, const int16x8_t n) noexcept
+    {
+      return vreinterpretq_s16_u16(vshlq_u16(vreinterpretq_u16_s16(a), n));
+    }
+
+    static inline int32x4_t shl_u32(const int32x4_t a, const int32x4_t n) noexcept
+    {
+      return vreinterpretq_s32_u32(vshlq_u32(vreinterpretq_u32_s32(a), n));
+    }
+
+    static inline int64x2_t shl_u64(const int64x2_t a, const int64x2_t n) noexcept
+    {
+      return vreinterpretq_s64_u64(vshlq_u64(vreinterpretq_u64_s64(a), n));
+    }
+
+    static inline int32x4_t clamp_count_s32(const int32x4_t count) noexcept
+    {
+      return vreinterpretq_s32_u32(vminq_u32(vreinterpretq_u32_s32(count), vdupq_n_u32(32)));
+    }
+
+    static inline int64x2_t clamp_count_s64(const int64x2_t count) noexcept
+    {
+      const uint64x2_t n     = vreinterpretq_u64_s64(count);
+      const uint64x2_t width = vdupq_n_u64(64);
+      return vreinterpretq_s64_u64(vbslq_u64(vcgtq_u64(n, width), width, n));
+    }
+
+    static inline epi16x16 m256_sll_epi16(const epi16x16 &a, const unsigned count) noexcept
+    {
+      const int16x8_t n = vdupq_n_s16(static_cast<int16_t>(std::min(count, 16u)));
+      return join_s16(shl_u16(lo_s16(a), n), shl_u16(hi_s16(a), n));
+    }
+
+    static inline epi16x16 m256_srl_epi16(const epi16x16 &a, const unsigned count) noexcept
+    {
+      const int shift   = static_cast<int>(std::min(count, 16u));
+      const int16x8_t n = vdupq_n_s16(static_cast<int16_t>(-shift));
+      return join_s16(shl_u16(lo_s16(a), n), shl_u16(hi_s16(a), n));
+    }
+
+    static inline epi32x8 m256_sllv_epi32(const epi32x8 &a, const epi32x8 &count) noexcept
+    {
+      return join_s32(shl_u32(lo_s32(a), clamp_count_s32(lo_s32(count))),
+                      shl_u32(hi_s32(a), clamp_count_s32(hi_s32(count))));
+    }
+
+    static inline epi32x8 m256_srlv_epi32(const epi32x8 &a, const epi32x8 &count) noexcept
+    {
+      return join_s32(shl_u32(lo_s32(a), vnegq_s32(clamp_count_s32(lo_s32(count)))),
+                      shl_u32(hi_s32(a), vnegq_s32(clamp_count_s32(hi_s32(count)))));
+    }
+
+    static inline epi64x4 m256_sllv_epi64(const epi64x4 &a, const epi64x4 &count) noexcept
+    {
+      return join_s64(shl_u64(lo_s64(a), clamp_count_s64(lo_s64(count))),
+                      shl_u64(hi_s64(a), clamp_count_s64(hi_s64(count))));
+    }
+
+    static inline epi64x4 m256_srlv_epi64(const epi64x4 &a, const epi64x4 &count) noexcept
+    {
+      return join_s64(shl_u64(lo_s64(a), vnegq_s64(clamp_count_s64(lo_s64(count)))),
+                      shl_u64(hi_s64(a), vnegq_s64(clamp_count_s64(hi_s64(count)))));
+    }
+
+    // vmull_s16 and vmull_high_s16 widen the products of the bottom and top four lanes into 32
+    // bits, and vpaddq_s32 then adds adjacent pairs across the two: this is exactly pmaddwd.
+    static inline int32x4_t madd_s16(const int16x8_t a, const int16x8_t b) noexcept
+    {
+      return vpaddq_s32(vmull_s16(vget_low_s16(a), vget_low_s16(b)), vmull_high_s16(a, b));
+    }
+
+    static inline epi32x8 m256_madd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return join_s32(madd_s16(lo_s16(a), lo_s16(b)), madd_s16(hi_s16(a), hi_s16(b)));
+    }
+
+    static inline uint16_t m256_cmpgt_epi16_mask(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return static_cast<uint16_t>(m256_movemask_epi16(m256_cmpgt_epi16(a, b)));
+    }
+
+    // The 512-bit operations are the 256-bit ones applied to each half, as in Plain. They're
+    // repeated here so that they call the NEON versions above: the element-wise ones (add, sub,
+    // and, or, xor) and m512_permute4x64_epi64 are inherited from Plain, like their m256
+    // counterparts.
+    static inline epi16x32 m512_sign_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(m256_sign_epi16(a.lo(), b.lo()), m256_sign_epi16(a.hi(), b.hi()));
+    }
+
+    static inline epi16x32 m512_abs_epi16(const epi16x32 &a) noexcept
+    {
+      return epi16x32::join(m256_abs_epi16(a.lo()), m256_abs_epi16(a.hi()));
+    }
+
+    static inline epi8x64 m512_shuffle_epi8(const epi8x64 &a, const epi8x64 &b) noexcept
+    {
+      return epi8x64::join(m256_shuffle_epi8(a.lo(), b.lo()), m256_shuffle_epi8(a.hi(), b.hi()));
+    }
+
+    static inline bool m512_testz_si512(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return m256_testz_si256(a.lo(), b.lo()) && m256_testz_si256(a.hi(), b.hi());
+    }
+
+    static inline epi16x32 m512_cmpgt_epi16(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(m256_cmpgt_epi16(a.lo(), b.lo()), m256_cmpgt_epi16(a.hi(), b.hi()));
+    }
+
+    static inline uint32_t m512_cmpgt_epi16_mask(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return uint32_t(m256_cmpgt_epi16_mask(a.lo(), b.lo())) |
+             (uint32_t(m256_cmpgt_epi16_mask(a.hi(), b.hi())) << 16);
+    }
+  };
+#endif
+
+#if CPP_INTRIN_X86
+  /***
+   * SSE. This struct contains the implementations that operate over two 128-bit halves. Each
+   * function is compiled for the smallest instruction set that it needs (e.g _mm_shuffle_epi8 needs
+   * SSSE3, whereas _mm_testz_si128 needs SSE4.1): this is so that the public functions can use
+   * these whenever the matching macro is defined.
+   *
+   * For the runtime dispatch this tier is only selected if SSE4.1 is available, and so the
+   * operations that GCC vectorises well on its own are simply the Plain versions re-compiled for
+   * SSE4.1.
+   */
+  struct SSE
+  {
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16
+    m256_hadd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      // Split the input arrays into two, separate chunks.
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c),
+                      _mm_hadd_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a)),
+                                     _mm_load_si128(reinterpret_cast<const __m128i *>(&b))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
+                      _mm_hadd_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[8])),
+                                     _mm_load_si128(reinterpret_cast<const __m128i *>(&b[8]))));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi64x4
+    m256_xor_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      return Plain::m256_xor_epi64(a, b);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi64x4
+    m256_or_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      return Plain::m256_or_epi64(a, b);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi64x4
+    m256_and_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      return Plain::m256_and_epi64(a, b);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi16x16
+    m256_and_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return Plain::m256_and_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_cmpgt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c),
+                      _mm_cmpgt_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a)),
+                                      _mm_load_si128(reinterpret_cast<const __m128i *>(&b))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
+                      _mm_cmpgt_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[8])),
+                                      _mm_load_si128(reinterpret_cast<const __m128i *>(&b[8]))));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi8x32
+    m256_cmpeq_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi8x32 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_cmpeq_epi8(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_cmpeq_epi8(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_cmpeq_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_cmpeq_epi16(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_cmpeq_epi16(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi8x32
+    m256_cmpgt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi8x32 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_cmpgt_epi8(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_cmpgt_epi8(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi8x32
+    m256_cmplt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi8x32 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_cmplt_epi8(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_cmplt_epi8(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_cmplt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_cmplt_epi16(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_cmplt_epi16(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi8x32
+    m256_blendv_epi8(const epi8x32 &a, const epi8x32 &b, const epi8x32 &mask) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      const __m128i *in_m = reinterpret_cast<const __m128i *>(&mask);
+      epi8x32 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      for (unsigned i = 0; i < 2; i++)
+      {
+        _mm_store_si128(out + i, _mm_blendv_epi8(_mm_load_si128(in_a + i), _mm_load_si128(in_b + i),
+                                                 _mm_load_si128(in_m + i)));
+      }
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline uint32_t m256_movemask_epi8(const epi8x32 &a) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      return static_cast<uint32_t>(_mm_movemask_epi8(_mm_load_si128(in))) |
+             (static_cast<uint32_t>(_mm_movemask_epi8(_mm_load_si128(in + 1))) << 16);
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline uint32_t m256_movemask_epi16(const epi16x16 &a) noexcept
+    {
+      // The signed pack saturates, which keeps the sign of each lane: so the top bit of each byte
+      // is exactly the top bit of the corresponding lane.
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      return static_cast<uint32_t>(
+          _mm_movemask_epi8(_mm_packs_epi16(_mm_load_si128(in), _mm_load_si128(in + 1))));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16 compress_halves(const __m128i lo,
+                                                                   const __m128i hi,
+                                                                   const uint32_t mask) noexcept
+    {
+      const auto &lut  = ShuffleMasks::compress_epi16_lut();
+      const unsigned m = mask & 0xFF;
+      const __m128i packed_lo =
+          _mm_shuffle_epi8(lo, _mm_load_si128(reinterpret_cast<const __m128i *>(lut[m].data())));
+      const __m128i packed_hi = _mm_shuffle_epi8(
+          hi, _mm_load_si128(reinterpret_cast<const __m128i *>(lut[(mask >> 8) & 0xFF].data())));
+
+      // The packed bottom half is followed by zeros, so we write it and then zero the top half.
+      // Writing the packed top half directly after the lanes kept from the bottom then leaves
+      // zeros in every lane that wasn't written. This stays in bounds, as at most 8 lanes are
+      // kept from the bottom.
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, packed_lo);
+      _mm_store_si128(out + 1, _mm_setzero_si128());
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(c.data() + __builtin_popcount(m)), packed_hi);
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16 m256_compress_epi16(const epi16x16 &a,
+                                                                       const uint32_t mask) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      return compress_halves(_mm_load_si128(in), _mm_load_si128(in + 1), mask);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi32x8
+    m256_permutevar8x32_epi32(const epi32x8 &a, const epi32x8 &idx) noexcept
+    {
+      return Plain::m256_permutevar8x32_epi32(a, idx);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi32x8
+    m256_i32gather_epi32(const int32_t *base, const epi32x8 &idx) noexcept
+    {
+      return Plain::m256_i32gather_epi32(base, idx);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi64x4
+    m256_i32gather_epi64(const int64_t *base, const epi32x8 &idx) noexcept
+    {
+      return Plain::m256_i32gather_epi64(base, idx);
+    }
+
+    /**
+     * lut_chunks. Looks up each byte of idx in a table of `chunks` 16-byte chunks, where every
+     * index is already less than 16 * chunks. pshufb can only index a single chunk, so we look up
+     * every chunk and OR the results together: for chunk k, the indices in [16k, 16k + 16) have to
+     * be turned into their low nibble, and every other index has to have its top bit set (which
+     * makes pshufb produce zero). Subtracting 16k and then adding 0x70 with unsigned saturation
+     * does exactly that: [16k, 16k + 16) maps to [0x70, 0x80), larger indices end up at or above
+     * 0x80, and smaller ones wrap around below zero and so saturate at 0xFF.
+     */
+    CPP_INTRIN_TARGET_SSSE3 static inline __m128i lut_chunks(const __m128i *table,
+                                                             const unsigned chunks,
+                                                             __m128i idx) noexcept
+    {
+      const __m128i bias = _mm_set1_epi8(0x70);
+      const __m128i step = _mm_set1_epi8(16);
+      __m128i out        = _mm_setzero_si128();
+      for (unsigned k = 0; k < chunks; k++)
+      {
+        const __m128i chunk = _mm_load_si128(table + k);
+        out                 = _mm_or_si128(out, _mm_shuffle_epi8(chunk, _mm_adds_epu8(idx, bias)));
+        idx = _mm_sub_epi8(idx, step);
+      }
+      return out;
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi8x32 lut_halves(const __m128i *table,
+                                                             const unsigned chunks,
+                                                             const __m128i lo,
+                                                             const __m128i hi) noexcept
+    {
+      epi8x32 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, lut_chunks(table, chunks, lo));
+      _mm_store_si128(out + 1, lut_chunks(table, chunks, hi));
+      return c;
+    }
+
+    // Lane j of an int16_t table is bytes 2j and 2j + 1, i.e (2j << 8 | 2j) + 0x0100 as a 16-bit
+    // lane. The shifts can't carry into each other, as 2j < 64.
+    CPP_INTRIN_TARGET_SSE2 static inline __m128i lut_control_epi16(const __m128i idx,
+                                                                   const int16_t index_mask) noexcept
+    {
+      const __m128i j = _mm_and_si128(idx, _mm_set1_epi16(index_mask));
+      return _mm_add_epi16(_mm_or_si128(_mm_slli_epi16(j, 1), _mm_slli_epi16(j, 9)),
+                           _mm_set1_epi16(0x0100));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi8x32 m256_lut32_epi8(const epi8x32 &table,
+                                                                  const epi8x32 &idx) noexcept
+    {
+      const __m128i mask = _mm_set1_epi8(31);
+      const __m128i *in  = reinterpret_cast<const __m128i *>(&idx);
+      return lut_halves(reinterpret_cast<const __m128i *>(&table), 2,
+                        _mm_and_si128(_mm_load_si128(in), mask),
+                        _mm_and_si128(_mm_load_si128(in + 1), mask));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi8x32 m256_lut64_epi8(const epi8x64 &table,
+                                                                  const epi8x32 &idx) noexcept
+    {
+      const __m128i mask = _mm_set1_epi8(63);
+      const __m128i *in  = reinterpret_cast<const __m128i *>(&idx);
+      return lut_halves(reinterpret_cast<const __m128i *>(&table), 4,
+                        _mm_and_si128(_mm_load_si128(in), mask),
+                        _mm_and_si128(_mm_load_si128(in + 1), mask));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16 m256_lut16_epi16(const epi16x16 &table,
+                                                                    const epi16x16 &idx) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&idx);
+      return lut_halves(reinterpret_cast<const __m128i *>(&table), 2,
+                        lut_control_epi16(_mm_load_si128(in), 15),
+                        lut_control_epi16(_mm_load_si128(in + 1), 15))
+          .epi16();
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16 m256_lut32_epi16(const epi16x32 &table,
+                                                                    const epi16x16 &idx) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&idx);
+      return lut_halves(reinterpret_cast<const __m128i *>(&table), 4,
+                        lut_control_epi16(_mm_load_si128(in), 31),
+                        lut_control_epi16(_mm_load_si128(in + 1), 31))
+          .epi16();
+    }
+
+    // The 8-point Walsh-Hadamard transform of x. Each stage swaps the lanes h apart with a single
+    // shuffle and then computes swapped + sign(x, signs), where signs[i] is -1 if bit h of i is
+    // set: this gives x[i] + x[i ^ h] in the bottom lane of each pair, and x[i ^ h] - x[i] in the
+    // top. This is one shuffle, one psignw and one add per stage, rather than the three-uop phaddw.
+    CPP_INTRIN_TARGET_SSSE3 static inline __m128i hadamard8_epi16(__m128i x) noexcept
+    {
+      const __m128i swap_pairs =
+          _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+      x = _mm_add_epi16(_mm_shuffle_epi8(x, swap_pairs),
+                        _mm_sign_epi16(x, _mm_setr_epi16(1, -1, 1, -1, 1, -1, 1, -1)));
+      x = _mm_add_epi16(_mm_shuffle_epi32(x, 0xB1),
+                        _mm_sign_epi16(x, _mm_setr_epi16(1, 1, -1, -1, 1, 1, -1, -1)));
+      return _mm_add_epi16(_mm_shuffle_epi32(x, 0x4E),
+                           _mm_sign_epi16(x, _mm_setr_epi16(1, 1, 1, 1, -1, -1, -1, -1)));
+    }
+
+    // The Walsh-Hadamard transform of the 8 * n lanes in x: each register is transformed on its
+    // own, and then the butterflies between registers are just adds and subtracts.
+    template <unsigned n>
+    CPP_INTRIN_TARGET_SSSE3 static inline void hadamard_epi16(__m128i (&x)[n]) noexcept
+    {
+      for (auto &v : x)
+      {
+        v = hadamard8_epi16(v);
+      }
+      for (unsigned h = 1; h < n; h *= 2)
+      {
+        for (unsigned i = 0; i < n; i += 2 * h)
+        {
+          for (unsigned j = i; j < i + h; j++)
+          {
+            const __m128i u = x[j], v = x[j + h];
+            x[j]            = _mm_add_epi16(u, v);
+            x[j + h]        = _mm_sub_epi16(u, v);
+          }
+        }
+      }
+    }
+
+    // The n vectors at in are transformed as one (16 * n)-point transform, and written to out.
+    template <unsigned n>
+    CPP_INTRIN_TARGET_SSSE3 static inline void hadamard_block(const __m128i *in,
+                                                              __m128i *out) noexcept
+    {
+      __m128i x[2 * n];
+      for (unsigned i = 0; i < 2 * n; i++)
+      {
+        x[i] = _mm_load_si128(in + i);
+      }
+      hadamard_epi16(x);
+      for (unsigned i = 0; i < 2 * n; i++)
+      {
+        _mm_store_si128(out + i, x[i]);
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16 m256_hadamard16_epi16(const epi16x16 &a) noexcept
+    {
+      epi16x16 c;
+      hadamard_block<1>(reinterpret_cast<const __m128i *>(&a), reinterpret_cast<__m128i *>(&c));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x32 m512_hadamard32_epi16(const epi16x32 &a) noexcept
+    {
+      epi16x32 c;
+      hadamard_block<2>(reinterpret_cast<const __m128i *>(&a), reinterpret_cast<__m128i *>(&c));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline void m256_hadamard64_epi16(const epi16x16 *a,
+                                                                     epi16x16 *c) noexcept
+    {
+      hadamard_block<4>(reinterpret_cast<const __m128i *>(a), reinterpret_cast<__m128i *>(c));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline void
+    m256_hadamard16_epi16_bulk(const epi16x16 *a, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        hadamard_block<1>(reinterpret_cast<const __m128i *>(a + i),
+                          reinterpret_cast<__m128i *>(c + i));
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16 m256_sll_epi16(const epi16x16 &a,
+                                                                 const unsigned count) noexcept
+    {
+      // The count is read as a 64-bit integer, so zero-extending count is exactly right.
+      const __m128i n   = _mm_cvtsi32_si128(static_cast<int>(count));
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_sll_epi16(_mm_load_si128(in), n));
+      _mm_store_si128(out + 1, _mm_sll_epi16(_mm_load_si128(in + 1), n));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16 m256_srl_epi16(const epi16x16 &a,
+                                                                 const unsigned count) noexcept
+    {
+      // The count is read as a 64-bit integer, so zero-extending count is exactly right.
+      const __m128i n   = _mm_cvtsi32_si128(static_cast<int>(count));
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_srl_epi16(_mm_load_si128(in), n));
+      _mm_store_si128(out + 1, _mm_srl_epi16(_mm_load_si128(in + 1), n));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi32x8 m256_sllv_epi32(const epi32x8 &a,
+                                                                  const epi32x8 &count) noexcept
+    {
+      return Plain::m256_sllv_epi32(a, count);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi32x8 m256_srlv_epi32(const epi32x8 &a,
+                                                                  const epi32x8 &count) noexcept
+    {
+      return Plain::m256_srlv_epi32(a, count);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi64x4 m256_sllv_epi64(const epi64x4 &a,
+                                                                  const epi64x4 &count) noexcept
+    {
+      return Plain::m256_sllv_epi64(a, count);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi64x4 m256_srlv_epi64(const epi64x4 &a,
+                                                                  const epi64x4 &count) noexcept
+    {
+      return Plain::m256_srlv_epi64(a, count);
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi8x32
+    m256_shuffle_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      epi8x32 c;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[0]),
+                      _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[0])),
+                                       _mm_load_si128(reinterpret_cast<const __m128i *>(&b[0]))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[16]),
+                      _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[16])),
+                                       _mm_load_si128(reinterpret_cast<const __m128i *>(&b[16]))));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi16x16
+    m256_add_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return Plain::m256_add_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline bool
+    m256_testz_si256(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      // Both halves need to be zero for the whole vector to be zero: the & is deliberate, as it
+      // avoids a branch.
+      return _mm_testz_si128(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[0])),
+                             _mm_load_si128(reinterpret_cast<const __m128i *>(&b[0]))) &
+             _mm_testz_si128(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[8])),
+                             _mm_load_si128(reinterpret_cast<const __m128i *>(&b[8])));
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi16x16
+    m256_sub_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return Plain::m256_sub_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_adds_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_adds_epi16(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_adds_epi16(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_subs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_subs_epi16(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_subs_epi16(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_adds_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_adds_epu16(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_adds_epu16(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_subs_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi16x16 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_subs_epu16(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_subs_epu16(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi8x32
+    m256_adds_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi8x32 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_adds_epu8(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_adds_epu8(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi8x32
+    m256_subs_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi8x32 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_subs_epu8(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_subs_epu8(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16
+    m256_sign_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c),
+                      _mm_sign_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a)),
+                                     _mm_load_si128(reinterpret_cast<const __m128i *>(&b))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
+                      _mm_sign_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[8])),
+                                     _mm_load_si128(reinterpret_cast<const __m128i *>(&b[8]))));
+      return c;
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_SSE41 static inline epi64x4
+    m256_permute4x64_epi64(const epi64x4 &a) noexcept
+    {
+      return Plain::template m256_permute4x64_epi64<imm8>(a);
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_SSE41 static inline epi16x16
+    m256_slli_epi16(const epi16x16 &a) noexcept
+    {
+      return Plain::template m256_slli_epi16<imm8>(a);
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_SSE41 static inline epi16x16
+    m256_srli_epi16(const epi16x16 &a) noexcept
+    {
+      return Plain::template m256_srli_epi16<imm8>(a);
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_SSE41 static inline epi16x16
+    m256_srai_epi16(const epi16x16 &a) noexcept
+    {
+      return Plain::template m256_srai_epi16<imm8>(a);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi16x16
+    m256_mullo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return Plain::m256_mullo_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi16x16
+    m256_mulhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return Plain::m256_mulhi_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi32x8
+    m256_madd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      epi32x8 c;
+      __m128i *out = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, _mm_madd_epi16(_mm_load_si128(in_a), _mm_load_si128(in_b)));
+      _mm_store_si128(out + 1, _mm_madd_epi16(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1)));
+      return c;
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_SSE2 static inline Vec256<T> m256_loadu_si256(const T *ptr) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(ptr);
+      Vec256<T> out;
+      __m128i *out_ptr = reinterpret_cast<__m128i *>(&out);
+      _mm_store_si128(out_ptr, _mm_loadu_si128(in));
+      _mm_store_si128(out_ptr + 1, _mm_loadu_si128(in + 1));
+      return out;
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_SSE2 static inline void m256_storeu_si256(T *ptr, const Vec256<T> &a) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      __m128i *out      = reinterpret_cast<__m128i *>(ptr);
+      _mm_storeu_si128(out, _mm_load_si128(in));
+      _mm_storeu_si128(out + 1, _mm_load_si128(in + 1));
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_SSE2 static inline void m256_stream_si256(T *ptr, const Vec256<T> &a) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      __m128i *out      = reinterpret_cast<__m128i *>(ptr);
+      _mm_stream_si128(out, _mm_load_si128(in));
+      _mm_stream_si128(out + 1, _mm_load_si128(in + 1));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline void stream_fence() noexcept
+    {
+      _mm_sfence();
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi32x8
+    m256_maskload_epi32(const int32_t *ptr, const epi32x8 &mask) noexcept
+    {
+      return Plain::m256_maskload_epi32(ptr, mask);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline epi64x4
+    m256_maskload_epi64(const int64_t *ptr, const epi64x4 &mask) noexcept
+    {
+      return Plain::m256_maskload_epi64(ptr, mask);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline void
+    m256_maskstore_epi32(int32_t *ptr, const epi32x8 &mask, const epi32x8 &a) noexcept
+    {
+      Plain::m256_maskstore_epi32(ptr, mask, a);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline void
+    m256_maskstore_epi64(int64_t *ptr, const epi64x4 &mask, const epi64x4 &a) noexcept
+    {
+      Plain::m256_maskstore_epi64(ptr, mask, a);
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16
+    m256_abs_epi16(const epi16x16 &a) noexcept
+    {
+      epi16x16 b;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&b[0]),
+                      _mm_abs_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[0]))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&b[8]),
+                      _mm_abs_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[8]))));
+      return b;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_broadcastsi128_si256(const __uint128_t value) noexcept
+    {
+      epi16x16 a;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&a[0]), reinterpret_cast<__m128i>(value));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&a[8]), reinterpret_cast<__m128i>(value));
+      return a;
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_SSE41 static inline int64_t mm_extract_epi64(const __uint128_t value) noexcept
+    {
+      return static_cast<int64_t>(_mm_extract_epi64(reinterpret_cast<__m128i>(value), pos));
+    }
+
+    template <unsigned pos, typename T>
+    CPP_INTRIN_TARGET_SSE2 static inline __uint128_t
+    m256_extracti128_si256(const Vec256<T> &a) noexcept
+    {
+      return Plain::template m256_extracti128_si256<pos, T>(a);
+    }
+
+    template <unsigned pos, typename T>
+    CPP_INTRIN_TARGET_SSE2 static inline Vec256<T>
+    m256_inserti128_si256(const Vec256<T> &a, const __uint128_t b) noexcept
+    {
+      return Plain::template m256_inserti128_si256<pos, T>(a, b);
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_SSE2 static inline int16_t m256_extract_epi16(const epi16x16 &a) noexcept
+    {
+      return Plain::template m256_extract_epi16<pos>(a);
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_SSE2 static inline int64_t m256_extract_epi64(const epi64x4 &a) noexcept
+    {
+      return Plain::template m256_extract_epi64<pos>(a);
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_unpacklo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[0]),
+                      _mm_unpacklo_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[0])),
+                                         _mm_load_si128(reinterpret_cast<const __m128i *>(&b[0]))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
+                      _mm_unpacklo_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[8])),
+                                         _mm_load_si128(reinterpret_cast<const __m128i *>(&b[8]))));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x16
+    m256_unpackhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[0]),
+                      _mm_unpackhi_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[0])),
+                                         _mm_load_si128(reinterpret_cast<const __m128i *>(&b[0]))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[8]),
+                      _mm_unpackhi_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[8])),
+                                         _mm_load_si128(reinterpret_cast<const __m128i *>(&b[8]))));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi32x8
+    m256_unpacklo_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+    {
+      epi32x8 c;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[0]),
+                      _mm_unpacklo_epi32(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[0])),
+                                         _mm_load_si128(reinterpret_cast<const __m128i *>(&b[0]))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[4]),
+                      _mm_unpacklo_epi32(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[4])),
+                                         _mm_load_si128(reinterpret_cast<const __m128i *>(&b[4]))));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi32x8
+    m256_unpackhi_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+    {
+      epi32x8 c;
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[0]),
+                      _mm_unpackhi_epi32(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[0])),
+                                         _mm_load_si128(reinterpret_cast<const __m128i *>(&b[0]))));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&c[4]),
+                      _mm_unpackhi_epi32(_mm_load_si128(reinterpret_cast<const __m128i *>(&a[4])),
+                                         _mm_load_si128(reinterpret_cast<const __m128i *>(&b[4]))));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x16
+    m256_subabs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      epi16x16 c;
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      for (unsigned i = 0; i < 2; i++)
+      {
+        _mm_store_si128(reinterpret_cast<__m128i *>(&c) + i,
+                        _mm_abs_epi16(_mm_sub_epi16(_mm_load_si128(in_a + i),
+                                                    _mm_load_si128(in_b + i))));
+      }
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline bool
+    m256_and_testz_si256(const epi16x16 &a, const epi16x16 &b, const epi16x16 &c) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      const __m128i *in_c = reinterpret_cast<const __m128i *>(&c);
+      // We fold both halves together before testing, so there's only one ptest.
+      const __m128i lo   = _mm_and_si128(_mm_load_si128(in_a), _mm_load_si128(in_b));
+      const __m128i hi   = _mm_and_si128(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1));
+      const __m128i both = _mm_or_si128(_mm_and_si128(lo, _mm_load_si128(in_c)),
+                                        _mm_and_si128(hi, _mm_load_si128(in_c + 1)));
+      return _mm_testz_si128(both, both);
+    }
+
+    // popcount_epi8. Returns the number of set bits in each byte of a, via the nibble lookup
+    // described above m256_popcount_epi8.
+    CPP_INTRIN_TARGET_SSSE3 static inline __m128i popcount_epi8(const __m128i a) noexcept
+    {
+      const __m128i lut      = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const __m128i low_mask = _mm_set1_epi8(0x0F);
+      const __m128i lo       = _mm_and_si128(a, low_mask);
+      const __m128i hi       = _mm_and_si128(_mm_srli_epi16(a, 4), low_mask);
+      return _mm_add_epi8(_mm_shuffle_epi8(lut, lo), _mm_shuffle_epi8(lut, hi));
+    }
+
+    // popcount_epi64. As above, but the byte counts are summed into each 64-bit lane via psadbw.
+    CPP_INTRIN_TARGET_SSSE3 static inline __m128i popcount_epi64(const __m128i a) noexcept
+    {
+      return _mm_sad_epu8(popcount_epi8(a), _mm_setzero_si128());
+    }
+
+    // reduce_add_epi64. Returns the sum of the two 64-bit lanes of a.
+    CPP_INTRIN_TARGET_SSE2 static inline uint64_t reduce_add_epi64(const __m128i a) noexcept
+    {
+      return static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_add_epi64(a, _mm_unpackhi_epi64(a, a))));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi8x32 m256_popcount_epi8(const epi8x32 &a) noexcept
+    {
+      epi8x32 c;
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      __m128i *out      = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, popcount_epi8(_mm_load_si128(in)));
+      _mm_store_si128(out + 1, popcount_epi8(_mm_load_si128(in + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi64x4 m256_popcount_epi64(const epi64x4 &a) noexcept
+    {
+      epi64x4 c;
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      __m128i *out      = reinterpret_cast<__m128i *>(&c);
+      _mm_store_si128(out, popcount_epi64(_mm_load_si128(in)));
+      _mm_store_si128(out + 1, popcount_epi64(_mm_load_si128(in + 1)));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline unsigned m256_popcount_si256(const epi64x4 &a) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      // We add the byte counts before the psadbw: each byte count is at most 8, so this can't
+      // overflow.
+      const __m128i bytes =
+          _mm_add_epi8(popcount_epi8(_mm_load_si128(in)), popcount_epi8(_mm_load_si128(in + 1)));
+      return static_cast<unsigned>(reduce_add_epi64(_mm_sad_epu8(bytes, _mm_setzero_si128())));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline unsigned
+    m256_xor_popcount_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      const __m128i bytes =
+          _mm_add_epi8(popcount_epi8(_mm_xor_si128(_mm_load_si128(in_a), _mm_load_si128(in_b))),
+                       popcount_epi8(_mm_xor_si128(_mm_load_si128(in_a + 1),
+                                                   _mm_load_si128(in_b + 1))));
+      return static_cast<unsigned>(reduce_add_epi64(_mm_sad_epu8(bytes, _mm_setzero_si128())));
+    }
+
+    // reduce_add_epi16. Returns the wrapping sum of the 8 lanes of `a` via a shuffle tree.
+    CPP_INTRIN_TARGET_SSE2 static inline int16_t reduce_add_epi16(__m128i a) noexcept
+    {
+      a = _mm_add_epi16(a, _mm_shuffle_epi32(a, 0x4E));
+      a = _mm_add_epi16(a, _mm_shuffle_epi32(a, 0xB1));
+      a = _mm_add_epi16(a, _mm_shufflelo_epi16(a, 0xB1));
+      return static_cast<int16_t>(_mm_cvtsi128_si32(a));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline int16_t
+    m256_hadd_reduce_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      const __m128i sum_a = _mm_add_epi16(_mm_load_si128(in_a), _mm_load_si128(in_a + 1));
+      const __m128i sum_b = _mm_add_epi16(_mm_load_si128(in_b), _mm_load_si128(in_b + 1));
+      return reduce_add_epi16(_mm_add_epi16(sum_a, sum_b));
+    }
+
+    // reduce_add_epi32. Returns the wrapping sum of the 4 lanes of `a` via a shuffle tree.
+    CPP_INTRIN_TARGET_SSE2 static inline int32_t reduce_add_epi32(__m128i a) noexcept
+    {
+      a = _mm_add_epi32(a, _mm_shuffle_epi32(a, 0x4E));
+      a = _mm_add_epi32(a, _mm_shuffle_epi32(a, 0xB1));
+      return _mm_cvtsi128_si32(a);
+    }
+
+    // reduce_min_epi16 and reduce_max_epi16 return the smallest (resp. largest) of the 8 signed
+    // lanes of `a`. _mm_minpos_epu16 only handles unsigned lanes: xoring with 0x8000 maps the
+    // signed order onto the unsigned order, and xoring with 0x7FFF maps it onto the reverse order.
+    CPP_INTRIN_TARGET_SSE41 static inline int16_t reduce_min_epi16(const __m128i a) noexcept
+    {
+      const __m128i flip = _mm_set1_epi16(INT16_MIN);
+      return static_cast<int16_t>(
+          _mm_cvtsi128_si32(_mm_xor_si128(_mm_minpos_epu16(_mm_xor_si128(a, flip)), flip)));
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline int16_t reduce_max_epi16(const __m128i a) noexcept
+    {
+      const __m128i flip = _mm_set1_epi16(INT16_MAX);
+      return static_cast<int16_t>(
+          _mm_cvtsi128_si32(_mm_xor_si128(_mm_minpos_epu16(_mm_xor_si128(a, flip)), flip)));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline int32_t m256_reduce_add_epi16(const epi16x16 &a) noexcept
+    {
+      // pmaddwd against ones sums adjacent pairs into 32-bit lanes, so nothing can overflow.
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      const __m128i one = _mm_set1_epi16(1);
+      return reduce_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_load_si128(in), one),
+                                            _mm_madd_epi16(_mm_load_si128(in + 1), one)));
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline int16_t m256_reduce_min_epi16(const epi16x16 &a) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      return reduce_min_epi16(_mm_min_epi16(_mm_load_si128(in), _mm_load_si128(in + 1)));
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline int16_t m256_reduce_max_epi16(const epi16x16 &a) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      return reduce_max_epi16(_mm_max_epi16(_mm_load_si128(in), _mm_load_si128(in + 1)));
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline unsigned
+    m256_reduce_argmax_epi16(const epi16x16 &a) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      const __m128i lo  = _mm_load_si128(in);
+      const __m128i hi  = _mm_load_si128(in + 1);
+      const __m128i max = _mm_set1_epi16(reduce_max_epi16(_mm_max_epi16(lo, hi)));
+      // Each 16-bit lane contributes two bits to the mask, so the index is half the bit position.
+      const unsigned lo_mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(lo, max)));
+      const unsigned hi_mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(hi, max)));
+      return static_cast<unsigned>(__builtin_ctz(lo_mask | (hi_mask << 16))) / 2;
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline void
+    m256_add_epi16_bulk(const epi16x16 *a, const epi16x16 *b,
+                        epi16x16 *c, const size_t n) noexcept
+    {
+      Plain::m256_add_epi16_bulk(a, b, c, n);
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline void
+    m256_sub_epi16_bulk(const epi16x16 *a, const epi16x16 *b,
+                        epi16x16 *c, const size_t n) noexcept
+    {
+      Plain::m256_sub_epi16_bulk(a, b, c, n);
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline void
+    m256_adds_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in_a = reinterpret_cast<const __m128i *>(&a[i]);
+        const __m128i *in_b = reinterpret_cast<const __m128i *>(&b[i]);
+        __m128i *out        = reinterpret_cast<__m128i *>(&c[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          _mm_store_si128(out + h,
+                          _mm_adds_epi16(_mm_load_si128(in_a + h), _mm_load_si128(in_b + h)));
+        }
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline void
+    m256_subs_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in_a = reinterpret_cast<const __m128i *>(&a[i]);
+        const __m128i *in_b = reinterpret_cast<const __m128i *>(&b[i]);
+        __m128i *out        = reinterpret_cast<__m128i *>(&c[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          _mm_store_si128(out + h,
+                          _mm_subs_epi16(_mm_load_si128(in_a + h), _mm_load_si128(in_b + h)));
+        }
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline void
+    m256_adds_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in_a = reinterpret_cast<const __m128i *>(&a[i]);
+        const __m128i *in_b = reinterpret_cast<const __m128i *>(&b[i]);
+        __m128i *out        = reinterpret_cast<__m128i *>(&c[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          _mm_store_si128(out + h,
+                          _mm_adds_epu16(_mm_load_si128(in_a + h), _mm_load_si128(in_b + h)));
+        }
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline void
+    m256_subs_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in_a = reinterpret_cast<const __m128i *>(&a[i]);
+        const __m128i *in_b = reinterpret_cast<const __m128i *>(&b[i]);
+        __m128i *out        = reinterpret_cast<__m128i *>(&c[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          _mm_store_si128(out + h,
+                          _mm_subs_epu16(_mm_load_si128(in_a + h), _mm_load_si128(in_b + h)));
+        }
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline void
+    m256_adds_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in_a = reinterpret_cast<const __m128i *>(&a[i]);
+        const __m128i *in_b = reinterpret_cast<const __m128i *>(&b[i]);
+        __m128i *out        = reinterpret_cast<__m128i *>(&c[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          _mm_store_si128(out + h,
+                          _mm_adds_epu8(_mm_load_si128(in_a + h), _mm_load_si128(in_b + h)));
+        }
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline void
+    m256_subs_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in_a = reinterpret_cast<const __m128i *>(&a[i]);
+        const __m128i *in_b = reinterpret_cast<const __m128i *>(&b[i]);
+        __m128i *out        = reinterpret_cast<__m128i *>(&c[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          _mm_store_si128(out + h,
+                          _mm_subs_epu8(_mm_load_si128(in_a + h), _mm_load_si128(in_b + h)));
+        }
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSE41 static inline void
+    m256_xor_epi64_bulk(const epi64x4 *a, const epi64x4 *b,
+                        epi64x4 *c, const size_t n) noexcept
+    {
+      Plain::m256_xor_epi64_bulk(a, b, c, n);
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline void
+    m256_sign_epi16_bulk(const epi16x16 *a, const epi16x16 *b,
+                         epi16x16 *c, const size_t n) noexcept
+    {
+      // Each vector is two independent halves, so there's plenty of parallelism per iteration
+      // already: we don't unroll any further than that.
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in_a = reinterpret_cast<const __m128i *>(&a[i]);
+        const __m128i *in_b = reinterpret_cast<const __m128i *>(&b[i]);
+        __m128i *out        = reinterpret_cast<__m128i *>(&c[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          _mm_store_si128(out + h,
+                          _mm_sign_epi16(_mm_load_si128(in_a + h), _mm_load_si128(in_b + h)));
+        }
+      }
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline uint64_t
+    m256_popcount_si256_bulk(const epi64x4 *a, const size_t n) noexcept
+    {
+      __m128i total = _mm_setzero_si128();
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in = reinterpret_cast<const __m128i *>(&a[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          total = _mm_add_epi64(total, popcount_epi64(_mm_load_si128(in + h)));
+        }
+      }
+      return reduce_add_epi64(total);
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline uint64_t
+    m256_xor_popcount_epi64_bulk(const epi64x4 *a, const epi64x4 *b, const size_t n) noexcept
+    {
+      __m128i total = _mm_setzero_si128();
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m128i *in_a = reinterpret_cast<const __m128i *>(&a[i]);
+        const __m128i *in_b = reinterpret_cast<const __m128i *>(&b[i]);
+        for (unsigned h = 0; h < 2; h++)
+        {
+          const __m128i diff = _mm_xor_si128(_mm_load_si128(in_a + h), _mm_load_si128(in_b + h));
+          total              = _mm_add_epi64(total, popcount_epi64(diff));
+        }
+      }
+      return reduce_add_epi64(total);
+    }
+    // The 512-bit operations are the 256-bit ones applied to each half. Each one has the same
+    // target as the 256-bit function that it calls, so that the calls are inlined.
+    // The element-wise m512 operations below only need SSE2, like m512_cmpgt_epi16, and so they
+    // use the plain m256 versions (which GCC vectorises) rather than the SSE4.1 ones.
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x32 m512_add_epi16(const epi16x32 &a,
+                                                                  const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(Plain::m256_add_epi16(a.lo(), b.lo()),
+                            Plain::m256_add_epi16(a.hi(), b.hi()));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x32 m512_sub_epi16(const epi16x32 &a,
+                                                                  const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(Plain::m256_sub_epi16(a.lo(), b.lo()),
+                            Plain::m256_sub_epi16(a.hi(), b.hi()));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x32 m512_sign_epi16(const epi16x32 &a,
+                                                                    const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(m256_sign_epi16(a.lo(), b.lo()), m256_sign_epi16(a.hi(), b.hi()));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi16x32 m512_abs_epi16(const epi16x32 &a) noexcept
+    {
+      return epi16x32::join(m256_abs_epi16(a.lo()), m256_abs_epi16(a.hi()));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi64x8 m512_and_epi64(const epi64x8 &a,
+                                                                const epi64x8 &b) noexcept
+    {
+      return epi64x8::join(Plain::m256_and_epi64(a.lo(), b.lo()),
+                           Plain::m256_and_epi64(a.hi(), b.hi()));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi64x8 m512_or_epi64(const epi64x8 &a,
+                                                               const epi64x8 &b) noexcept
+    {
+      return epi64x8::join(Plain::m256_or_epi64(a.lo(), b.lo()),
+                           Plain::m256_or_epi64(a.hi(), b.hi()));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi64x8 m512_xor_epi64(const epi64x8 &a,
+                                                                const epi64x8 &b) noexcept
+    {
+      return epi64x8::join(Plain::m256_xor_epi64(a.lo(), b.lo()),
+                           Plain::m256_xor_epi64(a.hi(), b.hi()));
+    }
+
+    CPP_INTRIN_TARGET_SSSE3 static inline epi8x64 m512_shuffle_epi8(const epi8x64 &a,
+                                                                     const epi8x64 &b) noexcept
+    {
+      return epi8x64::join(m256_shuffle_epi8(a.lo(), b.lo()), m256_shuffle_epi8(a.hi(), b.hi()));
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_SSE2 static inline epi64x8 m512_permute4x64_epi64(const epi64x8 &a) noexcept
+    {
+      return epi64x8::join(Plain::template m256_permute4x64_epi64<imm8>(a.lo()),
+                           Plain::template m256_permute4x64_epi64<imm8>(a.hi()));
+    }
+
+    // Without SSE4.1's ptest, we check that every byte of the combined vector is zero.
+    CPP_INTRIN_TARGET_SSE2 static inline bool m512_testz_si512(const epi16x32 &a,
+                                                                const epi16x32 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      __m128i both        = _mm_and_si128(_mm_load_si128(in_a), _mm_load_si128(in_b));
+      for (unsigned i = 1; i < 4; i++)
+      {
+        const __m128i next = _mm_and_si128(_mm_load_si128(in_a + i), _mm_load_si128(in_b + i));
+        both               = _mm_or_si128(both, next);
+      }
+      return _mm_movemask_epi8(_mm_cmpeq_epi8(both, _mm_setzero_si128())) == 0xFFFF;
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline epi16x32 m512_cmpgt_epi16(const epi16x32 &a,
+                                                                    const epi16x32 &b) noexcept
+    {
+      return epi16x32::join(m256_cmpgt_epi16(a.lo(), b.lo()), m256_cmpgt_epi16(a.hi(), b.hi()));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline uint16_t m256_cmpgt_epi16_mask(const epi16x16 &a,
+                                                                         const epi16x16 &b) noexcept
+    {
+      const __m128i *in_a = reinterpret_cast<const __m128i *>(&a);
+      const __m128i *in_b = reinterpret_cast<const __m128i *>(&b);
+      const __m128i lo    = _mm_cmpgt_epi16(_mm_load_si128(in_a), _mm_load_si128(in_b));
+      const __m128i hi    = _mm_cmpgt_epi16(_mm_load_si128(in_a + 1), _mm_load_si128(in_b + 1));
+      // The comparison results are 0 or -1, so the signed saturating pack keeps them intact.
+      return static_cast<uint16_t>(_mm_movemask_epi8(_mm_packs_epi16(lo, hi)));
+    }
+
+    CPP_INTRIN_TARGET_SSE2 static inline uint32_t m512_cmpgt_epi16_mask(const epi16x32 &a,
+                                                                         const epi16x32 &b) noexcept
+    {
+      return uint32_t(m256_cmpgt_epi16_mask(a.lo(), b.lo())) |
+             (uint32_t(m256_cmpgt_epi16_mask(a.hi(), b.hi())) << 16);
+    }
+  };
+
+  /***
+   * AVX2. This struct contains the implementations that operate over a single 256-bit register.
+   * As with the SSE tier, the operations that GCC vectorises well on its own are just the Plain
+   * versions re-compiled for AVX2: this is still worthwhile for the runtime dispatch, since it
+   * means the compiler can use the full 256-bit registers.
+   *
+   * This function also makes use of reinterpret cast: the C++ standard dictates that
+   * these should not generate extra machine instructions, so there's no overhead here.
+   */
+  struct AVX2
+  {
+    /**
+     * to_m256i and from_m256i convert between Vec256 and __m256i. Vec256 is 32-byte aligned, so
+     * these are aligned loads and stores: when the surrounding code is inlined, these typically
+     * disappear entirely.
+     */
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i to_m256i(const Vec256<T> &a) noexcept
+    {
+      return _mm256_load_si256(reinterpret_cast<const __m256i *>(&a));
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline Vec256<T> from_m256i(const __m256i a) noexcept
+    {
+      Vec256<T> out;
+      _mm256_store_si256(reinterpret_cast<__m256i *>(&out), a);
+      return out;
+    }
+
+    /**
+     * Register-resident implementations. These accept and return __m256i by value, so chained
+     * operations stay in YMM registers. The Vec256 implementations further down are layered on top
+     * of these.
+     */
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_hadd_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_hadd_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_xor_epi64(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_xor_si256(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_or_epi64(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_or_si256(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_and_epi64(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_and_si256(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_and_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_and_si256(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_cmpgt_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_cmpgt_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_cmpeq_epi8(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_cmpeq_epi8(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_cmpeq_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_cmpeq_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_cmpgt_epi8(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_cmpgt_epi8(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_cmplt_epi8(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_cmpgt_epi8(b, a);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_cmplt_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_cmpgt_epi16(b, a);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_blendv_epi8(const __m256i a, const __m256i b, const __m256i mask) noexcept
+    {
+      return _mm256_blendv_epi8(a, b, mask);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline uint32_t m256_movemask_epi8(const __m256i a) noexcept
+    {
+      return static_cast<uint32_t>(_mm256_movemask_epi8(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline uint32_t m256_movemask_epi16(const __m256i a) noexcept
+    {
+      // _mm256_packs_epi16 packs within each half, so we pack the two halves against each other
+      // instead: this keeps the lanes in order.
+      const __m128i packed =
+          _mm_packs_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+      return static_cast<uint32_t>(_mm_movemask_epi8(packed));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_compress_epi16(const __m256i a,
+                                                                     const uint32_t mask) noexcept
+    {
+      // AVX2 can't move 16-bit lanes across the two halves, and so this is the SSSE3 version.
+      return to_m256i(
+          SSE::compress_halves(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1), mask));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_permutevar8x32_epi32(const __m256i a, const __m256i idx) noexcept
+    {
+      return _mm256_permutevar8x32_epi32(a, idx);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_i32gather_epi32(const int32_t *base,
+                                                                      const __m256i idx) noexcept
+    {
+      return _mm256_i32gather_epi32(base, idx, 4);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_i32gather_epi64(const int64_t *base,
+                                                                      const __m256i idx) noexcept
+    {
+      return _mm256_i32gather_epi64(reinterpret_cast<const long long *>(base),
+                                    _mm256_castsi256_si128(idx), 8);
+    }
+
+    // This is SSE::lut_chunks over both halves at once: each chunk is broadcast to both halves.
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i lut_chunks(const __m256i *chunks,
+                                                            const unsigned n, __m256i idx) noexcept
+    {
+      const __m256i bias = _mm256_set1_epi8(0x70);
+      const __m256i step = _mm256_set1_epi8(16);
+      __m256i out        = _mm256_setzero_si256();
+      for (unsigned k = 0; k < n; k++)
+      {
+        out = _mm256_or_si256(out, _mm256_shuffle_epi8(chunks[k], _mm256_adds_epu8(idx, bias)));
+        idx = _mm256_sub_epi8(idx, step);
+      }
+      return out;
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    lut_control_epi16(const __m256i idx, const int16_t index_mask) noexcept
+    {
+      const __m256i j = _mm256_and_si256(idx, _mm256_set1_epi16(index_mask));
+      return _mm256_add_epi16(_mm256_or_si256(_mm256_slli_epi16(j, 1), _mm256_slli_epi16(j, 9)),
+                              _mm256_set1_epi16(0x0100));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_lut32_epi8(const __m256i table,
+                                                                 const __m256i idx) noexcept
+    {
+      const __m256i chunks[2] = {_mm256_permute2x128_si256(table, table, 0x00),
+                                 _mm256_permute2x128_si256(table, table, 0x11)};
+      return lut_chunks(chunks, 2, _mm256_and_si256(idx, _mm256_set1_epi8(31)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_lut16_epi16(const __m256i table,
+                                                                  const __m256i idx) noexcept
+    {
+      // The control is already in range, so the mask in m256_lut32_epi8 changes nothing.
+      return m256_lut32_epi8(table, lut_control_epi16(idx, 15));
+    }
+
+    /**
+     * m256_hadamard16_epi16. Each stage swaps the lanes h apart with a single shuffle and then
+     * computes swapped + sign(x, signs), where signs[i] is -1 if bit h of i is set. This is
+     * 4 shuffles, 4 vpsignws and 4 adds: the three in-lane shuffles are 1-cycle, and only the
+     * last stage crosses lanes. Building the same transform out of vphaddw costs two shuffles per
+     * stage instead, and these all compete for the one shuffle port on Intel cores.
+     */
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_hadamard16_epi16(__m256i x) noexcept
+    {
+      const __m256i swap_pairs = _mm256_broadcastsi128_si256(
+          _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13));
+      const __m256i s1 = _mm256_broadcastsi128_si256(_mm_setr_epi16(1, -1, 1, -1, 1, -1, 1, -1));
+      const __m256i s2 = _mm256_broadcastsi128_si256(_mm_setr_epi16(1, 1, -1, -1, 1, 1, -1, -1));
+      const __m256i s4 = _mm256_broadcastsi128_si256(_mm_setr_epi16(1, 1, 1, 1, -1, -1, -1, -1));
+      const __m256i s8 = _mm256_setr_m128i(_mm_set1_epi16(1), _mm_set1_epi16(-1));
+
+      x = _mm256_add_epi16(_mm256_shuffle_epi8(x, swap_pairs), _mm256_sign_epi16(x, s1));
+      x = _mm256_add_epi16(_mm256_shuffle_epi32(x, 0xB1), _mm256_sign_epi16(x, s2));
+      x = _mm256_add_epi16(_mm256_shuffle_epi32(x, 0x4E), _mm256_sign_epi16(x, s4));
+      return _mm256_add_epi16(_mm256_permute4x64_epi64(x, 0x4E), _mm256_sign_epi16(x, s8));
+    }
+
+    // The Walsh-Hadamard transform of the 16 * n lanes in x: each register is transformed on its
+    // own, and then the butterflies between registers are just adds and subtracts.
+    template <unsigned n>
+    CPP_INTRIN_TARGET_AVX2 static inline void hadamard_epi16(__m256i (&x)[n]) noexcept
+    {
+      for (auto &v : x)
+      {
+        v = m256_hadamard16_epi16(v);
+      }
+      for (unsigned h = 1; h < n; h *= 2)
+      {
+        for (unsigned i = 0; i < n; i += 2 * h)
+        {
+          for (unsigned j = i; j < i + h; j++)
+          {
+            const __m256i u = x[j], v = x[j + h];
+            x[j]            = _mm256_add_epi16(u, v);
+            x[j + h]        = _mm256_sub_epi16(u, v);
+          }
+        }
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_sll_epi16(const __m256i a,
+                                                                const unsigned count) noexcept
+    {
+      return _mm256_sll_epi16(a, _mm_cvtsi32_si128(static_cast<int>(count)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_srl_epi16(const __m256i a,
+                                                                const unsigned count) noexcept
+    {
+      return _mm256_srl_epi16(a, _mm_cvtsi32_si128(static_cast<int>(count)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_sllv_epi32(const __m256i a,
+                                                                 const __m256i count) noexcept
+    {
+      return _mm256_sllv_epi32(a, count);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_srlv_epi32(const __m256i a,
+                                                                 const __m256i count) noexcept
+    {
+      return _mm256_srlv_epi32(a, count);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_sllv_epi64(const __m256i a,
+                                                                 const __m256i count) noexcept
+    {
+      return _mm256_sllv_epi64(a, count);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_srlv_epi64(const __m256i a,
+                                                                 const __m256i count) noexcept
+    {
+      return _mm256_srlv_epi64(a, count);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_shuffle_epi8(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_shuffle_epi8(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_add_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_add_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline bool
+    m256_testz_si256(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_testz_si256(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_sub_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_sub_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_adds_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_adds_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_subs_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_subs_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_adds_epu16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_adds_epu16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_subs_epu16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_subs_epu16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_adds_epu8(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_adds_epu8(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_subs_epu8(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_subs_epu8(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_sign_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_sign_epi16(a, b);
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_permute4x64_epi64(const __m256i a) noexcept
+    {
+      return _mm256_permute4x64_epi64(a, imm8);
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_slli_epi16(const __m256i a) noexcept
+    {
+      return _mm256_slli_epi16(a, imm8);
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_srli_epi16(const __m256i a) noexcept
+    {
+      return _mm256_srli_epi16(a, imm8);
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_srai_epi16(const __m256i a) noexcept
+    {
+      return _mm256_srai_epi16(a, imm8);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_mullo_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_mullo_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_mulhi_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_mulhi_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_madd_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_madd_epi16(a, b);
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline Vec256<T> m256_loadu_si256(const T *ptr) noexcept
+    {
+      return from_m256i<T>(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr)));
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline void m256_storeu_si256(T *ptr, const Vec256<T> &a) noexcept
+    {
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(ptr), to_m256i(a));
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline void m256_stream_si256(T *ptr, const Vec256<T> &a) noexcept
+    {
+      _mm256_stream_si256(reinterpret_cast<__m256i *>(ptr), to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void stream_fence() noexcept
+    {
+      _mm_sfence();
+    }
+
+    // The 64-bit intrinsics take long long pointers, which are a different type to int64_t on
+    // LP64 platforms (where int64_t is long).
+    CPP_INTRIN_TARGET_AVX2 static inline epi32x8
+    m256_maskload_epi32(const int32_t *ptr, const epi32x8 &mask) noexcept
+    {
+      return from_m256i<int32_t>(_mm256_maskload_epi32(ptr, to_m256i(mask)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4
+    m256_maskload_epi64(const int64_t *ptr, const epi64x4 &mask) noexcept
+    {
+      return from_m256i<int64_t>(
+          _mm256_maskload_epi64(reinterpret_cast<const long long *>(ptr), to_m256i(mask)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_maskstore_epi32(int32_t *ptr, const epi32x8 &mask, const epi32x8 &a) noexcept
+    {
+      _mm256_maskstore_epi32(ptr, to_m256i(mask), to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_maskstore_epi64(int64_t *ptr, const epi64x4 &mask, const epi64x4 &a) noexcept
+    {
+      _mm256_maskstore_epi64(reinterpret_cast<long long *>(ptr), to_m256i(mask), to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_abs_epi16(const __m256i a) noexcept
+    {
+      return _mm256_abs_epi16(a);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_broadcastsi128_si256(const __m128i value) noexcept
+    {
+      return _mm256_broadcastsi128_si256(value);
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_AVX2 static inline int64_t mm_extract_epi64(const __m128i value) noexcept
+    {
+      return static_cast<int64_t>(_mm_extract_epi64(value, pos));
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_AVX2 static inline __m128i m256_extracti128_si256(const __m256i a) noexcept
+    {
+      return _mm256_extracti128_si256(a, pos);
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_inserti128_si256(const __m256i a, const __m128i b) noexcept
+    {
+      return _mm256_inserti128_si256(a, b, pos);
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_AVX2 static inline int16_t m256_extract_epi16(const __m256i a) noexcept
+    {
+      return static_cast<int16_t>(_mm256_extract_epi16(a, pos));
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_AVX2 static inline int64_t m256_extract_epi64(const __m256i a) noexcept
+    {
+      return static_cast<int64_t>(_mm256_extract_epi64(a, pos));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_unpacklo_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_unpacklo_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_unpackhi_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_unpackhi_epi16(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_unpacklo_epi32(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_unpacklo_epi32(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_unpackhi_epi32(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_unpackhi_epi32(a, b);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i
+    m256_subabs_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      return _mm256_abs_epi16(_mm256_sub_epi16(a, b));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline bool
+    m256_and_testz_si256(const __m256i a, const __m256i b, const __m256i c) noexcept
+    {
+      return _mm256_testz_si256(_mm256_and_si256(a, b), c);
+    }
+
+    // m256_popcount_epi8. This is the nibble lookup described above the public function: the
+    // lookup table is repeated in both 128-bit lanes, as vpshufb doesn't cross lanes.
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_popcount_epi8(const __m256i a) noexcept
+    {
+      const __m256i lut      = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const __m256i low_mask = _mm256_set1_epi8(0x0F);
+      const __m256i lo       = _mm256_and_si256(a, low_mask);
+      const __m256i hi       = _mm256_and_si256(_mm256_srli_epi16(a, 4), low_mask);
+      return _mm256_add_epi8(m256_shuffle_epi8(lut, lo), m256_shuffle_epi8(lut, hi));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i m256_popcount_epi64(const __m256i a) noexcept
+    {
+      return _mm256_sad_epu8(m256_popcount_epi8(a), _mm256_setzero_si256());
+    }
+
+    // reduce_add_epi64. Returns the sum of the four 64-bit lanes of a.
+    CPP_INTRIN_TARGET_AVX2 static inline uint64_t reduce_add_epi64(const __m256i a) noexcept
+    {
+      return SSE::reduce_add_epi64(
+          _mm_add_epi64(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline unsigned m256_popcount_si256(const __m256i a) noexcept
+    {
+      return static_cast<unsigned>(reduce_add_epi64(m256_popcount_epi64(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline unsigned
+    m256_xor_popcount_epi64(const __m256i a, const __m256i b) noexcept
+    {
+      return m256_popcount_si256(_mm256_xor_si256(a, b));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline int16_t
+    m256_hadd_reduce_epi16(const __m256i a, const __m256i b) noexcept
+    {
+      const __m256i sum = _mm256_add_epi16(a, b);
+      return SSE::reduce_add_epi16(
+          _mm_add_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+    }
+
+    // The reductions first combine the two 128-bit lanes, and then use the SSE shuffle trees.
+    CPP_INTRIN_TARGET_AVX2 static inline int32_t m256_reduce_add_epi16(const __m256i a) noexcept
+    {
+      const __m256i sum = _mm256_madd_epi16(a, _mm256_set1_epi16(1));
+      return SSE::reduce_add_epi32(
+          _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline int16_t m256_reduce_min_epi16(const __m256i a) noexcept
+    {
+      return SSE::reduce_min_epi16(
+          _mm_min_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline int16_t m256_reduce_max_epi16(const __m256i a) noexcept
+    {
+      return SSE::reduce_max_epi16(
+          _mm_max_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline unsigned m256_reduce_argmax_epi16(const __m256i a) noexcept
+    {
+      const __m256i max   = _mm256_set1_epi16(m256_reduce_max_epi16(a));
+      const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, max)));
+      return static_cast<unsigned>(__builtin_ctz(mask)) / 2;
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_hadd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_hadd_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4
+    m256_xor_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      return from_m256i<int64_t>(m256_xor_epi64(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4
+    m256_or_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      return from_m256i<int64_t>(m256_or_epi64(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4
+    m256_and_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      return from_m256i<int64_t>(m256_and_epi64(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_and_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_and_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_cmpgt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_cmpgt_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32
+    m256_cmpeq_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return from_m256i<int8_t>(m256_cmpeq_epi8(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_cmpeq_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_cmpeq_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32
+    m256_cmpgt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return from_m256i<int8_t>(m256_cmpgt_epi8(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32
+    m256_cmplt_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return from_m256i<int8_t>(m256_cmplt_epi8(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_cmplt_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_cmplt_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32
+    m256_blendv_epi8(const epi8x32 &a, const epi8x32 &b, const epi8x32 &mask) noexcept
+    {
+      return from_m256i<int8_t>(m256_blendv_epi8(to_m256i(a), to_m256i(b), to_m256i(mask)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline uint32_t m256_movemask_epi8(const epi8x32 &a) noexcept
+    {
+      return m256_movemask_epi8(to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline uint32_t m256_movemask_epi16(const epi16x16 &a) noexcept
+    {
+      return m256_movemask_epi16(to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16 m256_compress_epi16(const epi16x16 &a,
+                                                                      const uint32_t mask) noexcept
+    {
+      const __m128i *in = reinterpret_cast<const __m128i *>(&a);
+      return SSE::compress_halves(_mm_load_si128(in), _mm_load_si128(in + 1), mask);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi32x8
+    m256_permutevar8x32_epi32(const epi32x8 &a, const epi32x8 &idx) noexcept
+    {
+      return from_m256i<int32_t>(m256_permutevar8x32_epi32(to_m256i(a), to_m256i(idx)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi32x8 m256_i32gather_epi32(const int32_t *base,
+                                                                      const epi32x8 &idx) noexcept
+    {
+      return from_m256i<int32_t>(m256_i32gather_epi32(base, to_m256i(idx)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4 m256_i32gather_epi64(const int64_t *base,
+                                                                      const epi32x8 &idx) noexcept
+    {
+      return from_m256i<int64_t>(m256_i32gather_epi64(base, to_m256i(idx)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32 m256_lut32_epi8(const epi8x32 &table,
+                                                                 const epi8x32 &idx) noexcept
+    {
+      return from_m256i<int8_t>(m256_lut32_epi8(to_m256i(table), to_m256i(idx)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16 m256_lut16_epi16(const epi16x16 &table,
+                                                                   const epi16x16 &idx) noexcept
+    {
+      return from_m256i<int16_t>(m256_lut16_epi16(to_m256i(table), to_m256i(idx)));
+    }
+
+    // The 64-byte tables don't fit in a single register, so these read each chunk straight from
+    // memory with a broadcast.
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i lut64_chunks(const int8_t *table,
+                                                              const __m256i idx) noexcept
+    {
+      const __m128i *in       = reinterpret_cast<const __m128i *>(table);
+      const __m256i chunks[4] = {_mm256_broadcastsi128_si256(_mm_load_si128(in)),
+                                 _mm256_broadcastsi128_si256(_mm_load_si128(in + 1)),
+                                 _mm256_broadcastsi128_si256(_mm_load_si128(in + 2)),
+                                 _mm256_broadcastsi128_si256(_mm_load_si128(in + 3))};
+      return lut_chunks(chunks, 4, _mm256_and_si256(idx, _mm256_set1_epi8(63)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32 m256_lut64_epi8(const epi8x64 &table,
+                                                                 const epi8x32 &idx) noexcept
+    {
+      return from_m256i<int8_t>(lut64_chunks(table.data(), to_m256i(idx)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16 m256_lut32_epi16(const epi16x32 &table,
+                                                                   const epi16x16 &idx) noexcept
+    {
+      const int8_t *bytes = reinterpret_cast<const int8_t *>(table.data());
+      return from_m256i<int16_t>(lut64_chunks(bytes, lut_control_epi16(to_m256i(idx), 31)));
+    }
+
+    // The n vectors at in are transformed as one (16 * n)-point transform, and written to out.
+    template <unsigned n>
+    CPP_INTRIN_TARGET_AVX2 static inline void hadamard_block(const __m256i *in,
+                                                             __m256i *out) noexcept
+    {
+      __m256i x[n];
+      for (unsigned i = 0; i < n; i++)
+      {
+        x[i] = _mm256_load_si256(in + i);
+      }
+      hadamard_epi16(x);
+      for (unsigned i = 0; i < n; i++)
+      {
+        _mm256_store_si256(out + i, x[i]);
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16 m256_hadamard16_epi16(const epi16x16 &a) noexcept
+    {
+      return from_m256i<int16_t>(m256_hadamard16_epi16(to_m256i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x32 m512_hadamard32_epi16(const epi16x32 &a) noexcept
+    {
+      epi16x32 c;
+      hadamard_block<2>(reinterpret_cast<const __m256i *>(&a), reinterpret_cast<__m256i *>(&c));
+      return c;
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void m256_hadamard64_epi16(const epi16x16 *a,
+                                                                    epi16x16 *c) noexcept
+    {
+      hadamard_block<4>(reinterpret_cast<const __m256i *>(a), reinterpret_cast<__m256i *>(c));
+    }
+
+    // The transforms are independent, so unrolling lets the core overlap their dependency chains.
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_hadamard16_epi16_bulk(const epi16x16 *a, epi16x16 *c, const size_t n) noexcept
+    {
+      const __m256i *in = reinterpret_cast<const __m256i *>(a);
+      __m256i *out      = reinterpret_cast<__m256i *>(c);
+      size_t i          = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j, m256_hadamard16_epi16(_mm256_load_si256(in + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i, m256_hadamard16_epi16(_mm256_load_si256(in + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16 m256_sll_epi16(const epi16x16 &a,
+                                                                 const unsigned count) noexcept
+    {
+      return from_m256i<int16_t>(m256_sll_epi16(to_m256i(a), count));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16 m256_srl_epi16(const epi16x16 &a,
+                                                                 const unsigned count) noexcept
+    {
+      return from_m256i<int16_t>(m256_srl_epi16(to_m256i(a), count));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi32x8 m256_sllv_epi32(const epi32x8 &a,
+                                                                 const epi32x8 &count) noexcept
+    {
+      return from_m256i<int32_t>(m256_sllv_epi32(to_m256i(a), to_m256i(count)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi32x8 m256_srlv_epi32(const epi32x8 &a,
+                                                                 const epi32x8 &count) noexcept
+    {
+      return from_m256i<int32_t>(m256_srlv_epi32(to_m256i(a), to_m256i(count)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4 m256_sllv_epi64(const epi64x4 &a,
+                                                                 const epi64x4 &count) noexcept
+    {
+      return from_m256i<int64_t>(m256_sllv_epi64(to_m256i(a), to_m256i(count)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4 m256_srlv_epi64(const epi64x4 &a,
+                                                                 const epi64x4 &count) noexcept
+    {
+      return from_m256i<int64_t>(m256_srlv_epi64(to_m256i(a), to_m256i(count)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32
+    m256_shuffle_epi8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return from_m256i<int8_t>(m256_shuffle_epi8(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_add_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_add_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline bool
+    m256_testz_si256(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return m256_testz_si256(to_m256i(a), to_m256i(b));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_sub_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_sub_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_adds_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_adds_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_subs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_subs_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_adds_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_adds_epu16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_subs_epu16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_subs_epu16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32
+    m256_adds_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return from_m256i<int8_t>(m256_adds_epu8(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32
+    m256_subs_epu8(const epi8x32 &a, const epi8x32 &b) noexcept
+    {
+      return from_m256i<int8_t>(m256_subs_epu8(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_sign_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_sign_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4
+    m256_permute4x64_epi64(const epi64x4 &a) noexcept
+    {
+      return from_m256i<int64_t>(m256_permute4x64_epi64<imm8>(to_m256i(a)));
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_slli_epi16(const epi16x16 &a) noexcept
+    {
+      return from_m256i<int16_t>(m256_slli_epi16<imm8>(to_m256i(a)));
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_srli_epi16(const epi16x16 &a) noexcept
+    {
+      return from_m256i<int16_t>(m256_srli_epi16<imm8>(to_m256i(a)));
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_srai_epi16(const epi16x16 &a) noexcept
+    {
+      return from_m256i<int16_t>(m256_srai_epi16<imm8>(to_m256i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_mullo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_mullo_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_mulhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_mulhi_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi32x8
+    m256_madd_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int32_t>(m256_madd_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_abs_epi16(const epi16x16 &a) noexcept
+    {
+      return from_m256i<int16_t>(m256_abs_epi16(to_m256i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_broadcastsi128_si256(const __uint128_t value) noexcept
+    {
+      return from_m256i<int16_t>(m256_broadcastsi128_si256(reinterpret_cast<__m128i>(value)));
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_AVX2 static inline int64_t mm_extract_epi64(const __uint128_t value) noexcept
+    {
+      return mm_extract_epi64<pos>(reinterpret_cast<__m128i>(value));
+    }
+
+    template <unsigned pos, typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline __uint128_t
+    m256_extracti128_si256(const Vec256<T> &a) noexcept
+    {
+      return reinterpret_cast<__uint128_t>(m256_extracti128_si256<pos>(to_m256i(a)));
+    }
+
+    template <unsigned pos, typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline Vec256<T>
+    m256_inserti128_si256(const Vec256<T> &a, const __uint128_t b) noexcept
+    {
+      return from_m256i<T>(m256_inserti128_si256<pos>(to_m256i(a), reinterpret_cast<__m128i>(b)));
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_AVX2 static inline int16_t m256_extract_epi16(const epi16x16 &a) noexcept
+    {
+      return m256_extract_epi16<pos>(to_m256i(a));
+    }
+
+    template <unsigned pos>
+    CPP_INTRIN_TARGET_AVX2 static inline int64_t m256_extract_epi64(const epi64x4 &a) noexcept
+    {
+      return m256_extract_epi64<pos>(to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_unpacklo_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_unpacklo_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_unpackhi_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_unpackhi_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi32x8
+    m256_unpacklo_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+    {
+      return from_m256i<int32_t>(m256_unpacklo_epi32(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi32x8
+    m256_unpackhi_epi32(const epi32x8 &a, const epi32x8 &b) noexcept
+    {
+      return from_m256i<int32_t>(m256_unpackhi_epi32(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x16
+    m256_subabs_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return from_m256i<int16_t>(m256_subabs_epi16(to_m256i(a), to_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline bool
+    m256_and_testz_si256(const epi16x16 &a, const epi16x16 &b, const epi16x16 &c) noexcept
+    {
+      return m256_and_testz_si256(to_m256i(a), to_m256i(b), to_m256i(c));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline unsigned
+    m256_xor_popcount_epi64(const epi64x4 &a, const epi64x4 &b) noexcept
+    {
+      return m256_xor_popcount_epi64(to_m256i(a), to_m256i(b));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline int16_t
+    m256_hadd_reduce_epi16(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return m256_hadd_reduce_epi16(to_m256i(a), to_m256i(b));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline int32_t m256_reduce_add_epi16(const epi16x16 &a) noexcept
+    {
+      return m256_reduce_add_epi16(to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline int16_t m256_reduce_min_epi16(const epi16x16 &a) noexcept
+    {
+      return m256_reduce_min_epi16(to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline int16_t m256_reduce_max_epi16(const epi16x16 &a) noexcept
+    {
+      return m256_reduce_max_epi16(to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline unsigned
+    m256_reduce_argmax_epi16(const epi16x16 &a) noexcept
+    {
+      return m256_reduce_argmax_epi16(to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x32 m256_popcount_epi8(const epi8x32 &a) noexcept
+    {
+      return from_m256i<int8_t>(m256_popcount_epi8(to_m256i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x4 m256_popcount_epi64(const epi64x4 &a) noexcept
+    {
+      return from_m256i<int64_t>(m256_popcount_epi64(to_m256i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline unsigned m256_popcount_si256(const epi64x4 &a) noexcept
+    {
+      return m256_popcount_si256(to_m256i(a));
+    }
+
+    /**
+     * The bulk kernels below are unrolled by bulk_unroll vectors. This is enough to hide the
+     * latency of the loads behind independent work on current Intel and AMD cores. We don't
+     * issue software prefetches: these are sequential streams, which the hardware prefetcher
+     * already picks up.
+     */
+    static constexpr size_t bulk_unroll = 4;
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_add_epi16_bulk(const epi16x16 *a, const epi16x16 *b,
+                        epi16x16 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        // The inner loop has a constant trip count, so the compiler unrolls it completely.
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_add_epi16(_mm256_load_si256(in_a + i + j),
+                                              _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_add_epi16(_mm256_load_si256(in_a + i),
+                                            _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_sub_epi16_bulk(const epi16x16 *a, const epi16x16 *b,
+                        epi16x16 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_sub_epi16(_mm256_load_si256(in_a + i + j),
+                                              _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_sub_epi16(_mm256_load_si256(in_a + i),
+                                            _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_adds_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_adds_epi16(_mm256_load_si256(in_a + i + j),
+                                               _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_adds_epi16(_mm256_load_si256(in_a + i),
+                                             _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_subs_epi16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_subs_epi16(_mm256_load_si256(in_a + i + j),
+                                               _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_subs_epi16(_mm256_load_si256(in_a + i),
+                                             _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_adds_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_adds_epu16(_mm256_load_si256(in_a + i + j),
+                                               _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_adds_epu16(_mm256_load_si256(in_a + i),
+                                             _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_subs_epu16_bulk(const epi16x16 *a, const epi16x16 *b, epi16x16 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_subs_epu16(_mm256_load_si256(in_a + i + j),
+                                               _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_subs_epu16(_mm256_load_si256(in_a + i),
+                                             _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_adds_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_adds_epu8(_mm256_load_si256(in_a + i + j),
+                                              _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_adds_epu8(_mm256_load_si256(in_a + i),
+                                            _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_subs_epu8_bulk(const epi8x32 *a, const epi8x32 *b, epi8x32 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_subs_epu8(_mm256_load_si256(in_a + i + j),
+                                              _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_subs_epu8(_mm256_load_si256(in_a + i),
+                                            _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_xor_epi64_bulk(const epi64x4 *a, const epi64x4 *b,
+                        epi64x4 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_xor_si256(_mm256_load_si256(in_a + i + j),
+                                              _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_xor_si256(_mm256_load_si256(in_a + i),
+                                            _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline void
+    m256_sign_epi16_bulk(const epi16x16 *a, const epi16x16 *b,
+                         epi16x16 *c, const size_t n) noexcept
+    {
+      const __m256i *in_a = reinterpret_cast<const __m256i *>(a);
+      const __m256i *in_b = reinterpret_cast<const __m256i *>(b);
+      __m256i *out        = reinterpret_cast<__m256i *>(c);
+      size_t i            = 0;
+      for (; i + bulk_unroll <= n; i += bulk_unroll)
+      {
+        for (size_t j = 0; j < bulk_unroll; j++)
+        {
+          _mm256_store_si256(out + i + j,
+                             _mm256_sign_epi16(_mm256_load_si256(in_a + i + j),
+                                               _mm256_load_si256(in_b + i + j)));
+        }
+      }
+
+      for (; i < n; i++)
+      {
+        _mm256_store_si256(out + i,
+                           _mm256_sign_epi16(_mm256_load_si256(in_a + i),
+                                             _mm256_load_si256(in_b + i)));
+      }
+    }
+
+    // The population counts accumulate in 64-bit lanes. We could defer the psadbw by summing
+    // byte counts for up to 31 vectors first, but the psadbw is cheap next to the loads.
+    CPP_INTRIN_TARGET_AVX2 static inline uint64_t
+    m256_popcount_si256_bulk(const epi64x4 *a, const size_t n) noexcept
+    {
+      __m256i total = _mm256_setzero_si256();
+      for (size_t i = 0; i < n; i++)
+      {
+        total = _mm256_add_epi64(total, m256_popcount_epi64(to_m256i(a[i])));
+      }
+      return reduce_add_epi64(total);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline uint64_t
+    m256_xor_popcount_epi64_bulk(const epi64x4 *a, const epi64x4 *b, const size_t n) noexcept
+    {
+      __m256i total = _mm256_setzero_si256();
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m256i diff = _mm256_xor_si256(to_m256i(a[i]), to_m256i(b[i]));
+        total              = _mm256_add_epi64(total, m256_popcount_epi64(diff));
+      }
+      return reduce_add_epi64(total);
+    }
+    /**
+     * The 512-bit operations. Each one loads the two halves of its inputs into YMM registers and
+     * applies the 256-bit register kernel to each: so a 512-bit operation is exactly two AVX2
+     * instructions, plus the loads and stores.
+     */
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i lo_m256i(const Vec512<T> &a) noexcept
+    {
+      return _mm256_load_si256(reinterpret_cast<const __m256i *>(&a));
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline __m256i hi_m256i(const Vec512<T> &a) noexcept
+    {
+      return _mm256_load_si256(reinterpret_cast<const __m256i *>(&a) + 1);
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX2 static inline Vec512<T> join_m256i(const __m256i lo,
+                                                              const __m256i hi) noexcept
+    {
+      Vec512<T> out;
+      _mm256_store_si256(reinterpret_cast<__m256i *>(&out), lo);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(&out) + 1, hi);
+      return out;
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x32 m512_add_epi16(const epi16x32 &a,
+                                                                  const epi16x32 &b) noexcept
+    {
+      return join_m256i<int16_t>(m256_add_epi16(lo_m256i(a), lo_m256i(b)),
+                                 m256_add_epi16(hi_m256i(a), hi_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x32 m512_sub_epi16(const epi16x32 &a,
+                                                                  const epi16x32 &b) noexcept
+    {
+      return join_m256i<int16_t>(m256_sub_epi16(lo_m256i(a), lo_m256i(b)),
+                                 m256_sub_epi16(hi_m256i(a), hi_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x32 m512_sign_epi16(const epi16x32 &a,
+                                                                   const epi16x32 &b) noexcept
+    {
+      return join_m256i<int16_t>(m256_sign_epi16(lo_m256i(a), lo_m256i(b)),
+                                 m256_sign_epi16(hi_m256i(a), hi_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x32 m512_abs_epi16(const epi16x32 &a) noexcept
+    {
+      return join_m256i<int16_t>(m256_abs_epi16(lo_m256i(a)), m256_abs_epi16(hi_m256i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x8 m512_and_epi64(const epi64x8 &a,
+                                                                 const epi64x8 &b) noexcept
+    {
+      return join_m256i<int64_t>(m256_and_epi64(lo_m256i(a), lo_m256i(b)),
+                                 m256_and_epi64(hi_m256i(a), hi_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x8 m512_or_epi64(const epi64x8 &a,
+                                                                const epi64x8 &b) noexcept
+    {
+      return join_m256i<int64_t>(m256_or_epi64(lo_m256i(a), lo_m256i(b)),
+                                 m256_or_epi64(hi_m256i(a), hi_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x8 m512_xor_epi64(const epi64x8 &a,
+                                                                 const epi64x8 &b) noexcept
+    {
+      return join_m256i<int64_t>(m256_xor_epi64(lo_m256i(a), lo_m256i(b)),
+                                 m256_xor_epi64(hi_m256i(a), hi_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi8x64 m512_shuffle_epi8(const epi8x64 &a,
+                                                                    const epi8x64 &b) noexcept
+    {
+      return join_m256i<int8_t>(m256_shuffle_epi8(lo_m256i(a), lo_m256i(b)),
+                                m256_shuffle_epi8(hi_m256i(a), hi_m256i(b)));
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX2 static inline epi64x8 m512_permute4x64_epi64(const epi64x8 &a) noexcept
+    {
+      return join_m256i<int64_t>(m256_permute4x64_epi64<imm8>(lo_m256i(a)),
+                                 m256_permute4x64_epi64<imm8>(hi_m256i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline bool m512_testz_si512(const epi16x32 &a,
+                                                                const epi16x32 &b) noexcept
+    {
+      const __m256i lo = _mm256_and_si256(lo_m256i(a), lo_m256i(b));
+      const __m256i hi = _mm256_and_si256(hi_m256i(a), hi_m256i(b));
+      const __m256i both = _mm256_or_si256(lo, hi);
+      return _mm256_testz_si256(both, both);
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline epi16x32 m512_cmpgt_epi16(const epi16x32 &a,
+                                                                    const epi16x32 &b) noexcept
+    {
+      return join_m256i<int16_t>(m256_cmpgt_epi16(lo_m256i(a), lo_m256i(b)),
+                                 m256_cmpgt_epi16(hi_m256i(a), hi_m256i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline uint16_t m256_cmpgt_epi16_mask(const epi16x16 &a,
+                                                                         const epi16x16 &b) noexcept
+    {
+      const __m256i cmp = _mm256_cmpgt_epi16(to_m256i(a), to_m256i(b));
+      const __m128i packed =
+          _mm_packs_epi16(_mm256_castsi256_si128(cmp), _mm256_extracti128_si256(cmp, 1));
+      return static_cast<uint16_t>(_mm_movemask_epi8(packed));
+    }
+
+    CPP_INTRIN_TARGET_AVX2 static inline uint32_t m512_cmpgt_epi16_mask(const epi16x32 &a,
+                                                                         const epi16x32 &b) noexcept
+    {
+      const __m256i lo = _mm256_cmpgt_epi16(lo_m256i(a), lo_m256i(b));
+      const __m256i hi = _mm256_cmpgt_epi16(hi_m256i(a), hi_m256i(b));
+      // vpacksswb packs within 128-bit lanes, so the packed bytes come out as lo[0:7], hi[0:7],
+      // lo[8:15], hi[8:15]: the vpermq puts them back in order before the movemask.
+      const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+      return static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+    }
+  };
+
+  /***
+   * AVX512. This is the AVX-512 tier, which requires AVX512-F, AVX512-BW and AVX512-VL (i.e
+   * Skylake-X onwards). It only provides the 512-bit operations and the mask comparisons: every
+   * other 256-bit operation is inherited from the AVX2 tier, as AVX-512 has nothing better to offer
+   * for those at this width.
+   */
+  struct AVX512 : public AVX2
+  {
+    /**
+     * to_m512i and from_m512i convert between Vec512 and __m512i. Vec512 is 64-byte aligned, so
+     * these are aligned loads and stores.
+     */
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX512 static inline __m512i to_m512i(const Vec512<T> &a) noexcept
+    {
+      return _mm512_load_si512(&a);
+    }
+
+    template <typename T>
+    CPP_INTRIN_TARGET_AVX512 static inline Vec512<T> from_m512i(const __m512i a) noexcept
+    {
+      Vec512<T> out;
+      _mm512_store_si512(&out, a);
+      return out;
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi16x32 m512_add_epi16(const epi16x32 &a,
+                                                                    const epi16x32 &b) noexcept
+    {
+      return from_m512i<int16_t>(_mm512_add_epi16(to_m512i(a), to_m512i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi16x32 m512_sub_epi16(const epi16x32 &a,
+                                                                    const epi16x32 &b) noexcept
+    {
+      return from_m512i<int16_t>(_mm512_sub_epi16(to_m512i(a), to_m512i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi16x32 m512_sign_epi16(const epi16x32 &a,
+                                                                     const epi16x32 &b) noexcept
+    {
+      const __m512i va = to_m512i(a);
+      const __m512i vb = to_m512i(b);
+      // The sign bits of b give the lanes to negate, and the non-zero lanes of b the lanes to keep.
+      const __mmask32 negative = _mm512_movepi16_mask(vb);
+      const __mmask32 nonzero  = _mm512_test_epi16_mask(vb, vb);
+      const __m512i negated    = _mm512_mask_sub_epi16(va, negative, _mm512_setzero_si512(), va);
+      return from_m512i<int16_t>(_mm512_maskz_mov_epi16(nonzero, negated));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi16x32 m512_abs_epi16(const epi16x32 &a) noexcept
+    {
+      return from_m512i<int16_t>(_mm512_abs_epi16(to_m512i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi64x8 m512_and_epi64(const epi64x8 &a,
+                                                                   const epi64x8 &b) noexcept
+    {
+      return from_m512i<int64_t>(_mm512_and_si512(to_m512i(a), to_m512i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi64x8 m512_or_epi64(const epi64x8 &a,
+                                                                  const epi64x8 &b) noexcept
+    {
+      return from_m512i<int64_t>(_mm512_or_si512(to_m512i(a), to_m512i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi64x8 m512_xor_epi64(const epi64x8 &a,
+                                                                   const epi64x8 &b) noexcept
+    {
+      return from_m512i<int64_t>(_mm512_xor_si512(to_m512i(a), to_m512i(b)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi8x64 m512_shuffle_epi8(const epi8x64 &a,
+                                                                      const epi8x64 &b) noexcept
+    {
+      return from_m512i<int8_t>(_mm512_shuffle_epi8(to_m512i(a), to_m512i(b)));
+    }
+
+    // vpermw and vpermt2w only read the bottom 4 (resp. 5) bits of each index, which is exactly the
+    // wrap-around that the lookups need. The byte lookups would need AVX512-VBMI, so those are
+    // inherited from the AVX2 tier.
+    CPP_INTRIN_TARGET_AVX512 static inline epi16x16 m256_lut16_epi16(const epi16x16 &table,
+                                                                     const epi16x16 &idx) noexcept
+    {
+      return from_m256i<int16_t>(_mm256_permutexvar_epi16(to_m256i(idx), to_m256i(table)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi16x16 m256_lut32_epi16(const epi16x32 &table,
+                                                                     const epi16x16 &idx) noexcept
+    {
+      const __m256i *in = reinterpret_cast<const __m256i *>(&table);
+      return from_m256i<int16_t>(
+          _mm256_permutex2var_epi16(_mm256_load_si256(in), to_m256i(idx), _mm256_load_si256(in + 1)));
+    }
+
+    // One butterfly stage: x[i] + swapped[i] where bit h of i is clear (i.e where mask is clear),
+    // and swapped[i] - x[i] where it is set. AVX-512 has no vpsignw, but a masked subtract from
+    // zero does the same job, and it runs alongside the shuffle rather than after it.
+    CPP_INTRIN_TARGET_AVX512 static inline __m512i butterfly_epi16(const __m512i x,
+                                                                   const __m512i swapped,
+                                                                   const __mmask32 mask) noexcept
+    {
+      return _mm512_add_epi16(swapped, _mm512_mask_sub_epi16(x, mask, _mm512_setzero_si512(), x));
+    }
+
+    // The Walsh-Hadamard transform of each block of `lanes` lanes of x, where lanes is 16 (two
+    // independent transforms) or 32. As with m512_permute4x64_epi64, the unmasked shuffles trip
+    // -Wuninitialized inside GCC 12's headers: the zero-masked forms with a full mask are the
+    // same instructions.
+    template <unsigned lanes>
+    CPP_INTRIN_TARGET_AVX512 static inline __m512i hadamard_epi16(__m512i x) noexcept
+    {
+      static_assert(lanes == 16 || lanes == 32, "Error: lanes must be 16 or 32.");
+      const __m512i swap_pairs = _mm512_maskz_broadcast_i32x4(
+          __mmask16(0xFFFF), _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13));
+      const __mmask16 all32 = 0xFFFF;
+      const __mmask8 all64  = 0xFF;
+      x = butterfly_epi16(x, _mm512_shuffle_epi8(x, swap_pairs), 0xAAAAAAAA);
+      x = butterfly_epi16(x, _mm512_maskz_shuffle_epi32(all32, x, _MM_PERM_CDAB), 0xCCCCCCCC);
+      x = butterfly_epi16(x, _mm512_maskz_shuffle_epi32(all32, x, _MM_PERM_BADC), 0xF0F0F0F0);
+      x = butterfly_epi16(x, _mm512_maskz_shuffle_i64x2(all64, x, x, 0xB1), 0xFF00FF00);
+      if (lanes == 32)
+      {
+        x = butterfly_epi16(x, _mm512_maskz_shuffle_i64x2(all64, x, x, 0x4E), 0xFFFF0000);
+      }
+      return x;
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi16x32
+    m512_hadamard32_epi16(const epi16x32 &a) noexcept
+    {
+      return from_m512i<int16_t>(hadamard_epi16<32>(to_m512i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline void m256_hadamard64_epi16(const epi16x16 *a,
+                                                                      epi16x16 *c) noexcept
+    {
+      // The vectors are only 32-byte aligned, so each pair needs an unaligned load.
+      const __m512i lo = hadamard_epi16<32>(_mm512_loadu_si512(a));
+      const __m512i hi = hadamard_epi16<32>(_mm512_loadu_si512(a + 2));
+      _mm512_storeu_si512(c, _mm512_add_epi16(lo, hi));
+      _mm512_storeu_si512(c + 2, _mm512_sub_epi16(lo, hi));
+    }
+
+    // This transforms two vectors per instruction, which halves the number of shuffles compared
+    // to the AVX2 version: these are the bottleneck, as they all run on the same port.
+    CPP_INTRIN_TARGET_AVX512 static inline void
+    m256_hadamard16_epi16_bulk(const epi16x16 *a, epi16x16 *c, const size_t n) noexcept
+    {
+      size_t i = 0;
+      for (; i + 2 <= n; i += 2)
+      {
+        _mm512_storeu_si512(c + i, hadamard_epi16<16>(_mm512_loadu_si512(a + i)));
+      }
+
+      if (i < n)
+      {
+        c[i] = AVX2::m256_hadamard16_epi16(a[i]);
+      }
+    }
+
+    template <int8_t imm8>
+    CPP_INTRIN_TARGET_AVX512 static inline epi64x8 m512_permute4x64_epi64(const epi64x8 &a) noexcept
+    {
+      // The unmasked _mm512_permutex_epi64 trips -Wuninitialized inside GCC 12's own header (it
+      // passes an undefined vector as the merge source). With a full mask this is the same
+      // instruction.
+      const __m512i va = to_m512i(a);
+      return from_m512i<int64_t>(_mm512_mask_permutex_epi64(va, __mmask8(0xFF), va, imm8));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline bool m512_testz_si512(const epi16x32 &a,
+                                                                  const epi16x32 &b) noexcept
+    {
+      return _mm512_test_epi64_mask(to_m512i(a), to_m512i(b)) == 0;
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline epi16x32 m512_cmpgt_epi16(const epi16x32 &a,
+                                                                      const epi16x32 &b) noexcept
+    {
+      return from_m512i<int16_t>(
+          _mm512_movm_epi16(_mm512_cmpgt_epi16_mask(to_m512i(a), to_m512i(b))));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline uint16_t
+    m256_cmpgt_epi16_mask(const epi16x16 &a, const epi16x16 &b) noexcept
+    {
+      return _mm256_cmpgt_epi16_mask(to_m256i(a), to_m256i(b));
+    }
+
+    CPP_INTRIN_TARGET_AVX512 static inline uint32_t
+    m512_cmpgt_epi16_mask(const epi16x32 &a, const epi16x32 &b) noexcept
+    {
+      return _mm512_cmpgt_epi16_mask(to_m512i(a), to_m512i(b));
+    }
+  };
+
+  /***
+   * VPOPCNTDQ. This struct contains the operations that benefit from AVX512-VPOPCNTDQ while still
+   * operating over 256-bit vectors (via AVX512-VL). VPOPCNTDQ isn't implied by the AVX-512 tier
+   * (e.g Skylake-X has AVX512-BW but not VPOPCNTDQ), so these aren't part of the runtime
+   * dispatch: the public functions only use them if the extensions are enabled at compile-time.
+   */
+  struct VPOPCNTDQ
+  {
+    CPP_INTRIN_TARGET_AVX512_VPOPCNTDQ static inline __m256i
+    m256_popcount_epi64(const __m256i a) noexcept
+    {
+      return _mm256_popcnt_epi64(a);
+    }
+
+    CPP_INTRIN_TARGET_AVX512_VPOPCNTDQ static inline unsigned
+    m256_popcount_si256(const __m256i a) noexcept
+    {
+      return static_cast<unsigned>(AVX2::reduce_add_epi64(m256_popcount_epi64(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512_VPOPCNTDQ static inline epi64x4
+    m256_popcount_epi64(const epi64x4 &a) noexcept
+    {
+      return AVX2::from_m256i<int64_t>(m256_popcount_epi64(AVX2::to_m256i(a)));
+    }
+
+    CPP_INTRIN_TARGET_AVX512_VPOPCNTDQ static inline unsigned
+    m256_popcount_si256(const epi64x4 &a) noexcept
+    {
+      return m256_popcount_si256(AVX2::to_m256i(a));
+    }
+
+    CPP_INTRIN_TARGET_AVX512_VPOPCNTDQ static inline uint64_t
+    m256_popcount_si256_bulk(const epi64x4 *a, const size_t n) noexcept
+    {
+      __m256i total = _mm256_setzero_si256();
+      for (size_t i = 0; i < n; i++)
+      {
+        total = _mm256_add_epi64(total, _mm256_popcnt_epi64(AVX2::to_m256i(a[i])));
+      }
+      return AVX2::reduce_add_epi64(total);
+    }
+
+    CPP_INTRIN_TARGET_AVX512_VPOPCNTDQ static inline uint64_t
+    m256_xor_popcount_epi64_bulk(const epi64x4 *a, const epi64x4 *b, const size_t n) noexcept
+    {
+      __m256i total = _mm256_setzero_si256();
+      for (size_t i = 0; i < n; i++)
+      {
+        const __m256i diff = _mm256_xor_si256(AVX2::to_m256i(a[i]), AVX2::to_m256i(b[i]));
+        total              = _mm256_add_epi64(total, _mm256_popcnt_epi64(diff));
+      }
+      return AVX2::reduce_add_epi64(total);
+    }
+  };
+
+  /***
+   * AES. This struct contains the AES-NI implementations. AES-NI isn't one of the ISA tiers (it is
+   * neither implied by nor implies any of them), so these are used either when __AES__ is defined
+   * or when detect_aes() says so at runtime.
+   */
+  struct AES
+  {
+    CPP_INTRIN_TARGET_AES static inline __uint128_t get_randomness(__uint128_t &gstate_1,
+                                                                  __uint128_t &gstate_2) noexcept
+    {
+      const __m128i out = _mm_aesenc_si128(_mm_loadu_si128(reinterpret_cast<__m128i *>(&gstate_1)),
+                                           _mm_loadu_si128(reinterpret_cast<__m128i *>(&gstate_2)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(&gstate_1), out);
+      return gstate_1 ^ gstate_2;
+    }
+  };
+#endif
+
+  /**
+   * ISA. These are the tiers that the runtime dispatch knows about, ordered from the least to
+   * the most capable. The SSE tier requires SSE4.1 (which implies SSSE3), the AVX2 tier requires
+   * AVX2, and the AVX-512 tier requires AVX512-F, AVX512-BW and AVX512-VL. The NEON tier is the
+   * only one above plain on AArch64, and is never available on x86: see clamp_isa.
+   */
+  enum class ISA : unsigned
+  {
+    plain  = 0,
+    sse    = 1,
+    avx2   = 2,
+    avx512 = 3,
+    neon   = 4,
+  };
+
+  /**
+   * detect_isa. Returns the most capable ISA tier that the running machine supports. This issues
+   * CPUID (via GCC's __builtin_cpu_supports) exactly once: the result is cached for all later
+   * calls.
+   */
+  static inline ISA detect_isa() noexcept
+  {
+#if CPP_INTRIN_X86
+    static const ISA detected = []() {
+      // This is necessary if we're called before libgcc has run its own constructors (e.g from
+      // another static initialiser).
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+          __builtin_cpu_supports("avx512vl"))
+      {
+        return ISA::avx512;
+      }
+      if (__builtin_cpu_supports("avx2"))
+      {
+        return ISA::avx2;
+      }
+      if (__builtin_cpu_supports("sse4.1"))
+      {
+        return ISA::sse;
+      }
+      return ISA::plain;
+    }();
+    return detected;
+#elif CPP_INTRIN_NEON
+    return ISA::neon;
+#else
+    return ISA::plain;
+#endif
+  }
+
+  /**
+   * clamp_isa. Returns the most capable tier that the running machine supports and that is no
+   * more capable than `isa`. On x86 this is just the lower of `isa` and detect_isa(), so asking for
+   * neon gives the detected tier. On AArch64 every tier other than plain gives neon.
+   */
+  static inline ISA clamp_isa(const ISA isa) noexcept
+  {
+#if CPP_INTRIN_NEON
+    return isa == ISA::plain ? ISA::plain : ISA::neon;
+#else
+    return std::min(isa, detect_isa());
+#endif
+  }
+
+  /**
+   * detect_aes. Returns true if the running machine supports AES-NI. Like detect_isa this issues
+   * CPUID exactly once. AES-NI is not implied by any of the ISA tiers, so it is reported
+   * separately.
+   */
+  static inline bool detect_aes() noexcept
+  {
+#if CPP_INTRIN_X86
+    static const bool detected = []() {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("aes") != 0;
+    }();
+    return detected;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * detect_vaes. Returns true if the running machine supports VAES, i.e aesenc over each 128-bit
+   * lane of a 256-bit register, along with the AES-NI and AVX2 that go with it.
+   */
+  static inline bool detect_vaes() noexcept
+  {
+#if CPP_INTRIN_X86
+    static const bool detected = []() {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx2") && detect_aes();
+    }();
+    return detected;
+#else
+    return false;
+#endif
+  }
+
+  /***
+   * Dispatch. This is a table of function pointers, one per operation, each bound to the
+   * implementation from a single tier. Calling through the table costs an indirect call, which is
+   * perfectly predictable: in exchange a single binary can run the AVX2 kernels on machines that
+   * support them and still run on machines that don't.
+   *
+   * The templated operations (e.g m256_permute4x64_epi64) can't be stored as a single pointer, as
+   * there's one function per immediate. Instead, these are member functions that index a
+   * per-immediate array of pointers by the bound tier.
+   */
+  struct Dispatch
+  {
+    // The tier that this table is bound to.
+    ISA isa;
+
+    epi16x16 (*m256_hadd_epi16)(const epi16x16 &, const epi16x16 &);
+    epi64x4 (*m256_xor_epi64)(const epi64x4 &, const epi64x4 &);
+    epi64x4 (*m256_or_epi64)(const epi64x4 &, const epi64x4 &);
+    epi64x4 (*m256_and_epi64)(const epi64x4 &, const epi64x4 &);
+    epi16x16 (*m256_and_epi16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_cmpgt_epi16)(const epi16x16 &, const epi16x16 &);
+    epi8x32 (*m256_cmpeq_epi8)(const epi8x32 &, const epi8x32 &);
+    epi16x16 (*m256_cmpeq_epi16)(const epi16x16 &, const epi16x16 &);
+    epi8x32 (*m256_cmpgt_epi8)(const epi8x32 &, const epi8x32 &);
+    epi8x32 (*m256_cmplt_epi8)(const epi8x32 &, const epi8x32 &);
+    epi16x16 (*m256_cmplt_epi16)(const epi16x16 &, const epi16x16 &);
+    epi8x32 (*m256_blendv_epi8)(const epi8x32 &, const epi8x32 &, const epi8x32 &);
+    uint32_t (*m256_movemask_epi8)(const epi8x32 &);
+    uint32_t (*m256_movemask_epi16)(const epi16x16 &);
+    epi16x16 (*m256_compress_epi16)(const epi16x16 &, const uint32_t);
+    epi32x8 (*m256_permutevar8x32_epi32)(const epi32x8 &, const epi32x8 &);
+    epi32x8 (*m256_i32gather_epi32)(const int32_t *, const epi32x8 &);
+    epi64x4 (*m256_i32gather_epi64)(const int64_t *, const epi32x8 &);
+    epi8x32 (*m256_lut32_epi8)(const epi8x32 &, const epi8x32 &);
+    epi8x32 (*m256_lut64_epi8)(const epi8x64 &, const epi8x32 &);
+    epi16x16 (*m256_lut16_epi16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_lut32_epi16)(const epi16x32 &, const epi16x16 &);
+    epi16x16 (*m256_hadamard16_epi16)(const epi16x16 &);
+    epi16x32 (*m512_hadamard32_epi16)(const epi16x32 &);
+    void (*m256_hadamard64_epi16)(const epi16x16 *, epi16x16 *);
+    void (*m256_hadamard16_epi16_bulk)(const epi16x16 *, epi16x16 *, size_t);
+    epi16x16 (*m256_sll_epi16)(const epi16x16 &, const unsigned);
+    epi16x16 (*m256_srl_epi16)(const epi16x16 &, const unsigned);
+    epi32x8 (*m256_sllv_epi32)(const epi32x8 &, const epi32x8 &);
+    epi32x8 (*m256_srlv_epi32)(const epi32x8 &, const epi32x8 &);
+    epi64x4 (*m256_sllv_epi64)(const epi64x4 &, const epi64x4 &);
+    epi64x4 (*m256_srlv_epi64)(const epi64x4 &, const epi64x4 &);
+    epi16x16 (*m256_mullo_epi16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_mulhi_epi16)(const epi16x16 &, const epi16x16 &);
+    epi32x8 (*m256_madd_epi16)(const epi16x16 &, const epi16x16 &);
+    epi32x8 (*m256_maskload_epi32)(const int32_t *, const epi32x8 &);
+    epi64x4 (*m256_maskload_epi64)(const int64_t *, const epi64x4 &);
+    void (*m256_maskstore_epi32)(int32_t *, const epi32x8 &, const epi32x8 &);
+    void (*m256_maskstore_epi64)(int64_t *, const epi64x4 &, const epi64x4 &);
+    void (*stream_fence)();
+    epi8x32 (*m256_shuffle_epi8)(const epi8x32 &, const epi8x32 &);
+    epi16x16 (*m256_add_epi16)(const epi16x16 &, const epi16x16 &);
+    bool (*m256_testz_si256)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_sub_epi16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_sign_epi16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_abs_epi16)(const epi16x16 &);
+    epi16x16 (*m256_broadcastsi128_si256)(const __uint128_t);
+    epi16x16 (*m256_unpacklo_epi16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_unpackhi_epi16)(const epi16x16 &, const epi16x16 &);
+    epi32x8 (*m256_unpacklo_epi32)(const epi32x8 &, const epi32x8 &);
+    epi32x8 (*m256_unpackhi_epi32)(const epi32x8 &, const epi32x8 &);
+    epi16x16 (*m256_subabs_epi16)(const epi16x16 &, const epi16x16 &);
+    bool (*m256_and_testz_si256)(const epi16x16 &, const epi16x16 &, const epi16x16 &);
+    unsigned (*m256_xor_popcount_epi64)(const epi64x4 &, const epi64x4 &);
+    int16_t (*m256_hadd_reduce_epi16)(const epi16x16 &, const epi16x16 &);
+    int32_t (*m256_reduce_add_epi16)(const epi16x16 &);
+    int16_t (*m256_reduce_min_epi16)(const epi16x16 &);
+    int16_t (*m256_reduce_max_epi16)(const epi16x16 &);
+    unsigned (*m256_reduce_argmax_epi16)(const epi16x16 &);
+    epi8x32 (*m256_popcount_epi8)(const epi8x32 &);
+    epi64x4 (*m256_popcount_epi64)(const epi64x4 &);
+    unsigned (*m256_popcount_si256)(const epi64x4 &);
+
+    void (*m256_add_epi16_bulk)(const epi16x16 *, const epi16x16 *, epi16x16 *, size_t);
+    void (*m256_sub_epi16_bulk)(const epi16x16 *, const epi16x16 *, epi16x16 *, size_t);
+    void (*m256_xor_epi64_bulk)(const epi64x4 *, const epi64x4 *, epi64x4 *, size_t);
+    void (*m256_sign_epi16_bulk)(const epi16x16 *, const epi16x16 *, epi16x16 *, size_t);
+    uint64_t (*m256_popcount_si256_bulk)(const epi64x4 *, size_t);
+    uint64_t (*m256_xor_popcount_epi64_bulk)(const epi64x4 *, const epi64x4 *, size_t);
+
+    epi16x32 (*m512_add_epi16)(const epi16x32 &, const epi16x32 &);
+    epi16x32 (*m512_sub_epi16)(const epi16x32 &, const epi16x32 &);
+    epi16x32 (*m512_sign_epi16)(const epi16x32 &, const epi16x32 &);
+    epi16x32 (*m512_abs_epi16)(const epi16x32 &);
+    epi64x8 (*m512_and_epi64)(const epi64x8 &, const epi64x8 &);
+    epi64x8 (*m512_or_epi64)(const epi64x8 &, const epi64x8 &);
+    epi64x8 (*m512_xor_epi64)(const epi64x8 &, const epi64x8 &);
+    epi8x64 (*m512_shuffle_epi8)(const epi8x64 &, const epi8x64 &);
+    bool (*m512_testz_si512)(const epi16x32 &, const epi16x32 &);
+    epi16x32 (*m512_cmpgt_epi16)(const epi16x32 &, const epi16x32 &);
+    uint16_t (*m256_cmpgt_epi16_mask)(const epi16x16 &, const epi16x16 &);
+    uint32_t (*m512_cmpgt_epi16_mask)(const epi16x32 &, const epi16x32 &);
+    epi16x16 (*m256_adds_epi16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_subs_epi16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_adds_epu16)(const epi16x16 &, const epi16x16 &);
+    epi16x16 (*m256_subs_epu16)(const epi16x16 &, const epi16x16 &);
+    epi8x32 (*m256_adds_epu8)(const epi8x32 &, const epi8x32 &);
+    epi8x32 (*m256_subs_epu8)(const epi8x32 &, const epi8x32 &);
+    void (*m256_adds_epi16_bulk)(const epi16x16 *, const epi16x16 *, epi16x16 *, size_t);
+    void (*m256_subs_epi16_bulk)(const epi16x16 *, const epi16x16 *, epi16x16 *, size_t);
+    void (*m256_adds_epu16_bulk)(const epi16x16 *, const epi16x16 *, epi16x16 *, size_t);
+    void (*m256_subs_epu16_bulk)(const epi16x16 *, const epi16x16 *, epi16x16 *, size_t);
+    void (*m256_adds_epu8_bulk)(const epi8x32 *, const epi8x32 *, epi8x32 *, size_t);
+    void (*m256_subs_epu8_bulk)(const epi8x32 *, const epi8x32 *, epi8x32 *, size_t);
+
+    // This is bound separately from the tier: see make_dispatch.
+    __uint128_t (*get_randomness)(__uint128_t &, __uint128_t &);
+
+    template <int8_t imm8> epi64x4 m256_permute4x64_epi64(const epi64x4 &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr epi64x4 (*table[])(const epi64x4 &) =
+          {&Plain::template m256_permute4x64_epi64<imm8>,
+           &SSE::template m256_permute4x64_epi64<imm8>,
+           &AVX2::template m256_permute4x64_epi64<imm8>,
+           &AVX512::template m256_permute4x64_epi64<imm8>};
+      return table[static_cast<unsigned>(isa)](a);
+#else
+      return Plain::template m256_permute4x64_epi64<imm8>(a);
+#endif
+    }
+
+    // These two are views over the general operations, exactly as with the compile-time versions.
+    epi16x16 m256_shuffle_epi8_epi16(const epi16x16 &a, const epi16x16 &b) const noexcept
+    {
+      return m256_shuffle_epi8(a.epi8(), b.epi8()).epi16();
+    }
+
+    template <int8_t imm8> epi16x16 m256_permute4x64_epi16(const epi16x16 &a) const noexcept
+    {
+      return m256_permute4x64_epi64<imm8>(a.epi64()).epi16();
+    }
+
+    template <int8_t imm8> epi16x16 m256_slli_epi16(const epi16x16 &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr epi16x16 (*table[])(const epi16x16 &) =
+          {&Plain::template m256_slli_epi16<imm8>,
+           &SSE::template m256_slli_epi16<imm8>,
+           &AVX2::template m256_slli_epi16<imm8>,
+           &AVX512::template m256_slli_epi16<imm8>};
+      return table[static_cast<unsigned>(isa)](a);
+#else
+      return Plain::template m256_slli_epi16<imm8>(a);
+#endif
+    }
+
+    template <int8_t imm8> epi16x16 m256_srli_epi16(const epi16x16 &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr epi16x16 (*table[])(const epi16x16 &) =
+          {&Plain::template m256_srli_epi16<imm8>,
+           &SSE::template m256_srli_epi16<imm8>,
+           &AVX2::template m256_srli_epi16<imm8>,
+           &AVX512::template m256_srli_epi16<imm8>};
+      return table[static_cast<unsigned>(isa)](a);
+#else
+      return Plain::template m256_srli_epi16<imm8>(a);
+#endif
+    }
+
+    template <int8_t imm8> epi16x16 m256_srai_epi16(const epi16x16 &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr epi16x16 (*table[])(const epi16x16 &) =
+          {&Plain::template m256_srai_epi16<imm8>,
+           &SSE::template m256_srai_epi16<imm8>,
+           &AVX2::template m256_srai_epi16<imm8>,
+           &AVX512::template m256_srai_epi16<imm8>};
+      return table[static_cast<unsigned>(isa)](a);
+#else
+      return Plain::template m256_srai_epi16<imm8>(a);
+#endif
+    }
+
+    template <typename T> Vec256<T> m256_loadu_si256(const T *ptr) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr Vec256<T> (*table[])(const T *) =
+          {&Plain::template m256_loadu_si256<T>,
+           &SSE::template m256_loadu_si256<T>,
+           &AVX2::template m256_loadu_si256<T>,
+           &AVX512::template m256_loadu_si256<T>};
+      return table[static_cast<unsigned>(isa)](ptr);
+#else
+      return Plain::template m256_loadu_si256<T>(ptr);
+#endif
+    }
+
+    template <typename T> void m256_storeu_si256(T *ptr, const Vec256<T> &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr void (*table[])(T *, const Vec256<T> &) =
+          {&Plain::template m256_storeu_si256<T>,
+           &SSE::template m256_storeu_si256<T>,
+           &AVX2::template m256_storeu_si256<T>,
+           &AVX512::template m256_storeu_si256<T>};
+      table[static_cast<unsigned>(isa)](ptr, a);
+#else
+      Plain::template m256_storeu_si256<T>(ptr, a);
+#endif
+    }
+
+    template <typename T> void m256_stream_si256(T *ptr, const Vec256<T> &a) const noexcept
+    {
+      assert(reinterpret_cast<uintptr_t>(ptr) % 32 == 0);
+#if CPP_INTRIN_X86
+      constexpr void (*table[])(T *, const Vec256<T> &) =
+          {&Plain::template m256_stream_si256<T>,
+           &SSE::template m256_stream_si256<T>,
+           &AVX2::template m256_stream_si256<T>,
+           &AVX512::template m256_stream_si256<T>};
+      table[static_cast<unsigned>(isa)](ptr, a);
+#else
+      Plain::template m256_stream_si256<T>(ptr, a);
+#endif
+    }
+
+    template <unsigned pos> int64_t mm_extract_epi64(const __uint128_t value) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr int64_t (*table[])(const __uint128_t) =
+          {&Plain::template mm_extract_epi64<pos>,
+           &SSE::template mm_extract_epi64<pos>,
+           &AVX2::template mm_extract_epi64<pos>,
+           &AVX512::template mm_extract_epi64<pos>};
+      return table[static_cast<unsigned>(isa)](value);
+#else
+      return Plain::template mm_extract_epi64<pos>(value);
+#endif
+    }
+
+    template <unsigned pos, typename T>
+    __uint128_t m256_extracti128_si256(const Vec256<T> &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr __uint128_t (*table[])(const Vec256<T> &) =
+          {&Plain::template m256_extracti128_si256<pos, T>,
+           &SSE::template m256_extracti128_si256<pos, T>,
+           &AVX2::template m256_extracti128_si256<pos, T>,
+           &AVX512::template m256_extracti128_si256<pos, T>};
+      return table[static_cast<unsigned>(isa)](a);
+#else
+      return Plain::template m256_extracti128_si256<pos, T>(a);
+#endif
+    }
+
+    template <unsigned pos, typename T>
+    Vec256<T> m256_inserti128_si256(const Vec256<T> &a, const __uint128_t b) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr Vec256<T> (*table[])(const Vec256<T> &, const __uint128_t) =
+          {&Plain::template m256_inserti128_si256<pos, T>,
+           &SSE::template m256_inserti128_si256<pos, T>,
+           &AVX2::template m256_inserti128_si256<pos, T>,
+           &AVX512::template m256_inserti128_si256<pos, T>};
+      return table[static_cast<unsigned>(isa)](a, b);
+#else
+      return Plain::template m256_inserti128_si256<pos, T>(a, b);
+#endif
+    }
+
+    template <unsigned pos> int16_t m256_extract_epi16(const epi16x16 &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr int16_t (*table[])(const epi16x16 &) =
+          {&Plain::template m256_extract_epi16<pos>,
+           &SSE::template m256_extract_epi16<pos>,
+           &AVX2::template m256_extract_epi16<pos>,
+           &AVX512::template m256_extract_epi16<pos>};
+      return table[static_cast<unsigned>(isa)](a);
+#else
+      return Plain::template m256_extract_epi16<pos>(a);
+#endif
+    }
+
+    template <unsigned pos> int64_t m256_extract_epi64(const epi64x4 &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr int64_t (*table[])(const epi64x4 &) =
+          {&Plain::template m256_extract_epi64<pos>,
+           &SSE::template m256_extract_epi64<pos>,
+           &AVX2::template m256_extract_epi64<pos>,
+           &AVX512::template m256_extract_epi64<pos>};
+      return table[static_cast<unsigned>(isa)](a);
+#else
+      return Plain::template m256_extract_epi64<pos>(a);
+#endif
+    }
+
+    template <int8_t imm8> epi64x8 m512_permute4x64_epi64(const epi64x8 &a) const noexcept
+    {
+#if CPP_INTRIN_X86
+      constexpr epi64x8 (*table[])(const epi64x8 &) =
+          {&Plain::template m512_permute4x64_epi64<imm8>,
+           &SSE::template m512_permute4x64_epi64<imm8>,
+           &AVX2::template m512_permute4x64_epi64<imm8>,
+           &AVX512::template m512_permute4x64_epi64<imm8>};
+      return table[static_cast<unsigned>(isa)](a);
+#else
+      return Plain::template m512_permute4x64_epi64<imm8>(a);
+#endif
+    }
+
+    /**
+     * bind. Returns a table where every operation is bound to the implementation in Impl.
+     */
+    template <typename Impl> static Dispatch bind(const ISA isa) noexcept
+    {
+      return Dispatch{isa,
+                      &Impl::m256_hadd_epi16,
+                      &Impl::m256_xor_epi64,
+                      &Impl::m256_or_epi64,
+                      &Impl::m256_and_epi64,
+                      &Impl::m256_and_epi16,
+                      &Impl::m256_cmpgt_epi16,
+                      &Impl::m256_cmpeq_epi8,
+                      &Impl::m256_cmpeq_epi16,
+                      &Impl::m256_cmpgt_epi8,
+                      &Impl::m256_cmplt_epi8,
+                      &Impl::m256_cmplt_epi16,
+                      &Impl::m256_blendv_epi8,
+                      &Impl::m256_movemask_epi8,
+                      &Impl::m256_movemask_epi16,
+                      &Impl::m256_compress_epi16,
+                      &Impl::m256_permutevar8x32_epi32,
+                      &Impl::m256_i32gather_epi32,
+                      &Impl::m256_i32gather_epi64,
+                      &Impl::m256_lut32_epi8,
+                      &Impl::m256_lut64_epi8,
+                      &Impl::m256_lut16_epi16,
+                      &Impl::m256_lut32_epi16,
+                      &Impl::m256_hadamard16_epi16,
+                      &Impl::m512_hadamard32_epi16,
+                      &Impl::m256_hadamard64_epi16,
+                      &Impl::m256_hadamard16_epi16_bulk,
+                      &Impl::m256_sll_epi16,
+                      &Impl::m256_srl_epi16,
+                      &Impl::m256_sllv_epi32,
+                      &Impl::m256_srlv_epi32,
+                      &Impl::m256_sllv_epi64,
+                      &Impl::m256_srlv_epi64,
+                      &Impl::m256_mullo_epi16,
+                      &Impl::m256_mulhi_epi16,
+                      &Impl::m256_madd_epi16,
+                      &Impl::m256_maskload_epi32,
+                      &Impl::m256_maskload_epi64,
+                      &Impl::m256_maskstore_epi32,
+                      &Impl::m256_maskstore_epi64,
+                      &Impl::stream_fence,
+                      &Impl::m256_shuffle_epi8,
+                      &Impl::m256_add_epi16,
+                      &Impl::m256_testz_si256,
+                      &Impl::m256_sub_epi16,
+                      &Impl::m256_sign_epi16,
+                      &Impl::m256_abs_epi16,
+                      &Impl::m256_broadcastsi128_si256,
+                      &Impl::m256_unpacklo_epi16,
+                      &Impl::m256_unpackhi_epi16,
+                      &Impl::m256_unpacklo_epi32,
+                      &Impl::m256_unpackhi_epi32,
+                      &Impl::m256_subabs_epi16,
+                      &Impl::m256_and_testz_si256,
+                      &Impl::m256_xor_popcount_epi64,
+                      &Impl::m256_hadd_reduce_epi16,
+                      &Impl::m256_reduce_add_epi16,
+                      &Impl::m256_reduce_min_epi16,
+                      &Impl::m256_reduce_max_epi16,
+                      &Impl::m256_reduce_argmax_epi16,
+                      &Impl::m256_popcount_epi8,
+                      &Impl::m256_popcount_epi64,
+                      &Impl::m256_popcount_si256,
+                      &Impl::m256_add_epi16_bulk,
+                      &Impl::m256_sub_epi16_bulk,
+                      &Impl::m256_xor_epi64_bulk,
+                      &Impl::m256_sign_epi16_bulk,
+                      &Impl::m256_popcount_si256_bulk,
+                      &Impl::m256_xor_popcount_epi64_bulk,
+                      &Impl::m512_add_epi16,
+                      &Impl::m512_sub_epi16,
+                      &Impl::m512_sign_epi16,
+                      &Impl::m512_abs_epi16,
+                      &Impl::m512_and_epi64,
+                      &Impl::m512_or_epi64,
+                      &Impl::m512_xor_epi64,
+                      &Impl::m512_shuffle_epi8,
+                      &Impl::m512_testz_si512,
+                      &Impl::m512_cmpgt_epi16,
+                      &Impl::m256_cmpgt_epi16_mask,
+                      &Impl::m512_cmpgt_epi16_mask,
+                      &Impl::m256_adds_epi16,
+                      &Impl::m256_subs_epi16,
+                      &Impl::m256_adds_epu16,
+                      &Impl::m256_subs_epu16,
+                      &Impl::m256_adds_epu8,
+                      &Impl::m256_subs_epu8,
+                      &Impl::m256_adds_epi16_bulk,
+                      &Impl::m256_subs_epi16_bulk,
+                      &Impl::m256_adds_epu16_bulk,
+                      &Impl::m256_subs_epu16_bulk,
+                      &Impl::m256_adds_epu8_bulk,
+                      &Impl::m256_subs_epu8_bulk,
+                      &Plain::get_randomness};
+    }
+  };
+
+  /**
+   * make_dispatch. Returns a dispatch table bound to the tier `isa`, with get_randomness bound to
+   * the AES-NI implementation if `aes` is true. This does not check whether the running machine
+   * supports `isa`: use set_dispatch_isa if you want that. A tier that isn't compiled in at all
+   * (e.g neon on x86) gives the plain implementations. Similarly, `aes` should only be true if
+   * detect_aes() is.
+   */
+  static inline Dispatch make_dispatch(const ISA isa, const bool aes = detect_aes()) noexcept
+  {
+#if CPP_INTRIN_X86
+    Dispatch table;
+    switch (isa)
+    {
+    case ISA::avx512:
+      table = Dispatch::bind<AVX512>(isa);
+      break;
+    case ISA::avx2:
+      table = Dispatch::bind<AVX2>(isa);
+      break;
+    case ISA::sse:
+      table = Dispatch::bind<SSE>(isa);
+      break;
+    default:
+      table = Dispatch::bind<Plain>(ISA::plain);
+      break;
+    }
+
+    if (aes)
+    {
+      table.get_randomness = &AES::get_randomness;
+    }
+    return table;
+#else
+    // Off x86 there is no AES-NI, and the only tier above plain is NEON (where it exists).
+    (void)aes;
+#if CPP_INTRIN_NEON
+    if (isa != ISA::plain)
+    {
+      return Dispatch::bind<NEON>(ISA::neon);
+    }
+#else
+    (void)isa;
+#endif
+    return Dispatch::bind<Plain>(ISA::plain);
+#endif
+  }
+
+  /**
+   * requested_isa. Returns the tier requested by the CPP_INTRIN_ISA environment variable (one of
+   * "plain", "sse", "avx2", "avx512" or "neon"), or the detected tier if the variable isn't set or
+   * isn't recognised. The request goes through clamp_isa, so this can only ever force a lower tier.
+   */
+  static inline ISA requested_isa() noexcept
+  {
+    const char *const env = std::getenv("CPP_INTRIN_ISA");
+    ISA requested         = detect_isa();
+    if (env == nullptr)
+    {
+      return requested;
+    }
+
+    if (std::strcmp(env, "plain") == 0)
+    {
+      requested = ISA::plain;
+    }
+    else if (std::strcmp(env, "sse") == 0)
+    {
+      requested = ISA::sse;
+    }
+    else if (std::strcmp(env, "avx2") == 0)
+    {
+      requested = ISA::avx2;
+    }
+    else if (std::strcmp(env, "avx512") == 0)
+    {
+      requested = ISA::avx512;
+    }
+    else if (std::strcmp(env, "neon") == 0)
+    {
+      requested = ISA::neon;
+    }
+    return clamp_isa(requested);
+  }
+
+  /**
+   * dispatch. Returns the process-wide dispatch table. This is bound on first use to the tier
+   * returned by requested_isa(). Callers in hot loops should hold onto the reference rather than
+   * calling this each time, e.g:
+   *
+   * const auto &d = CPP_INTRIN::dispatch();
+   * for (...) { c = d.m256_hadd_epi16(a, b); }
+   */
+  static inline Dispatch &dispatch() noexcept
+  {
+    static Dispatch table = make_dispatch(requested_isa());
+    return table;
+  }
+
+  /**
+   * set_dispatch_isa. Rebinds the process-wide dispatch table to `isa`, clamped to the tiers that
+   * the running machine supports (see clamp_isa). Returns the tier that was actually bound.
+   * This is primarily meant for testing: it is not safe to call this while other threads are
+   * calling through the table.
+   */
+  static inline ISA set_dispatch_isa(const ISA isa) noexcept
+  {
+    const ISA bound = clamp_isa(isa);
+    dispatch()      = make_dispatch(bound);
+    return bound;
+  }
+
+  /***
+   * Instrument. Opt-in profiling of the public functions, for finding out which operations a
+   * program actually spends its time in, and which tier each of them ran on. If the header is
+   * included with CPP_INTRIN_INSTRUMENT set to 1, e.g
+   *
+   * g++ -DCPP_INTRIN_INSTRUMENT=1 ...
+   *
+   * then every call to a public function (e.g CPP_INTRIN::m256_hadd_epi16) adds one to a counter for
+   * that function and tier, and adds the number of cycles (from rdtsc on x86, and the virtual
+   * counter on AArch64) that the call took to another. When the program exits a summary is written
+   * to std::cerr, sorted by the total number of cycles:
+   *
+   * function                                 tier            calls           cycles  cycles/call
+   * m256_hadd_epi16                          AVX2          1048576         25165824         24.0
+   *
+   * The summary can also be written at any point with report(), or read with snapshot(), and
+   * reset() zeroes the counters (e.g to skip a warm-up phase).
+   *
+   * Each function gets its counters the first time it's called, and after that a call costs two
+   * timestamp reads and two relaxed atomic additions. This is a lot compared to a single
+   * instruction, and so the cycle counts are only useful relative to each other: the call counts
+   * are exact. Calls through the dispatch() table are not counted, as the table holds pointers
+   * straight to the tier functions. With CPP_INTRIN_INSTRUMENT unset nothing here is ever called.
+   */
+  struct Instrument
+  {
+    // The counters for one function on one tier. These are never freed, so that the counters
+    // outlive every static object that might still be calling the function while the program exits.
+    struct Site
+    {
+      const char           *name;
+      const char           *tier;
+      std::atomic<uint64_t> calls{0};
+      std::atomic<uint64_t> cycles{0};
+      Site                 *next;
+    };
+
+    // A copy of the counters for one Site, as returned by snapshot().
+    struct Entry
+    {
+      const char *name;
+      const char *tier;
+      uint64_t    calls;
+      uint64_t    cycles;
+    };
+
+    // Probe. Times the scope that it lives in, and adds the result to `site` when it's destroyed.
+    class Probe
+    {
+    public:
+      explicit Probe(Site &site) noexcept : site_(site), start_(ticks()) {}
+      ~Probe()
+      {
+        site_.calls.fetch_add(1, std::memory_order_relaxed);
+        site_.cycles.fetch_add(ticks() - start_, std::memory_order_relaxed);
+      }
+
+      Probe(const Probe &)            = delete;
+      Probe &operator=(const Probe &) = delete;
+
+    private:
+      Site          &site_;
+      const uint64_t start_;
+    };
+
+    /**
+     * ticks. Returns the current value of the cheapest timestamp counter available: rdtsc on x86,
+     * the virtual counter on AArch64, and std::chrono::steady_clock (in nanoseconds) otherwise.
+     */
+    static inline uint64_t ticks() noexcept
+    {
+#if CPP_INTRIN_X86
+      return __rdtsc();
+#elif CPP_INTRIN_NEON
+      uint64_t t;
+      asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+      return t;
+#else
+      return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    /**
+     * site. Returns the counters for `name` on `tier`, creating them if they don't exist yet. Each
+     * public function calls this once (through CPP_INTRIN_PROBE), and keeps hold of the result.
+     * Different instantiations of the same template share their counters.
+     */
+    static Site &site(const char *const name, const char *const tier)
+    {
+      Registry                   &r = registry();
+      std::lock_guard<std::mutex> guard(r.lock);
+      for (Site *s = r.head; s != nullptr; s = s->next)
+      {
+        if (std::strcmp(s->name, name) == 0 && std::strcmp(s->tier, tier) == 0)
+        {
+          return *s;
+        }
+      }
+
+      Site *const s = new Site;
+      s->name       = name;
+      s->tier       = tier;
+      s->next       = r.head;
+      r.head        = s;
+      return *s;
+    }
+
+    /**
+     * snapshot. Returns a copy of the counters of every function that has been called, sorted from
+     * the most cycles to the fewest. Functions that haven't been called since the last reset() are
+     * left out.
+     */
+    static std::vector<Entry> snapshot() { return collect(registry()); }
+
+    /**
+     * report. Writes the summary described above to `os`. Nothing is written if no function has
+     * been called.
+     */
+    static void report(std::ostream &os = std::cerr) { write(os, snapshot()); }
+
+    /**
+     * reset. Zeroes every counter. This isn't atomic with respect to calls that are running at the
+     * same time on other threads: each of those is either counted in full or not at all.
+     */
+    static void reset()
+    {
+      Registry                   &r = registry();
+      std::lock_guard<std::mutex> guard(r.lock);
+      for (Site *s = r.head; s != nullptr; s = s->next)
+      {
+        s->calls.store(0, std::memory_order_relaxed);
+        s->cycles.store(0, std::memory_order_relaxed);
+      }
+    }
+
+  private:
+    // The list of every Site. This is created by the first call to site(), and so it's destroyed
+    // after every static object that was constructed before that call: its destructor writes the
+    // exit summary.
+    struct Registry
+    {
+      std::mutex lock;
+      Site      *head{nullptr};
+
+      Registry() = default;
+      ~Registry() { write(std::cerr, collect(*this)); }
+    };
+
+    static Registry &registry()
+    {
+      static Registry r;
+      return r;
+    }
+
+    static std::vector<Entry> collect(Registry &r)
+    {
+      std::vector<Entry> entries;
+      {
+        std::lock_guard<std::mutex> guard(r.lock);
+        for (const Site *s = r.head; s != nullptr; s = s->next)
+        {
+          const Entry e{s->name, s->tier, s->calls.load(std::memory_order_relaxed),
+                        s->cycles.load(std::memory_order_relaxed)};
+          if (e.calls != 0)
+          {
+            entries.push_back(e);
+          }
+        }
+      }
+
+      std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) noexcept {
+        return a.cycles != b.cycles ? a.cycles > b.cycles : std::strcmp(a.name, b.name) < 0;
+      });
+      return entries;
+    }
+
+    static void write(std::ostream &os, const std::vector<Entry> &entries)
+    {
+      if (entries.empty())
+      {
+        return;
+      }
+
+      char line[160];
+      std::snprintf(line, sizeof(line), "%-40s %-8s %12s %16s %12s\n", "function", "tier", "calls",
+                    "cycles", "cycles/call");
+      os << line;
+      for (const auto &e : entries)
+      {
+        std::snprintf(line, sizeof(line), "%-40s %-8s %12llu %16llu %12.1f\n", e.name, e.tier,
+                      static_cast<unsigned long long>(e.calls),
+                      static_cast<unsigned long long>(e.cycles),
+                      static_cast<double>(e.cycles) / static_cast<double>(e.calls));
+        os << line;
+      }
+    }
+  };
+
+  /***
+   * RandomGenerator. A stateful generator that fills buffers of random 256-bit vectors.
+   *
+   * get_randomness produces 128 bits per call, and the usual way of turning that into a vector
+   * (by feeding it to m256_broadcastsi128_si256) leaves the two halves of the vector identical.
+   * That is fine for a one-off, but for generating many vectors (e.g. bucket centres) it is both
+   * slow and wasteful: each call costs a function call and a dependency on the previous state, and
+   * half of every vector is redundant. This generator instead fills every byte of every vector.
+   *
+   * Where AES-NI is available we run `streams` independent AES counter streams: each 128-bit
+   * output is two rounds of aesenc over a per-stream counter. aesenc has a latency of around 4
+   * cycles but a throughput of one or two per cycle, and because the streams do not depend on
+   * each other the core can keep several rounds in flight at once. Otherwise we use xorshift128+
+   * over 2 * `streams` 64-bit lanes: this is written as a plain loop over the lanes, which GCC
+   * vectorises with whatever vector unit the translation unit is compiled for.
+   *
+   * Where VAES is available as well, the same streams are run two to a 256-bit register.
+   *
+   * The back-end is picked once, at construction, by a runtime check (so a binary built without
+   * -maes still uses AES-NI where it can). The AES and xorshift back-ends produce different
+   * sequences for the same seed: pass `backend` explicitly if you need the output to be
+   * reproducible across machines. For a fixed seed and back-end, the output only depends on the
+   * total number of vectors requested so far if every fill() asks for a multiple of `block`
+   * vectors. Other sizes are fine, but the sequence then also depends on how the requests were
+   * split up.
+   *
+   * The same warning as get_randomness applies: this is fast, not secure. Do not use it for
+   * anything that needs real randomness.
+   *
+   * Usage:
+   * CPP_INTRIN::RandomGenerator rng(seed);
+   * std::vector<CPP_INTRIN::epi16x16> centres(n);
+   * rng.fill(centres.data(), centres.size());
+   */
+  struct RandomGenerator
+  {
+    // The number of independent 128-bit streams.
+    static constexpr unsigned streams = 8;
+    // The number of vectors produced by a single step of all of the streams.
+    static constexpr unsigned block = streams / 2;
+
+    // The implementation that produces the values. aes and vaes produce exactly the same
+    // sequence: vaes just runs two streams per instruction.
+    enum class Backend
+    {
+      xorshift = 0,
+      aes      = 1,
+      vaes     = 2,
+    };
+
+    /**
+     * best_backend. Returns the fastest back-end that the running machine supports.
+     */
+    static Backend best_backend() noexcept
+    {
+      if (detect_vaes())
+      {
+        return Backend::vaes;
+      }
+      return detect_aes() ? Backend::aes : Backend::xorshift;
+    }
+
+    explicit RandomGenerator(const uint64_t seed, const Backend backend = best_backend()) noexcept
+        : impl{backend}
+    {
+      uint64_t x = seed;
+      for (unsigned i = 0; i < streams; i++)
+      {
+        counter[2 * i]     = splitmix64(x);
+        counter[2 * i + 1] = splitmix64(x);
+      }
+      key[0] = splitmix64(x);
+      key[1] = splitmix64(x);
+
+      // xorshift128+ must not start from an all-zero state. splitmix64 is a bijection applied to
+      // distinct counter values, so at most one of s0[i] and s1[i] can be zero.
+      for (unsigned i = 0; i < 2 * streams; i++)
+      {
+        s0[i] = splitmix64(x);
+        s1[i] = splitmix64(x);
+      }
+    }
+
+    /**
+     * backend. Returns the back-end that this generator uses.
+     */
+    Backend backend() const noexcept { return impl; }
+
+    /**
+     * fill. Writes `n` random vectors to `out`.
+     */
+    template <typename T> void fill(Vec256<T> *const out, const size_t n) noexcept
+    {
+#if CPP_INTRIN_X86
+      switch (impl)
+      {
+      case Backend::vaes:
+        fill_vaes(reinterpret_cast<__m128i *>(out), n);
+        break;
+      case Backend::aes:
+        fill_aes(reinterpret_cast<__m128i *>(out), n);
+        break;
+      default:
+        fill_xorshift(reinterpret_cast<unsigned char *>(out), n);
+        break;
+      }
+#else
+      fill_xorshift(reinterpret_cast<unsigned char *>(out), n);
+#endif
+    }
+
+    /**
+     * next. Returns a single random vector. This is a convenience wrapper around fill: prefer
+     * filling a buffer where possible.
+     */
+    template <typename T = int16_t> Vec256<T> next() noexcept
+    {
+      Vec256<T> out;
+      fill(&out, 1);
+      return out;
+    }
+
+  private:
+#if CPP_INTRIN_X86
+    // Unlike fill_aes, this only handles whole blocks itself: the tail is left to fill_aes, which
+    // picks up from the same counters.
+    CPP_INTRIN_TARGET_VAES void fill_vaes(__m128i *const out, const size_t n) noexcept
+    {
+      constexpr unsigned pairs = streams / 2;
+      const __m256i k =
+          _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(key)));
+      const __m256i step = _mm256_set_epi64x(0, 1, 0, 1);
+
+      // Streams 2j and 2j + 1 are adjacent in `counter`, so they share a register.
+      __m256i ctr[pairs];
+      for (unsigned j = 0; j < pairs; j++)
+      {
+        ctr[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(counter + 4 * j));
+      }
+
+      size_t i = 0;
+      for (; i + block <= n; i += block)
+      {
+        __m256i *const dst = reinterpret_cast<__m256i *>(out + 2 * i);
+        for (unsigned j = 0; j < pairs; j++)
+        {
+          _mm256_store_si256(dst + j, _mm256_aesenc_epi128(_mm256_aesenc_epi128(ctr[j], k), k));
+          ctr[j] = _mm256_add_epi64(ctr[j], step);
+        }
+      }
+
+      for (unsigned j = 0; j < pairs; j++)
+      {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(counter + 4 * j), ctr[j]);
+      }
+
+      if (i < n)
+      {
+        fill_aes(out + 2 * i, n - i);
+      }
+    }
+#endif
+
+    static uint64_t splitmix64(uint64_t &x) noexcept
+    {
+      uint64_t z = (x += 0x9e3779b97f4a7c15);
+      z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+      z          = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+      return z ^ (z >> 31);
+    }
+
+#if CPP_INTRIN_X86
+    CPP_INTRIN_TARGET_AES void fill_aes(__m128i *const out, const size_t n) noexcept
+    {
+      const __m128i k    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(key));
+      const __m128i step = _mm_set_epi64x(0, 1);
+      __m128i ctr[streams];
+      for (unsigned i = 0; i < streams; i++)
+      {
+        ctr[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(counter + 2 * i));
+      }
+
+      // Each output is a separate store, so the streams never wait on each other.
+      const size_t halves = 2 * n;
+      size_t i            = 0;
+      for (; i + streams <= halves; i += streams)
+      {
+        for (unsigned j = 0; j < streams; j++)
+        {
+          _mm_store_si128(out + i + j, _mm_aesenc_si128(_mm_aesenc_si128(ctr[j], k), k));
+          ctr[j] = _mm_add_epi64(ctr[j], step);
+        }
+      }
+
+      // The tail is always shorter than `streams`: the explicit bound is just for the compiler.
+      for (unsigned j = 0; j < streams && i + j < halves; j++)
+      {
+        _mm_store_si128(out + i + j, _mm_aesenc_si128(_mm_aesenc_si128(ctr[j], k), k));
+        ctr[j] = _mm_add_epi64(ctr[j], step);
+      }
+
+      for (unsigned j = 0; j < streams; j++)
+      {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(counter + 2 * j), ctr[j]);
+      }
+    }
+#endif
+
+    static void xorshift_step(uint64_t *const a, uint64_t *const b, uint64_t *const out) noexcept
+    {
+      for (unsigned j = 0; j < 2 * streams; j++)
+      {
+        uint64_t x       = a[j];
+        const uint64_t y = b[j];
+        out[j]           = x + y;
+        x ^= x << 23;
+        a[j] = y;
+        b[j] = x ^ y ^ (x >> 18) ^ (y >> 5);
+      }
+    }
+
+    // This is kept out of line: when GCC 12 inlines it into a caller's loop it stops
+    // SLP-vectorising the lane loop, which costs roughly a factor of three in the benchmarks.
+    __attribute__((noinline)) void fill_xorshift(unsigned char *const out, const size_t n) noexcept
+    {
+      constexpr unsigned lanes = 2 * streams;
+      // One step of every lane produces exactly `block` vectors.
+      static_assert(lanes * sizeof(uint64_t) == block * sizeof(epi16x16), "mismatched block");
+
+      // The state is copied into locals: otherwise the stores to `out` (which may alias anything)
+      // would force every lane back to memory on every step, and GCC would not vectorise the loop.
+      uint64_t a[lanes], b[lanes];
+      std::memcpy(a, s0, sizeof(a));
+      std::memcpy(b, s1, sizeof(b));
+
+      // Copying out via memcpy keeps this fine for any lane type T. The whole blocks use a fixed
+      // size so that the copy is inlined as vector stores.
+      uint64_t tmp[lanes];
+      size_t i = 0;
+      for (; i + block <= n; i += block)
+      {
+        xorshift_step(a, b, tmp);
+        std::memcpy(out + i * sizeof(epi16x16), tmp, sizeof(tmp));
+      }
+
+      if (i < n)
+      {
+        xorshift_step(a, b, tmp);
+        std::memcpy(out + i * sizeof(epi16x16), tmp, (n - i) * sizeof(epi16x16));
+      }
+
+      std::memcpy(s0, a, sizeof(a));
+      std::memcpy(s1, b, sizeof(b));
+    }
+
+    Backend impl;
+    uint64_t counter[2 * streams];
+    uint64_t key[2];
+    uint64_t s0[2 * streams];
+    uint64_t s1[2 * streams];
+  };
+
+  /***
+   * VectorStore. An aligned container for large databases of vectors, with optional columns of
+   * side data (e.g norms or bucket hashes) kept alongside them as a structure of arrays:
+   *
+   * CPP_INTRIN::VectorStore<CPP_INTRIN::epi16x16, uint32_t, uint64_t> db(n);
+   * db.push_back(v, norm, hash);
+   * CPP_INTRIN::m256_add_epi16_bulk(db.data(), other.data(), out.data(), db.size());
+   * const uint32_t *const norms = db.column<0>();
+   *
+   * The vectors and every column live in a single allocation (the arena), and each array starts
+   * on a cache line. This means that the aligned loads and stores in the bulk kernels are always
+   * valid on data(), and that a pass over the vectors streams whole cache lines without touching
+   * the side data. Growing never allocates per element: the arena is replaced by one twice the
+   * size, and each array is moved across with a single memcpy. New elements are always zero.
+   *
+   * On Linux the arena is an anonymous mapping. With `huge_pages`, it is rounded up to a whole
+   * number of 2MiB pages, and backed by explicit huge pages (MAP_HUGETLB) if the system has any
+   * reserved, or by transparent huge pages (MADV_HUGEPAGE) otherwise: on a large database this
+   * removes almost all of the TLB misses from a pass over the vectors. Elsewhere the arena comes
+   * from aligned_alloc, and `huge_pages` is ignored. Allocation failures throw std::bad_alloc,
+   * and a capacity whose size doesn't fit in a size_t throws std::length_error.
+   */
+  template <typename V, typename... Columns> struct VectorStore
+  {
+    static_assert(std::is_trivially_copyable<V>::value &&
+                      (std::is_trivially_copyable<Columns>::value && ...),
+                  "Error: VectorStore only holds trivially copyable types.");
+
+    // Each array starts on a boundary of this many bytes.
+    static constexpr size_t alignment      = 64;
+    static constexpr size_t huge_page_size = size_t(1) << 21;
+
+    template <size_t I> using column_type = std::tuple_element_t<I, std::tuple<Columns...>>;
+
+    explicit VectorStore(const size_t capacity = 0, const bool huge_pages = false)
+        : huge{huge_pages}
+    {
+      reserve(capacity);
+    }
+
+    ~VectorStore() { release(arena, bytes); }
+
+    VectorStore(VectorStore &&other) noexcept { swap(other); }
+
+    VectorStore &operator=(VectorStore &&other) noexcept
+    {
+      swap(other);
+      return *this;
+    }
+
+    VectorStore(const VectorStore &)            = delete;
+    VectorStore &operator=(const VectorStore &) = delete;
+
+    void swap(VectorStore &other) noexcept
+    {
+      std::swap(arena, other.arena);
+      std::swap(bytes, other.bytes);
+      std::swap(count, other.count);
+      std::swap(cap, other.cap);
+      std::swap(huge, other.huge);
+      std::swap(arrays, other.arrays);
+    }
+
+    size_t size() const noexcept { return count; }
+    size_t capacity() const noexcept { return cap; }
+    bool empty() const noexcept { return count == 0; }
+    bool huge_pages() const noexcept { return huge; }
+
+    V *data() noexcept { return reinterpret_cast<V *>(arrays[0]); }
+    const V *data() const noexcept { return reinterpret_cast<const V *>(arrays[0]); }
+    V *begin() noexcept { return data(); }
+    V *end() noexcept { return data() + count; }
+    const V *begin() const noexcept { return data(); }
+    const V *end() const noexcept { return data() + count; }
+
+    V &operator[](const size_t i) noexcept
+    {
+      assert(i < count);
+      return data()[i];
+    }
+
+    const V &operator[](const size_t i) const noexcept
+    {
+      assert(i < count);
+      return data()[i];
+    }
+
+    /**
+     * column. Returns the I-th column of side data, which has one entry per vector.
+     */
+    template <size_t I> column_type<I> *column() noexcept
+    {
+      return reinterpret_cast<column_type<I> *>(arrays[I + 1]);
+    }
+
+    template <size_t I> const column_type<I> *column() const noexcept
+    {
+      return reinterpret_cast<const column_type<I> *>(arrays[I + 1]);
+    }
+
+    /**
+     * reserve. Makes room for at least n vectors (and their side data).
+     */
+    void reserve(const size_t n)
+    {
+      if (n > cap)
+      {
+        grow(n);
+      }
+    }
+
+    /**
+     * resize. Sets the number of vectors to n. Any new vectors and side data are zero.
+     */
+    void resize(const size_t n)
+    {
+      if (n > cap)
+      {
+        grow(std::max(n, 2 * cap));
+      }
+
+      // Everything past the end is kept zeroed, so that growing never has to clear anything.
+      for (size_t a = 0; a < arity && n < count; a++)
+      {
+        std::memset(arrays[a] + n * element_sizes[a], 0, (count - n) * element_sizes[a]);
+      }
+      count = n;
+    }
+
+    void clear() noexcept { resize(0); }
+
+    void push_back(const V &v, const Columns &...side)
+    {
+      if (count == cap)
+      {
+        grow(std::max(2 * cap, min_capacity));
+      }
+      data()[count] = v;
+      set(count, std::index_sequence_for<Columns...>{}, side...);
+      count++;
+    }
+
+  private:
+    // The first push_back makes room for this many vectors.
+    static constexpr size_t min_capacity = 64;
+    static constexpr size_t arity        = sizeof...(Columns) + 1;
+    static constexpr std::array<size_t, arity> element_sizes{sizeof(V), sizeof(Columns)...};
+
+    template <size_t... I>
+    void set(const size_t i, std::index_sequence<I...>, const Columns &...side) noexcept
+    {
+      ((column<I>()[i] = side), ...);
+    }
+
+    void grow(const size_t n)
+    {
+      // Each array starts on the next multiple of alignment after the previous one.
+      std::array<size_t, arity> offsets;
+      size_t total = 0;
+      for (size_t a = 0; a < arity; a++)
+      {
+        // The array (rounded up to the alignment) has to fit in what's left of a size_t.
+        const size_t left = std::numeric_limits<size_t>::max() - total;
+        if (left < alignment - 1 || n > (left - (alignment - 1)) / element_sizes[a])
+        {
+          throw std::length_error("VectorStore: too many vectors");
+        }
+        offsets[a] = total;
+        total += (n * element_sizes[a] + alignment - 1) / alignment * alignment;
+      }
+
+      size_t allocated        = total;
+      unsigned char *const to = allocate(allocated, huge);
+      for (size_t a = 0; a < arity; a++)
+      {
+        if (count != 0)
+        {
+          std::memcpy(to + offsets[a], arrays[a], count * element_sizes[a]);
+        }
+        arrays[a] = to + offsets[a];
+      }
+
+      release(arena, bytes);
+      arena = to;
+      bytes = allocated;
+      cap   = n;
+    }
+
+    // Returns a zeroed, page-aligned block of at least `size` bytes, and sets size to the number
+    // of bytes that were actually allocated.
+    static unsigned char *allocate(size_t &size, const bool huge_pages)
+    {
+#ifdef __linux__
+      if (huge_pages)
+      {
+        size       = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED)
+        {
+          return static_cast<unsigned char *>(addr);
+        }
+      }
+
+      void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (addr == MAP_FAILED)
+      {
+        throw std::bad_alloc();
+      }
+      if (huge_pages)
+      {
+        madvise(addr, size, MADV_HUGEPAGE);
+      }
+      return static_cast<unsigned char *>(addr);
+#else
+      (void)huge_pages;
+      constexpr size_t page = 4096;
+      size                  = (size + page - 1) / page * page;
+      void *const addr      = std::aligned_alloc(page, size);
+      if (addr == nullptr)
+      {
+        throw std::bad_alloc();
+      }
+      std::memset(addr, 0, size);
+      return static_cast<unsigned char *>(addr);
+#endif
+    }
+
+    static void release(unsigned char *const addr, const size_t size) noexcept
+    {
+      if (addr == nullptr)
+      {
+        return;
+      }
+#ifdef __linux__
+      munmap(addr, size);
+#else
+      (void)size;
+      std::free(addr);
+#endif
+    }
+
+    unsigned char *arena = nullptr;
+    size_t bytes         = 0;
+    size_t count         = 0;
+    size_t cap           = 0;
+    bool huge            = false;
+    // The start of the vectors, followed by the start of each column.
+    std::array<unsigned char *, arity> arrays{};
+  };
+
+  /***
+   * VectorFile. A versioned on-disk format for vector databases, and a reader that maps the file
+   * into memory rather than parsing it:
+   *
+   * CPP_INTRIN::VectorFile<CPP_INTRIN::epi16x16, uint32_t>::save("db.vec", store);
+   * const CPP_INTRIN::VectorFile<CPP_INTRIN::epi16x16, uint32_t> db("db.vec");
+   * CPP_INTRIN::m256_popcount_si256_bulk(db.data(), db.size());
+   *
+   * The file is a header, then the vectors, then each column of side data, laid out exactly as
+   * in a VectorStore: every array starts on a 64-byte boundary of the file. Since a mapping starts
+   * on a page boundary, data() and column<I>() are aligned too, and so they can be passed straight
+   * to the bulk kernels (and the Bucketer). Nothing is read up front: pages are faulted in as the
+   * kernels touch them, unless `populate` is set, in which case the whole file is read in when
+   * it's opened (MAP_POPULATE).
+   *
+   * The header holds a magic string, the format version, a byte-order marker, the number of
+   * vectors, and the size and offset of each array. Opening a file checks all of these against
+   * V and Columns, and throws std::runtime_error if they don't match (e.g a file from a newer
+   * version, a different machine's byte order, or different column types). I/O errors throw
+   * std::system_error. save() writes to a temporary file and renames it over `path`, so a
+   * checkpoint that's interrupted part-way never replaces a good one.
+   *
+   * The mapping is read-only and private. On systems other than Linux the file is read into an
+   * aligned buffer instead.
+   */
+  template <typename V, typename... Columns> struct VectorFile
+  {
+    static constexpr uint32_t version = 1;
+
+    template <size_t I> using column_type = std::tuple_element_t<I, std::tuple<Columns...>>;
+
+    /**
+     * save. Writes n vectors and their side data to path.
+     */
+    static void save(const std::string &path, const V *const vectors, const size_t n,
+                     const Columns *const... columns)
+    {
+      const std::array<const void *, arity> sources{vectors, columns...};
+      static const char zero[alignment]{};
+      const auto layout      = make_layout(n);
+      const std::string temp = path + ".tmp";
+      FILE *const file       = std::fopen(temp.c_str(), "wb");
+      if (file == nullptr)
+      {
+        throw std::system_error(errno, std::generic_category(), temp);
+      }
+
+      bool ok = std::fwrite(layout.data(), 1, layout.size(), file) == layout.size();
+      for (size_t a = 0; a < arity && ok; a++)
+      {
+        const size_t bytes = n * element_sizes[a];
+        const size_t pad   = (alignment - bytes % alignment) % alignment;
+        ok = (bytes == 0 || std::fwrite(sources[a], 1, bytes, file) == bytes) &&
+             std::fwrite(zero, 1, pad, file) == pad;
+      }
+      ok = std::fclose(file) == 0 && ok;
+      if (!ok || std::rename(temp.c_str(), path.c_str()) != 0)
+      {
+        const int error = errno;
+        std::remove(temp.c_str());
+        throw std::system_error(error, std::generic_category(), path);
+      }
+    }
+
+    static void save(const std::string &path, const VectorStore<V, Columns...> &store)
+    {
+      save_store(path, store, std::index_sequence_for<Columns...>{});
+    }
+
+    /**
+     * Opens the file at path, which must have been written by save() with the same V and Columns.
+     */
+    explicit VectorFile(const std::string &path, const bool populate = false)
+    {
+#ifdef __linux__
+      const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+      {
+        throw std::system_error(errno, std::generic_category(), path);
+      }
+
+      struct stat info;
+      if (fstat(fd, &info) != 0)
+      {
+        const int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+      }
+
+      bytes = static_cast<size_t>(info.st_size);
+      if (bytes != 0)
+      {
+        const int flags  = MAP_PRIVATE | (populate ? MAP_POPULATE : 0);
+        void *const addr = mmap(nullptr, bytes, PROT_READ, flags, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+          const int error = errno;
+          close(fd);
+          throw std::system_error(error, std::generic_category(), path);
+        }
+        base = static_cast<const unsigned char *>(addr);
+      }
+      // The mapping keeps the file alive.
+      close(fd);
+#else
+      (void)populate;
+      read_whole(path);
+#endif
+
+      try
+      {
+        check(path);
+      }
+      catch (...)
+      {
+        release();
+        throw;
+      }
+    }
+
+    ~VectorFile() { release(); }
+
+    VectorFile(VectorFile &&other) noexcept { swap(other); }
+
+    VectorFile &operator=(VectorFile &&other) noexcept
+    {
+      swap(other);
+      return *this;
+    }
+
+    VectorFile(const VectorFile &)            = delete;
+    VectorFile &operator=(const VectorFile &) = delete;
+
+    void swap(VectorFile &other) noexcept
+    {
+      std::swap(base, other.base);
+      std::swap(bytes, other.bytes);
+      std::swap(count, other.count);
+      std::swap(arrays, other.arrays);
+    }
+
+    size_t size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    const V *data() const noexcept { return reinterpret_cast<const V *>(arrays[0]); }
+    const V *begin() const noexcept { return data(); }
+    const V *end() const noexcept { return data() + count; }
+
+    const V &operator[](const size_t i) const noexcept
+    {
+      assert(i < count);
+      return data()[i];
+    }
+
+    template <size_t I> const column_type<I> *column() const noexcept
+    {
+      return reinterpret_cast<const column_type<I> *>(arrays[I + 1]);
+    }
+
+  private:
+    static constexpr size_t alignment = 64;
+    static constexpr size_t arity     = sizeof...(Columns) + 1;
+    static constexpr std::array<size_t, arity> element_sizes{sizeof(V), sizeof(Columns)...};
+
+    // Written in the byte order of the machine, so that a file from a machine with the other
+    // byte order reads back as 0x04030201.
+    static constexpr uint32_t byte_order = 0x01020304;
+    static constexpr char magic[8]       = {'C', 'P', 'P', 'I', 'N', 'V', 'E', 'C'};
+
+    struct Header
+    {
+      char signature[8];
+      uint32_t version;
+      uint32_t byte_order;
+      uint64_t count;
+      uint64_t array_count;
+    };
+
+    struct Array
+    {
+      uint64_t element_size;
+      uint64_t offset;
+    };
+
+    static constexpr size_t header_size =
+        (sizeof(Header) + arity * sizeof(Array) + alignment - 1) / alignment * alignment;
+
+    // Returns the header (padded to header_size) for a file holding n vectors.
+    static std::array<unsigned char, header_size> make_layout(const size_t n) noexcept
+    {
+      std::array<unsigned char, header_size> out{};
+      Header header;
+      std::memcpy(header.signature, magic, sizeof(magic));
+      header.version     = version;
+      header.byte_order  = byte_order;
+      header.count       = n;
+      header.array_count = arity;
+      std::memcpy(out.data(), &header, sizeof(header));
+
+      uint64_t offset = header_size;
+      for (size_t a = 0; a < arity; a++)
+      {
+        const Array array{element_sizes[a], offset};
+        std::memcpy(out.data() + sizeof(Header) + a * sizeof(Array), &array, sizeof(array));
+        offset += (n * element_sizes[a] + alignment - 1) / alignment * alignment;
+      }
+      return out;
+    }
+
+    template <size_t... I>
+    static void save_store(const std::string &path, const VectorStore<V, Columns...> &store,
+                           std::index_sequence<I...>)
+    {
+      save(path, store.data(), store.size(), store.template column<I>()...);
+    }
+
+    // Checks the header against V and Columns, and sets count and arrays.
+    void check(const std::string &path)
+    {
+      const auto fail = [&](const char *const reason) {
+        throw std::runtime_error(path + ": " + reason);
+      };
+
+      Header header;
+      if (bytes < header_size)
+      {
+        fail("too short to be a vector file");
+      }
+      std::memcpy(&header, base, sizeof(header));
+      if (std::memcmp(header.signature, magic, sizeof(magic)) != 0)
+      {
+        fail("not a vector file");
+      }
+      if (header.byte_order != byte_order)
+      {
+        fail("written on a machine with a different byte order");
+      }
+      if (header.version != version)
+      {
+        fail("unsupported version");
+      }
+      if (header.array_count != arity)
+      {
+        fail("wrong number of columns");
+      }
+
+      count = static_cast<size_t>(header.count);
+      for (size_t a = 0; a < arity; a++)
+      {
+        Array array;
+        std::memcpy(&array, base + sizeof(Header) + a * sizeof(Array), sizeof(array));
+        if (array.element_size != element_sizes[a])
+        {
+          fail("wrong element size");
+        }
+        if (array.offset % alignment != 0 || array.offset > bytes ||
+            count > (bytes - array.offset) / element_sizes[a])
+        {
+          fail("truncated");
+        }
+        arrays[a] = base + array.offset;
+      }
+    }
+
+#ifndef __linux__
+    void read_whole(const std::string &path)
+    {
+      FILE *const file = std::fopen(path.c_str(), "rb");
+      if (file == nullptr)
+      {
+        throw std::system_error(errno, std::generic_category(), path);
+      }
+      std::fseek(file, 0, SEEK_END);
+      const long end = std::ftell(file);
+      std::fseek(file, 0, SEEK_SET);
+      bytes = end > 0 ? static_cast<size_t>(end) : 0;
+
+      unsigned char *const buffer =
+          bytes == 0 ? nullptr
+                     : static_cast<unsigned char *>(std::aligned_alloc(
+                           alignment, (bytes + alignment - 1) / alignment * alignment));
+      base = buffer;
+      if ((bytes != 0 && buffer == nullptr) || std::fread(buffer, 1, bytes, file) != bytes)
+      {
+        const int error = errno;
+        std::fclose(file);
+        release();
+        throw std::system_error(error, std::generic_category(), path);
+      }
+      std::fclose(file);
+    }
+#endif
+
+    void release() noexcept
+    {
+      if (base == nullptr)
+      {
+        return;
+      }
+#ifdef __linux__
+      munmap(const_cast<unsigned char *>(base), bytes);
+#else
+      std::free(const_cast<unsigned char *>(base));
+#endif
+      base = nullptr;
+    }
+
+    const unsigned char *base = nullptr;
+    size_t bytes              = 0;
+    size_t count              = 0;
+    // The start of the vectors, followed by the start of each column.
+    std::array<const unsigned char *, arity> arrays{};
+  };
+
+  /***
+   * ThreadPool. A persistent pool of threads for running the bulk kernels (and the Bucketer) over
+   * very large arrays. A single core can't saturate the memory bandwidth of a large machine, but
+   * starting threads for every call costs far more than a call over a few thousand vectors takes:
+   * this pool starts its threads once, and parks them on a condition variable between jobs.
+   *
+   * parallel_for(n, f, grain) splits [0, n) into chunks of `grain` elements, and calls f(begin,
+   * end) once for each chunk. Scheduling is by work stealing:
+   * a) Each thread starts with a contiguous block of chunks, in order. With the same n and grain,
+   *    each thread gets the same block every time, and so repeated passes over the same data (with
+   *    first-touch page placement) keep reading memory that is local to the thread's NUMA node.
+   *    The default grain is a whole number of 4KiB pages of vectors, so that no page is split
+   *    between two threads.
+   * b) A thread that runs out of work steals chunks from the far end of another thread's block,
+   *    trying its nearest neighbours first (with pinned threads, these are usually on the same
+   *    node). Each block is a single 64-bit word holding [begin, end), so taking a chunk from
+   *    either end is one compare-and-swap, and every chunk runs exactly once.
+   * c) If there are fewer than two chunks, or the pool has a single thread, or parallel_for is
+   *    called from inside another parallel_for, f just runs on the calling thread. This is the
+   *    serial fallback: small inputs don't pay for waking the pool.
+   *
+   * The calling thread takes part in every job, so a pool of size() threads starts size() - 1 of
+   * its own. Jobs run one at a time: concurrent calls from different threads wait for each other.
+   * f must not throw.
+   *
+   * If `pin` is set (on Linux), worker i is pinned to CPU i: this keeps each block of chunks on
+   * the same node from call to call. Otherwise the scheduler is free to move the threads.
+   *
+   * Usage:
+   * CPP_INTRIN::ThreadPool pool(8);
+   * pool.parallel_for(n, [&](size_t begin, size_t end) { ... });
+   * CPP_INTRIN::parallel_bulk(CPP_INTRIN::m256_add_epi16_bulk, a, b, c, n, pool);
+   */
+  struct ThreadPool
+  {
+    // 1 << 14 vectors is 512KiB per array: enough work to amortise waking the threads.
+    static constexpr size_t default_grain = size_t(1) << 14;
+
+    explicit ThreadPool(unsigned threads = 0, const bool pin = false)
+    {
+      if (threads == 0)
+      {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      }
+
+      queues = std::vector<Queue>(threads);
+      for (unsigned i = 1; i < threads; i++)
+      {
+        workers.emplace_back([this, i]() noexcept { worker_loop(i); });
+#ifdef __linux__
+        if (pin)
+        {
+          cpu_set_t cpus;
+          CPU_ZERO(&cpus);
+          CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+          pthread_setaffinity_np(workers.back().native_handle(), sizeof(cpus), &cpus);
+        }
+#else
+        (void)pin;
+#endif
+      }
+    }
+
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(state);
+        stop = true;
+      }
+      wake.notify_all();
+      for (auto &worker : workers)
+      {
+        worker.join();
+      }
+    }
+
+    ThreadPool(const ThreadPool &)            = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * size. Returns the number of threads that run each job, including the caller.
+     */
+    unsigned size() const noexcept { return static_cast<unsigned>(queues.size()); }
+
+    /**
+     * global. Returns a process-wide pool with one thread per hardware thread. This is created on
+     * first use.
+     */
+    static ThreadPool &global()
+    {
+      static ThreadPool pool;
+      return pool;
+    }
+
+    /**
+     * parallel_for. Calls f(begin, end) for consecutive chunks of [0, n), each of `grain`
+     * elements (apart from the last), and returns once every call has finished. The chunk
+     * indices are 32-bit, so if n needs more than 2^32 - 1 chunks, they are made larger.
+     */
+    template <typename F>
+    void parallel_for(const size_t n, const F &f, size_t grain = default_grain)
+    {
+      assert(grain > 0);
+      constexpr size_t max_chunks = std::numeric_limits<uint32_t>::max();
+      if (n != 0)
+      {
+        grain = std::max(grain, (n - 1) / max_chunks + 1);
+      }
+      const size_t chunks = n == 0 ? 0 : (n - 1) / grain + 1;
+      bool &inside        = inside_job();
+      if (chunks < 2 || size() == 1 || inside)
+      {
+        if (n != 0)
+        {
+          f(size_t(0), n);
+        }
+        return;
+      }
+
+      std::lock_guard<std::mutex> one_at_a_time(running);
+      const auto run = [](const void *const context, const size_t begin, const size_t end) {
+        (*static_cast<const F *>(context))(begin, end);
+      };
+      job = Job{run, static_cast<const void *>(&f), n, grain};
+
+      // Thread t gets chunks [t * chunks / size(), (t + 1) * chunks / size()).
+      const size_t threads = size();
+      for (size_t t = 0; t < threads; t++)
+      {
+        queues[t].range.store(pack(t * chunks / threads, (t + 1) * chunks / threads));
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(state);
+        pending = workers.size();
+        generation++;
+      }
+      wake.notify_all();
+
+      inside = true;
+      work(0);
+      inside = false;
+
+      std::unique_lock<std::mutex> lock(state);
+      done.wait(lock, [this] { return pending == 0; });
+    }
+
+  private:
+    // A type-erased call to the current job's f.
+    struct Job
+    {
+      void (*run)(const void *, size_t, size_t);
+      const void *context;
+      size_t n;
+      size_t grain;
+    };
+
+    // Each thread's block of chunks, as begin | (end << 32). This is on its own cache line, so
+    // that the threads taking chunks from their own blocks don't contend.
+    struct alignas(64) Queue
+    {
+      std::atomic<uint64_t> range{0};
+    };
+
+    static uint64_t pack(const size_t begin, const size_t end) noexcept
+    {
+      return uint64_t(begin) | (uint64_t(end) << 32);
+    }
+
+    static bool &inside_job() noexcept
+    {
+      static thread_local bool inside = false;
+      return inside;
+    }
+
+    // Takes a chunk from the front of queue (if owner) or the back (if not). Returns false if
+    // the queue is empty.
+    static bool take(Queue &queue, const bool owner, size_t &chunk) noexcept
+    {
+      uint64_t range = queue.range.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        const size_t begin = range & 0xFFFFFFFF, end = range >> 32;
+        if (begin >= end)
+        {
+          return false;
+        }
+        chunk               = owner ? begin : end - 1;
+        const uint64_t next = owner ? pack(begin + 1, end) : pack(begin, end - 1);
+        if (queue.range.compare_exchange_weak(range, next, std::memory_order_relaxed))
+        {
+          return true;
+        }
+      }
+    }
+
+    void work(const unsigned self) noexcept
+    {
+      const auto run_chunk = [this](const size_t chunk) {
+        const size_t begin = chunk * job.grain;
+        job.run(job.context, begin, std::min(job.n, begin + job.grain));
+      };
+
+      size_t chunk;
+      while (take(queues[self], true, chunk))
+      {
+        run_chunk(chunk);
+      }
+
+      // Steal from the nearest threads first: self + 1, self - 1, self + 2, ...
+      const unsigned threads = size();
+      for (unsigned distance = 1; distance < threads; distance++)
+      {
+        const unsigned victim = (distance % 2) ? (self + (distance + 1) / 2) % threads
+                                               : (self + threads - distance / 2) % threads;
+        while (take(queues[victim], false, chunk))
+        {
+          run_chunk(chunk);
+        }
+      }
+    }
+
+    void worker_loop(const unsigned self) noexcept
+    {
+      inside_job()  = true;
+      uint64_t seen = 0;
+      for (;;)
+      {
+        {
+          std::unique_lock<std::mutex> lock(state);
+          wake.wait(lock, [&] { return stop || generation != seen; });
+          if (stop)
+          {
+            return;
+          }
+          seen = generation;
+        }
+
+        work(self);
+
+        std::lock_guard<std::mutex> lock(state);
+        if (--pending == 0)
+        {
+          done.notify_one();
+        }
+      }
+    }
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    Job job{};
+
+    // Held for the whole of parallel_for, so that jobs run one at a time.
+    std::mutex running;
+    // Guards generation, pending and stop.
+    std::mutex state;
+    std::condition_variable wake, done;
+    uint64_t generation = 0;
+    size_t pending      = 0;
+    bool stop           = false;
+  };
+
+  /***
+   * parallel_bulk. Runs a bulk kernel over [0, n) on a ThreadPool, by calling it on each chunk of
+   * the inputs. This works for any of the bulk kernels, whether the compile-time functions or the
+   * dispatch() pointers, e.g:
+   *
+   * parallel_bulk(m256_add_epi16_bulk, a, b, c, n);
+   * parallel_bulk(dispatch().m256_hadamard16_epi16_bulk, a, c, n, pool);
+   * const uint64_t ones = parallel_bulk(m256_popcount_si256_bulk, a, n);
+   *
+   * The reduction sums the results of each chunk. As with the kernels themselves, c may be the
+   * same as a, but must not otherwise overlap the inputs. The default pool is ThreadPool::global(),
+   * and inputs with fewer than two chunks of `grain` vectors run serially on the calling thread.
+   */
+  template <typename T>
+  static inline void parallel_bulk(void (*op)(const T *, const T *, T *, size_t), const T *a,
+                                   const T *b, T *c, const size_t n,
+                                   ThreadPool &pool    = ThreadPool::global(),
+                                   const size_t grain = ThreadPool::default_grain)
+  {
+    pool.parallel_for(
+        n,
+        [=](const size_t begin, const size_t end) {
+          op(a + begin, b + begin, c + begin, end - begin);
+        },
+        grain);
+  }
+
+  template <typename T>
+  static inline void parallel_bulk(void (*op)(const T *, T *, size_t), const T *a, T *c,
+                                   const size_t n, ThreadPool &pool = ThreadPool::global(),
+                                   const size_t grain = ThreadPool::default_grain)
+  {
+    pool.parallel_for(
+        n, [=](const size_t begin, const size_t end) { op(a + begin, c + begin, end - begin); },
+        grain);
+  }
+
+  template <typename T>
+  static inline uint64_t parallel_bulk(uint64_t (*op)(const T *, size_t), const T *a,
+                                       const size_t n, ThreadPool &pool = ThreadPool::global(),
+                                       const size_t grain = ThreadPool::default_grain)
+  {
+    std::atomic<uint64_t> total{0};
+    pool.parallel_for(
+        n,
+        [&](const size_t begin, const size_t end) {
+          total.fetch_add(op(a + begin, end - begin), std::memory_order_relaxed);
+        },
+        grain);
+    return total.load();
+  }
+
+  /***
+   * Bucketer. Sorts int16 vectors into buckets, so that vectors that are close together (in angle)
+   * are likely to land in the same bucket. This is the bucketing step from BDGL-style lattice
+   * sieving (e.g G6K, https://github.com/lducas/AVX2-BDGL-bucketer): rather than being rebuilt
+   * out of m256_sign_epi16, m256_hadd_epi16 and friends in every project, the composition lives
+   * here and is tuned once.
+   *
+   * Each vector is hashed by `codes` independent random transforms. Each transform is `rounds`
+   * rounds of: flip the sign of a random subset of the lanes, apply a random permutation, and
+   * apply the 16-point Hadamard transform. Every step is orthogonal (up to scaling), so the
+   * transform is a random rotation that is far cheaper than a dense one. The bucket for a single
+   * code is then the lane with the largest magnitude, along with its sign: 32 buckets per code.
+   * The codes are combined as a product code, so there are 32^codes buckets in total, and the
+   * best bucket is the one whose per-code lanes have the largest summed magnitude. There can be
+   * at most max_codes = 4 codes: the constructor throws std::invalid_argument otherwise.
+   *
+   * With top-k bucketing, each vector is placed in the k buckets with the largest summed
+   * magnitudes, which is how the sieve trades more buckets per vector for fewer missed pairs.
+   *
+   * The Hadamard transform multiplies the Euclidean norm by 4, and so each round shifts its output
+   * right by 2. This keeps the norm of the vector (almost) unchanged through every round, and so
+   * the transform never overflows as long as the Euclidean norm of the input is below 8000.
+   *
+   * The transforms are generated from `seed` using the xorshift back-end of RandomGenerator, so
+   * the same seed gives the same buckets on every machine. Like the public functions, the
+   * bucketer is compiled for the best tier available at compile-time.
+   *
+   * Usage:
+   * const CPP_INTRIN::Bucketer bucketer(2, seed);
+   * const auto bins = bucketer.bin(db.data(), db.size(), 4, pool); // 4 buckets each, on a pool.
+   * for (size_t i = bins.offsets[b]; i < bins.offsets[b + 1]; i++) { ... db[bins.items[i]] ... }
+   */
+  struct Bucketer
+  {
+    static constexpr unsigned buckets_per_code = 32;
+    // Each code takes 5 bits of a bucket index. bin() allocates an offset for each of the
+    // 32^codes buckets, which is already 8MiB with 4 codes (and 8GiB with 6).
+    static constexpr unsigned max_codes = 4;
+
+    /**
+     * Bins. The output of bin(). This is in compressed sparse row form: the items in bucket b are
+     * items[offsets[b]] up to (but excluding) items[offsets[b + 1]], in increasing order.
+     */
+    struct Bins
+    {
+      std::vector<size_t> offsets;
+      std::vector<uint32_t> items;
+    };
+
+    Bucketer(const unsigned codes, const uint64_t seed, const unsigned rounds = 3)
+        : n_codes{codes}, n_rounds{rounds}
+    {
+      if (codes < 1 || codes > max_codes)
+      {
+        throw std::invalid_argument("Bucketer: codes must be in [1, " + std::to_string(max_codes) +
+                                    "]");
+      }
+      assert(rounds >= 1);
+      RandomGenerator rng(seed, RandomGenerator::Backend::xorshift);
+      transforms.resize(size_t(codes) * rounds);
+      for (auto &round : transforms)
+      {
+        const auto signs = rng.next<uint16_t>();
+        for (unsigned i = 0; i < 16; i++)
+        {
+          round.signs[i] = (signs[i] & 1) ? -1 : 1;
+        }
+
+        // Each 128-bit half gets its own permutation of its 16-bit lanes, followed by a
+        // permutation of the 32-bit lanes across the whole vector.
+        const auto r  = rng.next<uint16_t>();
+        const auto lo = random_permutation(r, 0);
+        const auto hi = random_permutation(r, 8);
+        for (unsigned i = 0; i < 8; i++)
+        {
+          round.shuffle[2 * i]          = static_cast<int8_t>(2 * lo[i]);
+          round.shuffle[2 * i + 1]      = static_cast<int8_t>(2 * lo[i] + 1);
+          round.shuffle[16 + 2 * i]     = static_cast<int8_t>(2 * hi[i]);
+          round.shuffle[16 + 2 * i + 1] = static_cast<int8_t>(2 * hi[i] + 1);
+        }
+        const auto lanes = random_permutation(rng.next<uint16_t>(), 0);
+        for (unsigned i = 0; i < 8; i++)
+        {
+          round.permute[i] = lanes[i];
+        }
+      }
+    }
+
+    unsigned codes() const noexcept { return n_codes; }
+    unsigned rounds() const noexcept { return n_rounds; }
+    size_t buckets() const noexcept { return size_t(1) << (5 * n_codes); }
+
+    /**
+     * transform. Returns the random transform of a for the given code.
+     */
+    epi16x16 transform(const epi16x16 &a, const unsigned code) const noexcept
+    {
+      assert(code < n_codes);
+      const Round *round = transforms.data() + size_t(code) * n_rounds;
+      epi16x16 x         = a;
+      for (unsigned r = 0; r < n_rounds; r++)
+      {
+        x = Native::m256_sign_epi16(x, round[r].signs);
+        x = Native::m256_shuffle_epi8(x.epi8(), round[r].shuffle).epi16();
+        x = m256_permutevar8x32_epi32(x.epi32(), round[r].permute).epi16();
+        x = m256_srai_epi16<2>(m256_hadamard16_epi16(x));
+      }
+      return x;
+    }
+
+    /**
+     * hash. Returns the best bucket for a.
+     */
+    uint32_t hash(const epi16x16 &a) const noexcept
+    {
+      uint32_t bucket = 0;
+      for (unsigned code = 0; code < n_codes; code++)
+      {
+        const auto x     = transform(a, code);
+        const unsigned i = m256_reduce_argmax_epi16(m256_abs_epi16(x));
+        bucket |= (2 * i + (x[i] < 0)) << (5 * code);
+      }
+      return bucket;
+    }
+
+    /**
+     * hash. Writes the k best buckets for a to out, best first. k must be at least 1 and at most
+     * 16^codes.
+     */
+    void hash(const epi16x16 &a, uint32_t *const out, const unsigned k) const
+    {
+      Scratch scratch;
+      hash(a, out, k, scratch);
+    }
+
+    /**
+     * hash_bulk. Writes the k best buckets for each of a[0], ..., a[n - 1] to out, which must
+     * have room for n * k buckets: the buckets for a[i] are out[i * k], ..., out[i * k + k - 1].
+     * With a pool, the vectors are split over the pool's threads in chunks of `grain` vectors.
+     */
+    void hash_bulk(const epi16x16 *const a, const size_t n, uint32_t *const out,
+                   const unsigned k) const
+    {
+      hash_range(a, out, k, 0, n);
+    }
+
+    void hash_bulk(const epi16x16 *const a, const size_t n, uint32_t *const out, const unsigned k,
+                   ThreadPool &pool) const
+    {
+      pool.parallel_for(
+          n, [&](const size_t begin, const size_t end) { hash_range(a, out, k, begin, end); },
+          grain);
+    }
+
+    /**
+     * bin. Places each of a[0], ..., a[n - 1] into its k best buckets, and returns the contents of
+     * every bucket. This allocates one offset per bucket, and so it's meant for up to 4 codes
+     * (about a million buckets). With a pool, the hashing is split over its threads, as with
+     * hash_bulk. The items are 32-bit, so n must be below 2^32: otherwise this throws
+     * std::invalid_argument.
+     */
+    Bins bin(const epi16x16 *const a, const size_t n, const unsigned k) const
+    {
+      check_count(n);
+      std::vector<uint32_t> hashes(n * k);
+      hash_bulk(a, n, hashes.data(), k);
+      return sort_by_bucket(hashes, k);
+    }
+
+    Bins bin(const epi16x16 *const a, const size_t n, const unsigned k, ThreadPool &pool) const
+    {
+      check_count(n);
+      std::vector<uint32_t> hashes(n * k);
+      hash_bulk(a, n, hashes.data(), k, pool);
+      return sort_by_bucket(hashes, k);
+    }
+
+  private:
+    // Hashing a vector takes tens to hundreds of nanoseconds, so this is much smaller than the
+    // default grain of the pool.
+    static constexpr size_t grain = 1024;
+
+    static void check_count(const size_t n)
+    {
+      if (n > std::numeric_limits<uint32_t>::max())
+      {
+        throw std::invalid_argument("Bucketer: bin takes at most " +
+                                    std::to_string(std::numeric_limits<uint32_t>::max()) +
+                                    " vectors");
+      }
+    }
+
+    void hash_range(const epi16x16 *const a, uint32_t *const out, const unsigned k,
+                    const size_t begin, const size_t end) const
+    {
+      Scratch scratch;
+      for (size_t i = begin; i < end; i++)
+      {
+        if (k == 1)
+        {
+          out[i] = hash(a[i]);
+        }
+        else
+        {
+          hash(a[i], out + i * k, k, scratch);
+        }
+      }
+    }
+
+    // Given the k buckets of each item, returns the items in each bucket.
+    Bins sort_by_bucket(const std::vector<uint32_t> &hashes, const unsigned k) const
+    {
+      // This is a counting sort of the items by bucket.
+      Bins bins;
+      bins.offsets.assign(buckets() + 1, 0);
+      for (const auto bucket : hashes)
+      {
+        bins.offsets[bucket + 1]++;
+      }
+      std::partial_sum(bins.offsets.begin(), bins.offsets.end(), bins.offsets.begin());
+
+      std::vector<size_t> cursor(bins.offsets.begin(), bins.offsets.end() - 1);
+      bins.items.resize(hashes.size());
+      for (size_t i = 0; i < hashes.size(); i++)
+      {
+        bins.items[cursor[hashes[i]]++] = static_cast<uint32_t>(i / k);
+      }
+      return bins;
+    }
+
+    // m256_sign_epi16 and m256_shuffle_epi8 assert that their arguments differ, which is
+    // perfectly legitimate here (e.g for a vector of +-1s), and so we call the tier that they
+    // would use directly.
+#if defined(__AVX2__)
+    using Native = AVX2;
+#elif defined(__SSSE3__)
+    using Native = SSE;
+#elif CPP_INTRIN_NEON
+    using Native = NEON;
+#else
+    using Native = Plain;
+#endif
+
+    struct Round
+    {
+      epi16x16 signs;
+      epi8x32 shuffle;
+      epi32x8 permute;
+    };
+
+    struct Candidate
+    {
+      uint32_t score;
+      uint32_t bucket;
+    };
+
+    // Ties are broken by bucket, so that the order doesn't depend on the sort.
+    static bool better(const Candidate &a, const Candidate &b) noexcept
+    {
+      return a.score > b.score || (a.score == b.score && a.bucket < b.bucket);
+    }
+
+    // The buffers used by top-k hashing, which are reused across calls by hash_bulk.
+    struct Scratch
+    {
+      std::vector<Candidate> best, next, lanes;
+    };
+
+    void hash(const epi16x16 &a, uint32_t *const out, const unsigned k, Scratch &scratch) const
+    {
+      assert(k >= 1 && size_t(k) <= (size_t(1) << (4 * n_codes)));
+      // The best k buckets using the codes so far. This starts as the empty product.
+      auto &best = scratch.best, &next = scratch.next, &lanes = scratch.lanes;
+      best.assign(1, Candidate{0, 0});
+      for (unsigned code = 0; code < n_codes; code++)
+      {
+        const auto x = transform(a, code);
+        lanes.clear();
+        for (unsigned i = 0; i < 16; i++)
+        {
+          const auto score = static_cast<uint32_t>(std::abs(int32_t(x[i])));
+          lanes.push_back(Candidate{score, (2 * i + (x[i] < 0)) << (5 * code)});
+        }
+        // Only the best k lanes of this code can be part of the best k buckets.
+        keep_best(lanes, k);
+
+        next.clear();
+        for (const auto &prefix : best)
+        {
+          for (size_t i = 0; i < lanes.size(); i++)
+          {
+            next.push_back(
+                Candidate{prefix.score + lanes[i].score, prefix.bucket | lanes[i].bucket});
+          }
+        }
+        keep_best(next, k);
+        std::swap(best, next);
+      }
+
+      assert(best.size() == k);
+      for (unsigned i = 0; i < k; i++)
+      {
+        out[i] = best[i].bucket;
+      }
+    }
+
+    // Shrinks c to its best min(k, c.size()) entries, best first. k is small, so this just keeps
+    // the best entries so far in order at the front of c, inserting each new one into place.
+    static void keep_best(std::vector<Candidate> &c, const size_t k) noexcept
+    {
+      size_t kept = 0;
+      for (size_t i = 0; i < c.size(); i++)
+      {
+        const auto candidate = c[i];
+        if (kept == k && !better(candidate, c[kept - 1]))
+        {
+          continue;
+        }
+        size_t pos = std::min(kept, k - 1);
+        for (; pos > 0 && better(candidate, c[pos - 1]); pos--)
+        {
+          c[pos] = c[pos - 1];
+        }
+        c[pos] = candidate;
+        kept   = std::min(kept + 1, k);
+      }
+      c.resize(kept);
+    }
+
+    // A Fisher-Yates shuffle of {0, ..., 7}, using r[offset], ..., r[offset + 6].
+    static std::array<int8_t, 8> random_permutation(const Vec256<uint16_t> &r,
+                                                    const unsigned offset) noexcept
+    {
+      std::array<int8_t, 8> perm{0, 1, 2, 3, 4, 5, 6, 7};
+      for (unsigned i = 7; i > 0; i--)
+      {
+        std::swap(perm[i], perm[r[offset + 7 - i] % (i + 1)]);
+      }
+      return perm;
+    }
+
+    unsigned n_codes;
+    unsigned n_rounds;
+    // The rounds for code c are transforms[c * n_rounds] up to transforms[(c + 1) * n_rounds - 1].
+    std::vector<Round> transforms;
+  };
 };
 
 #endif
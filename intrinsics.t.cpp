@@ -1,7 +1,14 @@
 #include "intrinsics.hpp"
 #include "gtest/gtest.h"
 #include <bitset>
+#include <cmath>
 #include <cstdlib>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
 
 /***
  * Intrinsics.t.cpp.
@@ -126,6 +133,77 @@ TEST(testIntrin, testPermu4x64_epi64)
 #undef CHECK_PERMU
 }
 
+TEST(testIntrin, testCompare)
+{
+  CPP_INTRIN::epi8x32 a8, b8, m8;
+  CPP_INTRIN::epi16x16 a, b;
+  for (unsigned iter = 0; iter < 64; iter++)
+  {
+    // Small values, so that the equality comparisons hold in a good number of lanes.
+    for (unsigned i = 0; i < 32; i++)
+    {
+      a8[i] = static_cast<int8_t>(rand() % 5 - 2);
+      b8[i] = static_cast<int8_t>(rand() % 5 - 2);
+      m8[i] = static_cast<int8_t>(rand());
+    }
+    for (unsigned i = 0; i < 16; i++)
+    {
+      a[i] = static_cast<int16_t>(rand() % 5 - 2);
+      b[i] = static_cast<int16_t>(rand() % 5 - 2);
+    }
+    a8[0] = INT8_MIN;
+    a8[1] = INT8_MAX;
+    a[0]  = INT16_MIN;
+    a[1]  = INT16_MAX;
+
+    for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+    {
+      const auto table    = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+      const auto eq8      = table.m256_cmpeq_epi8(a8, b8);
+      const auto gt8      = table.m256_cmpgt_epi8(a8, b8);
+      const auto lt8      = table.m256_cmplt_epi8(a8, b8);
+      const auto eq16     = table.m256_cmpeq_epi16(a, b);
+      const auto lt16     = table.m256_cmplt_epi16(a, b);
+      const auto blend    = table.m256_blendv_epi8(a8, b8, m8);
+      const uint32_t mask = table.m256_movemask_epi8(m8);
+
+      for (unsigned i = 0; i < 32; i++)
+      {
+        EXPECT_EQ(eq8[i], a8[i] == b8[i] ? -1 : 0);
+        EXPECT_EQ(gt8[i], a8[i] > b8[i] ? -1 : 0);
+        EXPECT_EQ(lt8[i], a8[i] < b8[i] ? -1 : 0);
+        EXPECT_EQ(blend[i], m8[i] < 0 ? b8[i] : a8[i]);
+        EXPECT_EQ((mask >> i) & 1, m8[i] < 0 ? 1u : 0u);
+      }
+      for (unsigned i = 0; i < 16; i++)
+      {
+        EXPECT_EQ(eq16[i], a[i] == b[i] ? -1 : 0);
+        EXPECT_EQ(lt16[i], a[i] < b[i] ? -1 : 0);
+      }
+
+      EXPECT_EQ(eq8, CPP_INTRIN::m256_cmpeq_epi8(a8, b8));
+      EXPECT_EQ(gt8, CPP_INTRIN::m256_cmpgt_epi8(a8, b8));
+      EXPECT_EQ(lt8, CPP_INTRIN::m256_cmplt_epi8(a8, b8));
+      EXPECT_EQ(eq16, CPP_INTRIN::m256_cmpeq_epi16(a, b));
+      EXPECT_EQ(lt16, CPP_INTRIN::m256_cmplt_epi16(a, b));
+      EXPECT_EQ(blend, CPP_INTRIN::m256_blendv_epi8(a8, b8, m8));
+      EXPECT_EQ(mask, CPP_INTRIN::m256_movemask_epi8(m8));
+    }
+  }
+
+  // The intended use: finding the first matching byte without scanning the array.
+  CPP_INTRIN::epi8x32 haystack{}, needle{};
+  needle.fill(42);
+  haystack[19] = 42;
+  haystack[27] = 42;
+  const auto matches   = CPP_INTRIN::m256_cmpeq_epi8(haystack, needle);
+  const uint32_t found = CPP_INTRIN::m256_movemask_epi8(matches);
+  EXPECT_EQ(__builtin_ctz(found), 19);
+  EXPECT_EQ(found, (1u << 19) | (1u << 27));
+  const auto all = CPP_INTRIN::m256_cmpeq_epi8(needle, needle);
+  EXPECT_EQ(CPP_INTRIN::m256_movemask_epi8(all), UINT32_MAX);
+}
+
 TEST(testIntrin, testShuffle_epi8)
 {
   // This function tests the shuffling functionality in this m256_shuffle_epi8.
@@ -202,6 +280,300 @@ TEST(testIntrin, testShuffle_epi8)
   }
 }
 
+TEST(testIntrin, testShuffleMasks)
+{
+  // The masks are built at compile-time.
+  constexpr auto reverse = CPP_INTRIN::ShuffleMasks::reverse_epi16();
+  static_assert(reverse[0] == 14 && reverse[1] == 15 && reverse[16] == 14,
+                "Error: reverse_epi16 must reverse each half");
+  constexpr auto partial = CPP_INTRIN::ShuffleMasks::make_epi16({0, -1, 2, 3, 4, 5, 6, 7});
+  static_assert(partial[2] == CPP_INTRIN::ShuffleMasks::zero, "Error: -1 must zero the lane");
+
+  CPP_INTRIN::epi16x16 a;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    a[i] = static_cast<int16_t>(rand());
+  }
+
+  const auto rev = CPP_INTRIN::m256_shuffle_epi8(a.epi8(), reverse).epi16();
+  const auto swapped =
+      CPP_INTRIN::m256_shuffle_epi8(a.epi8(), CPP_INTRIN::ShuffleMasks::swap_adjacent_epi16());
+  const auto zeroed = CPP_INTRIN::m256_shuffle_epi8(a.epi8(), partial).epi16();
+  const auto bswap =
+      CPP_INTRIN::m256_shuffle_epi8(a.epi8(), CPP_INTRIN::ShuffleMasks::bswap_epi16()).epi16();
+  for (unsigned i = 0; i < 16; i++)
+  {
+    const unsigned half = i & ~7u;
+    EXPECT_EQ(rev[i], a[half + 7 - (i & 7)]);
+    EXPECT_EQ(swapped.epi16()[i], a[i ^ 1]);
+    EXPECT_EQ(zeroed[i], (i & 7) == 1 ? 0 : a[i]);
+    EXPECT_EQ(static_cast<uint16_t>(bswap[i]), __builtin_bswap16(static_cast<uint16_t>(a[i])));
+  }
+
+  const auto b32 = CPP_INTRIN::m256_shuffle_epi8(a.epi8(), CPP_INTRIN::ShuffleMasks::bswap_epi32());
+  const auto b64 = CPP_INTRIN::m256_shuffle_epi8(a.epi8(), CPP_INTRIN::ShuffleMasks::bswap_epi64());
+  for (unsigned i = 0; i < 8; i++)
+  {
+    EXPECT_EQ(static_cast<uint32_t>(b32.epi32()[i]),
+              __builtin_bswap32(static_cast<uint32_t>(a.epi32()[i])));
+  }
+  for (unsigned i = 0; i < 4; i++)
+  {
+    EXPECT_EQ(static_cast<uint64_t>(b64.epi64()[i]),
+              __builtin_bswap64(static_cast<uint64_t>(a.epi64()[i])));
+  }
+
+  // Every entry of the compress table packs the selected lanes to the front.
+  const auto &lut = CPP_INTRIN::ShuffleMasks::compress_epi16_lut();
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(lut.data()) % 64, 0u);
+  for (unsigned mask = 0; mask < 256; mask++)
+  {
+    unsigned pos = 0;
+    for (unsigned i = 0; i < 8; i++)
+    {
+      if (mask & (1u << i))
+      {
+        EXPECT_EQ(lut[mask][2 * pos], 2 * i);
+        EXPECT_EQ(lut[mask][2 * pos + 1], 2 * i + 1);
+        pos++;
+      }
+    }
+    for (unsigned i = 2 * pos; i < 16; i++)
+    {
+      EXPECT_EQ(lut[mask][i], CPP_INTRIN::ShuffleMasks::zero);
+    }
+  }
+}
+
+TEST(testIntrin, testCompress)
+{
+  CPP_INTRIN::epi16x16 a, b;
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+  {
+    const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+    for (unsigned iter = 0; iter < 1024; iter++)
+    {
+      for (unsigned i = 0; i < 16; i++)
+      {
+        a[i] = static_cast<int16_t>(rand());
+      }
+      // Include the all-kept and none-kept masks, as well as masks with junk in the top bits.
+      const uint32_t mask = (iter == 0) ? 0 : (iter == 1) ? 0xFFFF : static_cast<uint32_t>(rand());
+
+      uint32_t expected_mask = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        expected_mask |= uint32_t(a[i] < 0) << i;
+      }
+      EXPECT_EQ(table.m256_movemask_epi16(a), expected_mask);
+
+      CPP_INTRIN::epi16x16 expected{};
+      unsigned pos = 0;
+      for (unsigned i = 0; i < 16; i++)
+      {
+        if (mask & (1u << i))
+        {
+          expected[pos++] = a[i];
+        }
+      }
+      EXPECT_EQ(table.m256_compress_epi16(a, mask), expected);
+      EXPECT_EQ(CPP_INTRIN::m256_compress_epi16(a, mask), expected);
+      EXPECT_EQ(CPP_INTRIN::m256_movemask_epi16(a), expected_mask);
+    }
+  }
+
+  // Stream compaction: keep every value greater than a threshold.
+  std::vector<int16_t> in(16 * 64), out(16 * 64 + 16);
+  for (auto &x : in)
+  {
+    x = static_cast<int16_t>(rand());
+  }
+  b.fill(1000);
+  int16_t *dst = out.data();
+  for (unsigned i = 0; i < in.size(); i += 16)
+  {
+    const CPP_INTRIN::epi16x16 v = CPP_INTRIN::m256_loadu_si256(in.data() + i);
+    const auto greater           = CPP_INTRIN::m256_cmpgt_epi16(v, b);
+    const uint32_t keep          = CPP_INTRIN::m256_movemask_epi16(greater);
+    CPP_INTRIN::m256_storeu_si256(dst, CPP_INTRIN::m256_compress_epi16(v, keep));
+    dst += __builtin_popcount(keep);
+  }
+  std::vector<int16_t> expected;
+  std::copy_if(in.begin(), in.end(), std::back_inserter(expected),
+               [](const int16_t x) { return x > 1000; });
+  EXPECT_EQ(std::vector<int16_t>(out.data(), dst), expected);
+}
+
+TEST(testIntrin, testLookup)
+{
+  std::vector<int32_t> base32(1024);
+  std::vector<int64_t> base64(1024);
+  for (unsigned i = 0; i < base32.size(); i++)
+  {
+    base32[i] = static_cast<int32_t>(rand());
+    base64[i] = (int64_t(rand()) << 32) ^ rand();
+  }
+
+  CPP_INTRIN::epi32x8 idx32;
+  CPP_INTRIN::epi8x32 t8, idx8;
+  CPP_INTRIN::epi8x64 t8x64;
+  CPP_INTRIN::epi16x16 t16, idx16;
+  CPP_INTRIN::epi16x32 t16x32;
+  for (unsigned iter = 0; iter < 256; iter++)
+  {
+    for (unsigned i = 0; i < 8; i++)
+    {
+      idx32[i] = rand() % 1024;
+    }
+    // Every lookup must ignore the high bits of its indices, including the sign bit.
+    for (unsigned i = 0; i < 32; i++)
+    {
+      t8[i]   = static_cast<int8_t>(rand());
+      idx8[i] = static_cast<int8_t>(rand());
+    }
+    for (unsigned i = 0; i < 64; i++)
+    {
+      t8x64[i] = static_cast<int8_t>(rand());
+    }
+    for (unsigned i = 0; i < 16; i++)
+    {
+      t16[i]   = static_cast<int16_t>(rand());
+      idx16[i] = static_cast<int16_t>(rand());
+    }
+    for (unsigned i = 0; i < 32; i++)
+    {
+      t16x32[i] = static_cast<int16_t>(rand());
+    }
+
+    for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+    {
+      const auto table  = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+      const auto g32    = table.m256_i32gather_epi32(base32.data(), idx32);
+      const auto g64    = table.m256_i32gather_epi64(base64.data(), idx32);
+      const auto l32_8  = table.m256_lut32_epi8(t8, idx8);
+      const auto l64_8  = table.m256_lut64_epi8(t8x64, idx8);
+      const auto l16_16 = table.m256_lut16_epi16(t16, idx16);
+      const auto l32_16 = table.m256_lut32_epi16(t16x32, idx16);
+
+      for (unsigned i = 0; i < 8; i++)
+      {
+        EXPECT_EQ(g32[i], base32[static_cast<size_t>(idx32[i])]);
+      }
+      for (unsigned i = 0; i < 4; i++)
+      {
+        EXPECT_EQ(g64[i], base64[static_cast<size_t>(idx32[i])]);
+      }
+      for (unsigned i = 0; i < 32; i++)
+      {
+        EXPECT_EQ(l32_8[i], t8[idx8[i] & 31]);
+        EXPECT_EQ(l64_8[i], t8x64[idx8[i] & 63]);
+      }
+      for (unsigned i = 0; i < 16; i++)
+      {
+        EXPECT_EQ(l16_16[i], t16[idx16[i] & 15]);
+        EXPECT_EQ(l32_16[i], t16x32[idx16[i] & 31]);
+      }
+
+      EXPECT_EQ(g32, CPP_INTRIN::m256_i32gather_epi32(base32.data(), idx32));
+      EXPECT_EQ(g64, CPP_INTRIN::m256_i32gather_epi64(base64.data(), idx32));
+      EXPECT_EQ(l32_8, CPP_INTRIN::m256_lut32_epi8(t8, idx8));
+      EXPECT_EQ(l64_8, CPP_INTRIN::m256_lut64_epi8(t8x64, idx8));
+      EXPECT_EQ(l16_16, CPP_INTRIN::m256_lut16_epi16(t16, idx16));
+      EXPECT_EQ(l32_16, CPP_INTRIN::m256_lut32_epi16(t16x32, idx16));
+    }
+  }
+
+  // A lookup into a table of 0..n-1 is just the (masked) index.
+  std::iota(t16x32.begin(), t16x32.end(), 0);
+  for (unsigned i = 0; i < 16; i++)
+  {
+    idx16[i] = static_cast<int16_t>(31 - 2 * i);
+  }
+  EXPECT_EQ(CPP_INTRIN::m256_lut32_epi16(t16x32, idx16), idx16);
+}
+
+// The transform straight from the definition: c[i] = sum_j (-1)^popcount(i & j) * a[j], wrapped
+// to 16 bits.
+static std::vector<int16_t> hadamard_reference(const int16_t *a, const unsigned n)
+{
+  std::vector<int16_t> c(n);
+  for (unsigned i = 0; i < n; i++)
+  {
+    int64_t total = 0;
+    for (unsigned j = 0; j < n; j++)
+    {
+      total += (__builtin_popcount(i & j) % 2) ? -a[j] : a[j];
+    }
+    c[i] = static_cast<int16_t>(static_cast<uint16_t>(total));
+  }
+  return c;
+}
+
+TEST(testIntrin, testHadamard)
+{
+  constexpr size_t n = 7;
+  std::vector<CPP_INTRIN::epi16x16> a(n), c(n);
+  CPP_INTRIN::epi16x32 a32;
+  for (unsigned iter = 0; iter < 64; iter++)
+  {
+    // Full-range inputs check that every tier wraps around in the same way.
+    for (auto &v : a)
+    {
+      for (auto &x : v)
+      {
+        x = static_cast<int16_t>(rand());
+      }
+    }
+    for (auto &x : a32)
+    {
+      x = static_cast<int16_t>(rand());
+    }
+
+    const auto h16 = hadamard_reference(a[0].data(), 16);
+    const auto h32 = hadamard_reference(a32.data(), 32);
+    const auto h64 = hadamard_reference(a[0].data(), 64);
+
+    for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+    {
+      const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+      const auto c16   = table.m256_hadamard16_epi16(a[0]);
+      const auto c32   = table.m512_hadamard32_epi16(a32);
+      EXPECT_TRUE(std::equal(c16.begin(), c16.end(), h16.begin()));
+      EXPECT_TRUE(std::equal(c32.begin(), c32.end(), h32.begin()));
+      EXPECT_EQ(c16, CPP_INTRIN::m256_hadamard16_epi16(a[0]));
+      EXPECT_EQ(c32, CPP_INTRIN::m512_hadamard32_epi16(a32));
+
+      table.m256_hadamard64_epi16(a.data(), c.data());
+      EXPECT_TRUE(std::equal(h64.begin(), h64.end(), c[0].data()));
+
+      // n is odd, so this covers the tail of the unrolled and paired loops.
+      table.m256_hadamard16_epi16_bulk(a.data(), c.data(), n);
+      for (size_t i = 0; i < n; i++)
+      {
+        EXPECT_EQ(c[i], CPP_INTRIN::m256_hadamard16_epi16(a[i]));
+      }
+    }
+
+    // The in-place forms give the same answer as the out-of-place ones.
+    auto b = a;
+    CPP_INTRIN::m256_hadamard64_epi16(b.data());
+    EXPECT_TRUE(std::equal(h64.begin(), h64.end(), b[0].data()));
+    b = a;
+    CPP_INTRIN::m256_hadamard16_epi16_bulk(b.data(), n);
+    CPP_INTRIN::m256_hadamard16_epi16_bulk(a.data(), c.data(), n);
+    EXPECT_EQ(b, c);
+  }
+
+  // Transforming twice multiplies by the size of the transform, as long as nothing overflows.
+  CPP_INTRIN::epi16x16 small;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    small[i] = static_cast<int16_t>(rand() % 256 - 128);
+  }
+  EXPECT_EQ(CPP_INTRIN::m256_hadamard16_epi16(CPP_INTRIN::m256_hadamard16_epi16(small)),
+            CPP_INTRIN::m256_slli_epi16<4>(small));
+}
+
 TEST(testIntrin, testz_and_si256)
 {
   // Generate two random vectors for the failure case.
@@ -394,6 +766,60 @@ TEST(testIntrin, testHaddEpi16)
   }
 }
 
+TEST(testIntrin, testReduce)
+{
+  std::vector<CPP_INTRIN::epi16x16> inputs(64);
+  for (auto &a : inputs)
+  {
+    for (unsigned i = 0; i < 16; i++)
+    {
+      a[i] = rand();
+    }
+  }
+
+  // The boundaries of the range, sums that overflow 16 bits, and repeated maxima.
+  inputs[0].fill(INT16_MIN);
+  inputs[1].fill(INT16_MAX);
+  inputs[2].fill(-1);
+  inputs[3].fill(7);
+  inputs[3][5]  = 9;
+  inputs[3][12] = 9;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    // A single maximum (and minimum) in each position, so every lane of the shuffle tree is used.
+    CPP_INTRIN::epi16x16 a{};
+    a[i]      = 1;
+    a[15 - i] = -1;
+    inputs.push_back(a);
+  }
+
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+  {
+    const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+    for (const auto &a : inputs)
+    {
+      const int32_t sum   = std::accumulate(a.cbegin(), a.cend(), int32_t(0));
+      const auto smallest = *std::min_element(a.cbegin(), a.cend());
+      const auto largest  = std::max_element(a.cbegin(), a.cend());
+      const auto index    = static_cast<unsigned>(largest - a.cbegin());
+
+      EXPECT_EQ(CPP_INTRIN::m256_reduce_add_epi16(a), sum);
+      EXPECT_EQ(CPP_INTRIN::m256_reduce_min_epi16(a), smallest);
+      EXPECT_EQ(CPP_INTRIN::m256_reduce_max_epi16(a), *largest);
+      EXPECT_EQ(CPP_INTRIN::m256_reduce_argmax_epi16(a), index);
+
+      EXPECT_EQ(table.m256_reduce_add_epi16(a), sum);
+      EXPECT_EQ(table.m256_reduce_min_epi16(a), smallest);
+      EXPECT_EQ(table.m256_reduce_max_epi16(a), *largest);
+      EXPECT_EQ(table.m256_reduce_argmax_epi16(a), index);
+    }
+  }
+
+  EXPECT_EQ(CPP_INTRIN::m256_reduce_add_epi16(inputs[1]), 16 * INT16_MAX);
+  EXPECT_EQ(CPP_INTRIN::m256_reduce_argmax_epi16(inputs[3]), 5u);
+  EXPECT_EQ(CPP_INTRIN::m256_reduce_argmax_epi16(inputs[0]), 0u);
+}
+
 TEST(testIntrin, testSLLIepi16)
 {
   std::array<int16_t, 16> a;
@@ -492,6 +918,189 @@ TEST(testIntrin, testSRLIepi16)
   CHECK_RSHIFT(a, b, 16);
 }
 
+TEST(testIntrin, testSRAIepi16)
+{
+  CPP_INTRIN::epi16x16 a;
+  for (unsigned int i = 0; i < 16; i++)
+  {
+    a[i] = static_cast<int16_t>(rand());
+  }
+  a[0] = INT16_MIN;
+  a[1] = -1;
+  a[2] = INT16_MAX;
+
+  // Shifts by more than 15 fill each lane with its sign, just like a shift by 15.
+#define CHECK_ARSHIFT(a, x)                                                                        \
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)        \
+  {                                                                                                \
+    const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));              \
+    const auto b     = table.m256_srai_epi16<x>(a);                                                \
+    for (unsigned i = 0; i < 16; i++)                                                              \
+    {                                                                                              \
+      EXPECT_EQ(b[i], int16_t(a[i] >> ((x) > 15 ? 15 : (x))));                                     \
+    }                                                                                              \
+    EXPECT_EQ(b, CPP_INTRIN::m256_srai_epi16<x>(a));                                               \
+  }
+
+  CHECK_ARSHIFT(a, 0);
+  CHECK_ARSHIFT(a, 1);
+  CHECK_ARSHIFT(a, 3);
+  CHECK_ARSHIFT(a, 7);
+  CHECK_ARSHIFT(a, 8);
+  CHECK_ARSHIFT(a, 14);
+  CHECK_ARSHIFT(a, 15);
+  CHECK_ARSHIFT(a, 16);
+  CHECK_ARSHIFT(a, 100);
+#undef CHECK_ARSHIFT
+}
+
+TEST(testIntrin, testMultiply)
+{
+  CPP_INTRIN::epi16x16 a, b;
+  for (unsigned iter = 0; iter < 64; iter++)
+  {
+    for (unsigned i = 0; i < 16; i++)
+    {
+      a[i] = static_cast<int16_t>(rand());
+      b[i] = static_cast<int16_t>(rand());
+    }
+    // The one case where madd overflows.
+    a[0] = a[1] = b[0] = b[1] = INT16_MIN;
+    a[2] = b[3]             = INT16_MAX;
+
+    for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+    {
+      const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+      const auto lo    = table.m256_mullo_epi16(a, b);
+      const auto hi    = table.m256_mulhi_epi16(a, b);
+      const auto madd  = table.m256_madd_epi16(a, b);
+
+      for (unsigned i = 0; i < 16; i++)
+      {
+        const int32_t prod = int32_t(a[i]) * int32_t(b[i]);
+        EXPECT_EQ(lo[i], static_cast<int16_t>(prod));
+        EXPECT_EQ(hi[i], static_cast<int16_t>(prod >> 16));
+      }
+      for (unsigned i = 0; i < 8; i++)
+      {
+        const int64_t sum = int64_t(a[2 * i]) * b[2 * i] + int64_t(a[2 * i + 1]) * b[2 * i + 1];
+        EXPECT_EQ(madd[i], static_cast<int32_t>(sum));
+      }
+      EXPECT_EQ(madd[0], INT32_MIN);
+
+      EXPECT_EQ(lo, CPP_INTRIN::m256_mullo_epi16(a, b));
+      EXPECT_EQ(hi, CPP_INTRIN::m256_mulhi_epi16(a, b));
+      EXPECT_EQ(madd, CPP_INTRIN::m256_madd_epi16(a, b));
+    }
+  }
+
+  // The intended use: an int16 dot product, accumulated in 32 bits and reduced at the end.
+  constexpr unsigned size = 64;
+  std::vector<CPP_INTRIN::epi16x16> x(size), y(size);
+  int64_t expected = 0;
+  for (unsigned i = 0; i < size; i++)
+  {
+    for (unsigned j = 0; j < 16; j++)
+    {
+      x[i][j] = static_cast<int16_t>(rand() % 512 - 256);
+      y[i][j] = static_cast<int16_t>(rand() % 512 - 256);
+      expected += x[i][j] * y[i][j];
+    }
+  }
+  CPP_INTRIN::epi32x8 acc{};
+  for (unsigned i = 0; i < size; i++)
+  {
+    const auto prod = CPP_INTRIN::m256_madd_epi16(x[i], y[i]);
+    for (unsigned j = 0; j < 8; j++)
+    {
+      acc[j] += prod[j];
+    }
+  }
+  EXPECT_EQ(std::accumulate(acc.begin(), acc.end(), int64_t(0)), expected);
+}
+
+TEST(testIntrin, testVariableShift)
+{
+  CPP_INTRIN::epi16x16 a;
+  CPP_INTRIN::epi32x8 a32, idx, c32;
+  CPP_INTRIN::epi64x4 a64, c64;
+  for (unsigned iter = 0; iter < 64; iter++)
+  {
+    for (unsigned i = 0; i < 16; i++)
+    {
+      a[i] = static_cast<int16_t>(rand());
+    }
+    for (unsigned i = 0; i < 8; i++)
+    {
+      a32[i] = static_cast<int32_t>(rand()) * 2 - 1;
+      // The high bits of each index must be ignored.
+      idx[i] = static_cast<int32_t>(rand());
+      // Mostly in-range counts, but with some that are too large (including "negative" ones).
+      c32[i] = (i % 4 == 3) ? static_cast<int32_t>(rand()) - RAND_MAX / 2 : rand() % 40;
+    }
+    for (unsigned i = 0; i < 4; i++)
+    {
+      a64[i] = (int64_t(rand()) << 32) ^ rand() ^ INT64_MIN;
+      c64[i] = (i == 3) ? 256 : rand() % 72;
+    }
+    const unsigned count = (iter % 8 == 7) ? 256 + iter : iter % 18;
+
+    for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+    {
+      const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+      const auto perm  = table.m256_permutevar8x32_epi32(a32, idx);
+      const auto sll   = table.m256_sll_epi16(a, count);
+      const auto srl   = table.m256_srl_epi16(a, count);
+      const auto sllv  = table.m256_sllv_epi32(a32, c32);
+      const auto srlv  = table.m256_srlv_epi32(a32, c32);
+      const auto sllv2 = table.m256_sllv_epi64(a64, c64);
+      const auto srlv2 = table.m256_srlv_epi64(a64, c64);
+
+      for (unsigned i = 0; i < 16; i++)
+      {
+        const uint16_t x = static_cast<uint16_t>(a[i]);
+        EXPECT_EQ(sll[i], count > 15 ? 0 : static_cast<int16_t>(x << count));
+        EXPECT_EQ(srl[i], count > 15 ? 0 : static_cast<int16_t>(x >> count));
+      }
+      for (unsigned i = 0; i < 8; i++)
+      {
+        const uint32_t x = static_cast<uint32_t>(a32[i]);
+        const uint32_t n = static_cast<uint32_t>(c32[i]);
+        EXPECT_EQ(perm[i], a32[idx[i] & 7]);
+        EXPECT_EQ(sllv[i], n > 31 ? 0 : static_cast<int32_t>(x << n));
+        EXPECT_EQ(srlv[i], n > 31 ? 0 : static_cast<int32_t>(x >> n));
+      }
+      for (unsigned i = 0; i < 4; i++)
+      {
+        const uint64_t x = static_cast<uint64_t>(a64[i]);
+        const uint64_t n = static_cast<uint64_t>(c64[i]);
+        EXPECT_EQ(sllv2[i], n > 63 ? 0 : static_cast<int64_t>(x << n));
+        EXPECT_EQ(srlv2[i], n > 63 ? 0 : static_cast<int64_t>(x >> n));
+      }
+
+      EXPECT_EQ(perm, CPP_INTRIN::m256_permutevar8x32_epi32(a32, idx));
+      EXPECT_EQ(sll, CPP_INTRIN::m256_sll_epi16(a, count));
+      EXPECT_EQ(srl, CPP_INTRIN::m256_srl_epi16(a, count));
+      EXPECT_EQ(sllv, CPP_INTRIN::m256_sllv_epi32(a32, c32));
+      EXPECT_EQ(srlv, CPP_INTRIN::m256_srlv_epi32(a32, c32));
+      EXPECT_EQ(sllv2, CPP_INTRIN::m256_sllv_epi64(a64, c64));
+      EXPECT_EQ(srlv2, CPP_INTRIN::m256_srlv_epi64(a64, c64));
+    }
+  }
+
+  // A runtime count must agree with the immediate forms.
+  EXPECT_EQ(CPP_INTRIN::m256_sll_epi16(a, 5), CPP_INTRIN::m256_slli_epi16<5>(a));
+  EXPECT_EQ(CPP_INTRIN::m256_srl_epi16(a, 11), CPP_INTRIN::m256_srli_epi16<11>(a));
+  // A permutation with idx = {2i, 2i + 1} is the same as the 64-bit permutation with imm8 = i.
+  for (unsigned i = 0; i < 4; i++)
+  {
+    idx[2 * i]     = static_cast<int32_t>(2 * (3 - i));
+    idx[2 * i + 1] = static_cast<int32_t>(2 * (3 - i) + 1);
+  }
+  EXPECT_EQ(CPP_INTRIN::m256_permutevar8x32_epi32(a64.epi32(), idx).epi64(),
+            CPP_INTRIN::m256_permute4x64_epi64<0b00011011>(a64));
+}
+
 TEST(testIntrin, testAbsepi16)
 {
   std::array<int16_t, 16> a;
@@ -507,6 +1116,252 @@ TEST(testIntrin, testAbsepi16)
   }
 }
 
+TEST(testIntrin, testSaturating)
+{
+  // The expected result is the exact result, clamped to the range of the type that the lanes are
+  // interpreted as. We check the boundaries explicitly, as random inputs rarely reach them.
+  const auto clamp = [](const int32_t x, const int32_t lo, const int32_t hi) {
+    return std::min(std::max(x, lo), hi);
+  };
+
+  constexpr size_t n = 37;
+  std::vector<CPP_INTRIN::epi16x16> a(n), b(n), c(n);
+  std::vector<CPP_INTRIN::epi8x32> a8(n), b8(n), c8(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    for (unsigned j = 0; j < 16; j++)
+    {
+      a[i][j] = rand();
+      b[i][j] = rand();
+    }
+    for (unsigned j = 0; j < 32; j++)
+    {
+      a8[i][j] = rand();
+      b8[i][j] = rand();
+    }
+  }
+
+  const std::array<int16_t, 6> edges{INT16_MIN, INT16_MIN + 1, -1, 0, 1, INT16_MAX};
+  for (unsigned i = 0; i < 6; i++)
+  {
+    for (unsigned j = 0; j < 6; j++)
+    {
+      a[0][(6 * i + j) % 16] = edges[i];
+      b[0][(6 * i + j) % 16] = edges[j];
+      a8[0][6 * i + j]       = static_cast<int8_t>(edges[i]);
+      b8[0][6 * i + j]       = static_cast<int8_t>(edges[j] >> 8);
+    }
+  }
+  a[1].fill(INT16_MAX);
+  b[1].fill(1);
+  a8[1].fill(-1);
+  b8[1].fill(1);
+
+  for (size_t i = 0; i < n; i++)
+  {
+    const auto adds  = CPP_INTRIN::m256_adds_epi16(a[i], b[i]);
+    const auto subs  = CPP_INTRIN::m256_subs_epi16(a[i], b[i]);
+    const auto addu  = CPP_INTRIN::m256_adds_epu16(a[i], b[i]);
+    const auto subu  = CPP_INTRIN::m256_subs_epu16(a[i], b[i]);
+    const auto addu8 = CPP_INTRIN::m256_adds_epu8(a8[i], b8[i]);
+    const auto subu8 = CPP_INTRIN::m256_subs_epu8(a8[i], b8[i]);
+    for (unsigned j = 0; j < 16; j++)
+    {
+      const int32_t x = a[i][j], y = b[i][j];
+      const int32_t ux = uint16_t(a[i][j]), uy = uint16_t(b[i][j]);
+      EXPECT_EQ(adds[j], clamp(x + y, INT16_MIN, INT16_MAX));
+      EXPECT_EQ(subs[j], clamp(x - y, INT16_MIN, INT16_MAX));
+      EXPECT_EQ(uint16_t(addu[j]), clamp(ux + uy, 0, UINT16_MAX));
+      EXPECT_EQ(uint16_t(subu[j]), clamp(ux - uy, 0, UINT16_MAX));
+    }
+    for (unsigned j = 0; j < 32; j++)
+    {
+      const int32_t ux = uint8_t(a8[i][j]), uy = uint8_t(b8[i][j]);
+      EXPECT_EQ(uint8_t(addu8[j]), clamp(ux + uy, 0, UINT8_MAX));
+      EXPECT_EQ(uint8_t(subu8[j]), clamp(ux - uy, 0, UINT8_MAX));
+    }
+  }
+
+  // Unlike the wrapping versions, these stick at the boundary.
+  EXPECT_EQ(CPP_INTRIN::m256_adds_epi16(a[1], b[1])[0], INT16_MAX);
+  EXPECT_EQ(CPP_INTRIN::m256_add_epi16(a[1], b[1])[0], INT16_MIN);
+  EXPECT_EQ(CPP_INTRIN::m256_adds_epu8(a8[1], b8[1])[0], -1);
+
+  // The bulk versions agree with the single-vector versions, both out-of-place and in-place.
+  CPP_INTRIN::m256_adds_epi16_bulk(a.data(), b.data(), c.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(c[i], CPP_INTRIN::m256_adds_epi16(a[i], b[i]));
+  }
+  CPP_INTRIN::m256_subs_epu16_bulk(a.data(), b.data(), c.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(c[i], CPP_INTRIN::m256_subs_epu16(a[i], b[i]));
+  }
+  CPP_INTRIN::m256_adds_epu8_bulk(a8.data(), b8.data(), c8.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(c8[i], CPP_INTRIN::m256_adds_epu8(a8[i], b8[i]));
+  }
+
+  auto d = a;
+  CPP_INTRIN::m256_subs_epi16_bulk(d.data(), b.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(d[i], CPP_INTRIN::m256_subs_epi16(a[i], b[i]));
+  }
+  d = a;
+  CPP_INTRIN::m256_adds_epu16_bulk(d.data(), b.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(d[i], CPP_INTRIN::m256_adds_epu16(a[i], b[i]));
+  }
+  auto d8 = a8;
+  CPP_INTRIN::m256_subs_epu8_bulk(d8.data(), b8.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(d8[i], CPP_INTRIN::m256_subs_epu8(a8[i], b8[i]));
+  }
+
+  // Every tier that this machine supports gives the same answers.
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+  {
+    const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+    for (size_t i = 0; i < n; i++)
+    {
+      EXPECT_EQ(table.m256_adds_epi16(a[i], b[i]), CPP_INTRIN::m256_adds_epi16(a[i], b[i]));
+      EXPECT_EQ(table.m256_subs_epi16(a[i], b[i]), CPP_INTRIN::m256_subs_epi16(a[i], b[i]));
+      EXPECT_EQ(table.m256_adds_epu16(a[i], b[i]), CPP_INTRIN::m256_adds_epu16(a[i], b[i]));
+      EXPECT_EQ(table.m256_subs_epu16(a[i], b[i]), CPP_INTRIN::m256_subs_epu16(a[i], b[i]));
+      EXPECT_EQ(table.m256_adds_epu8(a8[i], b8[i]), CPP_INTRIN::m256_adds_epu8(a8[i], b8[i]));
+      EXPECT_EQ(table.m256_subs_epu8(a8[i], b8[i]), CPP_INTRIN::m256_subs_epu8(a8[i], b8[i]));
+    }
+
+    table.m256_adds_epi16_bulk(a.data(), b.data(), c.data(), n);
+    EXPECT_EQ(c[5], CPP_INTRIN::m256_adds_epi16(a[5], b[5]));
+    table.m256_subs_epi16_bulk(a.data(), b.data(), c.data(), n);
+    EXPECT_EQ(c[n - 1], CPP_INTRIN::m256_subs_epi16(a[n - 1], b[n - 1]));
+    table.m256_adds_epu16_bulk(a.data(), b.data(), c.data(), n);
+    EXPECT_EQ(c[0], CPP_INTRIN::m256_adds_epu16(a[0], b[0]));
+    table.m256_subs_epu16_bulk(a.data(), b.data(), c.data(), n);
+    EXPECT_EQ(c[n - 1], CPP_INTRIN::m256_subs_epu16(a[n - 1], b[n - 1]));
+    table.m256_adds_epu8_bulk(a8.data(), b8.data(), c8.data(), n);
+    EXPECT_EQ(c8[0], CPP_INTRIN::m256_adds_epu8(a8[0], b8[0]));
+    table.m256_subs_epu8_bulk(a8.data(), b8.data(), c8.data(), n);
+    EXPECT_EQ(c8[n - 1], CPP_INTRIN::m256_subs_epu8(a8[n - 1], b8[n - 1]));
+  }
+}
+
+TEST(testIntrin, testLoadStore)
+{
+  // Deliberately misaligned input and output, as if they were in the middle of a mapped file.
+  std::vector<int16_t> in(16 * 9 + 1), out(16 * 9 + 1);
+  for (auto &x : in)
+  {
+    x = static_cast<int16_t>(rand());
+  }
+  const int16_t *src = in.data() + 1;
+  int16_t *dst       = out.data() + 1;
+  std::vector<CPP_INTRIN::epi16x16> streamed(8);
+
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+  {
+    const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+    std::fill(out.begin(), out.end(), 0);
+    for (unsigned i = 0; i < 8; i++)
+    {
+      const auto a = table.m256_loadu_si256(src + 16 * i);
+      EXPECT_TRUE(std::equal(a.begin(), a.end(), src + 16 * i));
+      EXPECT_EQ(a, CPP_INTRIN::m256_loadu_si256(src + 16 * i));
+      table.m256_storeu_si256(dst + 16 * i, a);
+      table.m256_stream_si256(streamed[i].data(), a);
+    }
+    table.stream_fence();
+    EXPECT_TRUE(std::equal(src, src + 16 * 8, dst));
+    // Nothing past the end of the stores was touched.
+    EXPECT_EQ(dst[16 * 8], 0);
+    for (unsigned i = 0; i < 8; i++)
+    {
+      EXPECT_TRUE(std::equal(streamed[i].begin(), streamed[i].end(), src + 16 * i));
+    }
+  }
+
+  // The public functions too.
+  CPP_INTRIN::epi16x16 a = CPP_INTRIN::m256_loadu_si256(src + 3), b;
+  CPP_INTRIN::m256_storeu_si256(dst + 5, a);
+  CPP_INTRIN::m256_stream_si256(b.data(), CPP_INTRIN::m256_loadu_si256(dst + 5));
+  CPP_INTRIN::stream_fence();
+  EXPECT_EQ(a, b);
+  EXPECT_TRUE(std::equal(a.begin(), a.end(), src + 3));
+}
+
+TEST(testIntrin, testMaskLoad)
+{
+  // The masked-off lanes must never be touched, so we put the tail of each array right up
+  // against an inaccessible page: touching any lane past the end faults.
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  void *mem = mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(mem, MAP_FAILED);
+  char *guard = static_cast<char *>(mem) + page;
+  ASSERT_EQ(mprotect(guard, page, PROT_NONE), 0);
+
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+  {
+    const auto table = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+    for (unsigned n = 0; n <= 8; n++)
+    {
+      // The last n int32_ts before the guard page, with a mask for just those.
+      int32_t *ptr = reinterpret_cast<int32_t *>(guard) - n;
+      CPP_INTRIN::epi32x8 mask, a, expected{};
+      for (unsigned i = 0; i < 8; i++)
+      {
+        mask[i] = (i < n) ? -1 : 0;
+        a[i]    = static_cast<int32_t>(rand());
+      }
+      for (unsigned i = 0; i < n; i++)
+      {
+        ptr[i]      = static_cast<int32_t>(rand());
+        expected[i] = ptr[i];
+      }
+      EXPECT_EQ(table.m256_maskload_epi32(ptr, mask), expected);
+      EXPECT_EQ(CPP_INTRIN::m256_maskload_epi32(ptr, mask), expected);
+      table.m256_maskstore_epi32(ptr, mask, a);
+      EXPECT_TRUE(std::equal(ptr, ptr + n, a.begin()));
+    }
+
+    for (unsigned n = 0; n <= 4; n++)
+    {
+      int64_t *ptr = reinterpret_cast<int64_t *>(guard) - n;
+      CPP_INTRIN::epi64x4 mask, a, expected{};
+      for (unsigned i = 0; i < 4; i++)
+      {
+        // Only the top bit of each mask lane matters.
+        mask[i] = (i < n) ? INT64_MIN : INT64_MAX;
+        a[i]    = (int64_t(rand()) << 32) ^ rand();
+      }
+      for (unsigned i = 0; i < n; i++)
+      {
+        ptr[i]      = (int64_t(rand()) << 32) ^ rand();
+        expected[i] = ptr[i];
+      }
+      EXPECT_EQ(table.m256_maskload_epi64(ptr, mask), expected);
+      EXPECT_EQ(CPP_INTRIN::m256_maskload_epi64(ptr, mask), expected);
+      table.m256_maskstore_epi64(ptr, mask, a);
+      EXPECT_TRUE(std::equal(ptr, ptr + n, a.begin()));
+      CPP_INTRIN::m256_maskstore_epi64(ptr, mask, expected);
+      EXPECT_TRUE(std::equal(ptr, ptr + n, expected.begin()));
+    }
+  }
+
+  // Lanes whose mask is clear are left alone by the stores.
+  CPP_INTRIN::epi32x8 dst{}, src, mask{};
+  src.fill(7);
+  mask[2] = mask[5] = -1;
+  CPP_INTRIN::m256_maskstore_epi32(dst.data(), mask, src);
+  EXPECT_EQ(dst, (CPP_INTRIN::epi32x8{std::array<int32_t, 8>{0, 0, 7, 0, 0, 7, 0, 0}}));
+  munmap(mem, 2 * page);
+}
+
 TEST(testIntrin, testRand)
 {
   __uint128_t a = static_cast<unsigned>(rand());
@@ -515,6 +1370,37 @@ TEST(testIntrin, testRand)
   auto k = CPP_INTRIN::get_randomness(a, b);
   EXPECT_NE(k, a);
   EXPECT_NE(k, b);
+
+  // Both implementations must advance their state, so repeated calls give fresh values.
+  std::vector<CPP_INTRIN::Dispatch> tables{
+      CPP_INTRIN::make_dispatch(CPP_INTRIN::ISA::plain, false)};
+  if (CPP_INTRIN::detect_aes())
+  {
+    tables.push_back(CPP_INTRIN::make_dispatch(CPP_INTRIN::ISA::plain, true));
+  }
+
+  for (const auto &table : tables)
+  {
+    __uint128_t s1 = 1, s2 = 2;
+    const auto first  = table.get_randomness(s1, s2);
+    const auto second = table.get_randomness(s1, s2);
+    EXPECT_NE(first, second);
+  }
+
+#if CPP_INTRIN_X86
+  // The default table uses AES-NI whenever the machine has it.
+  EXPECT_EQ(CPP_INTRIN::make_dispatch(CPP_INTRIN::ISA::plain).get_randomness ==
+                &CPP_INTRIN::AES::get_randomness,
+            CPP_INTRIN::detect_aes());
+#endif
+
+  // The compile-time choice and the runtime choice agree.
+#ifdef __AES__
+  {
+    __uint128_t s1 = 3, s2 = 4, t1 = 3, t2 = 4;
+    EXPECT_EQ(CPP_INTRIN::get_randomness(s1, s2), CPP_INTRIN::dispatch().get_randomness(t1, t2));
+  }
+#endif
 }
 
 TEST(testIntrin, testBroadcast)
@@ -547,3 +1433,1368 @@ TEST(testIntrin, testExtract)
   ASSERT_EQ(c1, c);
   ASSERT_EQ(c2, d);
 }
+
+TEST(testIntrin, testLanes)
+{
+  CPP_INTRIN::epi16x16 a, b;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    a[i] = static_cast<int16_t>(i);
+    b[i] = static_cast<int16_t>(-1 - static_cast<int>(i));
+  }
+
+  // The unpacks interleave the low (resp. high) lanes of each 128-bit half, not of the whole
+  // vector.
+  const CPP_INTRIN::epi16x16 lo16 = CPP_INTRIN::m256_unpacklo_epi16(a, b);
+  const CPP_INTRIN::epi16x16 hi16 = CPP_INTRIN::m256_unpackhi_epi16(a, b);
+  for (unsigned h = 0; h < 16; h += 8)
+  {
+    for (unsigned i = 0; i < 4; i++)
+    {
+      EXPECT_EQ(lo16[h + 2 * i], a[h + i]);
+      EXPECT_EQ(lo16[h + 2 * i + 1], b[h + i]);
+      EXPECT_EQ(hi16[h + 2 * i], a[h + 4 + i]);
+      EXPECT_EQ(hi16[h + 2 * i + 1], b[h + 4 + i]);
+    }
+  }
+
+  const CPP_INTRIN::epi32x8 a32 = a.epi32(), b32 = b.epi32();
+  const CPP_INTRIN::epi32x8 lo32 = CPP_INTRIN::m256_unpacklo_epi32(a32, b32);
+  const CPP_INTRIN::epi32x8 hi32 = CPP_INTRIN::m256_unpackhi_epi32(a32, b32);
+  for (unsigned h = 0; h < 8; h += 4)
+  {
+    for (unsigned i = 0; i < 2; i++)
+    {
+      EXPECT_EQ(lo32[h + 2 * i], a32[h + i]);
+      EXPECT_EQ(lo32[h + 2 * i + 1], b32[h + i]);
+      EXPECT_EQ(hi32[h + 2 * i], a32[h + 2 + i]);
+      EXPECT_EQ(hi32[h + 2 * i + 1], b32[h + 2 + i]);
+    }
+  }
+
+  // Unlike the intrinsic, m256_extract_epi16 keeps the sign of the lane.
+  EXPECT_EQ(CPP_INTRIN::m256_extract_epi16<0>(a), 0);
+  EXPECT_EQ(CPP_INTRIN::m256_extract_epi16<9>(a), 9);
+  EXPECT_EQ(CPP_INTRIN::m256_extract_epi16<15>(b), -16);
+  const CPP_INTRIN::epi64x4 a64 = b.epi64();
+  EXPECT_EQ(CPP_INTRIN::m256_extract_epi64<0>(a64), a64[0]);
+  EXPECT_EQ(CPP_INTRIN::m256_extract_epi64<3>(a64), a64[3]);
+
+  // Swapping the halves of a and b via extract and insert should give the same answer as
+  // swapping them by hand.
+  const __uint128_t a_hi = CPP_INTRIN::m256_extracti128_si256<1>(a);
+  const __uint128_t b_lo = CPP_INTRIN::m256_extracti128_si256<0>(b);
+  __uint128_t expected;
+  memcpy(&expected, &a[8], sizeof(expected));
+  EXPECT_EQ(a_hi, expected);
+  memcpy(&expected, &b[0], sizeof(expected));
+  EXPECT_EQ(b_lo, expected);
+
+  const CPP_INTRIN::epi16x16 c = CPP_INTRIN::m256_inserti128_si256<1>(a, b_lo);
+  const CPP_INTRIN::epi16x16 d = CPP_INTRIN::m256_inserti128_si256<0>(b, a_hi);
+  for (unsigned i = 0; i < 8; i++)
+  {
+    EXPECT_EQ(c[i], a[i]);
+    EXPECT_EQ(c[i + 8], b[i]);
+    EXPECT_EQ(d[i], a[i + 8]);
+    EXPECT_EQ(d[i + 8], b[i + 8]);
+  }
+}
+
+TEST(testIntrin, testDispatch)
+{
+  // The dispatch table should give exactly the same answers as the compile-time functions,
+  // regardless of which tier it's bound to. We check every tier that this machine supports.
+  std::array<int16_t, 16> a;
+  std::array<int16_t, 16> b;
+  std::array<int8_t, 32> a8;
+  std::array<int8_t, 32> b8;
+  std::array<int64_t, 4> a64;
+  std::array<int64_t, 4> b64;
+
+  for (unsigned i = 0; i < 16; i++)
+  {
+    a[i] = rand();
+    b[i] = rand();
+  }
+
+  for (unsigned i = 0; i < 32; i++)
+  {
+    a8[i] = rand();
+    b8[i] = rand();
+  }
+
+  for (unsigned i = 0; i < 4; i++)
+  {
+    a64[i] = static_cast<int64_t>(rand());
+    b64[i] = static_cast<int64_t>(rand());
+  }
+
+  const __uint128_t value =
+      (static_cast<__uint128_t>(rand()) << 64) | static_cast<unsigned>(rand());
+  // The lane functions deduce the lane type from a Vec256, so they can't take a std::array.
+  const CPP_INTRIN::epi16x16 va = a, vb = b;
+  const auto detected = CPP_INTRIN::detect_isa();
+
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(detected); tier++)
+  {
+    // On AArch64 the x86 tiers between plain and neon don't exist, and are clamped to neon.
+    const auto isa = CPP_INTRIN::clamp_isa(static_cast<CPP_INTRIN::ISA>(tier));
+    ASSERT_EQ(CPP_INTRIN::set_dispatch_isa(isa), isa);
+    const auto &d = CPP_INTRIN::dispatch();
+    ASSERT_EQ(d.isa, isa);
+
+    EXPECT_EQ(d.m256_hadd_epi16(a, b), CPP_INTRIN::m256_hadd_epi16(a, b));
+    EXPECT_EQ(d.m256_xor_epi64(a64, b64), CPP_INTRIN::m256_xor_epi64(a64, b64));
+    EXPECT_EQ(d.m256_or_epi64(a64, b64), CPP_INTRIN::m256_or_epi64(a64, b64));
+    EXPECT_EQ(d.m256_and_epi64(a64, b64), CPP_INTRIN::m256_and_epi64(a64, b64));
+    EXPECT_EQ(d.m256_and_epi16(a, b), CPP_INTRIN::m256_and_epi16(a, b));
+    EXPECT_EQ(d.m256_cmpgt_epi16(a, b), CPP_INTRIN::m256_cmpgt_epi16(a, b));
+    EXPECT_EQ(d.m256_shuffle_epi8(a8, b8), CPP_INTRIN::m256_shuffle_epi8(a8, b8));
+    EXPECT_EQ(d.m256_shuffle_epi8_epi16(a, b), CPP_INTRIN::m256_shuffle_epi8_epi16(a, b));
+    EXPECT_EQ(d.m256_add_epi16(a, b), CPP_INTRIN::m256_add_epi16(a, b));
+    EXPECT_EQ(d.m256_testz_si256(a, b), CPP_INTRIN::m256_testz_si256(a, b));
+    EXPECT_EQ(d.m256_sub_epi16(a, b), CPP_INTRIN::m256_sub_epi16(a, b));
+    EXPECT_EQ(d.m256_sign_epi16(a, b), CPP_INTRIN::m256_sign_epi16(a, b));
+    EXPECT_EQ(d.m256_abs_epi16(a), CPP_INTRIN::m256_abs_epi16(a));
+    EXPECT_EQ(d.m256_broadcastsi128_si256(value), CPP_INTRIN::m256_broadcastsi128_si256(value));
+    EXPECT_EQ(d.m256_permute4x64_epi64<27>(a64), CPP_INTRIN::m256_permute4x64_epi64<27>(a64));
+    EXPECT_EQ(d.m256_permute4x64_epi16<114>(a), CPP_INTRIN::m256_permute4x64_epi16<114>(a));
+    EXPECT_EQ(d.m256_slli_epi16<3>(a), CPP_INTRIN::m256_slli_epi16<3>(a));
+    EXPECT_EQ(d.m256_srli_epi16<5>(a), CPP_INTRIN::m256_srli_epi16<5>(a));
+    EXPECT_EQ(d.mm_extract_epi64<0>(value), CPP_INTRIN::mm_extract_epi64<0>(value));
+    EXPECT_EQ(d.mm_extract_epi64<1>(value), CPP_INTRIN::mm_extract_epi64<1>(value));
+    EXPECT_EQ(d.m256_unpacklo_epi16(a, b), CPP_INTRIN::m256_unpacklo_epi16(a, b));
+    EXPECT_EQ(d.m256_unpackhi_epi16(a, b), CPP_INTRIN::m256_unpackhi_epi16(a, b));
+    EXPECT_EQ(d.m256_unpacklo_epi32(va.epi32(), vb.epi32()),
+              CPP_INTRIN::m256_unpacklo_epi32(va.epi32(), vb.epi32()));
+    EXPECT_EQ(d.m256_unpackhi_epi32(va.epi32(), vb.epi32()),
+              CPP_INTRIN::m256_unpackhi_epi32(va.epi32(), vb.epi32()));
+    EXPECT_EQ(d.m256_extract_epi16<11>(a), CPP_INTRIN::m256_extract_epi16<11>(a));
+    EXPECT_EQ(d.m256_extract_epi64<2>(a64), CPP_INTRIN::m256_extract_epi64<2>(a64));
+    EXPECT_EQ(d.m256_extracti128_si256<1>(va), CPP_INTRIN::m256_extracti128_si256<1>(va));
+    EXPECT_EQ(d.m256_inserti128_si256<0>(va, value),
+              CPP_INTRIN::m256_inserti128_si256<0>(va, value));
+  }
+
+  // Asking for more than the machine supports should only ever give us what the machine supports.
+  EXPECT_EQ(CPP_INTRIN::set_dispatch_isa(CPP_INTRIN::ISA::avx512), detected);
+  EXPECT_EQ(CPP_INTRIN::dispatch().isa, detected);
+  EXPECT_EQ(CPP_INTRIN::set_dispatch_isa(CPP_INTRIN::ISA::neon), detected);
+  EXPECT_EQ(CPP_INTRIN::dispatch().isa, detected);
+}
+
+#if CPP_INTRIN_NEON
+TEST(testIntrin, testNEON)
+{
+  // The NEON tier must agree with the plain implementations, including on the edge cases that
+  // NEON handles differently (e.g vqtbl1q_u8 uses all of the index byte, and there's no psignw).
+  CPP_INTRIN::epi16x16 a, b;
+  CPP_INTRIN::epi8x32 a8, b8;
+  CPP_INTRIN::epi64x4 a64, b64;
+  using Neon  = CPP_INTRIN::NEON;
+  using Plain = CPP_INTRIN::Plain;
+
+  for (unsigned iter = 0; iter < 256; iter++)
+  {
+    for (unsigned i = 0; i < 16; i++)
+    {
+      a[i] = rand();
+      // Zeroes and INT16_MIN are the interesting values for sign and abs.
+      b[i] = (i % 4 == 0) ? 0 : rand();
+    }
+    a[1] = INT16_MIN;
+    for (unsigned i = 0; i < 32; i++)
+    {
+      a8[i] = rand();
+      b8[i] = rand();
+    }
+    for (unsigned i = 0; i < 4; i++)
+    {
+      a64[i] = (int64_t(rand()) << 32) ^ rand();
+      b64[i] = (int64_t(rand()) << 32) ^ rand();
+    }
+    const __uint128_t value = (static_cast<__uint128_t>(a64[0]) << 64) | uint64_t(a64[1]);
+
+    EXPECT_EQ(Neon::m256_hadd_epi16(a, b), Plain::m256_hadd_epi16(a, b));
+    EXPECT_EQ(Neon::m256_cmpgt_epi16(a, b), Plain::m256_cmpgt_epi16(a, b));
+    EXPECT_EQ(Neon::m256_shuffle_epi8(a8, b8), Plain::m256_shuffle_epi8(a8, b8));
+    EXPECT_EQ(Neon::m256_sign_epi16(a, b), Plain::m256_sign_epi16(a, b));
+    EXPECT_EQ(Neon::m256_abs_epi16(a), Plain::m256_abs_epi16(a));
+    EXPECT_EQ(Neon::m256_subabs_epi16(a, b), Plain::m256_subabs_epi16(a, b));
+    EXPECT_EQ(Neon::m256_broadcastsi128_si256(value), Plain::m256_broadcastsi128_si256(value));
+    EXPECT_EQ(Neon::m256_unpacklo_epi16(a, b), Plain::m256_unpacklo_epi16(a, b));
+    EXPECT_EQ(Neon::m256_unpackhi_epi16(a, b), Plain::m256_unpackhi_epi16(a, b));
+    EXPECT_EQ(Neon::m256_unpacklo_epi32(a.epi32(), b.epi32()),
+              Plain::m256_unpacklo_epi32(a.epi32(), b.epi32()));
+    EXPECT_EQ(Neon::m256_unpackhi_epi32(a.epi32(), b.epi32()),
+              Plain::m256_unpackhi_epi32(a.epi32(), b.epi32()));
+    EXPECT_EQ(Neon::m256_testz_si256(a, b), Plain::m256_testz_si256(a, b));
+    EXPECT_EQ(Neon::m256_and_testz_si256(a, b, a), Plain::m256_and_testz_si256(a, b, a));
+    EXPECT_EQ(Neon::m256_popcount_epi8(a8), Plain::m256_popcount_epi8(a8));
+    EXPECT_EQ(Neon::m256_popcount_epi64(a64), Plain::m256_popcount_epi64(a64));
+    EXPECT_EQ(Neon::m256_popcount_si256(a64), Plain::m256_popcount_si256(a64));
+    EXPECT_EQ(Neon::m256_xor_popcount_epi64(a64, b64), Plain::m256_xor_popcount_epi64(a64, b64));
+    EXPECT_EQ(Neon::m256_adds_epi16(a, b), Plain::m256_adds_epi16(a, b));
+    EXPECT_EQ(Neon::m256_subs_epi16(a, b), Plain::m256_subs_epi16(a, b));
+    EXPECT_EQ(Neon::m256_adds_epu16(a, b), Plain::m256_adds_epu16(a, b));
+    EXPECT_EQ(Neon::m256_subs_epu16(a, b), Plain::m256_subs_epu16(a, b));
+    EXPECT_EQ(Neon::m256_adds_epu8(a8, b8), Plain::m256_adds_epu8(a8, b8));
+    EXPECT_EQ(Neon::m256_subs_epu8(a8, b8), Plain::m256_subs_epu8(a8, b8));
+    EXPECT_EQ(Neon::m256_reduce_add_epi16(a), Plain::m256_reduce_add_epi16(a));
+    EXPECT_EQ(Neon::m256_reduce_min_epi16(a), Plain::m256_reduce_min_epi16(a));
+    EXPECT_EQ(Neon::m256_reduce_max_epi16(b), Plain::m256_reduce_max_epi16(b));
+    EXPECT_EQ(Neon::m256_reduce_argmax_epi16(b), Plain::m256_reduce_argmax_epi16(b));
+    EXPECT_EQ(Neon::m256_cmpeq_epi8(a8, b8), Plain::m256_cmpeq_epi8(a8, b8));
+    EXPECT_EQ(Neon::m256_cmpgt_epi8(a8, b8), Plain::m256_cmpgt_epi8(a8, b8));
+    EXPECT_EQ(Neon::m256_cmplt_epi8(a8, b8), Plain::m256_cmplt_epi8(a8, b8));
+    EXPECT_EQ(Neon::m256_cmpeq_epi16(a, b), Plain::m256_cmpeq_epi16(a, b));
+    EXPECT_EQ(Neon::m256_cmplt_epi16(a, b), Plain::m256_cmplt_epi16(a, b));
+    EXPECT_EQ(Neon::m256_blendv_epi8(a8, b8, a8), Plain::m256_blendv_epi8(a8, b8, a8));
+    EXPECT_EQ(Neon::m256_movemask_epi8(a8), Plain::m256_movemask_epi8(a8));
+
+    // vshlq only reads the bottom byte of its counts, so include counts like 256.
+    CPP_INTRIN::epi32x8 a32 = a8.epi32(), c32;
+    CPP_INTRIN::epi64x4 c64;
+    for (unsigned i = 0; i < 8; i++)
+    {
+      c32[i] = (i % 4 == 3) ? 256 + i : ((i % 4 == 2) ? rand() : rand() % 40);
+    }
+    for (unsigned i = 0; i < 4; i++)
+    {
+      c64[i] = (i == 3) ? 256 : ((i == 2) ? b64[i] : rand() % 72);
+    }
+    const unsigned count = (iter % 8 == 7) ? 256 + iter : iter % 18;
+    EXPECT_EQ(Neon::m256_sll_epi16(a, count), Plain::m256_sll_epi16(a, count));
+    EXPECT_EQ(Neon::m256_srl_epi16(a, count), Plain::m256_srl_epi16(a, count));
+    EXPECT_EQ(Neon::m256_sllv_epi32(a32, c32), Plain::m256_sllv_epi32(a32, c32));
+    EXPECT_EQ(Neon::m256_srlv_epi32(a32, c32), Plain::m256_srlv_epi32(a32, c32));
+    EXPECT_EQ(Neon::m256_sllv_epi64(a64, c64), Plain::m256_sllv_epi64(a64, c64));
+    EXPECT_EQ(Neon::m256_srlv_epi64(a64, c64), Plain::m256_srlv_epi64(a64, c64));
+    EXPECT_EQ(Neon::m256_madd_epi16(a, b), Plain::m256_madd_epi16(a, b));
+    EXPECT_EQ(Neon::m256_permutevar8x32_epi32(a32, c32),
+              Plain::m256_permutevar8x32_epi32(a32, c32));
+    EXPECT_EQ(Neon::m256_hadd_reduce_epi16(a, b), Plain::m256_hadd_reduce_epi16(a, b));
+    EXPECT_EQ(Neon::m256_movemask_epi16(a), Plain::m256_movemask_epi16(a));
+    const uint32_t keep = Plain::m256_movemask_epi16(b) ^ (iter * 0x9E37u);
+    EXPECT_EQ(Neon::m256_compress_epi16(a, keep), Plain::m256_compress_epi16(a, keep));
+    const auto t64 = CPP_INTRIN::epi8x64::join(a8, b8);
+    EXPECT_EQ(Neon::m256_lut32_epi8(a8, b8), Plain::m256_lut32_epi8(a8, b8));
+    EXPECT_EQ(Neon::m256_lut64_epi8(t64, b8), Plain::m256_lut64_epi8(t64, b8));
+    EXPECT_EQ(Neon::m256_lut16_epi16(a, b), Plain::m256_lut16_epi16(a, b));
+    EXPECT_EQ(Neon::m256_lut32_epi16(t64.epi16(), b), Plain::m256_lut32_epi16(t64.epi16(), b));
+    EXPECT_EQ(Neon::m256_hadamard16_epi16(a), Plain::m256_hadamard16_epi16(a));
+    EXPECT_EQ(Neon::m512_hadamard32_epi16(t64.epi16()), Plain::m512_hadamard32_epi16(t64.epi16()));
+    const auto ab = CPP_INTRIN::epi16x32::join(a, b), ba = CPP_INTRIN::epi16x32::join(b, a);
+    EXPECT_EQ(Neon::m512_sign_epi16(ab, ba), Plain::m512_sign_epi16(ab, ba));
+    EXPECT_EQ(Neon::m512_abs_epi16(ab), Plain::m512_abs_epi16(ab));
+    EXPECT_EQ(Neon::m512_shuffle_epi8(t64, ba.epi8()), Plain::m512_shuffle_epi8(t64, ba.epi8()));
+    EXPECT_EQ(Neon::m512_testz_si512(ab, ba), Plain::m512_testz_si512(ab, ba));
+    EXPECT_EQ(Neon::m512_cmpgt_epi16(ab, ba), Plain::m512_cmpgt_epi16(ab, ba));
+    EXPECT_EQ(Neon::m256_cmpgt_epi16_mask(a, b), Plain::m256_cmpgt_epi16_mask(a, b));
+    EXPECT_EQ(Neon::m512_cmpgt_epi16_mask(ab, ba), Plain::m512_cmpgt_epi16_mask(ab, ba));
+    const CPP_INTRIN::epi16x16 block[4] = {a, b, a8.epi16(), b8.epi16()};
+    CPP_INTRIN::epi16x16 neon_block[4], plain_block[4];
+    Neon::m256_hadamard64_epi16(block, neon_block);
+    Plain::m256_hadamard64_epi16(block, plain_block);
+    EXPECT_TRUE(std::equal(neon_block, neon_block + 4, plain_block));
+
+    // The bulk versions, over vectors that are each different.
+    Neon::m256_sign_epi16_bulk(block, block + 1, neon_block, 3);
+    Plain::m256_sign_epi16_bulk(block, block + 1, plain_block, 3);
+    EXPECT_TRUE(std::equal(neon_block, neon_block + 3, plain_block));
+    const CPP_INTRIN::epi64x4 words[3] = {a64, b64, c64};
+    EXPECT_EQ(Neon::m256_popcount_si256_bulk(words, 3), Plain::m256_popcount_si256_bulk(words, 3));
+    EXPECT_EQ(Neon::m256_xor_popcount_epi64_bulk(words, words + 1, 2),
+              Plain::m256_xor_popcount_epi64_bulk(words, words + 1, 2));
+  }
+
+  // testz is only true if every lane of a & b is zero, so check a single set bit in each half.
+  CPP_INTRIN::epi16x16 zero{}, one{};
+  EXPECT_TRUE(Neon::m256_testz_si256(a, zero));
+  for (unsigned i = 0; i < 16; i++)
+  {
+    one    = zero;
+    one[i] = 1;
+    EXPECT_FALSE(Neon::m256_testz_si256(one, one));
+  }
+
+  // The NEON tier is reported as such, and plain can still be asked for.
+  EXPECT_EQ(CPP_INTRIN::detect_isa(), CPP_INTRIN::ISA::neon);
+  EXPECT_EQ(CPP_INTRIN::make_dispatch(CPP_INTRIN::ISA::neon).isa, CPP_INTRIN::ISA::neon);
+  EXPECT_EQ(CPP_INTRIN::make_dispatch(CPP_INTRIN::ISA::neon).m512_shuffle_epi8,
+            &Neon::m512_shuffle_epi8);
+  EXPECT_EQ(CPP_INTRIN::set_dispatch_isa(CPP_INTRIN::ISA::plain), CPP_INTRIN::ISA::plain);
+  EXPECT_EQ(CPP_INTRIN::dispatch().isa, CPP_INTRIN::ISA::plain);
+  EXPECT_EQ(CPP_INTRIN::set_dispatch_isa(CPP_INTRIN::ISA::avx2), CPP_INTRIN::ISA::neon);
+  EXPECT_EQ(CPP_INTRIN::dispatch().isa, CPP_INTRIN::ISA::neon);
+}
+#endif
+
+TEST(testIntrin, testBulk)
+{
+  // We deliberately pick a size that isn't a multiple of any unroll factor, so that we also test
+  // the remainder loops.
+  constexpr size_t n = 37;
+  std::vector<CPP_INTRIN::epi16x16> a(n), b(n), c(n);
+  std::vector<CPP_INTRIN::epi64x4> a64(n), b64(n), c64(n);
+
+  for (size_t i = 0; i < n; i++)
+  {
+    for (unsigned j = 0; j < 16; j++)
+    {
+      a[i][j] = rand();
+      b[i][j] = rand();
+    }
+
+    for (unsigned j = 0; j < 4; j++)
+    {
+      a64[i][j] = static_cast<int64_t>(rand());
+      b64[i][j] = static_cast<int64_t>(rand());
+    }
+  }
+
+  // Each bulk call should give exactly the same answer as the single-vector call.
+  CPP_INTRIN::m256_add_epi16_bulk(a.data(), b.data(), c.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(c[i], CPP_INTRIN::m256_add_epi16(a[i], b[i]));
+  }
+
+  CPP_INTRIN::m256_sub_epi16_bulk(a.data(), b.data(), c.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(c[i], CPP_INTRIN::m256_sub_epi16(a[i], b[i]));
+  }
+
+  CPP_INTRIN::m256_sign_epi16_bulk(a.data(), b.data(), c.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(c[i], CPP_INTRIN::m256_sign_epi16(a[i], b[i]));
+  }
+
+  CPP_INTRIN::m256_xor_epi64_bulk(a64.data(), b64.data(), c64.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(c64[i], CPP_INTRIN::m256_xor_epi64(a64[i], b64[i]));
+  }
+
+  // The in-place variants overwrite their first argument.
+  auto d = a;
+  CPP_INTRIN::m256_add_epi16_bulk(d.data(), b.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(d[i], CPP_INTRIN::m256_add_epi16(a[i], b[i]));
+  }
+
+  d = a;
+  CPP_INTRIN::m256_sub_epi16_bulk(d.data(), b.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(d[i], CPP_INTRIN::m256_sub_epi16(a[i], b[i]));
+  }
+
+  d = a;
+  CPP_INTRIN::m256_sign_epi16_bulk(d.data(), b.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(d[i], CPP_INTRIN::m256_sign_epi16(a[i], b[i]));
+  }
+
+  auto d64 = a64;
+  CPP_INTRIN::m256_xor_epi64_bulk(d64.data(), b64.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    ASSERT_EQ(d64[i], CPP_INTRIN::m256_xor_epi64(a64[i], b64[i]));
+  }
+
+  // And the same should be true for every tier in the dispatch table.
+  const auto detected = CPP_INTRIN::detect_isa();
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(detected); tier++)
+  {
+    CPP_INTRIN::set_dispatch_isa(static_cast<CPP_INTRIN::ISA>(tier));
+    const auto &disp = CPP_INTRIN::dispatch();
+
+    disp.m256_add_epi16_bulk(a.data(), b.data(), c.data(), n);
+    for (size_t i = 0; i < n; i++)
+    {
+      ASSERT_EQ(c[i], CPP_INTRIN::m256_add_epi16(a[i], b[i]));
+    }
+
+    disp.m256_sub_epi16_bulk(a.data(), b.data(), c.data(), n);
+    for (size_t i = 0; i < n; i++)
+    {
+      ASSERT_EQ(c[i], CPP_INTRIN::m256_sub_epi16(a[i], b[i]));
+    }
+
+    disp.m256_sign_epi16_bulk(a.data(), b.data(), c.data(), n);
+    for (size_t i = 0; i < n; i++)
+    {
+      ASSERT_EQ(c[i], CPP_INTRIN::m256_sign_epi16(a[i], b[i]));
+    }
+
+    disp.m256_xor_epi64_bulk(a64.data(), b64.data(), c64.data(), n);
+    for (size_t i = 0; i < n; i++)
+    {
+      ASSERT_EQ(c64[i], CPP_INTRIN::m256_xor_epi64(a64[i], b64[i]));
+    }
+  }
+  CPP_INTRIN::set_dispatch_isa(detected);
+}
+
+TEST(testIntrin, testVec256)
+{
+  // The whole point of the vector type is that it's aligned, both on the stack and on the heap.
+  CPP_INTRIN::epi16x16 a;
+  CPP_INTRIN::epi8x32 b;
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(&a) % 32, 0);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(&b) % 32, 0);
+
+  std::vector<CPP_INTRIN::epi64x4> c(3);
+  for (const auto &v : c)
+  {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&v) % 32, 0);
+  }
+
+  // It should also behave exactly like the std::array that it wraps, and convert in both
+  // directions.
+  std::array<int16_t, 16> d;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    d[i] = rand();
+  }
+
+  a = d;
+  EXPECT_EQ(a, d);
+  EXPECT_EQ(a.size(), 16);
+
+  std::array<int16_t, 16> e = CPP_INTRIN::m256_abs_epi16(a);
+  EXPECT_EQ(e, CPP_INTRIN::m256_abs_epi16(d));
+}
+
+TEST(testIntrin, testViews)
+{
+  CPP_INTRIN::epi16x16 a;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    a[i] = rand();
+  }
+
+  // Each view should be the same bits: we check this against a plain memcpy.
+  const auto a8  = a.epi8();
+  const auto a32 = a.epi32();
+  const auto a64 = a.epi64();
+  EXPECT_EQ(memcmp(&a8, &a, sizeof(a)), 0);
+  EXPECT_EQ(memcmp(&a32, &a, sizeof(a)), 0);
+  EXPECT_EQ(memcmp(&a64, &a, sizeof(a)), 0);
+
+  std::array<int64_t, 4> expected;
+  memcpy(&expected, &a, sizeof(a));
+  EXPECT_EQ(a64, expected);
+
+  // And views should round-trip.
+  EXPECT_EQ(a8.epi16(), a);
+  EXPECT_EQ(a32.epi16(), a);
+  EXPECT_EQ(a64.as<int16_t>(), a);
+
+  // This means that the 64-bit operations can be applied to 16-bit vectors directly.
+  EXPECT_EQ(CPP_INTRIN::m256_permute4x64_epi64<78>(a.epi64()).epi16(),
+            CPP_INTRIN::m256_permute4x64_epi16<78>(a));
+}
+
+#if CPP_INTRIN_HAS_CONSTEXPR
+TEST(testIntrin, testConstexpr)
+{
+  // Everything here is computed at compile-time, by the Plain tier. The static_asserts check a few
+  // lanes by hand, and then each result is checked against the same call at runtime (which uses
+  // whichever tier the flags pick).
+  using epi16x16 = CPP_INTRIN::epi16x16;
+  constexpr epi16x16 a{{-3, 7, 0, -32768, 5, -1, 32767, 2, 9, -8, 4, 1, -6, 3, 0, -2}};
+  constexpr epi16x16 b{{1, -1, 1, 1, 0, -5, 2, -2, 3, 3, -3, 0, 1, -1, 8, 8}};
+
+  constexpr auto sign = CPP_INTRIN::m256_sign_epi16(a, b);
+  constexpr auto abs  = CPP_INTRIN::m256_abs_epi16(a);
+  constexpr auto gt   = CPP_INTRIN::m256_cmpgt_epi16(a, b);
+  constexpr auto sum  = CPP_INTRIN::m256_add_epi16(a, b);
+  constexpr auto diff = CPP_INTRIN::m256_sub_epi16(a, b);
+  constexpr auto lo   = CPP_INTRIN::m256_mullo_epi16(a, b);
+  constexpr auto hi   = CPP_INTRIN::m256_mulhi_epi16(a, b);
+  constexpr auto both = CPP_INTRIN::m256_and_epi16(a, b);
+  constexpr auto sl   = CPP_INTRIN::m256_slli_epi16<3>(a);
+  constexpr auto srl  = CPP_INTRIN::m256_srli_epi16<3>(a);
+  constexpr auto sra  = CPP_INTRIN::m256_srai_epi16<3>(a);
+  static_assert(sign[0] == -3 && sign[1] == -7 && sign[4] == 0 && sign[5] == 1, "Error: sign");
+  static_assert(abs[0] == 3 && abs[3] == -32768 && abs[15] == 2, "Error: abs");
+  static_assert(gt[0] == 0 && gt[1] == -1 && gt[6] == -1, "Error: cmpgt");
+  static_assert(sum[3] == -32767 && diff[3] == 32767, "Error: add and sub wrap");
+  static_assert(lo[6] == -2 && hi[6] == 0 && hi[0] == -1, "Error: mullo and mulhi");
+  static_assert(sl[0] == -24 && srl[0] == 8191 && sra[0] == -1, "Error: shifts");
+
+  // The shuffles and lane functions, including the views, e.g to derive one mask from another.
+  constexpr auto reversed =
+      CPP_INTRIN::m256_shuffle_epi8(a.epi8(), CPP_INTRIN::ShuffleMasks::reverse_epi16()).epi16();
+  constexpr auto permuted = CPP_INTRIN::m256_permute4x64_epi16<0x1B>(a);
+  constexpr auto unpacklo = CPP_INTRIN::m256_unpacklo_epi16(a, b);
+  constexpr auto unpackhi = CPP_INTRIN::m256_unpackhi_epi32(a.epi32(), b.epi32());
+  static_assert(reversed[0] == a[7] && reversed[8] == a[15], "Error: shuffle_epi8");
+  static_assert(permuted[0] == a[12] && permuted[15] == a[3], "Error: permute4x64");
+  static_assert(unpacklo[0] == a[0] && unpacklo[1] == b[0] && unpacklo[8] == a[8], "Error: unpack");
+  static_assert(unpackhi[0] == a.epi32()[2] && unpackhi[1] == b.epi32()[2], "Error: unpack");
+  static_assert(CPP_INTRIN::m256_extract_epi16<9>(a) == -8, "Error: extract_epi16");
+  static_assert(CPP_INTRIN::m256_extract_epi64<1>(a.epi64()) == a.epi64()[1], "Error: extract");
+
+  constexpr auto x = CPP_INTRIN::m256_xor_epi64(a.epi64(), b.epi64());
+  constexpr auto o = CPP_INTRIN::m256_or_epi64(a.epi64(), b.epi64());
+  constexpr auto n = CPP_INTRIN::m256_and_epi64(a.epi64(), b.epi64());
+  static_assert(x[1] == (a.epi64()[1] ^ b.epi64()[1]), "Error: xor");
+  static_assert(o[1] == (a.epi64()[1] | b.epi64()[1]), "Error: or");
+  static_assert(n[1] == (a.epi64()[1] & b.epi64()[1]), "Error: and");
+
+  // The Vec512 views are constexpr too.
+  constexpr CPP_INTRIN::epi16x32 wide{{-3, 7}};
+  static_assert(wide.epi8()[2] == 7 && wide.epi64().epi16()[0] == -3, "Error: Vec512 views");
+
+  // The same calls at runtime.
+  const epi16x16 ra = a, rb = b;
+  EXPECT_EQ(sign, CPP_INTRIN::m256_sign_epi16(ra, rb));
+  EXPECT_EQ(abs, CPP_INTRIN::m256_abs_epi16(ra));
+  EXPECT_EQ(gt, CPP_INTRIN::m256_cmpgt_epi16(ra, rb));
+  EXPECT_EQ(sum, CPP_INTRIN::m256_add_epi16(ra, rb));
+  EXPECT_EQ(diff, CPP_INTRIN::m256_sub_epi16(ra, rb));
+  EXPECT_EQ(lo, CPP_INTRIN::m256_mullo_epi16(ra, rb));
+  EXPECT_EQ(hi, CPP_INTRIN::m256_mulhi_epi16(ra, rb));
+  EXPECT_EQ(both, CPP_INTRIN::m256_and_epi16(ra, rb));
+  EXPECT_EQ(sl, CPP_INTRIN::m256_slli_epi16<3>(ra));
+  EXPECT_EQ(srl, CPP_INTRIN::m256_srli_epi16<3>(ra));
+  EXPECT_EQ(sra, CPP_INTRIN::m256_srai_epi16<3>(ra));
+  EXPECT_EQ(reversed, CPP_INTRIN::m256_shuffle_epi8_epi16(
+                          ra, CPP_INTRIN::ShuffleMasks::reverse_epi16().epi16()));
+  EXPECT_EQ(permuted, CPP_INTRIN::m256_permute4x64_epi16<0x1B>(ra));
+  EXPECT_EQ(unpacklo, CPP_INTRIN::m256_unpacklo_epi16(ra, rb));
+  EXPECT_EQ(unpackhi, CPP_INTRIN::m256_unpackhi_epi32(ra.epi32(), rb.epi32()));
+  EXPECT_EQ(x, CPP_INTRIN::m256_xor_epi64(ra.epi64(), rb.epi64()));
+  EXPECT_EQ(o, CPP_INTRIN::m256_or_epi64(ra.epi64(), rb.epi64()));
+  EXPECT_EQ(n, CPP_INTRIN::m256_and_epi64(ra.epi64(), rb.epi64()));
+}
+#endif
+
+#ifdef __AVX2__
+TEST(testIntrin, testRegisterAPI)
+{
+  CPP_INTRIN::epi16x16 a, b;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    a[i] = rand();
+    b[i] = rand();
+  }
+
+  const __m256i ra = CPP_INTRIN::to_m256i(a);
+  const __m256i rb = CPP_INTRIN::to_m256i(b);
+  EXPECT_EQ(CPP_INTRIN::from_m256i<int16_t>(ra), a);
+
+  // Every register-resident overload should agree with the Vec256 version.
+  const auto as16 = [](const __m256i v) { return CPP_INTRIN::from_m256i<int16_t>(v); };
+  EXPECT_EQ(as16(CPP_INTRIN::m256_hadd_epi16(ra, rb)), CPP_INTRIN::m256_hadd_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_xor_epi64(ra, rb)).epi64(),
+            CPP_INTRIN::m256_xor_epi64(a.epi64(), b.epi64()));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_or_epi64(ra, rb)).epi64(),
+            CPP_INTRIN::m256_or_epi64(a.epi64(), b.epi64()));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_and_epi64(ra, rb)).epi64(),
+            CPP_INTRIN::m256_and_epi64(a.epi64(), b.epi64()));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_and_epi16(ra, rb)), CPP_INTRIN::m256_and_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_cmpgt_epi16(ra, rb)), CPP_INTRIN::m256_cmpgt_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_shuffle_epi8_epi16(ra, rb)),
+            CPP_INTRIN::m256_shuffle_epi8_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_add_epi16(ra, rb)), CPP_INTRIN::m256_add_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_sub_epi16(ra, rb)), CPP_INTRIN::m256_sub_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_sign_epi16(ra, rb)), CPP_INTRIN::m256_sign_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_abs_epi16(ra)), CPP_INTRIN::m256_abs_epi16(a));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_permute4x64_epi16<78>(ra)),
+            CPP_INTRIN::m256_permute4x64_epi16<78>(a));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_slli_epi16<3>(ra)), CPP_INTRIN::m256_slli_epi16<3>(a));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_srli_epi16<3>(ra)), CPP_INTRIN::m256_srli_epi16<3>(a));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_lut16_epi16(ra, rb)), CPP_INTRIN::m256_lut16_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_hadamard16_epi16(ra)), CPP_INTRIN::m256_hadamard16_epi16(a));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_lut32_epi8(ra, rb)).epi8(),
+            CPP_INTRIN::m256_lut32_epi8(a.epi8(), b.epi8()));
+  EXPECT_EQ(CPP_INTRIN::m256_testz_si256(ra, rb), CPP_INTRIN::m256_testz_si256(a, b));
+  EXPECT_TRUE(CPP_INTRIN::m256_testz_si256(ra, _mm256_setzero_si256()));
+
+  // Chained operations should give the same answer as the chained Vec256 operations.
+  EXPECT_EQ(as16(CPP_INTRIN::m256_abs_epi16(CPP_INTRIN::m256_sub_epi16(ra, rb))),
+            CPP_INTRIN::m256_abs_epi16(CPP_INTRIN::m256_sub_epi16(a, b)));
+
+  const __uint128_t value =
+      (static_cast<__uint128_t>(rand()) << 64) | static_cast<unsigned>(rand());
+  const __m128i rvalue = reinterpret_cast<const __m128i &>(value);
+  EXPECT_EQ(as16(CPP_INTRIN::m256_broadcastsi128_si256(rvalue)),
+            CPP_INTRIN::m256_broadcastsi128_si256(value));
+  EXPECT_EQ(CPP_INTRIN::mm_extract_epi64<1>(rvalue), CPP_INTRIN::mm_extract_epi64<1>(value));
+
+  EXPECT_EQ(as16(CPP_INTRIN::m256_unpacklo_epi16(ra, rb)), CPP_INTRIN::m256_unpacklo_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_unpackhi_epi16(ra, rb)), CPP_INTRIN::m256_unpackhi_epi16(a, b));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_unpacklo_epi32(ra, rb)).epi32(),
+            CPP_INTRIN::m256_unpacklo_epi32(a.epi32(), b.epi32()));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_unpackhi_epi32(ra, rb)).epi32(),
+            CPP_INTRIN::m256_unpackhi_epi32(a.epi32(), b.epi32()));
+  EXPECT_EQ(CPP_INTRIN::m256_extract_epi16<13>(ra), CPP_INTRIN::m256_extract_epi16<13>(a));
+  EXPECT_EQ(CPP_INTRIN::m256_extract_epi64<3>(ra), CPP_INTRIN::m256_extract_epi64<3>(a.epi64()));
+  const __m128i rhalf = CPP_INTRIN::m256_extracti128_si256<1>(ra);
+  __uint128_t half;
+  memcpy(&half, &rhalf, sizeof(half));
+  EXPECT_EQ(half, CPP_INTRIN::m256_extracti128_si256<1>(a));
+  EXPECT_EQ(as16(CPP_INTRIN::m256_inserti128_si256<0>(ra, rvalue)),
+            CPP_INTRIN::m256_inserti128_si256<0>(a, value));
+}
+#endif
+
+TEST(testIntrin, testFused)
+{
+  CPP_INTRIN::epi16x16 a, b, c;
+  CPP_INTRIN::epi64x4 a64, b64;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    a[i] = rand();
+    b[i] = rand();
+    c[i] = rand();
+  }
+
+  for (unsigned i = 0; i < 4; i++)
+  {
+    a64[i] = static_cast<int64_t>(rand()) << 32 | rand();
+    b64[i] = static_cast<int64_t>(rand()) << 32 | rand();
+  }
+
+  // The extreme values are where abs and the wrapping sums are most likely to go wrong.
+  a[0] = INT16_MIN;
+  b[0] = 0;
+  a[1] = INT16_MIN;
+  b[1] = INT16_MAX;
+  a[2] = INT16_MAX;
+  b[2] = INT16_MAX;
+
+  // Each fused operation should be exactly the chain it replaces.
+  const auto subabs = CPP_INTRIN::m256_abs_epi16(CPP_INTRIN::m256_sub_epi16(a, b));
+  const auto testz  = CPP_INTRIN::m256_testz_si256(CPP_INTRIN::m256_and_epi16(a, b), c);
+  const auto xored  = CPP_INTRIN::m256_xor_epi64(a64, b64);
+  unsigned popcount = 0;
+  for (const auto v : xored)
+  {
+    popcount += std::bitset<64>(static_cast<uint64_t>(v)).count();
+  }
+
+  const auto hadd = CPP_INTRIN::m256_hadd_epi16(a, b);
+  int16_t sum     = 0;
+  for (const auto v : hadd)
+  {
+    sum = static_cast<int16_t>(sum + v);
+  }
+
+  // We also want a case where the and-testz should return true.
+  CPP_INTRIN::epi16x16 d;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    d[i] = static_cast<int16_t>(~(a[i] & b[i]));
+  }
+
+  EXPECT_EQ(CPP_INTRIN::m256_subabs_epi16(a, b), subabs);
+  EXPECT_EQ(CPP_INTRIN::m256_and_testz_si256(a, b, c), testz);
+  EXPECT_TRUE(CPP_INTRIN::m256_and_testz_si256(a, b, d));
+  EXPECT_EQ(CPP_INTRIN::m256_xor_popcount_epi64(a64, b64), popcount);
+  EXPECT_EQ(CPP_INTRIN::m256_xor_popcount_epi64(a64, a64), 0);
+  EXPECT_EQ(CPP_INTRIN::m256_hadd_reduce_epi16(a, b), sum);
+
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+  {
+    const auto &dispatch = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+    EXPECT_EQ(dispatch.m256_subabs_epi16(a, b), subabs);
+    EXPECT_EQ(dispatch.m256_and_testz_si256(a, b, c), testz);
+    EXPECT_TRUE(dispatch.m256_and_testz_si256(a, b, d));
+    EXPECT_EQ(dispatch.m256_xor_popcount_epi64(a64, b64), popcount);
+    EXPECT_EQ(dispatch.m256_hadd_reduce_epi16(a, b), sum);
+  }
+
+#ifdef __AVX2__
+  const __m256i ra = CPP_INTRIN::to_m256i(a), rb = CPP_INTRIN::to_m256i(b);
+  EXPECT_EQ(CPP_INTRIN::from_m256i<int16_t>(CPP_INTRIN::m256_subabs_epi16(ra, rb)), subabs);
+  EXPECT_EQ(CPP_INTRIN::m256_and_testz_si256(ra, rb, CPP_INTRIN::to_m256i(c)), testz);
+  const __m256i ra64 = CPP_INTRIN::to_m256i(a64), rb64 = CPP_INTRIN::to_m256i(b64);
+  EXPECT_EQ(CPP_INTRIN::m256_xor_popcount_epi64(ra64, rb64), popcount);
+  EXPECT_EQ(CPP_INTRIN::m256_hadd_reduce_epi16(ra, rb), sum);
+#endif
+}
+
+TEST(testIntrin, testExpr)
+{
+  using E = CPP_INTRIN::Expr;
+  CPP_INTRIN::epi16x16 a, b, c;
+  for (unsigned i = 0; i < 16; i++)
+  {
+    a[i] = rand();
+    b[i] = rand();
+    c[i] = rand();
+  }
+  a[0] = INT16_MIN;
+  b[0] = 0;
+
+  // Each expression should give exactly the same result as the eager operations.
+  EXPECT_EQ(E::eval(E::abs(E::sub(a, b))),
+            CPP_INTRIN::m256_abs_epi16(CPP_INTRIN::m256_sub_epi16(a, b)));
+  EXPECT_EQ(E::eval(E::add(a, b)), CPP_INTRIN::m256_add_epi16(a, b));
+  EXPECT_EQ(E::eval(E::bit_and(a, b)), CPP_INTRIN::m256_and_epi16(a, b));
+  EXPECT_EQ(E::eval(E::bit_or(a, b)).epi64(), CPP_INTRIN::m256_or_epi64(a.epi64(), b.epi64()));
+  EXPECT_EQ(E::eval(E::bit_xor(a, b)).epi64(), CPP_INTRIN::m256_xor_epi64(a.epi64(), b.epi64()));
+  EXPECT_EQ(E::eval(E::sign(a, b)), CPP_INTRIN::m256_sign_epi16(a, b));
+  EXPECT_EQ(E::eval(E::cmpgt(a, b)), CPP_INTRIN::m256_cmpgt_epi16(a, b));
+
+  // Longer chains, and chains that mix in eagerly computed vectors.
+  const auto sum = CPP_INTRIN::m256_add_epi16(a, c);
+  EXPECT_EQ(E::eval(E::sign(E::abs(E::sub(a, b)), E::add(a, c))),
+            CPP_INTRIN::m256_sign_epi16(CPP_INTRIN::m256_subabs_epi16(a, b), sum));
+  EXPECT_EQ(E::eval(E::sub(CPP_INTRIN::m256_add_epi16(a, c), b)),
+            CPP_INTRIN::m256_sub_epi16(sum, b));
+
+  // And the reductions.
+  EXPECT_EQ(E::testz(E::bit_and(E::bit_and(a, b), c)), CPP_INTRIN::m256_and_testz_si256(a, b, c));
+  EXPECT_TRUE(E::testz(E::sub(a, a)));
+  c[0] = 1;
+  EXPECT_FALSE(E::testz(E::add(E::sub(a, a), c)));
+
+  int16_t total = 0;
+  for (const auto v : CPP_INTRIN::m256_subabs_epi16(a, b))
+  {
+    total = static_cast<int16_t>(total + v);
+  }
+  EXPECT_EQ(E::reduce_add(E::abs(E::sub(a, b))), total);
+}
+
+TEST(testIntrin, testPopcount)
+{
+  constexpr size_t n = 37;
+  std::vector<CPP_INTRIN::epi64x4> a(n), b(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    for (unsigned j = 0; j < 4; j++)
+    {
+      a[i][j] = static_cast<int64_t>(rand()) << 33 ^ static_cast<int64_t>(rand());
+      b[i][j] = static_cast<int64_t>(rand()) << 33 ^ static_cast<int64_t>(rand());
+    }
+  }
+
+  // Make sure that we've got the extremes too.
+  a[0] = std::array<int64_t, 4>{0, -1, INT64_MIN, INT64_MAX};
+
+  // We check against std::bitset, which is about as obviously correct as it gets.
+  const auto count = [](const int64_t v) {
+    return static_cast<unsigned>(std::bitset<64>(static_cast<uint64_t>(v)).count());
+  };
+  uint64_t total = 0, xor_total = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    for (unsigned j = 0; j < 4; j++)
+    {
+      total += count(a[i][j]);
+      xor_total += count(a[i][j] ^ b[i][j]);
+    }
+  }
+
+  for (size_t i = 0; i < n; i++)
+  {
+    const auto lanes = CPP_INTRIN::m256_popcount_epi64(a[i]);
+    const auto bytes = CPP_INTRIN::m256_popcount_epi8(a[i].epi8());
+    unsigned expected = 0;
+    for (unsigned j = 0; j < 4; j++)
+    {
+      EXPECT_EQ(lanes[j], count(a[i][j]));
+      expected += count(a[i][j]);
+    }
+
+    for (unsigned j = 0; j < 32; j++)
+    {
+      EXPECT_EQ(bytes[j], std::bitset<8>(static_cast<uint8_t>(a[i].epi8()[j])).count());
+    }
+
+    EXPECT_EQ(CPP_INTRIN::m256_popcount_si256(a[i]), expected);
+  }
+
+  EXPECT_EQ(CPP_INTRIN::m256_popcount_si256_bulk(a.data(), n), total);
+  EXPECT_EQ(CPP_INTRIN::m256_xor_popcount_epi64_bulk(a.data(), b.data(), n), xor_total);
+  EXPECT_EQ(CPP_INTRIN::m256_popcount_si256_bulk(a.data(), 0), 0);
+
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+  {
+    const auto dispatch = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+    for (size_t i = 0; i < n; i++)
+    {
+      EXPECT_EQ(dispatch.m256_popcount_epi64(a[i]), CPP_INTRIN::m256_popcount_epi64(a[i]));
+      EXPECT_EQ(dispatch.m256_popcount_epi8(a[i].epi8()),
+                CPP_INTRIN::m256_popcount_epi8(a[i].epi8()));
+      EXPECT_EQ(dispatch.m256_popcount_si256(a[i]), CPP_INTRIN::m256_popcount_si256(a[i]));
+      EXPECT_EQ(dispatch.m256_xor_popcount_epi64(a[i], b[i]),
+                CPP_INTRIN::m256_xor_popcount_epi64(a[i], b[i]));
+    }
+
+    EXPECT_EQ(dispatch.m256_popcount_si256_bulk(a.data(), n), total);
+    EXPECT_EQ(dispatch.m256_xor_popcount_epi64_bulk(a.data(), b.data(), n), xor_total);
+  }
+
+#ifdef __AVX2__
+  const __m256i ra = CPP_INTRIN::to_m256i(a[0]);
+  EXPECT_EQ(CPP_INTRIN::from_m256i<int64_t>(CPP_INTRIN::m256_popcount_epi64(ra)),
+            CPP_INTRIN::m256_popcount_epi64(a[0]));
+  EXPECT_EQ(CPP_INTRIN::from_m256i<int8_t>(CPP_INTRIN::m256_popcount_epi8(ra)),
+            CPP_INTRIN::m256_popcount_epi8(a[0].epi8()));
+  EXPECT_EQ(CPP_INTRIN::m256_popcount_si256(ra), CPP_INTRIN::m256_popcount_si256(a[0]));
+#endif
+}
+
+TEST(testIntrin, testRandomGenerator)
+{
+  constexpr size_t n = 64;
+  static_assert(n % CPP_INTRIN::RandomGenerator::block == 0, "n must be a multiple of block");
+
+  using Backend = CPP_INTRIN::RandomGenerator::Backend;
+  std::vector<Backend> backends{Backend::xorshift};
+  if (CPP_INTRIN::detect_aes())
+  {
+    backends.push_back(Backend::aes);
+  }
+  if (CPP_INTRIN::detect_vaes())
+  {
+    backends.push_back(Backend::vaes);
+  }
+
+  for (const auto backend : backends)
+  {
+    CPP_INTRIN::RandomGenerator rng(42, backend);
+    EXPECT_EQ(rng.backend(), backend);
+
+    std::vector<CPP_INTRIN::epi64x4> a(n);
+    rng.fill(a.data(), n);
+
+    // The same seed gives the same sequence, however it is split up (in whole blocks).
+    CPP_INTRIN::RandomGenerator same(42, backend);
+    std::vector<CPP_INTRIN::epi64x4> b(n);
+    same.fill(b.data(), n / 2);
+    same.fill(b.data() + n / 2, n / 2);
+    EXPECT_EQ(a, b);
+
+    // A different seed gives a different sequence.
+    CPP_INTRIN::RandomGenerator other(43, backend);
+    other.fill(b.data(), n);
+    EXPECT_NE(a, b);
+
+    // Every vector carries 256 bits: the two halves are not a broadcast of each other, and no
+    // vector repeats.
+    uint64_t ones = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      EXPECT_FALSE(a[i][0] == a[i][2] && a[i][1] == a[i][3]);
+      for (size_t j = 0; j < i; j++)
+      {
+        EXPECT_NE(a[i], a[j]);
+      }
+      ones += CPP_INTRIN::m256_popcount_si256(a[i]);
+    }
+
+    // Roughly half of the bits should be set: 16384 bits gives a standard deviation of 64.
+    EXPECT_GT(ones, n * 128 - 512);
+    EXPECT_LT(ones, n * 128 + 512);
+
+    // Sizes that are not a multiple of the block size are still filled completely.
+    std::vector<CPP_INTRIN::epi16x16> c(3);
+    for (auto &v : c)
+    {
+      v.fill(0);
+    }
+    rng.fill(c.data(), c.size());
+    for (const auto &v : c)
+    {
+      EXPECT_NE(v, CPP_INTRIN::epi16x16{});
+    }
+    EXPECT_NE(rng.next(), rng.next());
+  }
+
+  // VAES runs the AES streams two to a register, so the sequences must match exactly, including
+  // for sizes that aren't a multiple of the block size.
+  if (CPP_INTRIN::detect_vaes())
+  {
+    CPP_INTRIN::RandomGenerator aes(7, Backend::aes), vaes(7, Backend::vaes);
+    for (const size_t size : {1u, 4u, 7u, 64u, 3u})
+    {
+      std::vector<CPP_INTRIN::epi64x4> a(size), b(size);
+      aes.fill(a.data(), size);
+      vaes.fill(b.data(), size);
+      EXPECT_EQ(a, b);
+    }
+  }
+}
+
+TEST(testIntrin, testBucketer)
+{
+  constexpr size_t n = 500;
+  // Entries in [-256, 256) keep the Euclidean norm well below the bucketer's limit.
+  CPP_INTRIN::RandomGenerator rng(1, CPP_INTRIN::RandomGenerator::Backend::xorshift);
+  std::vector<CPP_INTRIN::epi16x16> db(n);
+  rng.fill(db.data(), n);
+  for (auto &v : db)
+  {
+    v = CPP_INTRIN::m256_srai_epi16<7>(v);
+  }
+
+  const auto norm = [](const CPP_INTRIN::epi16x16 &a) {
+    double total = 0;
+    for (const auto v : a)
+    {
+      total += double(v) * v;
+    }
+    return std::sqrt(total);
+  };
+
+  const CPP_INTRIN::Bucketer bucketer(2, 99);
+  ASSERT_EQ(bucketer.buckets(), 1024);
+
+  // bin() has an offset per bucket, so the number of codes is bounded.
+  EXPECT_EQ(CPP_INTRIN::Bucketer(CPP_INTRIN::Bucketer::max_codes, 1).buckets(), size_t(1) << 20);
+  EXPECT_THROW(CPP_INTRIN::Bucketer(CPP_INTRIN::Bucketer::max_codes + 1, 1), std::invalid_argument);
+  EXPECT_THROW(CPP_INTRIN::Bucketer(0, 1), std::invalid_argument);
+  // The items are 32-bit indices, and the count is checked before anything is read.
+  EXPECT_THROW(bucketer.bin(db.data(), size_t(1) << 32, 1), std::invalid_argument);
+  for (const auto &a : db)
+  {
+    // Each round is a rotation followed by a truncation, which loses at most 1 per lane.
+    for (unsigned code = 0; code < bucketer.codes(); code++)
+    {
+      EXPECT_NEAR(norm(bucketer.transform(a, code)), norm(a), 4.0 * bucketer.rounds());
+    }
+
+    // The top-k buckets are exactly those found by trying every pair of lanes.
+    const auto y0 = bucketer.transform(a, 0), y1 = bucketer.transform(a, 1);
+    std::vector<std::pair<int, uint32_t>> all;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+      for (uint32_t j = 0; j < 16; j++)
+      {
+        const uint32_t bucket = (2 * i + (y0[i] < 0)) | (2 * j + (y1[j] < 0)) << 5;
+        all.emplace_back(-(std::abs(y0[i]) + std::abs(y1[j])), bucket);
+      }
+    }
+    std::sort(all.begin(), all.end());
+
+    constexpr unsigned k = 8;
+    std::array<uint32_t, k> top;
+    bucketer.hash(a, top.data(), k);
+    for (unsigned i = 0; i < k; i++)
+    {
+      EXPECT_EQ(top[i], all[i].second);
+    }
+    EXPECT_EQ(bucketer.hash(a), top[0]);
+  }
+
+  // The same seed gives the same buckets, and running on a pool doesn't change the output.
+  CPP_INTRIN::ThreadPool pool(4);
+  const CPP_INTRIN::Bucketer same(2, 99), other(2, 100);
+  std::vector<uint32_t> a(n * 4), b(n * 4), c(n * 4);
+  bucketer.hash_bulk(db.data(), n, a.data(), 4);
+  same.hash_bulk(db.data(), n, b.data(), 4, pool);
+  other.hash_bulk(db.data(), n, c.data(), 4);
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+
+  // Every item appears in exactly k buckets, in increasing order.
+  const auto bins = bucketer.bin(db.data(), n, 4, pool);
+  ASSERT_EQ(bins.offsets.size(), bucketer.buckets() + 1);
+  ASSERT_EQ(bins.items.size(), n * 4);
+  std::vector<unsigned> seen(n);
+  for (uint32_t bucket = 0; bucket < bucketer.buckets(); bucket++)
+  {
+    for (size_t i = bins.offsets[bucket]; i < bins.offsets[bucket + 1]; i++)
+    {
+      const auto item = bins.items[i];
+      EXPECT_TRUE(i == bins.offsets[bucket] || bins.items[i - 1] < item);
+      const auto first = a.begin() + std::ptrdiff_t(item * 4);
+      EXPECT_NE(std::find(first, first + 4, bucket), first + 4);
+      seen[item]++;
+    }
+  }
+  EXPECT_EQ(std::count(seen.begin(), seen.end(), 4u), std::ptrdiff_t(n));
+}
+
+TEST(testIntrin, testVectorStore)
+{
+  using Store = CPP_INTRIN::VectorStore<CPP_INTRIN::epi16x16, uint32_t, uint8_t>;
+  const auto aligned = [](const void *const p) {
+    return reinterpret_cast<uintptr_t>(p) % Store::alignment == 0;
+  };
+
+  // Growing keeps every vector and every column, and the arrays stay aligned.
+  constexpr size_t n = 1001;
+  Store db;
+  EXPECT_TRUE(db.empty());
+  std::vector<CPP_INTRIN::epi16x16> expected(n);
+  CPP_INTRIN::RandomGenerator rng(3);
+  rng.fill(expected.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    db.push_back(expected[i], static_cast<uint32_t>(i * 3), static_cast<uint8_t>(i));
+  }
+  ASSERT_EQ(db.size(), n);
+  EXPECT_GE(db.capacity(), n);
+  EXPECT_TRUE(aligned(db.data()) && aligned(db.column<0>()) && aligned(db.column<1>()));
+  EXPECT_TRUE(std::equal(db.begin(), db.end(), expected.begin()));
+  for (size_t i = 0; i < n; i++)
+  {
+    EXPECT_EQ(db.column<0>()[i], i * 3);
+    EXPECT_EQ(db.column<1>()[i], static_cast<uint8_t>(i));
+  }
+
+  // The bulk kernels work on the store directly.
+  Store out(n);
+  out.resize(n);
+  CPP_INTRIN::m256_add_epi16_bulk(db.data(), db.data(), out.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    EXPECT_EQ(out[i], CPP_INTRIN::m256_add_epi16(expected[i], expected[i]));
+  }
+
+  // New elements are zero, even after shrinking.
+  const CPP_INTRIN::epi16x16 zero{};
+  db.resize(10);
+  db.resize(2 * n);
+  EXPECT_EQ(db[9], expected[9]);
+  for (size_t i = 10; i < 2 * n; i++)
+  {
+    EXPECT_EQ(db[i], zero);
+    EXPECT_EQ(db.column<0>()[i], 0u);
+    EXPECT_EQ(db.column<1>()[i], 0u);
+  }
+
+  // Moving hands over the arena.
+  const auto *const first = db.data();
+  Store moved(std::move(db));
+  EXPECT_EQ(moved.data(), first);
+  EXPECT_EQ(moved.size(), 2 * n);
+
+  // A capacity that overflows a size_t is rejected before anything is allocated.
+  EXPECT_THROW(moved.reserve(std::numeric_limits<size_t>::max() / 8), std::length_error);
+  EXPECT_THROW(moved.resize(std::numeric_limits<size_t>::max()), std::length_error);
+  EXPECT_EQ(moved.size(), 2 * n);
+  EXPECT_EQ(moved.data(), first);
+
+  // Huge pages are a hint: the store works whether or not the system has any.
+  CPP_INTRIN::VectorStore<CPP_INTRIN::epi64x4> huge(1 << 16, true);
+  EXPECT_TRUE(huge.huge_pages());
+  huge.resize(1 << 16);
+  EXPECT_TRUE(aligned(huge.data()));
+  rng.fill(huge.data(), huge.size());
+  EXPECT_EQ(CPP_INTRIN::m256_popcount_si256_bulk(huge.data(), huge.size()),
+            CPP_INTRIN::dispatch().m256_popcount_si256_bulk(huge.data(), huge.size()));
+}
+
+TEST(testIntrin, testVectorFile)
+{
+  using Store = CPP_INTRIN::VectorStore<CPP_INTRIN::epi16x16, uint32_t, uint8_t>;
+  using File  = CPP_INTRIN::VectorFile<CPP_INTRIN::epi16x16, uint32_t, uint8_t>;
+  const std::string path = testing::TempDir() + "intrinsics_test.vec";
+
+  constexpr size_t n = 1001;
+  Store store(n);
+  store.resize(n);
+  CPP_INTRIN::RandomGenerator(4).fill(store.data(), n);
+  for (size_t i = 0; i < n; i++)
+  {
+    store.column<0>()[i] = static_cast<uint32_t>(i * 5);
+    store.column<1>()[i] = static_cast<uint8_t>(i);
+  }
+
+  // A file reads back exactly as it was saved, aligned, with or without populate.
+  File::save(path, store);
+  for (const bool populate : {false, true})
+  {
+    const File db(path, populate);
+    ASSERT_EQ(db.size(), n);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(db.data()) % 64, 0u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(db.column<0>()) % 64, 0u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(db.column<1>()) % 64, 0u);
+    EXPECT_TRUE(std::equal(db.begin(), db.end(), store.begin()));
+    EXPECT_TRUE(std::equal(db.column<0>(), db.column<0>() + n, store.column<0>()));
+    EXPECT_TRUE(std::equal(db.column<1>(), db.column<1>() + n, store.column<1>()));
+
+    // The mapping goes straight into the kernels.
+    std::vector<CPP_INTRIN::epi16x16> a(n), b(n);
+    CPP_INTRIN::m256_hadamard16_epi16_bulk(db.data(), a.data(), n);
+    CPP_INTRIN::m256_hadamard16_epi16_bulk(store.data(), b.data(), n);
+    EXPECT_EQ(a, b);
+  }
+
+  // Saving replaces the old file, and an empty database is fine.
+  File::save(path, Store());
+  EXPECT_TRUE(File(path).empty());
+
+  // Anything that doesn't match is rejected.
+  File::save(path, store);
+  EXPECT_THROW((CPP_INTRIN::VectorFile<CPP_INTRIN::epi16x16, uint32_t>(path)), std::runtime_error);
+  EXPECT_THROW((CPP_INTRIN::VectorFile<CPP_INTRIN::epi16x16, uint64_t, uint8_t>(path)),
+               std::runtime_error);
+  EXPECT_THROW(File(path + ".missing"), std::system_error);
+
+  const auto rewrite = [&](const size_t keep, const size_t flip) {
+    std::vector<unsigned char> bytes;
+    FILE *file = fopen(path.c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    for (int c; (c = fgetc(file)) != EOF;)
+    {
+      bytes.push_back(static_cast<unsigned char>(c));
+    }
+    fclose(file);
+    bytes.resize(std::min(bytes.size(), keep));
+    if (flip < bytes.size())
+    {
+      bytes[flip] ^= 1;
+    }
+    file = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+  };
+
+  // Truncated, then with a bad magic string, then with a bad version.
+  rewrite(sizeof(CPP_INTRIN::epi16x16) * n, SIZE_MAX);
+  EXPECT_THROW(File{path}, std::runtime_error);
+  for (const size_t flip : {size_t(0), size_t(8)})
+  {
+    File::save(path, store);
+    rewrite(SIZE_MAX, flip);
+    EXPECT_THROW(File{path}, std::runtime_error);
+  }
+  remove(path.c_str());
+}
+
+TEST(testIntrin, testThreadPool)
+{
+  for (const unsigned threads : {1u, 2u, 4u})
+  {
+    CPP_INTRIN::ThreadPool pool(threads);
+    ASSERT_EQ(pool.size(), threads);
+
+    // Every index is covered exactly once, in chunks of at most `grain` (or all at once, when
+    // running serially).
+    for (const size_t n : {size_t(0), size_t(1), size_t(100), size_t(1000), size_t(12345)})
+    {
+      for (const size_t grain : {size_t(1), size_t(7), size_t(64), size_t(1 << 14)})
+      {
+        std::vector<std::atomic<unsigned>> seen(n);
+        pool.parallel_for(
+            n,
+            [&](const size_t begin, const size_t end) {
+              EXPECT_LT(begin, end);
+              EXPECT_TRUE(end - begin <= grain || (begin == 0 && end == n));
+              for (size_t i = begin; i < end; i++)
+              {
+                seen[i]++;
+              }
+            },
+            grain);
+        for (size_t i = 0; i < n; i++)
+        {
+          EXPECT_EQ(seen[i].load(), 1u);
+        }
+      }
+    }
+
+    // A parallel_for inside a parallel_for runs serially, rather than deadlocking.
+    std::atomic<size_t> total{0};
+    pool.parallel_for(
+        64,
+        [&](const size_t begin, const size_t end) {
+          pool.parallel_for(
+              (end - begin) * 10, [&](const size_t b, const size_t e) { total += e - b; }, 1);
+        },
+        1);
+    EXPECT_EQ(total.load(), 640u);
+  }
+
+  // The parallel kernels give the same results as the serial ones.
+  // n is odd, so that the chunks have tails.
+  CPP_INTRIN::ThreadPool pool(4);
+  constexpr size_t n = 1001;
+  std::vector<CPP_INTRIN::epi16x16> a(n), b(n), c(n), d(n);
+  CPP_INTRIN::RandomGenerator rng(5);
+  rng.fill(a.data(), n);
+  rng.fill(b.data(), n);
+
+  CPP_INTRIN::m256_add_epi16_bulk(a.data(), b.data(), c.data(), n);
+  CPP_INTRIN::parallel_bulk(CPP_INTRIN::m256_add_epi16_bulk, a.data(), b.data(), d.data(), n, pool,
+                            16);
+  EXPECT_EQ(c, d);
+
+  CPP_INTRIN::m256_hadamard16_epi16_bulk(a.data(), c.data(), n);
+  CPP_INTRIN::parallel_bulk(CPP_INTRIN::dispatch().m256_hadamard16_epi16_bulk, a.data(), d.data(),
+                            n, pool, 16);
+  EXPECT_EQ(c, d);
+
+  std::vector<CPP_INTRIN::epi64x4> x(n);
+  rng.fill(x.data(), n);
+  EXPECT_EQ(CPP_INTRIN::parallel_bulk(CPP_INTRIN::m256_popcount_si256_bulk, x.data(), n, pool, 16),
+            CPP_INTRIN::m256_popcount_si256_bulk(x.data(), n));
+  EXPECT_EQ(CPP_INTRIN::parallel_bulk(CPP_INTRIN::m256_popcount_si256_bulk, x.data(), n),
+            CPP_INTRIN::m256_popcount_si256_bulk(x.data(), n));
+}
+
+#if CPP_INTRIN_INSTRUMENT
+TEST(testIntrin, testInstrument)
+{
+  // The expected tier is whichever one the public function picks for the flags we're built with.
+#ifdef __AVX2__
+  const char *const testz_tier = "AVX2", *const permute_tier = "AVX2";
+#elif defined(__SSE4_1__)
+  const char *const testz_tier = "SSE", *const permute_tier = "Plain";
+#elif CPP_INTRIN_NEON
+  const char *const testz_tier = "NEON", *const permute_tier = "Plain";
+#else
+  const char *const testz_tier = "Plain", *const permute_tier = "Plain";
+#endif
+
+  const auto find = [](const char *const name) {
+    for (const auto &e : CPP_INTRIN::Instrument::snapshot())
+    {
+      if (std::strcmp(e.name, name) == 0)
+      {
+        return e;
+      }
+    }
+    return CPP_INTRIN::Instrument::Entry{name, "", 0, 0};
+  };
+
+  CPP_INTRIN::Instrument::reset();
+  EXPECT_EQ(find("m256_testz_si256").calls, 0u);
+
+  CPP_INTRIN::epi16x16 a{}, b{};
+  b[3] = 1;
+  for (unsigned i = 0; i < 5; i++)
+  {
+    a[i] = static_cast<int16_t>(i);
+    EXPECT_EQ(CPP_INTRIN::m256_testz_si256(a, b), i < 3);
+  }
+
+  const auto testz = find("m256_testz_si256");
+  EXPECT_EQ(testz.calls, 5u);
+  EXPECT_STREQ(testz.tier, testz_tier);
+
+  // Both instantiations of the template are counted against the same function.
+  const CPP_INTRIN::epi64x4 x{{1, 2, 3, 4}};
+  EXPECT_EQ(CPP_INTRIN::m256_permute4x64_epi64<0x1B>(x), (CPP_INTRIN::epi64x4{{4, 3, 2, 1}}));
+  EXPECT_EQ(CPP_INTRIN::m256_permute4x64_epi64<0x4E>(x), (CPP_INTRIN::epi64x4{{3, 4, 1, 2}}));
+  const auto permute = find("m256_permute4x64_epi64");
+  EXPECT_EQ(permute.calls, 2u);
+  EXPECT_STREQ(permute.tier, permute_tier);
+
+  // Calls from the pool's threads are counted too.
+  constexpr size_t                  n = 1001;
+  std::vector<CPP_INTRIN::epi16x16> c(n), d(n), e(n);
+  CPP_INTRIN::ThreadPool            pool(4);
+  CPP_INTRIN::parallel_bulk(CPP_INTRIN::m256_add_epi16_bulk, c.data(), d.data(), e.data(), n, pool,
+                            16);
+  EXPECT_EQ(find("m256_add_epi16_bulk").calls, (n + 15) / 16);
+
+  std::ostringstream report;
+  CPP_INTRIN::Instrument::report(report);
+  EXPECT_NE(report.str().find("m256_testz_si256"), std::string::npos);
+  EXPECT_NE(report.str().find("m256_add_epi16_bulk"), std::string::npos);
+
+  CPP_INTRIN::Instrument::reset();
+  EXPECT_TRUE(CPP_INTRIN::Instrument::snapshot().empty());
+  report.str("");
+  CPP_INTRIN::Instrument::report(report);
+  EXPECT_TRUE(report.str().empty());
+}
+#endif
+
+TEST(testIntrin, testM512)
+{
+  auto random_epi16x32 = []() {
+    CPP_INTRIN::epi16x32 out;
+    for (auto &elem : out)
+    {
+      elem = static_cast<int16_t>(rand());
+    }
+    return out;
+  };
+
+  // Some fixed lanes, so that the zero, negative and INT16_MIN cases are always covered.
+  auto a = random_epi16x32();
+  auto b = random_epi16x32();
+  a[0] = INT16_MIN;
+  a[1] = 5;
+  b[1] = 0;
+  b[2] = -1;
+  a[3] = b[3];
+
+  std::array<int16_t, 32> expected_add, expected_sub, expected_sign, expected_abs, expected_cmpgt;
+  uint32_t expected_mask = 0;
+  for (unsigned i = 0; i < 32; i++)
+  {
+    expected_add[i]   = static_cast<int16_t>(a[i] + b[i]);
+    expected_sub[i]   = static_cast<int16_t>(a[i] - b[i]);
+    expected_sign[i]  = static_cast<int16_t>(a[i] * CPP_INTRIN::e_sign(b[i]));
+    expected_abs[i]   = static_cast<int16_t>(std::abs(a[i]));
+    expected_cmpgt[i] = a[i] > b[i] ? int16_t(-1) : int16_t(0);
+    expected_mask |= uint32_t(a[i] > b[i]) << i;
+  }
+
+  EXPECT_EQ(CPP_INTRIN::m512_add_epi16(a, b), expected_add);
+  EXPECT_EQ(CPP_INTRIN::m512_sub_epi16(a, b), expected_sub);
+  EXPECT_EQ(CPP_INTRIN::m512_sign_epi16(a, b), expected_sign);
+  EXPECT_EQ(CPP_INTRIN::m512_abs_epi16(a), expected_abs);
+  EXPECT_EQ(CPP_INTRIN::m512_cmpgt_epi16(a, b), expected_cmpgt);
+  EXPECT_EQ(CPP_INTRIN::m512_cmpgt_epi16_mask(a, b), expected_mask);
+  EXPECT_EQ(CPP_INTRIN::m256_cmpgt_epi16_mask(a.lo(), b.lo()), expected_mask & 0xFFFF);
+
+  // The lane-wise operations are exactly the 256-bit ones applied to each half.
+  const auto a64 = a.epi64(), b64 = b.epi64();
+  const auto a8 = a.epi8(), b8 = b.epi8();
+  EXPECT_EQ(CPP_INTRIN::m512_and_epi64(a64, b64),
+            CPP_INTRIN::epi64x8::join(CPP_INTRIN::m256_and_epi64(a64.lo(), b64.lo()),
+                                      CPP_INTRIN::m256_and_epi64(a64.hi(), b64.hi())));
+  EXPECT_EQ(CPP_INTRIN::m512_or_epi64(a64, b64),
+            CPP_INTRIN::epi64x8::join(CPP_INTRIN::m256_or_epi64(a64.lo(), b64.lo()),
+                                      CPP_INTRIN::m256_or_epi64(a64.hi(), b64.hi())));
+  EXPECT_EQ(CPP_INTRIN::m512_xor_epi64(a64, b64),
+            CPP_INTRIN::epi64x8::join(CPP_INTRIN::m256_xor_epi64(a64.lo(), b64.lo()),
+                                      CPP_INTRIN::m256_xor_epi64(a64.hi(), b64.hi())));
+  EXPECT_EQ(CPP_INTRIN::m512_shuffle_epi8(a8, b8),
+            CPP_INTRIN::epi8x64::join(CPP_INTRIN::m256_shuffle_epi8(a8.lo(), b8.lo()),
+                                      CPP_INTRIN::m256_shuffle_epi8(a8.hi(), b8.hi())));
+  EXPECT_EQ(CPP_INTRIN::m512_permute4x64_epi64<0x1B>(a64),
+            CPP_INTRIN::epi64x8::join(CPP_INTRIN::m256_permute4x64_epi64<0x1B>(a64.lo()),
+                                      CPP_INTRIN::m256_permute4x64_epi64<0x1B>(a64.hi())));
+
+  // testz has to look at both halves.
+  CPP_INTRIN::epi16x32 zero{}, high{};
+  high[31] = 1;
+  EXPECT_TRUE(CPP_INTRIN::m512_testz_si512(zero, a));
+  EXPECT_TRUE(CPP_INTRIN::m512_testz_si512(high, zero));
+  EXPECT_FALSE(CPP_INTRIN::m512_testz_si512(high, high));
+  EXPECT_EQ(CPP_INTRIN::m512_testz_si512(a, b),
+            CPP_INTRIN::m256_testz_si256(a.lo(), b.lo()) &&
+                CPP_INTRIN::m256_testz_si256(a.hi(), b.hi()));
+
+  for (unsigned tier = 0; tier <= static_cast<unsigned>(CPP_INTRIN::detect_isa()); tier++)
+  {
+    const auto dispatch = CPP_INTRIN::make_dispatch(static_cast<CPP_INTRIN::ISA>(tier));
+    EXPECT_EQ(dispatch.m512_add_epi16(a, b), expected_add);
+    EXPECT_EQ(dispatch.m512_sub_epi16(a, b), expected_sub);
+    EXPECT_EQ(dispatch.m512_sign_epi16(a, b), expected_sign);
+    EXPECT_EQ(dispatch.m512_abs_epi16(a), expected_abs);
+    EXPECT_EQ(dispatch.m512_cmpgt_epi16(a, b), expected_cmpgt);
+    EXPECT_EQ(dispatch.m512_cmpgt_epi16_mask(a, b), expected_mask);
+    EXPECT_EQ(dispatch.m256_cmpgt_epi16_mask(a.lo(), b.lo()), expected_mask & 0xFFFF);
+    EXPECT_EQ(dispatch.m512_and_epi64(a64, b64), CPP_INTRIN::m512_and_epi64(a64, b64));
+    EXPECT_EQ(dispatch.m512_or_epi64(a64, b64), CPP_INTRIN::m512_or_epi64(a64, b64));
+    EXPECT_EQ(dispatch.m512_xor_epi64(a64, b64), CPP_INTRIN::m512_xor_epi64(a64, b64));
+    EXPECT_EQ(dispatch.m512_shuffle_epi8(a8, b8), CPP_INTRIN::m512_shuffle_epi8(a8, b8));
+    EXPECT_EQ(dispatch.m512_permute4x64_epi64<0x1B>(a64),
+              CPP_INTRIN::m512_permute4x64_epi64<0x1B>(a64));
+    EXPECT_TRUE(dispatch.m512_testz_si512(high, zero));
+    EXPECT_FALSE(dispatch.m512_testz_si512(high, high));
+  }
+}